@@ -0,0 +1,213 @@
+#include "CSVReader.h" // Include the CSVReader header file
+#include <cstring> // Include cstring for memchr and memmove
+#include <fstream> // Include fstream for the fallback reader
+#include <stdexcept> // Include stdexcept for std::runtime_error
+
+#ifndef _WIN32
+#include <fcntl.h> // Include fcntl for open
+#include <sys/mman.h> // Include mman for mmap
+#include <sys/stat.h> // Include stat for the file size
+#include <unistd.h> // Include unistd for close
+#endif
+
+MappedFile::MappedFile(const DSString& filename) : bytes(nullptr), length(0) { // Map a file into memory
+#ifndef _WIN32
+    int fd = ::open(filename.c_str(), O_RDONLY); // Open the file for reading
+    if (fd < 0) { // Check if the file is open
+        throw std::runtime_error("Could not open file for reading"); // Throw an error if the file could not be opened
+    }
+    struct stat info; // Declare the file information
+    if (::fstat(fd, &info) != 0) { // Get the file size
+        ::close(fd); // Close the file
+        throw std::runtime_error("Could not stat file"); // Throw an error if the size is unknown
+    }
+    length = static_cast<size_t>(info.st_size); // Record the file size
+    if (length > 0) { // Only non-empty files can be mapped
+        void* mapping = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0); // Map the file copy-on-write
+        if (mapping == MAP_FAILED) { // Check if the mapping succeeded
+            ::close(fd); // Close the file
+            throw std::runtime_error("Could not map file"); // Throw an error if the file could not be mapped
+        }
+        ::madvise(mapping, length, MADV_SEQUENTIAL); // Tell the kernel the file is read front to back
+        bytes = static_cast<char*>(mapping); // Keep the mapping
+    }
+    ::close(fd); // The mapping stays valid after the descriptor is closed
+#else
+    std::ifstream file(filename.c_str(), std::ios::binary); // Open the file for reading
+    if (!file.is_open()) { // Check if the file is open
+        throw std::runtime_error("Could not open file for reading"); // Throw an error if the file could not be opened
+    }
+    file.seekg(0, std::ios::end); // Move to the end of the file
+    length = static_cast<size_t>(file.tellg()); // Record the file size
+    file.seekg(0, std::ios::beg); // Move back to the start
+    buffer.resize(length); // Allocate the fallback buffer
+    file.read(buffer.data(), length); // Read the whole file
+    bytes = length > 0 ? buffer.data() : nullptr; // Point at the buffer
+#endif
+}
+
+MappedFile::~MappedFile() { // Unmap the file
+#ifndef _WIN32
+    if (bytes != nullptr) { // If a mapping exists
+        ::munmap(bytes, length); // Release the mapping
+    }
+#endif
+}
+
+char* MappedFile::data() const { // Get the first byte of the file
+    return bytes; // Return the mapping
+}
+
+size_t MappedFile::size() const { // Get the size of the file
+    return length; // Return the size
+}
+
+CSVReader::CSVReader(char* begin, char* end) : cursor(begin), limit(end) {} // Construct a reader over a byte range
+
+bool CSVReader::next(std::vector<std::string_view>& fields, size_t maxFields) { // Read the next record
+    fields.clear(); // Reuse the caller's field list
+    if (cursor >= limit) return false; // Stop at the end of the range
+
+    while (true) { // Loop through each field of the record
+        bool lastField = maxFields != 0 && fields.size() + 1 == maxFields; // Check if this field takes the rest of the record
+        if (*cursor == '"') { // If the field is quoted
+            ++cursor; // Skip the opening quote
+            fields.push_back(quotedField()); // Parse the quoted field
+            while (cursor < limit && *cursor != '\n' && (lastField || *cursor != ',')) { // Skip anything between the closing quote and the delimiter
+                ++cursor; // Move past the stray character
+            }
+        } else { // If the field is not quoted
+            char* start = cursor; // Remember the start of the field
+            while (cursor < limit && *cursor != '\n' && (lastField || *cursor != ',')) { // Scan to the delimiter
+                ++cursor; // Move to the next character
+            }
+            char* stop = cursor; // Remember the end of the field
+            if (stop > start && stop[-1] == '\r' && (stop == limit || *stop == '\n')) { // If the line ends with CRLF
+                --stop; // Drop the carriage return
+            }
+            fields.emplace_back(start, static_cast<size_t>(stop - start)); // Add the field
+        }
+
+        if (cursor < limit && *cursor == ',') { // If another field follows
+            ++cursor; // Skip the comma
+            if (cursor == limit) { // If the range ends right after the comma
+                fields.emplace_back(); // Add the trailing empty field
+                return true; // Report the record
+            }
+            continue; // Parse the next field
+        }
+        if (cursor < limit) { // If the record ended with a newline
+            ++cursor; // Skip the newline
+        }
+        return true; // Report the record
+    }
+}
+
+bool CSVReader::skip() { // Skip the next record
+    std::vector<std::string_view> fields; // Declare a field list to discard
+    return next(fields, 1); // Read the record as a single field
+}
+
+const char* CSVReader::position() const { // Get the position of the next record
+    return cursor; // Return the cursor
+}
+
+std::string_view CSVReader::quotedField() { // Parse a quoted field after its opening quote
+    char* start = cursor; // Remember the start of the contents
+    char* out = nullptr; // Write position once a doubled quote has been collapsed
+    char* contentEnd = limit; // End of the contents if the field is never closed
+    while (cursor < limit) { // Loop until the closing quote
+        char* quote = static_cast<char*>(std::memchr(cursor, '"', static_cast<size_t>(limit - cursor))); // Find the next quote
+        if (quote == nullptr) quote = limit; // Treat a missing quote as the end of the range
+        if (out != nullptr) { // If earlier text was shifted left
+            std::memmove(out, cursor, static_cast<size_t>(quote - cursor)); // Shift this run of text as well
+            out += quote - cursor; // Advance the write position
+        }
+        cursor = quote; // Move to the quote
+        if (cursor >= limit) break; // Stop if the field is never closed
+        if (cursor + 1 < limit && cursor[1] == '"') { // If the quote is doubled
+            if (out == nullptr) out = cursor; // Start shifting from here
+            *out++ = '"'; // Keep a single quote
+            cursor += 2; // Skip both quotes
+            continue; // Keep scanning
+        }
+        contentEnd = cursor; // The contents end at the closing quote
+        ++cursor; // Skip the closing quote
+        break; // Stop scanning
+    }
+    if (out != nullptr) contentEnd = out; // Collapsed fields end at the write position
+    return std::string_view(start, static_cast<size_t>(contentEnd - start)); // Return a view of the contents
+}
+
+const char* CSVReader::recordStart(const char* begin, const char* target, const char* end, size_t maxFields) { // Find the next record start
+    if (target <= begin) return begin; // The data starts with a record
+    if (target >= end) return end; // Nothing starts past the end
+    const char* record = begin; // Start at the known record start
+    while (record < target) record = skipRecord(record, end, maxFields); // Walk whole records, exactly as a serial reader splits them
+    return record; // The first record starting at or after the target
+}
+
+const char* CSVReader::skipRecord(const char* cursor, const char* limit, size_t maxFields) { // Find the end of a record without unescaping it
+    for (size_t field = 1;; ++field) { // Loop through each field of the record
+        bool lastField = maxFields != 0 && field == maxFields; // Check if this field takes the rest of the record, as in next()
+        if (*cursor == '"') { // If the field is quoted
+            for (++cursor; cursor < limit; ++cursor) { // Scan its contents
+                if (*cursor != '"') continue; // Skip ordinary characters
+                if (cursor + 1 < limit && cursor[1] == '"') { // If the quote is doubled
+                    ++cursor; // Skip both quotes
+                    continue; // Keep scanning
+                }
+                ++cursor; // Skip the closing quote
+                break; // Stop scanning
+            }
+        }
+        while (cursor < limit && *cursor != '\n' && (lastField || *cursor != ',')) { // Scan to the delimiter
+            ++cursor; // Move to the next character
+        }
+        if (cursor < limit && *cursor == ',') { // If another field follows
+            ++cursor; // Skip the comma
+            if (cursor == limit) return cursor; // The range ends right after the comma
+            continue; // Skip the next field
+        }
+        if (cursor < limit) ++cursor; // Skip the newline
+        return cursor; // The next record starts here
+    }
+}
+
+BufferedWriter::BufferedWriter(const DSString& filename, size_t capacity) : file(std::fopen(filename.c_str(), "wb")), buffer(capacity), used(0) { // Open the file
+    if (file == nullptr) { // Check if the file is open
+        throw std::runtime_error("Could not open file for writing"); // Throw an error if the file could not be opened
+    }
+    std::setvbuf(file, nullptr, _IONBF, 0); // Skip stdio's own buffer; the writes are already large
+}
+
+BufferedWriter::~BufferedWriter() { // Write what is buffered and close the file
+    if (file == nullptr) return; // Nothing to do after close()
+    std::fwrite(buffer.data(), 1, used, file); // Write the buffer, ignoring errors
+    std::fclose(file); // Close the file
+}
+
+void BufferedWriter::flush() { // Write the buffered bytes
+    if (used != 0 && std::fwrite(buffer.data(), 1, used, file) != used) { // Write the buffer
+        throw std::runtime_error("Could not write file"); // Report a failed write
+    }
+    used = 0; // The buffer is empty
+}
+
+void BufferedWriter::writeSlow(std::string_view text) { // Append text that does not fit the buffer
+    flush(); // Make room
+    if (text.size() >= buffer.size()) { // If the text would fill the buffer on its own
+        if (std::fwrite(text.data(), 1, text.size(), file) != text.size()) throw std::runtime_error("Could not write file"); // Write it directly
+        return; // Done
+    }
+    std::copy(text.begin(), text.end(), buffer.begin()); // Buffer it
+    used = text.size(); // Count it
+}
+
+void BufferedWriter::close() { // Write what is buffered and close the file
+    if (file == nullptr) return; // Already closed
+    flush(); // Write the buffer
+    bool failed = std::fclose(file) != 0; // Close the file
+    file = nullptr; // Mark it closed
+    if (failed) throw std::runtime_error("Could not close file"); // Report a failed close
+}
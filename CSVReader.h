@@ -0,0 +1,196 @@
+#ifndef CSV_READER_H // Include guard to prevent multiple inclusions
+#define CSV_READER_H // Define the include guard
+
+#include "DSString.h" // Include DSString header
+#include <string_view> // Include string_view for zero-copy fields
+#include <vector> // Include vector for field lists and the fallback buffer
+#include <algorithm> // Include algorithm for copying into the write buffer
+#include <cstddef> // Include cstddef for size_t
+#include <cstdio> // Include cstdio for the buffered writer's file
+
+/**
+ * @class MappedFile
+ * @brief A read-only view of a whole file backed by a private memory mapping.
+ *
+ * The mapping is copy-on-write, so the CSVReader can unescape doubled quotes in place without
+ * touching the file on disk. On platforms without mmap the file is read into a buffer instead.
+ */
+class MappedFile {
+public:
+    /**
+     * @brief Maps a file into memory.
+     * @param filename The name of the file to map.
+     * @throws std::runtime_error If the file could not be opened or mapped.
+     */
+    explicit MappedFile(const DSString& filename);
+
+    /**
+     * @brief Destructor. Unmaps the file.
+     */
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete; ///< Mappings are not copyable.
+    MappedFile& operator=(const MappedFile&) = delete; ///< Mappings are not copyable.
+
+    /**
+     * @brief Gets a pointer to the first byte of the file.
+     * @return Pointer to the mapped bytes (may be null for an empty file).
+     */
+    char* data() const;
+
+    /**
+     * @brief Gets the size of the file.
+     * @return The number of mapped bytes.
+     */
+    size_t size() const;
+
+private:
+    char* bytes; ///< First byte of the mapping or of the fallback buffer.
+    size_t length; ///< Number of bytes in the file.
+    std::vector<char> buffer; ///< Fallback storage when the file is not memory-mapped.
+};
+
+/**
+ * @class CSVReader
+ * @brief A zero-copy scanner that yields the fields of CSV records as views into a byte range.
+ *
+ * Fields may be quoted; quoted fields may contain commas, newlines and doubled quotes. The views
+ * point into the scanned bytes and stay valid as long as the underlying MappedFile. Doubled quotes
+ * are collapsed in place, which is the only time the scanner writes to the bytes.
+ */
+class CSVReader {
+public:
+    /**
+     * @brief Constructs a reader over a byte range.
+     * @param begin The first byte of the range; must be the start of a record.
+     * @param end One past the last byte of the range.
+     */
+    CSVReader(char* begin, char* end);
+
+    /**
+     * @brief Reads the next record.
+     *
+     * If @p maxFields is non-zero, the last field takes the rest of the record so that unquoted
+     * commas in a trailing free-text column are kept, like getline did.
+     *
+     * @param fields Receives the fields of the record (cleared first).
+     * @param maxFields The maximum number of fields to split the record into (0 for no limit).
+     * @return True if a record was read, false at the end of the range.
+     */
+    bool next(std::vector<std::string_view>& fields, size_t maxFields = 0);
+
+    /**
+     * @brief Skips the next record, e.g. a header line.
+     * @return True if a record was skipped, false at the end of the range.
+     */
+    bool skip();
+
+    /**
+     * @brief Gets the position of the next record.
+     * @return Pointer to the first byte of the next record.
+     */
+    const char* position() const;
+
+    /**
+     * @brief Finds the start of the first record beginning at or after a position.
+     *
+     * The records from @p begin are walked with the field rules of next() until one starts at or after
+     * the position, so the boundary is one a serial reader would reach: a quoted field containing
+     * newlines is never split, and a stray quote inside an unquoted field does not flip the quote
+     * state. The data is only read; doubled quotes are left for next() to collapse.
+     *
+     * @param begin A record start before the position, such as the previous boundary.
+     * @param target The position to search from.
+     * @param end One past the last byte of the data.
+     * @param maxFields The field count the records are read with (see next()), which decides which fields may be quoted.
+     * @return Pointer to the start of the record, or @p end if none starts after @p target.
+     */
+    static const char* recordStart(const char* begin, const char* target, const char* end, size_t maxFields);
+
+private:
+    /**
+     * @brief Finds the end of a record without unescaping its quoted fields.
+     * @param cursor The start of the record; must be before @p limit.
+     * @param limit One past the last byte of the data.
+     * @param maxFields The field count the record is read with (see next()).
+     * @return The start of the next record, or @p limit.
+     */
+    static const char* skipRecord(const char* cursor, const char* limit, size_t maxFields);
+
+    char* cursor; ///< Start of the next unread record.
+    char* limit; ///< One past the last byte of the range.
+
+    /**
+     * @brief Parses a quoted field starting at the cursor (after its opening quote).
+     * @return A view of the unescaped field contents.
+     */
+    std::string_view quotedField();
+};
+
+/**
+ * @class BufferedWriter
+ * @brief An output file written through one large buffer.
+ *
+ * Output is copied into the buffer and handed to the file only when the buffer is full or the writer
+ * is closed, so a results file of millions of short lines costs a few hundred large writes instead of
+ * a flush per line.
+ */
+class BufferedWriter {
+public:
+    static const size_t kDefaultCapacity = 1 << 20; ///< Default buffer size (1 MiB).
+
+    /**
+     * @brief Creates or truncates a file.
+     * @param filename The name of the file to write.
+     * @param capacity The size of the buffer.
+     * @throws std::runtime_error If the file could not be opened.
+     */
+    explicit BufferedWriter(const DSString& filename, size_t capacity = kDefaultCapacity);
+
+    /**
+     * @brief Destructor. Writes what is buffered and closes the file, ignoring errors; call close() to see them.
+     */
+    ~BufferedWriter();
+
+    BufferedWriter(const BufferedWriter&) = delete; ///< Writers are not copyable.
+    BufferedWriter& operator=(const BufferedWriter&) = delete; ///< Writers are not copyable.
+
+    /**
+     * @brief Appends text to the file.
+     * @param text The text to append.
+     * @throws std::runtime_error If a full buffer could not be written.
+     */
+    void write(std::string_view text) {
+        if (text.size() <= buffer.size() - used) { // If the text fits
+            std::copy(text.begin(), text.end(), buffer.begin() + used); // Copy it into the buffer
+            used += text.size(); // Advance past it
+            return; // Done
+        }
+        writeSlow(text); // Make room first
+    }
+
+    /**
+     * @brief Writes what is buffered and closes the file.
+     * @throws std::runtime_error If anything could not be written.
+     */
+    void close();
+
+private:
+    std::FILE* file; ///< The open file, or null once closed.
+    std::vector<char> buffer; ///< Output not written yet.
+    size_t used; ///< Number of buffered bytes.
+
+    /**
+     * @brief Writes the buffer, then buffers the text or writes it directly if it is larger than the buffer.
+     * @param text The text to append.
+     */
+    void writeSlow(std::string_view text);
+
+    /**
+     * @brief Writes the buffered bytes to the file.
+     * @throws std::runtime_error If they could not be written.
+     */
+    void flush();
+};
+
+#endif // CSV_READER_H // End of include guard
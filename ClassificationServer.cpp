@@ -0,0 +1,300 @@
+#include "ClassificationServer.h" // Include the ClassificationServer header file
+#include <cstdlib> // Include cstdlib for parsing batch sizes
+#include <cstring> // Include cstring for socket address handling
+#include <chrono> // Include chrono for measuring request latency
+#include <iostream> // Include iostream for status messages
+#include <stdexcept> // Include stdexcept for std::runtime_error
+#include <algorithm> // Include algorithm for std::min
+
+#ifndef _WIN32
+#include <arpa/inet.h> // Include inet for the loopback address
+#include <netinet/in.h> // Include in for TCP socket addresses
+#include <netinet/tcp.h> // Include tcp for TCP_NODELAY
+#include <poll.h> // Include poll for waiting on the listening socket
+#include <sys/socket.h> // Include socket for the socket calls
+#include <sys/un.h> // Include un for Unix domain socket addresses
+#include <unistd.h> // Include unistd for read, write and close
+#endif
+
+namespace {
+const size_t kMaxLineLength = 1 << 20; // Longest request line accepted; longer lines close the connection
+const size_t kMaxBatch = 1 << 20; // Largest batch accepted
+const int kPollMillis = 200; // How often run() checks the stop flag while no client connects
+const unsigned long kMaxPort = 65535; // Largest TCP port number
+
+#ifndef _WIN32
+bool sendAll(int fd, const std::string& data) { // Write a whole response to a socket
+    size_t sent = 0; // Number of bytes written so far
+    while (sent < data.size()) { // Loop until every byte is written
+#ifdef MSG_NOSIGNAL
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL); // Write without raising SIGPIPE
+#else
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, 0); // Write the remaining bytes
+#endif
+        if (n <= 0) return false; // Stop if the client went away
+        sent += static_cast<size_t>(n); // Count the written bytes
+    }
+    return true; // Report success
+}
+
+bool isPort(const DSString& address) { // Check if an address is a TCP port number
+    if (address.empty()) return false; // An empty address is not a port
+    for (char c : std::string_view(address)) { // Loop through each character
+        if (c < '0' || c > '9') return false; // Anything but a digit makes it a path
+    }
+    return true; // Every character is a digit
+}
+#endif
+} // namespace
+
+LatencyHistogram::LatencyHistogram() : largest(0) { // Construct an empty histogram
+    for (std::atomic<uint64_t>& bucket : buckets) bucket.store(0, std::memory_order_relaxed); // Zero every bucket
+}
+
+void LatencyHistogram::record(uint64_t micros) { // Record one latency
+    buckets[bucketOf(micros)].fetch_add(1, std::memory_order_relaxed); // Count it in its bucket
+    uint64_t seen = largest.load(std::memory_order_relaxed); // Get the largest latency so far
+    while (micros > seen && !largest.compare_exchange_weak(seen, micros, std::memory_order_relaxed)) {} // Raise it if needed
+}
+
+uint64_t LatencyHistogram::count() const { // Get the number of recorded latencies
+    uint64_t total = 0; // Initialize the count
+    for (const std::atomic<uint64_t>& bucket : buckets) total += bucket.load(std::memory_order_relaxed); // Add every bucket
+    return total; // Return the count
+}
+
+uint64_t LatencyHistogram::percentile(double fraction) const { // Get a percentile of the latencies
+    uint64_t total = count(); // Get the number of latencies
+    if (total == 0) return 0; // Nothing recorded yet
+    uint64_t rank = static_cast<uint64_t>(fraction * total); // Number of latencies at or below the percentile
+    if (rank == 0) rank = 1; // Always include at least one latency
+    uint64_t seen = 0; // Latencies counted so far
+    for (size_t i = 0; i < kBuckets; ++i) { // Loop through the buckets in order
+        seen += buckets[i].load(std::memory_order_relaxed); // Add the bucket
+        if (seen >= rank) return std::min(upperBound(i), max()); // Report the bucket, but never above the largest latency
+    }
+    return max(); // Latencies recorded during the walk can push the rank past the end
+}
+
+uint64_t LatencyHistogram::max() const { // Get the largest latency
+    return largest.load(std::memory_order_relaxed); // Return it
+}
+
+size_t LatencyHistogram::bucketOf(uint64_t micros) { // Get the bucket of a latency
+    if (micros < 16) return static_cast<size_t>(micros); // Small latencies have a bucket each
+    int exponent = 63; // Position of the highest set bit
+    while ((micros >> exponent) == 0) --exponent; // Find it
+    size_t sub = static_cast<size_t>(micros >> (exponent - 3)) & 7; // The next three bits pick one of eight buckets
+    return 16 + static_cast<size_t>(exponent - 4) * 8 + sub; // Return the bucket index
+}
+
+uint64_t LatencyHistogram::upperBound(size_t bucket) { // Get the largest latency in a bucket
+    if (bucket < 16) return bucket; // Small buckets hold one value
+    int exponent = static_cast<int>((bucket - 16) / 8) + 4; // Power of two of the bucket
+    uint64_t sub = (bucket - 16) % 8; // Position within the power of two
+    uint64_t width = uint64_t(1) << (exponent - 3); // Width of the bucket
+    return (8 + sub) * width + (width - 1); // Return the last value of the bucket
+}
+
+ClassificationServer::ClassificationServer(SentimentAnalyzer& analyzer, const DSString& address) // Construct a server and start listening
+    : analyzer(analyzer), listenAddress(address), listenFd(-1), stopping(false) {
+#ifndef _WIN32
+    if (isPort(address)) { // If the address is a TCP port
+        listenFd = ::socket(AF_INET, SOCK_STREAM, 0); // Create a TCP socket
+        if (listenFd < 0) throw std::runtime_error("Could not create socket"); // Throw an error if that failed
+        int reuse = 1; // Allow restarting on the same port right away
+        ::setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)); // Set the option
+        sockaddr_in addr; // Declare the address
+        std::memset(&addr, 0, sizeof(addr)); // Zero it
+        addr.sin_family = AF_INET; // Use IPv4
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // Only accept local connections
+        unsigned long port = std::strtoul(address.c_str(), nullptr, 10); // Read the port; too many digits read as ULONG_MAX
+        if (port == 0 || port > kMaxPort) { // Check that it is a usable port rather than truncating it
+            ::close(listenFd); // Close the socket
+            throw std::runtime_error("TCP port must be between 1 and 65535"); // Throw an error if it is not
+        }
+        addr.sin_port = htons(static_cast<uint16_t>(port)); // Set the port
+        if (::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) { // Bind the socket
+            ::close(listenFd); // Close the socket
+            throw std::runtime_error("Could not bind TCP port"); // Throw an error if the port is taken
+        }
+    } else { // If the address is a socket path
+        sockaddr_un addr; // Declare the address
+        std::memset(&addr, 0, sizeof(addr)); // Zero it
+        if (address.length() >= sizeof(addr.sun_path)) { // Check that the path fits
+            throw std::runtime_error("Socket path is too long"); // Throw an error if it does not
+        }
+        listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0); // Create a Unix domain socket
+        if (listenFd < 0) throw std::runtime_error("Could not create socket"); // Throw an error if that failed
+        addr.sun_family = AF_UNIX; // Use a Unix domain address
+        std::memcpy(addr.sun_path, address.c_str(), address.length()); // Set the path
+        ::unlink(address.c_str()); // Remove a socket left behind by an earlier run
+        if (::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) { // Bind the socket
+            ::close(listenFd); // Close the socket
+            throw std::runtime_error("Could not bind Unix domain socket"); // Throw an error if the path is unusable
+        }
+        socketPath = address; // Remember the path to remove it later
+    }
+    if (::listen(listenFd, SOMAXCONN) != 0) { // Start listening
+        ::close(listenFd); // Close the socket
+        throw std::runtime_error("Could not listen on socket"); // Throw an error if that failed
+    }
+#else
+    (void)address; // The address is unused on this platform
+    throw std::runtime_error("Server mode is not supported on this platform"); // Sockets are POSIX-only here
+#endif
+}
+
+ClassificationServer::~ClassificationServer() { // Destructor for ClassificationServer
+#ifndef _WIN32
+    stop(); // Make sure run() is not accepting
+    reapClients(true); // Disconnect and join every client
+    if (listenFd >= 0) ::close(listenFd); // Close the listening socket
+    if (!socketPath.empty()) ::unlink(socketPath.c_str()); // Remove the socket file
+#endif
+}
+
+void ClassificationServer::run() { // Accept and serve clients until stopped
+#ifndef _WIN32
+    std::cout << "Serving on " << (socketPath.empty() ? "127.0.0.1:" : "") << listenAddress << "..." << std::endl; // Print the serving message
+    while (!stopping) { // Loop until asked to stop
+        pollfd waiting{listenFd, POLLIN, 0}; // Declare the listening socket as the one to wait on
+        int ready = ::poll(&waiting, 1, kPollMillis); // Wait for a connection or the timeout
+        reapClients(false); // Join clients that have disconnected meanwhile
+        if (ready <= 0) continue; // Check the stop flag again on timeout or interruption
+        int fd = ::accept(listenFd, nullptr, nullptr); // Accept the connection
+        if (fd < 0) continue; // Ignore failed accepts
+        if (socketPath.empty()) { // If the client connected over TCP
+            int noDelay = 1; // Send responses without waiting to fill a segment
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay)); // Set the option
+        }
+        std::lock_guard<std::mutex> lock(clientsMutex); // Lock the client list
+        if (clients.size() >= kMaxClients) { // If every client slot is taken
+            sendAll(fd, "ERR too many clients\n"); // Tell the client why it is turned away
+            ::close(fd); // Refuse the connection instead of starting another thread
+            continue; // Wait for the next connection
+        }
+        clients.emplace_back(new Client()); // Add the client
+        Client& client = *clients.back(); // Get the new client
+        client.fd = fd; // Record its socket
+        client.done = false; // The client is being served
+        client.thread = std::thread(&ClassificationServer::serve, this, std::ref(client)); // Serve it on its own thread
+    }
+    reapClients(true); // Disconnect and join every client
+    std::cout << "Server stopped after " << histogram.count() << " requests (p50 " << histogram.percentile(0.50) << " us, p99 " << histogram.percentile(0.99) << " us, max " << histogram.max() << " us)." << std::endl; // Print the final latency counters
+#endif
+}
+
+void ClassificationServer::stop() { // Ask run() to return
+    stopping = true; // Set the flag; run() polls it
+}
+
+const LatencyHistogram& ClassificationServer::latencies() const { // Get the request latencies
+    return histogram; // Return the histogram
+}
+
+void ClassificationServer::serve(Client& client) { // Serve one connection
+#ifndef _WIN32
+    std::string buffer; // Bytes received but not yet consumed
+    size_t consumed = 0; // Start of the unconsumed bytes in the buffer
+    char chunk[65536]; // Receive buffer
+    auto readLine = [&](std::string_view& line) { // Read the next line; the view is valid until the next call
+        while (true) { // Loop until a full line is buffered
+            size_t newline = buffer.find('\n', consumed); // Look for the end of the line
+            if (newline != std::string::npos) { // If a full line is buffered
+                size_t end = newline > consumed && buffer[newline - 1] == '\r' ? newline - 1 : newline; // Drop a carriage return
+                line = std::string_view(buffer.data() + consumed, end - consumed); // Return a view of the line
+                consumed = newline + 1; // Consume the line and its newline
+                return true; // Report the line
+            }
+            buffer.erase(0, consumed); // Drop the consumed bytes
+            consumed = 0; // The unconsumed bytes now start at 0
+            if (buffer.size() > kMaxLineLength) return false; // Give up on overlong lines
+            ssize_t n = ::read(client.fd, chunk, sizeof(chunk)); // Receive more bytes
+            if (n <= 0) return false; // Stop when the client disconnects
+            buffer.append(chunk, static_cast<size_t>(n)); // Buffer them
+        }
+    };
+
+    TokenBuffer words; // Declare this client's token buffer, reused for every tweet
+    std::string response; // Declare the response buffer, reused for every request
+    std::string_view line; // Declare the current request line
+    while (!stopping && readLine(line)) { // Serve requests until the client quits or the server stops
+        auto start = std::chrono::steady_clock::now(); // Start timing the request
+        response.clear(); // Reuse the response buffer
+        bool keepOpen = true; // Flag cleared when the connection should close
+        if (line.compare(0, 9, "CLASSIFY ") == 0 || line == "CLASSIFY") { // If the request classifies one tweet
+            std::string_view tweet = line.size() > 9 ? line.substr(9) : std::string_view(); // Get the tweet
+            response += std::to_string(analyzer.classify(tweet, words)); // Classify it
+            response += '\n'; // End the response line
+        } else if (line.compare(0, 6, "BATCH ") == 0) { // If the request classifies several tweets
+            std::string count(line.substr(6)); // Get the batch size text
+            char* end = nullptr; // Declare the end of the parsed number
+            unsigned long long batch = std::strtoull(count.c_str(), &end, 10); // Parse the batch size
+            if (end == count.c_str() || *end != '\0' || batch > kMaxBatch) { // Check the batch size
+                response = "ERR invalid batch size\n"; // Report the error
+            } else { // If the batch size is valid
+                for (unsigned long long i = 0; i < batch && keepOpen; ++i) { // Loop through each tweet line
+                    std::string_view tweet; // Declare the tweet
+                    if (!readLine(tweet)) { // Read the tweet
+                        keepOpen = false; // Stop if the client went away mid-batch
+                        break; // Exit the loop
+                    }
+                    response += std::to_string(analyzer.classify(tweet, words)); // Classify it
+                    response += '\n'; // End the response line
+                }
+            }
+        } else if (line.compare(0, 6, "LEARN ") == 0) { // If the request adds a labeled tweet to the model
+            std::string_view rest = line.substr(6); // Get the label and the tweet
+            size_t space = rest.find(' '); // Find the end of the label
+            std::string_view label = rest.substr(0, space); // Get the label
+            if (label.size() != 1 || label[0] < '0' || label[0] > '9') { // Check the label; the word model counts anything but 4 as negative, a label model only its own labels
+                response = "ERR label must be one digit\n"; // Report the error
+            } else { // If the label is valid
+                std::string_view tweet = space == std::string_view::npos ? std::string_view() : rest.substr(space + 1); // Get the tweet
+                try { // Try block to catch a failed save of the updates
+                    analyzer.learn(std::vector<TrainingRecord>{TrainingRecord{label, tweet}}); // Fold it into the model
+                    response = "OK\n"; // Acknowledge it
+                } catch (const std::exception& e) { // Catch block for standard exceptions
+                    response = std::string("ERR ") + e.what() + "\n"; // Report the error
+                }
+            }
+        } else if (line == "STATS") { // If the request asks for the latency counters
+            response = "requests " + std::to_string(histogram.count()) + " p50_us " + std::to_string(histogram.percentile(0.50)) + // Report the count and median
+                       " p99_us " + std::to_string(histogram.percentile(0.99)) + " max_us " + std::to_string(histogram.max()) + "\n"; // Report the tail
+        } else if (line == "QUIT") { // If the client is done
+            break; // Close the connection
+        } else if (line == "SHUTDOWN") { // If the client stops the server
+            sendAll(client.fd, "OK\n"); // Acknowledge it
+            stop(); // Ask run() to return
+            break; // Close the connection
+        } else { // If the request is not understood
+            response = "ERR unknown command\n"; // Report the error
+        }
+        if (!keepOpen || !sendAll(client.fd, response)) break; // Send the response, or stop if the client went away
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count(); // Measure the request
+        histogram.record(static_cast<uint64_t>(micros)); // Record its latency
+    }
+    ::shutdown(client.fd, SHUT_RDWR); // Tell the client the connection is over
+#endif
+    client.done = true; // Let run() join this thread
+}
+
+void ClassificationServer::reapClients(bool all) { // Join the threads of disconnected clients
+#ifndef _WIN32
+    std::lock_guard<std::mutex> lock(clientsMutex); // Lock the client list
+    for (auto it = clients.begin(); it != clients.end();) { // Loop through the clients
+        Client& client = **it; // Get the client
+        if (!all && !client.done) { // If the client is still connected and may stay
+            ++it; // Keep it
+            continue; // Move to the next client
+        }
+        ::shutdown(client.fd, SHUT_RDWR); // Unblock a thread still waiting for the client
+        if (client.thread.joinable()) client.thread.join(); // Wait for the thread to exit
+        ::close(client.fd); // Close the connection
+        it = clients.erase(it); // Remove the client
+    }
+#else
+    (void)all; // Nothing to reap on this platform
+#endif
+}
@@ -0,0 +1,157 @@
+#ifndef CLASSIFICATION_SERVER_H // Include guard to prevent multiple inclusions
+#define CLASSIFICATION_SERVER_H // Define the include guard
+
+#include "DSString.h" // Include DSString for the listen address
+#include "SentimentAnalyzer.h" // Include SentimentAnalyzer for classification
+#include <atomic> // Include atomic for the latency counters and the stop flag
+#include <cstdint> // Include cstdint for fixed-width counters
+#include <list> // Include list for the connected clients
+#include <memory> // Include memory for std::unique_ptr
+#include <mutex> // Include mutex for the client list
+#include <string> // Include string for the line buffers
+#include <thread> // Include thread for the client threads
+
+/**
+ * @class LatencyHistogram
+ * @brief A lock-free histogram of request latencies in microseconds.
+ *
+ * Latencies below 16 us get a bucket each; above that every power of two is split into eight
+ * buckets, so a reported percentile is at most 12.5% above the true value. Recording is a single
+ * relaxed atomic increment, so any number of threads can record concurrently.
+ */
+class LatencyHistogram {
+public:
+    /**
+     * @brief Constructs an empty histogram.
+     */
+    LatencyHistogram();
+
+    /**
+     * @brief Records one latency.
+     * @param micros The latency in microseconds.
+     */
+    void record(uint64_t micros);
+
+    /**
+     * @brief Gets the number of recorded latencies.
+     * @return The number of latencies.
+     */
+    uint64_t count() const;
+
+    /**
+     * @brief Gets a percentile of the recorded latencies.
+     * @param fraction The percentile as a fraction, e.g. 0.99.
+     * @return The upper bound of the bucket holding the percentile, in microseconds (0 if empty).
+     */
+    uint64_t percentile(double fraction) const;
+
+    /**
+     * @brief Gets the largest recorded latency.
+     * @return The largest latency in microseconds.
+     */
+    uint64_t max() const;
+
+private:
+    static const size_t kBuckets = 16 + 8 * 60; ///< Exact buckets below 16 us, then eight per power of two.
+
+    std::atomic<uint64_t> buckets[kBuckets]; ///< Number of latencies in each bucket.
+    std::atomic<uint64_t> largest; ///< Largest latency recorded.
+
+    /**
+     * @brief Gets the bucket of a latency.
+     * @param micros The latency in microseconds.
+     * @return The bucket index.
+     */
+    static size_t bucketOf(uint64_t micros);
+
+    /**
+     * @brief Gets the largest latency that falls in a bucket.
+     * @param bucket The bucket index.
+     * @return The bucket's upper bound in microseconds.
+     */
+    static uint64_t upperBound(size_t bucket);
+};
+
+/**
+ * @class ClassificationServer
+ * @brief Serves tweet classifications from a model loaded once, over a Unix domain socket or a local TCP port.
+ *
+ * The protocol is line-delimited; every request is one line and every response line ends with '\n':
+ * - `CLASSIFY <tweet>` answers one label (0, 2 or 4).
+ * - `BATCH <n>` is followed by n tweet lines and answers n labels, one per line.
+ * - `LEARN <label> <tweet>` folds a labeled tweet (a one-digit label; 4 is positive) into the model and answers `OK`.
+ * - `STATS` answers `requests <n> p50_us <x> p99_us <y> max_us <z>`.
+ * - `QUIT` closes the connection; `SHUTDOWN` stops the server.
+ * Anything else answers a line starting with `ERR`.
+ *
+ * Every client is served by its own thread, up to kMaxClients at once; further connections are answered
+ * `ERR too many clients` and closed. Classifications never wait for a LEARN: updates publish a
+ * new snapshot of the incremental counts and each tweet is scored against the snapshot it started with. Latency is measured per request, from the request line being read
+ * to its response being written.
+ */
+class ClassificationServer {
+public:
+    static const size_t kMaxClients = 64; ///< Most clients served at once, each on its own thread.
+
+    /**
+     * @brief Constructs a server and starts listening.
+     * @param analyzer The analyzer classifying the tweets; must outlive the server.
+     * @param address A TCP port on 127.0.0.1 if it is all digits, otherwise the path of a Unix domain socket.
+     * @throws std::runtime_error If the port is 0 or above 65535, or the address cannot be bound.
+     */
+    ClassificationServer(SentimentAnalyzer& analyzer, const DSString& address);
+
+    /**
+     * @brief Stops the server and releases the socket.
+     */
+    ~ClassificationServer();
+
+    ClassificationServer(const ClassificationServer&) = delete; ///< Not copyable; owns a socket and threads.
+    ClassificationServer& operator=(const ClassificationServer&) = delete; ///< Not copyable; owns a socket and threads.
+
+    /**
+     * @brief Accepts and serves clients until stop() is called or a client sends SHUTDOWN.
+     */
+    void run();
+
+    /**
+     * @brief Asks run() to return. Safe to call from a signal handler or another thread.
+     */
+    void stop();
+
+    /**
+     * @brief Gets the request latencies recorded so far.
+     * @return The latency histogram.
+     */
+    const LatencyHistogram& latencies() const;
+
+private:
+    struct Client { // A connected client and the thread serving it
+        int fd; // Socket of the connection
+        std::thread thread; // Thread serving the connection
+        std::atomic<bool> done; // Flag set when the thread is about to exit
+    };
+
+    SentimentAnalyzer& analyzer; ///< Analyzer classifying the tweets and learning from labeled ones.
+    DSString listenAddress; ///< Address the server listens on, as given.
+    DSString socketPath; ///< Path of the Unix domain socket, empty for TCP.
+    int listenFd; ///< Listening socket.
+    std::atomic<bool> stopping; ///< Flag asking run() to return.
+    std::list<std::unique_ptr<Client>> clients; ///< Connected clients.
+    std::mutex clientsMutex; ///< Mutex protecting the client list.
+    LatencyHistogram histogram; ///< Latencies of every request served.
+
+    /**
+     * @brief Serves one connection until the client quits or the server stops.
+     * @param client The client to serve.
+     */
+    void serve(Client& client);
+
+    /**
+     * @brief Joins the threads of clients that have disconnected.
+     * @param all Whether to disconnect and join every client.
+     */
+    void reapClients(bool all);
+};
+
+#endif // CLASSIFICATION_SERVER_H // End of include guard
@@ -0,0 +1,190 @@
+#include "CompactTrie.h" // Include the CompactTrie header file
+#include "Trie.h" // Include Trie for the pointer-based TrieNode
+#include <algorithm> // Include algorithm for sorting and binary search
+#include <cstring> // Include cstring for comparing the signature
+#include <stdexcept> // Include stdexcept for std::runtime_error
+#include <utility> // Include utility for std::pair
+
+namespace {
+const uint32_t kLinearScanLimit = 8; // Nodes with at most this many children are scanned linearly
+
+const char kSignature[8] = {'S', 'E', 'N', 'T', 'T', 'R', 'I', 'E'}; // Magic bytes at the start of a model file
+const uint32_t kByteOrder = 0x01020304; // Byte order marker; reads back differently on a foreign-endian machine
+
+bool labelLess(char a, char b) { // Order labels as unsigned bytes
+    return static_cast<unsigned char>(a) < static_cast<unsigned char>(b); // Compare the byte values
+}
+
+uint64_t fnv1a(uint64_t hash, const char* bytes, size_t size) { // Continue a 64-bit FNV-1a hash over some bytes
+    for (size_t i = 0; i < size; ++i) { // Loop through each byte
+        hash ^= static_cast<unsigned char>(bytes[i]); // Mix in the byte
+        hash *= 1099511628211ULL; // Multiply by the FNV prime
+    }
+    return hash; // Return the updated hash
+}
+
+const uint64_t kFnvOffset = 14695981039346656037ULL; // FNV-1a 64-bit offset basis
+} // namespace
+
+CompactTrie::CompactTrie() : nodes(nullptr), labels(nullptr), nodeCount(0) {} // Construct an empty trie
+
+CompactTrie::CompactTrie(CompactTrie&& other) noexcept : CompactTrie() { // Move constructor
+    *this = std::move(other); // Reuse the move assignment
+}
+
+CompactTrie& CompactTrie::operator=(CompactTrie&& other) noexcept { // Move assignment
+    if (this != &other) { // Check for self-assignment
+        ownedNodes = std::move(other.ownedNodes); // Take the owned nodes (their buffer does not move)
+        ownedLabels = std::move(other.ownedLabels); // Take the owned labels
+        mapping = std::move(other.mapping); // Take the mapping
+        nodes = other.nodes; // Take the node pointer
+        labels = other.labels; // Take the label pointer
+        nodeCount = other.nodeCount; // Take the node count
+        other.nodes = nullptr; // Leave the other trie empty
+        other.labels = nullptr; // Leave the other trie empty
+        other.nodeCount = 0; // Leave the other trie empty
+    }
+    return *this; // Return the current object
+}
+
+void CompactTrie::build(const TrieNode* root) { // Build the compact layout from a pointer-based trie
+    *this = CompactTrie(); // Drop any previous layout or mapping
+    std::vector<Node>& nodes = ownedNodes; // Build into the owned node array
+    std::vector<char>& labels = ownedLabels; // Build into the owned label array
+    std::vector<const TrieNode*> sources; // Pointer node behind each compact node, in the same order
+    std::vector<std::pair<char, const TrieNode*>> children; // Children of the node being expanded
+
+    nodes.push_back(Node{0, 0, root->positiveSentiments, root->totalTweets}); // Add the root
+    labels.push_back('\0'); // The root has no incoming edge
+    sources.push_back(root); // Remember the root's source
+    for (size_t i = 0; i < sources.size(); ++i) { // Expand the nodes breadth first
+        children.assign(sources[i]->children.begin(), sources[i]->children.end()); // Collect the children
+        std::sort(children.begin(), children.end(), [](const std::pair<char, const TrieNode*>& a, const std::pair<char, const TrieNode*>& b) { // Sort them by label
+            return labelLess(a.first, b.first); // Compare the labels as bytes
+        });
+        nodes[i].firstChild = static_cast<uint32_t>(nodes.size()); // The children start at the end of the array
+        nodes[i].numChildren = static_cast<uint32_t>(children.size()); // Record the number of children
+        for (const auto& child : children) { // Loop through each child
+            nodes.push_back(Node{0, 0, child.second->positiveSentiments, child.second->totalTweets}); // Append the child
+            labels.push_back(child.first); // Record its label
+            sources.push_back(child.second); // Queue it for expansion
+        }
+    }
+    nodes.shrink_to_fit(); // Release any spare capacity
+    labels.shrink_to_fit(); // Release any spare capacity
+    this->nodes = ownedNodes.data(); // Point at the owned nodes
+    this->labels = ownedLabels.data(); // Point at the owned labels
+    nodeCount = ownedNodes.size(); // Record the node count
+}
+
+void CompactTrie::write(std::ostream& out) const { // Write the trie as a binary model file
+    FileHeader header; // Declare the header
+    std::memset(&header, 0, sizeof(header)); // Zero every field, including the reserved one
+    std::memcpy(header.magic, kSignature, sizeof(header.magic)); // Set the signature
+    header.version = kFormatVersion; // Set the format version
+    header.byteOrder = kByteOrder; // Set the byte order marker
+    header.nodeCount = nodeCount; // Set the node count
+    header.nodesOffset = sizeof(FileHeader); // The nodes follow the header
+    header.labelsOffset = header.nodesOffset + nodeCount * sizeof(Node); // The labels follow the nodes
+    header.fileSize = header.labelsOffset + nodeCount; // The file ends after the labels
+    const char* nodeBytes = reinterpret_cast<const char*>(nodes); // View the nodes as bytes
+    header.checksum = fnv1a(fnv1a(kFnvOffset, nodeBytes, nodeCount * sizeof(Node)), labels, nodeCount); // Hash everything after the header
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header)); // Write the header
+    out.write(nodeBytes, static_cast<std::streamsize>(nodeCount * sizeof(Node))); // Write the nodes
+    out.write(labels, static_cast<std::streamsize>(nodeCount)); // Write the labels
+}
+
+void CompactTrie::map(std::shared_ptr<MappedFile> file, bool verifyChecksum) { // Use a mapped model file as storage
+    const char* bytes = file->data(); // Get the mapped bytes
+    size_t size = file->size(); // Get the file size
+    if (!hasSignature(bytes, size) || size < sizeof(FileHeader)) { // Check the signature
+        throw std::runtime_error("Not a binary model file"); // Throw an error if it is missing
+    }
+    FileHeader header; // Declare the header
+    std::memcpy(&header, bytes, sizeof(header)); // Copy it out of the mapping
+    if (header.byteOrder != kByteOrder) { // Check the byte order
+        throw std::runtime_error("Binary model file was written with a different byte order"); // Throw an error if it differs
+    }
+    if (header.version != kFormatVersion) { // Check the version
+        throw std::runtime_error("Unsupported binary model file version"); // Throw an error if it is unknown
+    }
+    if (header.fileSize != size || header.nodeCount == 0 || header.nodesOffset != sizeof(FileHeader) || // Check the layout fields
+        header.labelsOffset != header.nodesOffset + header.nodeCount * sizeof(Node) || header.labelsOffset + header.nodeCount != size) {
+        throw std::runtime_error("Binary model file is truncated or malformed"); // Throw an error if they are inconsistent
+    }
+    if (verifyChecksum && fnv1a(kFnvOffset, bytes + sizeof(FileHeader), size - sizeof(FileHeader)) != header.checksum) { // Check the checksum
+        throw std::runtime_error("Binary model file checksum mismatch"); // Throw an error if the data is corrupt
+    }
+    *this = CompactTrie(); // Drop any previous layout or mapping
+    nodes = reinterpret_cast<const Node*>(bytes + header.nodesOffset); // Point at the mapped nodes
+    labels = bytes + header.labelsOffset; // Point at the mapped labels
+    nodeCount = static_cast<size_t>(header.nodeCount); // Record the node count
+    mapping = std::move(file); // Keep the mapping alive
+}
+
+bool CompactTrie::hasSignature(const char* bytes, size_t size) { // Check for the model signature
+    return size >= sizeof(kSignature) && std::memcmp(bytes, kSignature, sizeof(kSignature)) == 0; // Compare the first bytes
+}
+
+const CompactTrie::Node* CompactTrie::find(std::string_view word, size_t* visited) const { // Find the node of a word
+    if (visited != nullptr) *visited = nodeCount == 0 ? 0 : 1; // Count the root
+    if (nodeCount == 0) return nullptr; // An unbuilt trie holds no words
+    uint32_t index = 0; // Start at the root
+    for (char c : word) { // Loop through each character in the word
+        const Node& node = nodes[index]; // Get the current node
+        const char* first = labels + node.firstChild; // Get the labels of its children
+        const char* last = first + node.numChildren; // One past the last child label
+        const char* match = last; // Position of the matching label
+        if (node.numChildren <= kLinearScanLimit) { // If the node is narrow
+            for (const char* p = first; p < last; ++p) { // Scan the labels
+                if (*p == c) { match = p; break; } // Stop at the match
+            }
+        } else { // If the node is wide
+            const char* p = std::lower_bound(first, last, c, labelLess); // Binary search the sorted labels
+            if (p != last && *p == c) match = p; // Check for an exact match
+        }
+        if (match == last) return nullptr; // Return nullptr if the word is not found
+        index = static_cast<uint32_t>(match - labels); // Move to the child node
+        if (visited != nullptr) ++*visited; // Count the child
+    }
+    return &nodes[index]; // Return the node of the word
+}
+
+uint32_t CompactTrie::indexOf(const Node* node) const { // Get the position of a node
+    return static_cast<uint32_t>(node - nodes); // Return its offset from the root
+}
+
+const CompactTrie::Node& CompactTrie::at(uint32_t index) const { // Get a node by its position
+    return nodes[index]; // Return the node
+}
+
+void CompactTrie::forEachWord(const std::function<void(const std::string&, const Node&)>& visit) const { // Visit every counted word
+    if (nodeCount == 0) return; // An unbuilt trie holds no words
+    std::string prefix; // Word spelled by the path to the current node
+    std::vector<std::pair<uint32_t, uint32_t>> stack; // Pending (node, depth) pairs
+    stack.emplace_back(0, 0); // Start at the root
+    while (!stack.empty()) { // Loop until every node is visited
+        uint32_t index = stack.back().first; // Get the next node
+        uint32_t depth = stack.back().second; // Get its depth
+        stack.pop_back(); // Remove it from the stack
+        prefix.resize(depth > 0 ? depth - 1 : 0); // Trim the prefix to the parent's word
+        if (depth > 0) prefix += labels[index]; // Append the node's label
+        const Node& node = nodes[index]; // Get the node
+        if (node.totalTweets > 0) visit(prefix, node); // Visit it if it holds a word
+        for (uint32_t k = node.numChildren; k > 0; --k) { // Push the children in reverse so they pop in label order
+            stack.emplace_back(node.firstChild + k - 1, depth + 1); // Push the child
+        }
+    }
+}
+
+size_t CompactTrie::size() const { // Get the number of nodes
+    return nodeCount; // Return the node count
+}
+
+size_t CompactTrie::memoryUsage() const { // Get the memory held by the arrays
+    return nodeCount * (sizeof(Node) + 1); // Return the bytes of both arrays
+}
+
+uint64_t CompactTrie::checksum(const char* bytes, size_t size) { // Hash bytes with FNV-1a
+    return fnv1a(kFnvOffset, bytes, size); // Start from the offset basis
+}
@@ -0,0 +1,153 @@
+#ifndef COMPACT_TRIE_H // Include guard to prevent multiple inclusions
+#define COMPACT_TRIE_H // Define the include guard
+
+#include "CSVReader.h" // Include MappedFile for memory-mapped models
+#include <cstdint> // Include cstdint for 32-bit indices
+#include <cstddef> // Include cstddef for size_t
+#include <memory> // Include memory for sharing a mapping
+#include <ostream> // Include ostream for writing models
+#include <string> // Include string for building prefixes during traversal
+#include <string_view> // Include string_view for lookups
+#include <vector> // Include vector for the node arrays
+#include <functional> // Include functional for traversal callbacks
+
+class TrieNode; // Forward declaration of the pointer-based node
+
+/**
+ * @class CompactTrie
+ * @brief A read-only trie stored in two contiguous arrays with 32-bit indices.
+ *
+ * Nodes are laid out breadth-first, so the children of a node occupy a contiguous index range
+ * sorted by label. A lookup is a short scan (or binary search for wide nodes) of one byte array
+ * per character instead of a hash probe and a pointer chase, and each node costs 17 bytes instead
+ * of a heap-allocated TrieNode plus its unordered_map.
+ *
+ * The arrays are either owned or point into a memory-mapped model file written by write(), in
+ * which case the trie is queried straight from the mapping without deserialization.
+ */
+class CompactTrie {
+public:
+    /**
+     * @struct Node
+     * @brief A node of the compact trie.
+     */
+    struct Node {
+        uint32_t firstChild; ///< Index of the first child; children are contiguous.
+        uint32_t numChildren; ///< Number of children.
+        int32_t positiveSentiments; ///< Counter for positive sentiments.
+        int32_t totalTweets; ///< Counter for total tweets.
+    };
+
+    /**
+     * @struct FileHeader
+     * @brief The 64-byte header of a binary model file.
+     *
+     * The header is followed by the node array at nodesOffset and the label array at labelsOffset.
+     * The checksum is the 64-bit FNV-1a hash of every byte after the header.
+     */
+    struct FileHeader {
+        char magic[8]; ///< File signature, "SENTTRIE".
+        uint32_t version; ///< Format version, kFormatVersion.
+        uint32_t byteOrder; ///< 0x01020304 as written by the producing machine.
+        uint64_t nodeCount; ///< Number of nodes, including the root.
+        uint64_t nodesOffset; ///< Offset of the node array.
+        uint64_t labelsOffset; ///< Offset of the label array.
+        uint64_t fileSize; ///< Total size of the file.
+        uint64_t checksum; ///< FNV-1a hash of the bytes after the header.
+        uint64_t reserved; ///< Zero; reserved for later versions.
+    };
+
+    static const uint32_t kFormatVersion = 1; ///< Version written by write().
+
+    CompactTrie(); ///< Constructs an empty trie.
+    CompactTrie(CompactTrie&& other) noexcept; ///< Moves the arrays (or the mapping) of another trie.
+    CompactTrie& operator=(CompactTrie&& other) noexcept; ///< Moves the arrays (or the mapping) of another trie.
+    CompactTrie(const CompactTrie&) = delete; ///< Not copyable; the arrays may point into a mapping.
+    CompactTrie& operator=(const CompactTrie&) = delete; ///< Not copyable; the arrays may point into a mapping.
+
+    /**
+     * @brief Builds the compact layout from a pointer-based trie.
+     * @param root The root of the pointer-based trie.
+     */
+    void build(const TrieNode* root);
+
+    /**
+     * @brief Writes the trie as a binary model file.
+     * @param out The binary stream to write to.
+     */
+    void write(std::ostream& out) const;
+
+    /**
+     * @brief Uses a mapped binary model file as the trie's storage.
+     * @param file The mapped model file; kept alive as long as the trie uses it.
+     * @param verifyChecksum Whether to hash the whole file to detect corruption.
+     * @throws std::runtime_error If the file is not a valid model of this version.
+     */
+    void map(std::shared_ptr<MappedFile> file, bool verifyChecksum);
+
+    /**
+     * @brief Checks if a buffer starts with the binary model signature.
+     * @param bytes The first bytes of a file.
+     * @param size The number of bytes available.
+     * @return True if the bytes start a binary model file.
+     */
+    static bool hasSignature(const char* bytes, size_t size);
+
+    /**
+     * @brief Finds the node of a word.
+     * @param word The word to find.
+     * @param visited If not null, receives the number of nodes visited, root included.
+     * @return The node, or nullptr if the word is not a path in the trie.
+     */
+    const Node* find(std::string_view word, size_t* visited = nullptr) const;
+
+    /**
+     * @brief Gets the position of a node in the node array.
+     * @param node A node returned by find().
+     * @return The index of the node; indices run from 0 (the root) to size() - 1.
+     */
+    uint32_t indexOf(const Node* node) const;
+
+    /**
+     * @brief Gets a node by its position in the node array.
+     * @param index The index of the node, below size().
+     * @return The node.
+     */
+    const Node& at(uint32_t index) const;
+
+    /**
+     * @brief Calls a function for every node with a nonzero tweet count, depth first.
+     * @param visit The function receiving each word and its node.
+     */
+    void forEachWord(const std::function<void(const std::string&, const Node&)>& visit) const;
+
+    /**
+     * @brief Gets the number of nodes.
+     * @return The number of nodes, including the root.
+     */
+    size_t size() const;
+
+    /**
+     * @brief Gets the memory held by the node arrays.
+     * @return The number of bytes of node and label storage (owned or mapped).
+     */
+    size_t memoryUsage() const;
+
+    /**
+     * @brief Hashes bytes with the 64-bit FNV-1a hash the model file checksum uses.
+     * @param bytes The bytes to hash.
+     * @param size The number of bytes.
+     * @return The hash.
+     */
+    static uint64_t checksum(const char* bytes, size_t size);
+
+private:
+    std::vector<Node> ownedNodes; ///< Node storage when the trie was built in memory.
+    std::vector<char> ownedLabels; ///< Label storage when the trie was built in memory.
+    std::shared_ptr<MappedFile> mapping; ///< Model file backing the arrays when the trie was mapped.
+    const Node* nodes; ///< Nodes in breadth-first order; index 0 is the root.
+    const char* labels; ///< Label of the edge leading into each node.
+    size_t nodeCount; ///< Number of nodes.
+};
+
+#endif // COMPACT_TRIE_H // End of include guard
@@ -0,0 +1,248 @@
+#include "CorpusCache.h" // Include the CorpusCache header file
+#include "ThreadPool.h" // Include ThreadPool for parallel counting
+#include "TokenInterner.h" // Include TokenInterner for assigning the token ids
+#include "Tokenizer.h" // Include Tokenizer for tokenizing the tweets
+#include <algorithm> // Include algorithm for std::max
+#include <chrono> // Include the chrono library for timing
+#include <cstdio> // Include cstdio for replacing the cache file
+#include <cstring> // Include cstring for comparing the signature
+#include <filesystem> // Include filesystem for the source file's size and modification time
+#include <fstream> // Include fstream for reading the header and writing the cache
+#include <iostream> // Include iostream for the timing output
+#include <stdexcept> // Include stdexcept for std::runtime_error
+#include <string> // Include string for the temporary file name
+#include <thread> // Include thread for the hardware concurrency
+
+namespace {
+const char kMagic[8] = {'S', 'E', 'N', 'T', 'C', 'O', 'R', 'P'}; // Signature of a corpus cache file
+const uint32_t kByteOrder = 0x01020304; // Byte order marker, read back differently on a machine of the other endianness
+
+static_assert(sizeof(CorpusCache::FileHeader) == 64, "The corpus cache header must be 64 bytes"); // Keep the arrays after it aligned
+
+template <typename T>
+void writeArray(std::ofstream& out, const std::vector<T>& values) { // Write the elements of an array back to back
+    out.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T))); // Write the raw bytes
+}
+
+bool readHeader(const DSString& cacheFile, CorpusCache::FileHeader& header) { // Read and check the fixed part of a cache file's header
+    std::ifstream file(cacheFile.c_str(), std::ios::binary); // Open the file for reading in binary mode
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) return false; // Fail if it is missing or too short
+    return std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && // Check the signature
+           header.version == CorpusCache::kFormatVersion && // Check the format version
+           header.byteOrder == kByteOrder; // Check the byte order
+}
+} // namespace
+
+bool CorpusCache::statFile(const DSString& filename, uint64_t& size, int64_t& modified) { // Read the size and modification time of a file
+    std::error_code error; // Declare the error, so a missing file does not throw
+    std::filesystem::path path(filename.c_str()); // Get the path of the file
+    uintmax_t bytes = std::filesystem::file_size(path, error); // Get its size
+    if (error) return false; // Fail if it does not exist
+    std::filesystem::file_time_type time = std::filesystem::last_write_time(path, error); // Get its modification time
+    if (error) return false; // Fail if it cannot be read
+    size = static_cast<uint64_t>(bytes); // Return the size
+    modified = static_cast<int64_t>(time.time_since_epoch().count()); // Return the modification time in clock ticks
+    return true; // The file exists
+}
+
+void CorpusCache::compile(const DSString& csvFile, const DSString& cacheFile) { // Compile a training CSV into a cache file
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing
+
+    FileHeader header = FileHeader(); // Declare the header, zeroed
+    if (!statFile(csvFile, header.sourceSize, header.sourceModified)) { // Record the source's size and modification time
+        throw std::runtime_error("Could not open file for reading"); // Throw an error if the source is missing
+    }
+
+    std::vector<uint64_t> ends; // Declare the end of each record, in tokens
+    std::vector<uint32_t> ids; // Declare the token ids of every record
+    std::vector<uint8_t> labels; // Declare the label of each record
+    TokenInterner interner; // Declare the interner assigning the ids
+    {
+        MappedFile mapped(csvFile); // Map the training file into memory
+        CSVReader reader(mapped.data(), mapped.data() + mapped.size()); // Declare a reader over the file
+        reader.skip(); // Skip the header line
+        std::vector<std::string_view> fields; // Declare the field list, reused for every record
+        TokenBuffer tokens; // Declare the token buffer, reused for every record
+        std::vector<uint32_t> recordIds; // Declare the id stream, reused for every record
+        while (reader.next(fields, 6)) { // Read each record; the tweet takes the rest of the record, as train() reads it
+            if (fields.size() < 6) continue; // Skip records with missing fields
+            Tokenizer::tokenize(fields[5], tokens); // Tokenize the tweet into words
+            interner.intern(tokens, recordIds); // Turn the words into ids
+            ids.insert(ids.end(), recordIds.begin(), recordIds.end()); // Append them
+            ends.push_back(ids.size()); // Record where the record ends
+            bool digit = fields[0].size() == 1 && fields[0][0] >= '0' && fields[0][0] <= '9'; // Check for a one-digit label
+            labels.push_back(digit ? static_cast<uint8_t>(fields[0][0] - '0') : kNoLabel); // Record its label digit; 4 is positive
+        }
+    }
+
+    std::vector<uint32_t> offsets(1, 0); // Declare the start of each token, plus the end offset
+    std::string chars; // Declare the bytes of the vocabulary
+    for (uint32_t id = 0; id < interner.size(); ++id) { // Loop through each token in id order
+        chars.append(interner.token(id)); // Append its bytes
+        offsets.push_back(static_cast<uint32_t>(chars.size())); // Record where it ends; the interner keeps this within 32 bits
+    }
+
+    std::memcpy(header.magic, kMagic, sizeof(kMagic)); // Set the signature
+    header.version = kFormatVersion; // Set the format version
+    header.byteOrder = kByteOrder; // Set the byte order marker
+    header.recordCount = labels.size(); // Set the number of records
+    header.tokenCount = ids.size(); // Set the number of tokens
+    header.vocabularySize = interner.size(); // Set the number of distinct tokens
+    header.vocabularyBytes = chars.size(); // Set the length of the vocabulary
+
+    std::string temporary = std::string(cacheFile) + ".tmp"; // Write next to the destination first
+    std::ofstream file(temporary, std::ios::binary); // Open the temporary file for writing in binary mode
+    if (!file.is_open()) { // Check if the file is open
+        throw std::runtime_error("Could not open file for writing"); // Throw an error if the file could not be opened
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header)); // Write the header
+    writeArray(file, ends); // Write the record ends
+    writeArray(file, ids); // Write the token ids
+    writeArray(file, offsets); // Write the vocabulary offsets
+    writeArray(file, labels); // Write the labels
+    file.write(chars.data(), static_cast<std::streamsize>(chars.size())); // Write the vocabulary bytes
+    file.close(); // Close the file
+    if (!file || std::rename(temporary.c_str(), cacheFile.c_str()) != 0) { // Check the write, then replace the old cache
+        std::remove(temporary.c_str()); // Remove the partial file
+        throw std::runtime_error("Error writing corpus cache file"); // Throw an error if either failed
+    }
+
+    auto end = std::chrono::high_resolution_clock::now(); // End timing
+    std::chrono::duration<double> duration = end - start; // Calculate the duration
+    std::cout << "Compiling corpus completed in " << duration.count() << " seconds." << std::endl; // Output the duration
+}
+
+bool CorpusCache::isFresh(const DSString& cacheFile, const DSString& csvFile) { // Check a cache file against its source
+    FileHeader header; // Declare the cache's header
+    if (!readHeader(cacheFile, header)) return false; // A missing or foreign cache is never fresh
+    uint64_t size; // Declare the source's size
+    int64_t modified; // Declare the source's modification time
+    if (!statFile(csvFile, size, modified)) return false; // A missing source cannot be checked
+    return header.sourceSize == size && header.sourceModified == modified; // Fresh if the source is unchanged
+}
+
+std::unique_ptr<CorpusCache> CorpusCache::openOrCompile(const DSString& cacheFile, const DSString& csvFile) { // Map a cache file, compiling it if needed
+    if (!isFresh(cacheFile, csvFile)) { // If the cache is missing or older than the source
+        compile(csvFile, cacheFile); // Compile it again
+    }
+    return std::make_unique<CorpusCache>(cacheFile); // Map it
+}
+
+CorpusCache::CorpusCache(const DSString& cacheFile) : file(cacheFile) { // Constructor for CorpusCache, mapping the file
+    if (file.size() < sizeof(FileHeader)) { // Check that the header fits
+        throw std::runtime_error("Corpus cache file is truncated"); // Throw an error if it does not
+    }
+    std::memcpy(&header, file.data(), sizeof(header)); // Copy the header
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kFormatVersion || header.byteOrder != kByteOrder) { // Check the signature, version and byte order
+        throw std::runtime_error("Not a corpus cache file"); // Throw an error if any differs
+    }
+    if (header.recordCount > file.size() || header.tokenCount > file.size() || header.vocabularySize > file.size()) { // Keep the size computation below from overflowing
+        throw std::runtime_error("Corpus cache file is truncated"); // Throw an error if a count cannot fit the file
+    }
+    uint64_t expected = sizeof(FileHeader) + header.recordCount * sizeof(uint64_t) + header.tokenCount * sizeof(uint32_t) + // Header, record ends and ids
+                        (header.vocabularySize + 1) * sizeof(uint32_t) + header.recordCount + header.vocabularyBytes; // Offsets, labels and vocabulary
+    if (expected != file.size()) { // Check that the arrays fill the file exactly
+        throw std::runtime_error("Corpus cache file is truncated"); // Throw an error if they do not
+    }
+
+    const char* cursor = file.data() + sizeof(FileHeader); // Start after the header
+    ends = reinterpret_cast<const uint64_t*>(cursor); // Point at the record ends
+    cursor += header.recordCount * sizeof(uint64_t); // Skip them
+    ids = reinterpret_cast<const uint32_t*>(cursor); // Point at the token ids
+    cursor += header.tokenCount * sizeof(uint32_t); // Skip them
+    offsets = reinterpret_cast<const uint32_t*>(cursor); // Point at the vocabulary offsets
+    cursor += (header.vocabularySize + 1) * sizeof(uint32_t); // Skip them
+    labels = reinterpret_cast<const uint8_t*>(cursor); // Point at the labels
+    cursor += header.recordCount; // Skip them
+    chars = cursor; // Point at the vocabulary bytes
+
+    if (offsets[0] != 0 || offsets[header.vocabularySize] != header.vocabularyBytes) { // Check that the offsets span the vocabulary
+        throw std::runtime_error("Corpus cache vocabulary is corrupt"); // Throw an error if they do not
+    }
+    for (size_t id = 0; id < header.vocabularySize; ++id) { // Loop through each token
+        if (offsets[id] > offsets[id + 1]) throw std::runtime_error("Corpus cache vocabulary is corrupt"); // Check that its offsets are in order
+    }
+    uint64_t previous = 0; // Declare the end of the previous record
+    for (size_t record = 0; record < header.recordCount; ++record) { // Loop through each record
+        if (ends[record] < previous) throw std::runtime_error("Corpus cache records are corrupt"); // Check that the records are in order
+        if (labels[record] > 9 && labels[record] != kNoLabel) throw std::runtime_error("Corpus cache records are corrupt"); // Check that the label is a digit, so label() can index by it
+        previous = ends[record]; // Move to the next record
+    }
+    if (previous != header.tokenCount) { // Check that the records cover every token
+        throw std::runtime_error("Corpus cache records are corrupt"); // Throw an error if they do not
+    }
+}
+
+void CorpusCache::countRange(size_t first, size_t last, std::vector<WordCounts>& counts) const { // Count the tokens of a range of records
+    uint64_t begin = first == 0 ? 0 : ends[first - 1]; // Get the first token of the range
+    for (size_t record = first; record < last; ++record) { // Loop through each record
+        bool isPositive = labels[record] == 4; // Get its label; "4" is positive
+        for (uint64_t end = ends[record]; begin < end; ++begin) { // Loop through each of its tokens
+            uint32_t id = ids[begin]; // Get the token's id
+            if (id >= counts.size()) throw std::runtime_error("Corpus cache token id is out of range"); // Check it against the vocabulary
+            counts[id].totalTweets++; // Increment the totalTweets count
+            if (isPositive) counts[id].positiveSentiments++; // Increment the positiveSentiments count
+        }
+    }
+}
+
+std::vector<WordCounts> CorpusCache::countTokens(unsigned numThreads) const { // Sum the counts of every distinct token
+    if (numThreads == 0) { // If the caller asked for the hardware concurrency
+        numThreads = std::max(1u, std::thread::hardware_concurrency()); // Use every core, but at least one thread
+    }
+    size_t numRecords = records(); // Get the number of records
+    size_t numRanges = std::max<size_t>(1, std::min<size_t>(numThreads, numRecords)); // Use at most one range per record
+    std::vector<WordCounts> counts(vocabularySize()); // Declare the counts, zero for every token
+    if (numRanges == 1) { // If there is only one range
+        countRange(0, numRecords, counts); // Count in place
+        return counts; // Return the counts
+    }
+
+    std::vector<std::vector<WordCounts>> partials(numRanges, std::vector<WordCounts>(vocabularySize())); // Declare one partial array per range
+    ThreadPool pool(numThreads); // Declare the pool running the counting tasks
+    TaskGroup counting(pool); // Declare the group of counting tasks
+    counting.runEach(numRanges, [&](size_t i) { // Count each range on the pool
+        countRange(numRecords * i / numRanges, numRecords * (i + 1) / numRanges, partials[i]); // Count the range into its partial array
+    });
+    counting.wait(); // Wait for every range; rethrows the first failure
+    for (const std::vector<WordCounts>& partial : partials) { // Loop through the partial arrays in range order
+        for (size_t id = 0; id < counts.size(); ++id) { // Loop through each token
+            counts[id].totalTweets += partial[id].totalTweets; // Add the totalTweets count
+            counts[id].positiveSentiments += partial[id].positiveSentiments; // Add the positiveSentiments count
+        }
+    }
+    return counts; // Return the sums
+}
+
+size_t CorpusCache::records() const { // Get the number of training records
+    return static_cast<size_t>(header.recordCount); // Return the count from the header
+}
+
+size_t CorpusCache::tokens() const { // Get the number of tokens
+    return static_cast<size_t>(header.tokenCount); // Return the count from the header
+}
+
+size_t CorpusCache::vocabularySize() const { // Get the number of distinct tokens
+    return static_cast<size_t>(header.vocabularySize); // Return the count from the header
+}
+
+std::pair<const uint32_t*, const uint32_t*> CorpusCache::recordIds(size_t record) const { // Get the token ids of a record
+    uint64_t begin = record == 0 ? 0 : ends[record - 1]; // Get its first token
+    return std::make_pair(ids + begin, ids + ends[record]); // Point at its ids
+}
+
+bool CorpusCache::isPositive(size_t record) const { // Get the label of a record
+    return labels[record] == 4; // "4" is positive
+}
+
+int CorpusCache::label(size_t record) const { // Get the label digit of a record
+    return labels[record] == kNoLabel ? -1 : labels[record]; // Report fields that are not one digit as -1
+}
+
+std::string_view CorpusCache::token(uint32_t id) const { // Get the token of an id
+    return std::string_view(chars + offsets[id], offsets[id + 1] - offsets[id]); // View its bytes in the mapping
+}
+
+size_t CorpusCache::fileSize() const { // Get the size of the cache file
+    return file.size(); // Return the number of mapped bytes
+}
@@ -0,0 +1,182 @@
+#ifndef CORPUS_CACHE_H // Include guard to prevent multiple inclusions
+#define CORPUS_CACHE_H // Define the include guard
+
+#include "DSString.h" // Include DSString for file names
+#include "CSVReader.h" // Include MappedFile for mapping the cache
+#include "SentimentModel.h" // Include SentimentModel for the word counts
+#include <cstddef> // Include cstddef for size_t
+#include <cstdint> // Include cstdint for the fixed-width fields
+#include <memory> // Include memory for std::unique_ptr
+#include <string_view> // Include string_view for tokens
+#include <utility> // Include utility for std::pair
+#include <vector> // Include vector for the counts
+
+/**
+ * @class CorpusCache
+ * @brief A training file compiled into labels and token-id sequences, memory-mapped for repeated training.
+ *
+ * compile() parses and tokenizes a training CSV once, exactly as SentimentModel::train would, interns
+ * the tokens (see TokenInterner) and writes the result as flat arrays. Later runs map the file and
+ * stream the integers: counting a corpus is one pass over the ids with no parsing, tokenizing or
+ * hashing, and each distinct token is handed to the model once with its totals.
+ *
+ * The header records the size and modification time of the source CSV; isFresh() compares them with
+ * the file on disk, so an edited or replaced source is compiled again. The arrays are native-endian
+ * and aligned; a cache written on another machine is rejected by its byte order marker.
+ */
+class CorpusCache {
+public:
+    /**
+     * @struct FileHeader
+     * @brief The 64-byte header of a corpus cache file.
+     *
+     * The header is followed by the record ends (uint64_t, one per record, counted in tokens), the
+     * token ids (uint32_t), the vocabulary offsets (uint32_t, one per token plus an end offset), the
+     * labels (one byte per record: the digit of a one-digit label field, kNoLabel otherwise) and the
+     * vocabulary bytes, in that order.
+     */
+    struct FileHeader {
+        char magic[8]; ///< File signature, "SENTCORP".
+        uint32_t version; ///< Format version, kFormatVersion.
+        uint32_t byteOrder; ///< 0x01020304 as written by the producing machine.
+        uint64_t sourceSize; ///< Size of the source CSV when it was compiled.
+        int64_t sourceModified; ///< Modification time of the source CSV, in file clock ticks.
+        uint64_t recordCount; ///< Number of training records.
+        uint64_t tokenCount; ///< Number of tokens over every record.
+        uint64_t vocabularySize; ///< Number of distinct tokens.
+        uint64_t vocabularyBytes; ///< Total length of the distinct tokens.
+    };
+
+    static const uint32_t kFormatVersion = 2; ///< Version written by compile(); version 1 stored only whether a record was positive.
+    static const uint8_t kNoLabel = 0xFF; ///< Label byte of a record whose label field is not one digit.
+
+    /**
+     * @brief Maps and validates a corpus cache file.
+     * @param cacheFile The cache file.
+     * @throws std::runtime_error If the file cannot be opened or is not a valid corpus cache, including a label byte that is neither a digit nor kNoLabel.
+     */
+    explicit CorpusCache(const DSString& cacheFile);
+
+    CorpusCache(const CorpusCache&) = delete; ///< Not copyable; the arrays point into the mapping.
+    CorpusCache& operator=(const CorpusCache&) = delete; ///< Not copyable; the arrays point into the mapping.
+
+    /**
+     * @brief Compiles a training CSV into a cache file.
+     *
+     * The file is written next to its destination and renamed over it, so a crash leaves the previous cache.
+     *
+     * @param csvFile The training file; its header line is skipped.
+     * @param cacheFile The cache file to write.
+     * @throws std::runtime_error If either file cannot be opened or written.
+     */
+    static void compile(const DSString& csvFile, const DSString& cacheFile);
+
+    /**
+     * @brief Checks if a cache file was compiled from the current contents of a training CSV.
+     * @param cacheFile The cache file.
+     * @param csvFile The training file.
+     * @return True if the cache exists and records the training file's current size and modification time.
+     */
+    static bool isFresh(const DSString& cacheFile, const DSString& csvFile);
+
+    /**
+     * @brief Maps a cache file, compiling it first if it is missing or stale.
+     * @param cacheFile The cache file.
+     * @param csvFile The training file it is compiled from.
+     * @return The mapped cache.
+     * @throws std::runtime_error If the cache cannot be compiled or mapped.
+     */
+    static std::unique_ptr<CorpusCache> openOrCompile(const DSString& cacheFile, const DSString& csvFile);
+
+    /**
+     * @brief Sums the counts of every distinct token over the records.
+     *
+     * With more than one thread the records are split into ranges that are counted into separate
+     * arrays and added up in range order.
+     *
+     * @param numThreads The number of threads to count with (0 uses the hardware concurrency).
+     * @return The counts, indexed by token id.
+     * @throws std::runtime_error If a token id is out of range.
+     */
+    std::vector<WordCounts> countTokens(unsigned numThreads = 1) const;
+
+    /**
+     * @brief Gets the number of training records.
+     * @return The number of records.
+     */
+    size_t records() const;
+
+    /**
+     * @brief Gets the number of tokens over every record.
+     * @return The number of tokens.
+     */
+    size_t tokens() const;
+
+    /**
+     * @brief Gets the number of distinct tokens.
+     * @return The number of ids.
+     */
+    size_t vocabularySize() const;
+
+    /**
+     * @brief Gets the token ids of a record.
+     * @param record A record below records().
+     * @return Pointers to its first id and one past its last id, into the mapping.
+     */
+    std::pair<const uint32_t*, const uint32_t*> recordIds(size_t record) const;
+
+    /**
+     * @brief Gets the label of a record.
+     * @param record A record below records().
+     * @return True if the record is positive.
+     */
+    bool isPositive(size_t record) const;
+
+    /**
+     * @brief Gets the label digit of a record, for models with more than two labels.
+     * @param record A record below records().
+     * @return The digit of its label field (0 to 9), or -1 if the field is not one digit.
+     */
+    int label(size_t record) const;
+
+    /**
+     * @brief Gets the token of an id.
+     * @param id An id below vocabularySize().
+     * @return A view into the mapping.
+     */
+    std::string_view token(uint32_t id) const;
+
+    /**
+     * @brief Gets the size of the cache file.
+     * @return The number of mapped bytes.
+     */
+    size_t fileSize() const;
+
+private:
+    MappedFile file; ///< The mapped cache file.
+    FileHeader header; ///< Copy of the header.
+    const uint64_t* ends; ///< Token index one past the last token of each record.
+    const uint32_t* ids; ///< Token ids of every record, back to back.
+    const uint32_t* offsets; ///< Start of each token in chars, plus one final end offset.
+    const uint8_t* labels; ///< Label digit of each record, or kNoLabel.
+    const char* chars; ///< Bytes of every distinct token, back to back.
+
+    /**
+     * @brief Counts the tokens of a range of records.
+     * @param first The first record.
+     * @param last One past the last record.
+     * @param counts The counts to add to, indexed by token id.
+     */
+    void countRange(size_t first, size_t last, std::vector<WordCounts>& counts) const;
+
+    /**
+     * @brief Reads the size and modification time of a file.
+     * @param filename The file.
+     * @param size Receives its size.
+     * @param modified Receives its modification time, in file clock ticks.
+     * @return True if the file exists.
+     */
+    static bool statFile(const DSString& filename, uint64_t& size, int64_t& modified);
+};
+
+#endif // CORPUS_CACHE_H // End of include guard
@@ -18,74 +18,101 @@ void cstr_copy(char *dest, const char *src, size_t length) { // Function to copy
     dest[length] = '\0'; // Null-terminate the destination string
 }
 
+// Storage management
+bool DSString::isInline() const { // Check if the characters are stored inline
+    return data == local; // Return true if data points at the inline storage
+}
+
+void DSString::grow(size_t needed) { // Make room for at least the given number of characters
+    if (needed <= cap) return; // Nothing to do if the characters already fit
+    size_t newCap = cap * 2 > needed ? cap * 2 : needed; // Double the capacity so repeated appends are amortized
+    char *newData = new char[newCap + 1]; // Allocate the larger buffer
+    cstr_copy(newData, data, len); // Copy the current characters
+    if (!isInline()) delete[] data; // Delete the old heap buffer
+    data = newData; // Update data to point to newData
+    cap = newCap; // Update the capacity
+}
+
+void DSString::reserve(size_t newCapacity) { // Reserve room for a number of characters
+    grow(newCapacity); // Grow the buffer if needed
+}
+
+size_t DSString::capacity() const { // Get the capacity of the string
+    return cap; // Return cap
+}
+
 // Constructors and Destructor
-DSString::DSString() : data(nullptr), len(0) {} // Default constructor initializing data to nullptr and length to 0
-
-DSString::DSString(const char *str) { // Constructor from C-string
-    if (str) { // If the input string is not null
-        len = cstr_length(str); // Calculate the length of the input string
-        data = new (std::nothrow) char[len + 1]; // Allocate memory for the new string
-        if (data != nullptr) { // If memory allocation is successful
-            cstr_copy(data, str, len); // Copy the input string to data
-        } else { // If memory allocation fails
-            len = 0; // Set length to 0
-        }
-    } else { // If the input string is null
-        data = nullptr; // Set data to nullptr
-        len = 0; // Set length to 0
-    }
+DSString::DSString() : data(local), len(0), cap(kInlineCapacity) { // Default constructor initializing an empty inline string
+    local[0] = '\0'; // Null-terminate the empty string
 }
 
-DSString::DSString(const DSString &other) : len(other.len) { // Copy constructor
-    data = new char[len + 1]; // Allocate memory for the new string
-    cstr_copy(data, other.data, len); // Copy the other string to data
+DSString::DSString(const char *str) : DSString(str, cstr_length(str)) {} // Constructor from C-string
+
+DSString::DSString(const char *str, size_t length) : DSString() { // Constructor from a character range
+    append(str, length); // Copy the characters to data
 }
 
-DSString::DSString(size_t n, char c) : len(n) { // Constructor to create a string with n copies of character c
-    data = new char[len + 1]; // Allocate memory for the new string
-    for (size_t i = 0; i < len; ++i) { // Loop through each character
-        data[i] = c; // Set each character to c
-    }
-    data[len] = '\0'; // Null-terminate the string
+DSString::DSString(const DSString &other) : DSString(other.data, other.len) {} // Copy constructor
+
+DSString::DSString(DSString &&other) noexcept : DSString() { // Move constructor
+    *this = std::move(other); // Reuse the move assignment
+}
+
+DSString::DSString(size_t n, char c) : DSString() { // Constructor to create a string with n copies of character c
+    append(n, c); // Fill the string with c
 }
 
 DSString &DSString::operator=(const DSString &other) { // Assignment operator
     if (this != &other) { // Check for self-assignment
-        delete[] data; // Delete the existing data
+        len = 0; // Drop the current characters but keep the buffer
+        append(other.data, other.len); // Copy the other string to data
+    }
+    return *this; // Return the current object
+}
+
+DSString &DSString::operator=(DSString &&other) noexcept { // Move assignment operator
+    if (this != &other) { // Check for self-assignment
+        if (!isInline()) delete[] data; // Delete the existing heap buffer
+        if (other.isInline()) { // If the other string is stored inline
+            data = local; // Use the inline storage
+            cstr_copy(local, other.local, other.len); // Copy the characters
+            cap = kInlineCapacity; // Set the inline capacity
+        } else { // If the other string owns a heap buffer
+            data = other.data; // Take over the buffer
+            cap = other.cap; // Take over its capacity
+        }
         len = other.len; // Set the new length
-        data = new char[len + 1]; // Allocate memory for the new string
-        cstr_copy(data, other.data, len); // Copy the other string to data
+        other.data = other.local; // Leave the other string empty and inline
+        other.len = 0; // Set its length to 0
+        other.cap = kInlineCapacity; // Set its capacity to the inline capacity
+        other.local[0] = '\0'; // Null-terminate it
     }
     return *this; // Return the current object
 }
 
 DSString::~DSString() { // Destructor
-    delete[] data; // Delete the allocated memory
+    if (!isInline()) delete[] data; // Delete the heap buffer, if any
 }
 
 // New functions for compatibility with std::string
-DSString::DSString(const std::string &str) { // Constructor from std::string
-    len = str.length(); // Get the length of the std::string
-    data = new char[len + 1]; // Allocate memory for the new string
-    cstr_copy(data, str.c_str(), len); // Copy the std::string to data
-}
+DSString::DSString(const std::string &str) : DSString(str.data(), str.length()) {} // Constructor from std::string
 
 DSString &DSString::operator=(const std::string &str) { // Assignment operator from std::string
-    delete[] data; // Delete the existing data
-    len = str.length(); // Get the length of the std::string
-    data = new char[len + 1]; // Allocate memory for the new string
-    cstr_copy(data, str.c_str(), len); // Copy the std::string to data
-    return *this; // Return the current object
+    len = 0; // Drop the current characters but keep the buffer
+    return append(str.data(), str.length()); // Copy the std::string to data
 }
 
 DSString::operator std::string() const { // Conversion operator to std::string
-    return std::string(data); // Return a std::string constructed from data
+    return std::string(data, len); // Return a std::string constructed from data
+}
+
+DSString::operator std::string_view() const { // Conversion operator to std::string_view
+    return std::string_view(data, len); // Return a view of data
 }
 
 void DSString::clear() { // Function to clear the string
-    delete[] data; // Delete the allocated memory
-    data = nullptr; // Set data to nullptr
-    len = 0; // Set length to 0
+    len = 0; // Set length to 0 but keep the buffer for reuse
+    data[0] = '\0'; // Null-terminate the empty string
 }
 
 bool DSString::empty() const { // Function to check if the string is empty
@@ -111,36 +138,31 @@ size_t DSString::find(char c, size_t pos) const { // Function to find a characte
 }
 
 DSString &DSString::append(const DSString &str) { // Append a DSString to the current string
-    char *newData = new char[len + str.len + 1]; // Allocate new memory for the combined string
-    cstr_copy(newData, data, len); // Copy the current string to newData
-    cstr_copy(newData + len, str.data, str.len); // Copy the appended string to newData
-    delete[] data; // Delete the old data
-    data = newData; // Update data to point to newData
-    len += str.len; // Update the length
-    return *this; // Return the current object
+    return append(str.data, str.len); // Append its characters
 }
 
 DSString &DSString::append(const char *s) { // Append a C-string to the current string
-    size_t s_len = cstr_length(s); // Calculate the length of the C-string
-    char *newData = new char[len + s_len + 1]; // Allocate new memory for the combined string
-    cstr_copy(newData, data, len); // Copy the current string to newData
-    cstr_copy(newData + len, s, s_len); // Copy the appended C-string to newData
-    delete[] data; // Delete the old data
-    data = newData; // Update data to point to newData
-    len += s_len; // Update the length
+    return append(s, cstr_length(s)); // Append its characters
+}
+
+DSString &DSString::append(const char *s, size_t n) { // Append a character range to the current string
+    if (n == 0) return *this; // Nothing to append
+    bool aliased = std::less_equal<const char *>()(data, s) && std::less_equal<const char *>()(s, data + len); // Check if s points into this string
+    size_t offset = aliased ? static_cast<size_t>(s - data) : 0; // Offset of s within this string
+    grow(len + n); // Make room, amortized
+    if (aliased) s = data + offset; // Follow the characters if the buffer moved
+    cstr_copy(data + len, s, n); // Copy the appended characters to data
+    len += n; // Update the length
     return *this; // Return the current object
 }
 
 DSString &DSString::append(size_t n, char c) { // Append n copies of character c to the current string
-    char *newData = new char[len + n + 1]; // Allocate new memory for the combined string
-    cstr_copy(newData, data, len); // Copy the current string to newData
+    grow(len + n); // Make room, amortized
     for (size_t i = 0; i < n; ++i) { // Loop through each character to append
-        newData[len + i] = c; // Set each character to c
+        data[len + i] = c; // Set each character to c
     }
-    newData[len + n] = '\0'; // Null-terminate the new string
-    delete[] data; // Delete the old data
-    data = newData; // Update data to point to newData
     len += n; // Update the length
+    data[len] = '\0'; // Null-terminate the new string
     return *this; // Return the current object
 }
 
@@ -149,11 +171,7 @@ DSString &DSString::erase(size_t pos, size_t length) { // Erase a portion of the
     if (length == std::string::npos || pos + length > len) { // Adjust length if it exceeds bounds
         length = len - pos; // Set length to the remaining length from pos
     }
-    char *newData = new char[len - length + 1]; // Allocate new memory for the shortened string
-    cstr_copy(newData, data, pos); // Copy the part before the erased portion
-    cstr_copy(newData + pos, data + pos + length, len - pos - length); // Copy the part after the erased portion
-    delete[] data; // Delete the old data
-    data = newData; // Update data to point to newData
+    std::memmove(data + pos, data + pos + length, len - pos - length + 1); // Shift the rest, including the terminator, left
     len -= length; // Update the length
     return *this; // Return the current object
 }
@@ -171,40 +189,29 @@ DSString &DSString::replace(size_t pos, size_t length, const char *s) { // Repla
 }
 
 DSString &DSString::insert(size_t pos, const DSString &str) { // Insert a DSString at the specified position
+    if (&str == this) { // If the string is inserted into itself
+        DSString copy(str); // Copy it first, since the buffer is about to change
+        return insert(pos, copy); // Insert the copy
+    }
     if (pos > len) pos = len; // Adjust position if it exceeds bounds
-    char *newData = new char[len + str.len + 1]; // Allocate new memory for the combined string
-    cstr_copy(newData, data, pos); // Copy the part before the insertion point
-    cstr_copy(newData + pos, str.data, str.len); // Copy the inserted string
-    cstr_copy(newData + pos + str.len, data + pos, len - pos); // Copy the part after the insertion point
-    delete[] data; // Delete the old data
-    data = newData; // Update data to point to newData
+    grow(len + str.len); // Make room, amortized
+    std::memmove(data + pos + str.len, data + pos, len - pos + 1); // Shift the tail, including the terminator, right
+    std::memcpy(data + pos, str.data, str.len); // Copy the inserted string
     len += str.len; // Update the length
     return *this; // Return the current object
 }
 
 DSString &DSString::insert(size_t pos, const char *s) { // Insert a C-string at the specified position
-    size_t s_len = cstr_length(s); // Calculate the length of the C-string
-    if (pos > len) pos = len; // Adjust position if it exceeds bounds
-    char *newData = new char[len + s_len + 1]; // Allocate new memory for the combined string
-    cstr_copy(newData, data, pos); // Copy the part before the insertion point
-    cstr_copy(newData + pos, s, s_len); // Copy the inserted C-string
-    cstr_copy(newData + pos + s_len, data + pos, len - pos); // Copy the part after the insertion point
-    delete[] data; // Delete the old data
-    data = newData; // Update data to point to newData
-    len += s_len; // Update the length
-    return *this; // Return the current object
+    return insert(pos, DSString(s)); // Copy the C-string, which may point into this string, then insert it
 }
 
 DSString &DSString::insert(size_t pos, size_t n, char c) { // Insert n copies of character c at the specified position
     if (pos > len) pos = len; // Adjust position if it exceeds bounds
-    char *newData = new char[len + n + 1]; // Allocate new memory for the combined string
-    cstr_copy(newData, data, pos); // Copy the part before the insertion point
+    grow(len + n); // Make room, amortized
+    std::memmove(data + pos + n, data + pos, len - pos + 1); // Shift the tail, including the terminator, right
     for (size_t i = 0; i < n; ++i) { // Loop through each character to insert
-        newData[pos + i] = c; // Set each character to c
+        data[pos + i] = c; // Set each character to c
     }
-    cstr_copy(newData + pos + n, data + pos, len - pos); // Copy the part after the insertion point
-    delete[] data; // Delete the old data
-    data = newData; // Update data to point to newData
     len += n; // Update the length
     return *this; // Return the current object
 }
@@ -213,34 +220,18 @@ DSString &DSString::erase(char *first, char *last) { // Erase a range of charact
     if (first < data || last > data + len || first >= last) { // Check if the range is valid
         return *this; // Return if the range is invalid
     }
-    size_t newLen = len - (last - first); // Calculate the new length
-    char *newData = new char[newLen + 1]; // Allocate new memory for the shortened string
-    size_t i = 0; // Initialize index for newData
-    for (char *it = data; it < first; ++it, ++i) { // Copy the part before the erased range
-        newData[i] = *it; // Copy character
-    }
-    for (char *it = last; it < data + len; ++it, ++i) { // Copy the part after the erased range
-        newData[i] = *it; // Copy character
-    }
-    newData[newLen] = '\0'; // Null-terminate the new string
-    delete[] data; // Delete the old data
-    data = newData; // Update data to point to newData
-    len = newLen; // Update the length
-    return *this; // Return the current object
+    return erase(static_cast<size_t>(first - data), static_cast<size_t>(last - first)); // Erase by position
 }
 
 // Additional functions to support Trie.cpp usage
 DSString &DSString::erase(std::function<bool(char)> pred) { // Erase characters based on a predicate
-    char *newData = new char[len + 1]; // Allocate new memory for the modified string
     size_t newLen = 0; // Initialize new length to 0
     for (size_t i = 0; i < len; ++i) { // Loop through each character
         if (!pred(data[i])) { // If the character does not match the predicate
-            newData[newLen++] = data[i]; // Copy the character to newData
+            data[newLen++] = data[i]; // Keep the character, compacting in place
         }
     }
-    newData[newLen] = '\0'; // Null-terminate the new string
-    delete[] data; // Delete the old data
-    data = newData; // Update data to point to newData
+    data[newLen] = '\0'; // Null-terminate the new string
     len = newLen; // Update the length
     return *this; // Return the current object
 }
@@ -273,20 +264,17 @@ char &DSString::operator[](size_t index) { // Return a reference to the characte
 
 DSString DSString::operator+(const DSString &other) const { // Concatenate two DSString objects
     DSString result; // Create a new DSString object
-    result.len = len + other.len; // Set the length of the result
-    result.data = new char[result.len + 1]; // Allocate memory for the result
-    cstr_copy(result.data, data, len); // Copy the current string to result
-    cstr_copy(result.data + len, other.data, other.len); // Copy the other string to result
+    result.reserve(len + other.len); // Allocate memory for the result once
+    result.append(data, len); // Copy the current string to result
+    result.append(other.data, other.len); // Copy the other string to result
     return result; // Return the result
 }
 
 DSString DSString::operator+(char c) const { // Concatenate a character to the DSString
     DSString result; // Create a new DSString object
-    result.len = len + 1; // Set the length of the result
-    result.data = new char[result.len + 1]; // Allocate memory for the result
-    cstr_copy(result.data, data, len); // Copy the current string to result
-    result.data[len] = c; // Set the last character to c
-    result.data[len + 1] = '\0'; // Null-terminate the result
+    result.reserve(len + 1); // Allocate memory for the result once
+    result.append(data, len); // Copy the current string to result
+    result.append(1, c); // Append the character
     return result; // Return the result
 }
 
@@ -337,12 +325,7 @@ DSString &DSString::operator+=(const DSString &s) { // Append a DSString to the
 DSString DSString::substring(size_t start, size_t numChars) const { // Get a substring of the DSString
     DSString result; // Create a new DSString object
     if (start < len) { // If the start position is within bounds
-        result.len = (numChars < len - start) ? numChars : len - start; // Set the length of the result
-        result.data = new char[result.len + 1]; // Allocate memory for the result
-        for (size_t i = 0; i < result.len; ++i) { // Loop through each character
-            result.data[i] = data[start + i]; // Copy the character to result
-        }
-        result.data[result.len] = '\0'; // Null-terminate the result
+        result.append(data + start, (numChars < len - start) ? numChars : len - start); // Copy the characters to result
     }
     return result; // Return the result
 }
@@ -374,13 +357,13 @@ std::istream &operator>>(std::istream &is, DSString &str) { // Input stream oper
 std::istream &getline(std::istream &is, DSString &str, char delim) { // Get a line from the input stream with a delimiter
     std::string temp; // Temporary string to hold the input
     std::getline(is, temp, delim); // Read input into the temporary string
-    str = DSString(temp.c_str()); // Assign the temporary string to the DSString
+    str = temp; // Assign the temporary string to the DSString, reusing its buffer
     return is; // Return the input stream
 }
 
 std::istream &getline(std::istream &is, DSString &str) { // Get a line from the input stream
     std::string temp; // Temporary string to hold the input
     std::getline(is, temp); // Read input into the temporary string
-    str = DSString(temp.c_str()); // Assign the temporary string to the DSString
+    str = temp; // Assign the temporary string to the DSString, reusing its buffer
     return is; // Return the input stream
 }
\ No newline at end of file
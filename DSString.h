@@ -9,6 +9,7 @@
 #include <cstring> // Include cstring for C-style string functions
 #include <stdexcept> // Include stdexcept for standard exceptions
 #include <iterator> // Include iterator for iterator support
+#include <string_view> // Include string_view for non-owning views
 
 /**
  * @class DSString
@@ -18,12 +19,31 @@
  * concatenation, comparison, substring extraction, and more. It supports both C-style 
  * strings and std::string for initialization and assignment.
  * 
- * @note This class manages its own memory and provides deep copy semantics.
+ * @note This class manages its own memory and provides deep copy semantics. Strings of up to
+ * kInlineCapacity characters are stored inline without a heap allocation (most tweet tokens fit),
+ * moves steal the heap buffer of longer strings, and appends grow the capacity geometrically.
  */
 class DSString {
+public:
+    static const size_t kInlineCapacity = 15; ///< Longest string stored without a heap allocation.
+
 private:
-    char *data; ///< Pointer to character data
+    char *data; ///< Pointer to character data (points at local for short strings)
     size_t len; ///< Length of the string
+    size_t cap; ///< Characters that fit in data, excluding the null terminator
+    char local[kInlineCapacity + 1]; ///< Inline storage for short strings
+
+    /**
+     * @brief Check if the characters are stored inline.
+     * @return True if data points at the inline storage.
+     */
+    bool isInline() const;
+
+    /**
+     * @brief Make room for at least the given number of characters, keeping the contents.
+     * @param needed Number of characters required.
+     */
+    void grow(size_t needed);
 
 public:
     /**
@@ -37,12 +57,25 @@ public:
      */
     DSString(const char *str);
 
+    /**
+     * @brief Constructor from a character range.
+     * @param str Pointer to the first character (need not be null-terminated).
+     * @param length Number of characters to copy.
+     */
+    DSString(const char *str, size_t length);
+
     /**
      * @brief Copy constructor.
      * @param other DSString object to copy from.
      */
     DSString(const DSString &other);
 
+    /**
+     * @brief Move constructor. Takes over the other string's buffer and leaves it empty.
+     * @param other DSString object to move from.
+     */
+    DSString(DSString &&other) noexcept;
+
     /**
      * @brief Constructor with size and character.
      * @param size Number of characters.
@@ -57,6 +90,13 @@ public:
      */
     DSString &operator=(const DSString &other);
 
+    /**
+     * @brief Move assignment operator. Takes over the other string's buffer and leaves it empty.
+     * @param other DSString object to move from.
+     * @return Reference to the assigned DSString object.
+     */
+    DSString &operator=(DSString &&other) noexcept;
+
     /**
      * @brief Destructor. Releases allocated memory.
      */
@@ -68,6 +108,18 @@ public:
      */
     size_t length() const;
 
+    /**
+     * @brief Get the number of characters the string can hold without reallocating.
+     * @return Capacity of the string, excluding the null terminator.
+     */
+    size_t capacity() const;
+
+    /**
+     * @brief Reserve room for a number of characters.
+     * @param newCapacity Number of characters to make room for.
+     */
+    void reserve(size_t newCapacity);
+
     /**
      * @brief Subscript operator.
      * @param index Position of the character.
@@ -163,6 +215,12 @@ public:
      */
     operator std::string() const;
 
+    /**
+     * @brief Conversion to std::string_view.
+     * @return A view of the characters of the DSString object.
+     */
+    operator std::string_view() const;
+
     /**
      * @brief Clear the string.
      */
@@ -212,6 +270,14 @@ public:
      */
     DSString &append(const char *s);
 
+    /**
+     * @brief Append a character range.
+     * @param s Pointer to the first character (need not be null-terminated).
+     * @param n Number of characters to append.
+     * @return Reference to the modified DSString object.
+     */
+    DSString &append(const char *s, size_t n);
+
     /**
      * @brief Append character multiple times.
      * @param n Number of times to append the character.
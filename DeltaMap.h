@@ -0,0 +1,133 @@
+#ifndef DELTA_MAP_H // Include guard to prevent multiple inclusions
+#define DELTA_MAP_H // Define the include guard
+
+#include <array> // Include array for the shards
+#include <cstddef> // Include cstddef for size_t
+#include <deque> // Include deque for the spellings
+#include <functional> // Include functional for std::hash
+#include <memory> // Include memory for std::shared_ptr
+#include <string> // Include string for the spellings
+#include <string_view> // Include string_view for words
+#include <unordered_map> // Include unordered_map for the shard words
+#include <utility> // Include utility for std::pair
+
+/**
+ * @struct DeltaMap
+ * @brief Values added by incremental training, keyed by word, that readers use without locking.
+ *
+ * A published map is never modified. The words are spread over shards by hash, and an update
+ * copies only the shards it touches (see DeltaBuilder); the other shards are shared with the
+ * previous map, which is freed when the last reader holding it lets go. The words are keyed by
+ * views of spellings that every copy shares, so a lookup never builds a string.
+ *
+ * @tparam Value What is stored per word.
+ */
+template <typename Value>
+struct DeltaMap {
+    static const size_t kShards = 256; ///< Number of shards the words are spread over.
+    using Shard = std::unordered_map<std::string_view, Value>; ///< Values of a shard's words, keyed by a view of their spelling.
+
+    std::shared_ptr<std::deque<std::string>> spellings; ///< The added words' characters; only ever appended to, by the single writer.
+    std::array<std::shared_ptr<const Shard>, kShards> shards; ///< The words of each shard; nullptr if no word hashes to it.
+
+    /**
+     * @brief Looks a word up.
+     * @param word The word.
+     * @return The value added for the word, or nullptr if the map does not hold it.
+     */
+    const Value* find(std::string_view word) const {
+        const Shard* shard = shards[shardOf(word)].get(); // Get the word's shard
+        if (shard == nullptr) return nullptr; // No word of the shard was added
+        auto it = shard->find(word); // Look the word up in its shard
+        return it != shard->end() ? &it->second : nullptr; // Return its value if the shard holds it
+    }
+
+    /**
+     * @brief Calls a function for every added word.
+     * @param visit Called with the word and its value; the order is unspecified.
+     */
+    template <typename Visit>
+    void forEach(Visit visit) const {
+        for (const std::shared_ptr<const Shard>& shard : shards) { // Loop through each shard
+            if (shard == nullptr) continue; // Skip shards without words
+            for (const auto& pair : *shard) visit(pair.first, pair.second); // Visit each of its words
+        }
+    }
+
+    /**
+     * @brief Picks the shard a word belongs to.
+     * @param word The word.
+     * @return The index of its shard.
+     */
+    static size_t shardOf(std::string_view word) {
+        return std::hash<std::string_view>()(word) % kShards; // Spread the words by hash
+    }
+};
+
+/**
+ * @class DeltaBuilder
+ * @brief Builds the next version of a published delta, copying each shard the first time it is touched.
+ *
+ * @tparam Delta A DeltaMap, or a struct derived from one; its other members are copied as they are.
+ */
+template <typename Delta>
+class DeltaBuilder {
+public:
+    using Shard = typename Delta::Shard; ///< The shard type of the delta.
+
+    /**
+     * @brief Starts from the published delta.
+     * @param current The published delta, or nullptr if there is none yet.
+     */
+    explicit DeltaBuilder(const std::shared_ptr<const Delta>& current)
+        : next(current != nullptr ? std::make_shared<Delta>(*current) : std::make_shared<Delta>()), copied() { // Share every shard for now
+        if (next->spellings == nullptr) next->spellings = std::make_shared<std::deque<std::string>>(); // Start the spellings with the first delta
+    }
+
+    /**
+     * @brief Gets the entry of a word in the new delta, adding it if needed.
+     * @param word The word.
+     * @param created Set to whether the word was added by this call; may be nullptr.
+     * @return The word's entry; its key views the stored spelling, which outlives the builder.
+     */
+    typename Shard::value_type& entry(std::string_view word, bool* created = nullptr) {
+        size_t index = Delta::shardOf(word); // Find the word's shard
+        Shard*& shard = copied[index]; // Get the copy made by this update, if any
+        if (shard == nullptr) { // If the shard is still shared with readers
+            const Shard* current = next->shards[index].get(); // Get the published shard
+            auto copy = current != nullptr ? std::make_shared<Shard>(*current) : std::make_shared<Shard>(); // Copy it; readers keep the original
+            shard = copy.get(); // Remember the copy for the rest of the update
+            next->shards[index] = std::move(copy); // Put the copy in the new delta
+        }
+        auto it = shard->find(word); // Look the word up
+        bool isNew = (it == shard->end()); // Check if the delta holds it yet
+        if (isNew) { // If it does not
+            next->spellings->emplace_back(word); // Store the spelling; older deltas never read past their own words, and the deque never moves them
+            it = shard->emplace(std::string_view(next->spellings->back()), typename Shard::mapped_type()).first; // Key the new value by a view of the stored spelling
+        }
+        if (created != nullptr) *created = isNew; // Report whether it was added
+        return *it; // Return the entry
+    }
+
+    /**
+     * @brief Gets the new delta, for the members outside the shards.
+     * @return The delta being built.
+     */
+    Delta& delta() {
+        return *next; // Not published yet, so it may be modified
+    }
+
+    /**
+     * @brief Hands the new delta over for publishing.
+     * @return The delta; nothing may modify it from now on.
+     */
+    std::shared_ptr<const Delta> finish() {
+        return std::move(next); // Give up the builder's reference
+    }
+
+private:
+    std::shared_ptr<Delta> next; ///< The delta being built.
+    std::array<Shard*, Delta::kShards> copied; ///< The shards this update copied, nullptr while still shared.
+};
+
+#endif // DELTA_MAP_H
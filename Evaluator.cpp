@@ -0,0 +1,201 @@
+#include "Evaluator.h" // Include the Evaluator header file
+#include <algorithm> // Include algorithm for std::fill
+#include <charconv> // Include charconv for parsing labels
+#include <iomanip> // Include iomanip for formatting the summary
+#include <functional> // Include functional for hashing ids
+#include <sstream> // Include sstream for formatting the summary
+#include <stdexcept> // Include stdexcept for std::logic_error and std::runtime_error
+
+EvaluationReport::EvaluationReport() : EvaluationReport(std::vector<int>()) {} // Report over the labels 0, 2 and 4
+
+EvaluationReport::EvaluationReport(const std::vector<int>& evaluated) // Report over the given labels
+    : labels(evaluated.empty() ? std::vector<int>{0, 2, 4} : evaluated) {
+    if (labels.size() > kMaxLabels) { // Check the number of labels
+        throw std::logic_error("At most ten labels can be evaluated"); // Throw an error if there are too many
+    }
+    std::fill(positions, positions + kMaxLabels, labels.size()); // No digit is evaluated yet
+    for (size_t i = 0; i < labels.size(); ++i) { // Loop through each label
+        if (labels[i] < 0 || labels[i] >= static_cast<int>(kMaxLabels) || positions[labels[i]] != labels.size()) { // Check that it is a digit listed once
+            throw std::logic_error("Evaluated labels must be distinct digits"); // Throw an error if it is not
+        }
+        positions[labels[i]] = i; // Give it its matrix position
+    }
+    confusion.assign(labels.size() * labels.size(), 0); // Zero the matrix
+}
+
+uint64_t EvaluationReport::total() const { // Get the number of joined records
+    uint64_t sum = 0; // Initialize the sum
+    for (uint64_t cell : confusion) sum += cell; // Add each cell
+    return sum; // Return the sum
+}
+
+uint64_t EvaluationReport::correct() const { // Get the number of correct predictions
+    uint64_t sum = 0; // Initialize the sum
+    for (size_t i = 0; i < labels.size(); ++i) sum += count(i, i); // Add the diagonal
+    return sum; // Return the sum
+}
+
+double EvaluationReport::accuracy() const { // Get the fraction of correct predictions
+    uint64_t joined = total(); // Get the number of joined records
+    return joined == 0 ? 0.0 : static_cast<double>(correct()) / joined; // Avoid dividing by zero
+}
+
+double EvaluationReport::precision(int label) const { // Get the precision of a label
+    size_t index = indexOf(label); // Get its column
+    if (index == labels.size()) return 0.0; // Unknown labels are never predicted
+    uint64_t predicted = 0; // Number of records predicted as the label
+    for (size_t actual = 0; actual < labels.size(); ++actual) predicted += count(actual, index); // Sum the column
+    return predicted == 0 ? 0.0 : static_cast<double>(count(index, index)) / predicted; // Avoid dividing by zero
+}
+
+double EvaluationReport::recall(int label) const { // Get the recall of a label
+    size_t index = indexOf(label); // Get its row
+    if (index == labels.size()) return 0.0; // Unknown labels never occur
+    uint64_t actual = 0; // Number of records with the label
+    for (size_t predicted = 0; predicted < labels.size(); ++predicted) actual += count(index, predicted); // Sum the row
+    return actual == 0 ? 0.0 : static_cast<double>(count(index, index)) / actual; // Avoid dividing by zero
+}
+
+double EvaluationReport::f1(int label) const { // Get the F1 score of a label
+    double p = precision(label); // Get the precision
+    double r = recall(label); // Get the recall
+    return p + r == 0 ? 0.0 : 2 * p * r / (p + r); // Take the harmonic mean
+}
+
+std::string EvaluationReport::summary() const { // Format the report for people to read
+    std::ostringstream out; // Declare the output
+    out << "Confusion matrix (rows actual, columns predicted):\n"; // Write the matrix title
+    out << "      "; // Indent the column labels
+    for (size_t p = 0; p < labels.size(); ++p) out << std::setw(10) << labelAt(p); // Write the predicted labels
+    out << "\n"; // End the line
+    for (size_t a = 0; a < labels.size(); ++a) { // Loop through each actual label
+        out << std::setw(6) << labelAt(a); // Write the actual label
+        for (size_t p = 0; p < labels.size(); ++p) out << std::setw(10) << count(a, p); // Write the counts
+        out << "\n"; // End the line
+    }
+    double macroF1 = 0; // Sum of the F1 scores of the labels that occur
+    size_t occurring = 0; // Number of labels that occur in the answers
+    out << std::fixed << std::setprecision(5); // Format the scores
+    for (size_t i = 0; i < labels.size(); ++i) { // Loop through each label
+        int label = labelAt(i); // Get the label
+        uint64_t actual = 0, predicted = 0; // Records with the label and predictions of it
+        for (size_t j = 0; j < labels.size(); ++j) { actual += count(i, j); predicted += count(j, i); } // Sum the row and the column
+        if (actual == 0 && predicted == 0) continue; // Skip labels that never appear
+        out << "Label " << label << ": precision " << precision(label) << ", recall " << recall(label) << ", F1 " << f1(label) << "\n"; // Write the scores
+        if (actual != 0) { macroF1 += f1(label); ++occurring; } // Average over the labels that occur
+    }
+    if (occurring != 0) out << "Macro F1: " << macroF1 / occurring << "\n"; // Write the macro average
+    if (hashJoined) out << "The files were not in the same order; the rest was joined by id.\n"; // Report the fallback
+    if (unmatchedPredictions != 0) out << "Predictions without an answer: " << unmatchedPredictions << "\n"; // Report the unmatched predictions
+    if (unmatchedAnswers != 0) out << "Answers without a prediction: " << unmatchedAnswers << "\n"; // Report the unmatched answers
+    if (malformed != 0) out << "Malformed records skipped: " << malformed << "\n"; // Report the malformed records
+    return out.str(); // Return the text
+}
+
+Evaluator::Evaluator(const DSString& answersFile, std::ostream* mistakes, const std::vector<int>& labels) // Open the answers file
+    : answers(answersFile), reader(answers.data(), answers.data() + answers.size()), mistakes(mistakes), report(labels) {
+    reader.skip(); // Skip the header line
+}
+
+int Evaluator::parseLabel(std::string_view field) { // Parse a label field
+    while (!field.empty() && field.front() == ' ') field.remove_prefix(1); // Skip leading spaces
+    while (!field.empty() && field.back() == ' ') field.remove_suffix(1); // Skip trailing spaces
+    int label = -1; // Declare the label
+    auto parsed = std::from_chars(field.data(), field.data() + field.size(), label); // Parse the digits
+    if (parsed.ec != std::errc() || parsed.ptr != field.data() + field.size()) return -1; // Reject anything else
+    return label; // Return the label
+}
+
+bool Evaluator::nextAnswer(std::string_view& id, int& label) { // Read the next well-formed answer
+    while (reader.next(fields, 2)) { // Read each record
+        label = fields.size() == 2 ? parseLabel(fields[0]) : -1; // Parse its label
+        if (label < 0 || report.indexOf(label) == report.labels.size() || fields[1].empty()) { // Check the record
+            report.malformed++; // Count the malformed record
+            continue; // Skip it
+        }
+        id = fields[1]; // Return the id
+        return true; // Report success
+    }
+    return false; // The answers are exhausted
+}
+
+void Evaluator::tally(std::string_view id, int predicted, int actual) { // Count a joined record
+    size_t row = report.indexOf(actual), column = report.indexOf(predicted); // Get the matrix cell
+    if (row == report.labels.size() || column == report.labels.size()) return; // Both labels were checked already
+    report.confusion[row * report.labels.size() + column]++; // Add it to the matrix
+    if (predicted != actual && mistakes != nullptr) { // If the prediction was wrong
+        *mistakes << predicted << ',' << actual << ',' << id << '\n'; // Write the mistake
+    }
+}
+
+void Evaluator::buildIndex(std::string_view id, int label) { // Index the answers the merge join did not consume
+    std::hash<std::string_view> hasher; // Declare the id hash
+    pending.push_back(PendingAnswer{id, hasher(id), label, false}); // Keep the answer that broke the merge join
+    while (nextAnswer(id, label)) pending.push_back(PendingAnswer{id, hasher(id), label, false}); // Keep the rest
+    if (pending.size() >= UINT32_MAX / 2) throw std::runtime_error("Too many answers to join by id"); // Positions must fit the table
+    size_t slots = 1; // Table size, a power of two
+    while (slots < pending.size() * 2) slots *= 2; // Keep the load factor at most one half
+    index.assign(slots, 0); // Clear the table
+    for (size_t i = 0; i < pending.size(); ++i) { // Loop through each answer
+        size_t slot = pending[i].hash & (slots - 1); // Get its home slot
+        while (index[slot] != 0) slot = (slot + 1) & (slots - 1); // Probe linearly for a free slot
+        index[slot] = static_cast<uint32_t>(i + 1); // Store its position
+    }
+}
+
+void Evaluator::add(std::string_view id, int predicted) { // Join one prediction with its answer
+    if (report.indexOf(predicted) == report.labels.size() || id.empty()) { // Check the prediction
+        report.malformed++; // Count the malformed prediction
+        return; // Skip it
+    }
+    if (!report.hashJoined) { // While the files are aligned
+        std::string_view answerId; // Declare the id of the next answer
+        int actual; // Declare its label
+        if (!nextAnswer(answerId, actual)) { // If every answer was consumed
+            report.unmatchedPredictions++; // There is nothing to join with
+            return; // Done
+        }
+        if (answerId == id) { // If the files are still aligned
+            tally(id, predicted, actual); // Count the record
+            return; // Done
+        }
+        report.hashJoined = true; // Fall back to joining by id
+        buildIndex(answerId, actual); // Index the rest of the answers
+    }
+    size_t hash = std::hash<std::string_view>()(id); // Hash the prediction's id
+    size_t mask = index.size() - 1; // Mask for wrapping around the table
+    for (size_t slot = hash & mask; index[slot] != 0; slot = (slot + 1) & mask) { // Probe until an empty slot
+        PendingAnswer& answer = pending[index[slot] - 1]; // Get the answer in the slot
+        if (answer.joined || answer.hash != hash || answer.id != id) continue; // Skip other ids and joined repeats
+        answer.joined = true; // Each answer is joined once
+        tally(id, predicted, answer.label); // Count the record
+        return; // Done
+    }
+    report.unmatchedPredictions++; // There is no answer for it
+}
+
+EvaluationReport Evaluator::finish() { // Count the answers never predicted and return the report
+    std::string_view id; // Declare the id of an answer
+    int label; // Declare its label
+    while (nextAnswer(id, label)) report.unmatchedAnswers++; // Count the answers after the last prediction
+    for (const PendingAnswer& answer : pending) report.unmatchedAnswers += answer.joined ? 0 : 1; // Count the indexed answers never joined
+    pending.clear(); // Release the answers
+    index.clear(); // Release the table
+    return report; // Return the report
+}
+
+EvaluationReport Evaluator::evaluateFile(const DSString& predictionsFile, const DSString& answersFile, std::ostream* mistakes, const std::vector<int>& labels) { // Evaluate a predictions file
+    MappedFile predictions(predictionsFile); // Map the predictions
+    Evaluator evaluator(answersFile, mistakes, labels); // Open the answers
+    CSVReader reader(predictions.data(), predictions.data() + predictions.size()); // Declare a reader over the predictions
+    std::vector<std::string_view> fields; // Declare the field list, reused for every record
+    reader.skip(); // Skip the header line
+    while (reader.next(fields, 2)) { // Read each prediction
+        if (fields.size() != 2) { // Check the record
+            evaluator.report.malformed++; // Count the malformed record
+            continue; // Skip it
+        }
+        evaluator.add(fields[1], parseLabel(fields[0])); // Join it with its answer
+    }
+    return evaluator.finish(); // Count the rest of the answers
+}
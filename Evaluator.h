@@ -0,0 +1,211 @@
+#ifndef EVALUATOR_H // Include guard to prevent multiple inclusions
+#define EVALUATOR_H // Define the include guard
+
+#include "DSString.h" // Include DSString for file names
+#include "CSVReader.h" // Include the memory-mapped CSV reader for the answers
+#include <cstddef> // Include cstddef for size_t
+#include <cstdint> // Include cstdint for the counts
+#include <ostream> // Include ostream for the mistakes stream
+#include <string> // Include string for the summary
+#include <string_view> // Include string_view for ids
+#include <vector> // Include vector for the field list
+
+/**
+ * @brief Counts of an evaluation: a confusion matrix over the evaluated labels, and the records that could not be joined.
+ *
+ * The labels are 0, 2 and 4 unless others are given, such as the labels a LabelModel classifies into.
+ */
+struct EvaluationReport {
+    static const size_t kMaxLabels = 10; ///< Most labels evaluated; labels are single digits.
+
+    std::vector<int> labels; ///< The evaluated labels, in matrix order.
+    std::vector<uint64_t> confusion; ///< Joined records, one row per actual label of one count per predicted label, rows back to back.
+    uint64_t unmatchedPredictions = 0; ///< Predictions whose id is not in the answers.
+    uint64_t unmatchedAnswers = 0; ///< Answers whose id was never predicted.
+    uint64_t malformed = 0; ///< Records of either file without an id or with a label that is not evaluated.
+    bool hashJoined = false; ///< True if the files were not in the same order, so the rest was joined by id.
+
+    /**
+     * @brief Constructs an empty report over the labels 0, 2 and 4.
+     */
+    EvaluationReport();
+
+    /**
+     * @brief Constructs an empty report over the given labels.
+     * @param labels The labels in matrix order; empty selects 0, 2 and 4.
+     * @throws std::logic_error If a label is not a digit or is listed twice.
+     */
+    explicit EvaluationReport(const std::vector<int>& labels);
+
+    /**
+     * @brief Gets the index of a label in the confusion matrix.
+     * @param label The sentiment label.
+     * @return Its position in labels, or labels.size() for any other label.
+     */
+    size_t indexOf(int label) const {
+        return label >= 0 && label < static_cast<int>(kMaxLabels) ? positions[label] : labels.size(); // Look digits up; nothing else is evaluated
+    }
+
+    /**
+     * @brief Gets the label at an index of the confusion matrix.
+     * @param index The index.
+     * @return The sentiment label.
+     */
+    int labelAt(size_t index) const { return labels[index]; }
+
+    /**
+     * @brief Gets a cell of the confusion matrix.
+     * @param actual The index of the actual label.
+     * @param predicted The index of the predicted label.
+     * @return The number of joined records with those labels.
+     */
+    uint64_t count(size_t actual, size_t predicted) const { return confusion[actual * labels.size() + predicted]; }
+
+    /**
+     * @brief Gets the number of joined records.
+     * @return The sum of the confusion matrix.
+     */
+    uint64_t total() const;
+
+    /**
+     * @brief Gets the number of joined records predicted correctly.
+     * @return The trace of the confusion matrix.
+     */
+    uint64_t correct() const;
+
+    /**
+     * @brief Gets the fraction of joined records predicted correctly.
+     * @return The accuracy, or 0 if nothing was joined.
+     */
+    double accuracy() const;
+
+    /**
+     * @brief Gets the precision of a label: the fraction of its predictions that were right.
+     * @param label The sentiment label.
+     * @return The precision, or 0 if the label was never predicted.
+     */
+    double precision(int label) const;
+
+    /**
+     * @brief Gets the recall of a label: the fraction of its records that were predicted as it.
+     * @param label The sentiment label.
+     * @return The recall, or 0 if no record has the label.
+     */
+    double recall(int label) const;
+
+    /**
+     * @brief Gets the F1 score of a label, the harmonic mean of its precision and recall.
+     * @param label The sentiment label.
+     * @return The F1 score, or 0 if both are 0.
+     */
+    double f1(int label) const;
+
+    /**
+     * @brief Formats the confusion matrix, the per-label scores and the join counts for people to read.
+     * @return The text, one or more lines each ending in a newline.
+     */
+    std::string summary() const;
+
+private:
+    size_t positions[kMaxLabels]; ///< Index of each digit in labels, or labels.size() if it is not evaluated.
+};
+
+/**
+ * @class Evaluator
+ * @brief Compares predictions with an answers file ("Sentiment,id") in a single streaming pass.
+ *
+ * Predictions are added in any order. While they arrive in the order of the answers file, each one is
+ * compared with the next answer (a merge join) and nothing is kept. At the first id that differs, the
+ * remaining answers are indexed by id and every later prediction is looked up (a hash join), so
+ * unaligned files cost one flat open-addressing table of the answers not yet matched instead of an
+ * abort. A repeated id is joined once per occurrence. The answers file is memory-mapped and the ids
+ * are views into it.
+ *
+ * Mistakes are written to the stream as they are found, one "predicted,actual,id" line each.
+ */
+class Evaluator {
+public:
+    /**
+     * @brief Opens the answers file.
+     * @param answersFile The file holding the correct label of every id, after a header line.
+     * @param mistakes The stream receiving the mistakes, or null to discard them.
+     * @param labels The labels to evaluate; empty selects 0, 2 and 4. Records with other labels are malformed.
+     * @throws std::runtime_error If the answers file cannot be opened.
+     * @throws std::logic_error If a label is not a digit or is listed twice.
+     */
+    Evaluator(const DSString& answersFile, std::ostream* mistakes, const std::vector<int>& labels = std::vector<int>());
+
+    Evaluator(const Evaluator&) = delete; ///< Not copyable; the ids are views into the mapping.
+    Evaluator& operator=(const Evaluator&) = delete; ///< Not copyable; the ids are views into the mapping.
+
+    /**
+     * @brief Joins one prediction with its answer.
+     * @param id The id of the tweet.
+     * @param predicted The predicted label.
+     */
+    void add(std::string_view id, int predicted);
+
+    /**
+     * @brief Counts the answers that were never predicted and returns the report. Call once, after the last add().
+     * @return The report.
+     */
+    EvaluationReport finish();
+
+    /**
+     * @brief Evaluates a predictions file ("Sentiment,id", after a header line) against an answers file.
+     * @param predictionsFile The predictions.
+     * @param answersFile The correct labels.
+     * @param mistakes The stream receiving the mistakes, or null to discard them.
+     * @param labels The labels to evaluate; empty selects 0, 2 and 4.
+     * @return The report.
+     * @throws std::runtime_error If either file cannot be opened.
+     */
+    static EvaluationReport evaluateFile(const DSString& predictionsFile, const DSString& answersFile, std::ostream* mistakes, const std::vector<int>& labels = std::vector<int>());
+
+    /**
+     * @brief Parses a label field.
+     * @param field The field.
+     * @return The label, or -1 if the field is not a number.
+     */
+    static int parseLabel(std::string_view field);
+
+private:
+    MappedFile answers; ///< The mapped answers file.
+    CSVReader reader; ///< Reader over the answers not consumed yet.
+    std::vector<std::string_view> fields; ///< Field list reused for every answer.
+    struct PendingAnswer { // An answer indexed for the hash join
+        std::string_view id; // Its id, a view into the mapping
+        size_t hash; // Hash of the id
+        int label; // Its label
+        bool joined; // Set once a prediction was joined with it
+    };
+    std::vector<PendingAnswer> pending; ///< Answers not consumed by the merge join, once it fell back to hashing.
+    std::vector<uint32_t> index; ///< Open-addressing table of positions in pending plus one (0 marks an empty slot); its size is a power of two.
+    std::ostream* mistakes; ///< Stream receiving the mistakes, or null.
+    EvaluationReport report; ///< Counts so far.
+
+    /**
+     * @brief Reads the next well-formed answer.
+     * @param id Receives its id.
+     * @param label Receives its label.
+     * @return True if an answer was read, false at the end of the file.
+     */
+    bool nextAnswer(std::string_view& id, int& label);
+
+    /**
+     * @brief Indexes every answer not read yet, after the one that broke the merge join.
+     * @param id The id of the answer already read.
+     * @param label Its label.
+     */
+    void buildIndex(std::string_view id, int label);
+
+    /**
+     * @brief Counts a joined record and writes it to the mistakes stream if the prediction was wrong.
+     * @param id The id of the tweet.
+     * @param predicted The predicted label.
+     * @param actual The correct label.
+     */
+    void tally(std::string_view id, int predicted, int actual);
+};
+
+#endif // EVALUATOR_H // End of include guard
@@ -0,0 +1,333 @@
+#include "HashVocabulary.h" // Include the HashVocabulary header file
+#include "CSVReader.h" // Include CSVReader for memory-mapped CSV parsing
+#include "CompactTrie.h" // Include CompactTrie for reading binary model files
+#include "ThreadPool.h" // Include ThreadPool for parallel training
+#include "Metrics.h" // Include Metrics for the lookup and training counters
+#include <algorithm> // Include algorithm for sorting the words
+#include <chrono> // Include the chrono library for timing
+#include <fstream> // Include fstream for saving
+#include <iostream> // Include iostream for the timing output
+#include <memory> // Include memory for the partial tables
+#include <stdexcept> // Include stdexcept for std::runtime_error
+#include <string> // Include string for the encoded records
+#include <thread> // Include thread for the hardware concurrency
+
+HashVocabulary::HashVocabulary() : smoothingAlpha(1.0), finalized(false) {} // Constructor for HashVocabulary, with an empty table
+
+const char* HashVocabulary::name() const { // Get the name of the backend
+    return "hash table"; // Name the backend
+}
+
+uint32_t HashVocabulary::idOf(std::string_view word) { // Get the id of a word, adding it if it is missing
+    uint32_t id = words.intern(word); // Intern the word
+    if (id == counts.size()) { // If the word is new
+        counts.emplace_back(); // Give it zero counts
+        scores.emplace_back(); // And zero scores
+        finalized = false; // The new word has no cached scores
+    }
+    return id; // Return the id
+}
+
+void HashVocabulary::insert(std::string_view word, bool isPositive) { // Insert a word into the table
+    WordCounts& wordCounts = counts[idOf(word)]; // Find or add the word's counts
+    wordCounts.totalTweets++; // Increment the totalTweets count
+    if (isPositive) wordCounts.positiveSentiments++; // Increment the positiveSentiments count
+    finalized = false; // The counts changed
+}
+
+void HashVocabulary::addCounts(std::string_view word, const WordCounts& added) { // Add counts to a word
+    WordCounts& wordCounts = counts[idOf(word)]; // Find or add the word's counts
+    wordCounts.totalTweets += added.totalTweets; // Add the totalTweets count
+    wordCounts.positiveSentiments += added.positiveSentiments; // Add the positiveSentiments count
+    finalized = false; // The counts changed
+}
+
+size_t HashVocabulary::prune(const PruneOptions& options) { // Drop the words below the thresholds
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing
+    TokenInterner kept; // Declare the interner of the remaining words
+    std::vector<WordCounts> keptCounts; // Declare their counts, indexed by their new ids
+    size_t dropped = 0; // Declare the number of words dropped
+    for (uint32_t id = 0; id < counts.size(); ++id) { // Loop through each word in id order
+        if (counts[id].totalTweets == 0) continue; // Skip words that were interned but never counted
+        if (!keeps(counts[id], options, smoothingAlpha)) { // If the word is below the thresholds
+            ++dropped; // Count it
+            continue; // Drop it
+        }
+        kept.intern(words.token(id)); // Give the word its new id, in the same order
+        keptCounts.push_back(counts[id]); // Keep its counts
+    }
+    words = std::move(kept); // Use the smaller interner
+    counts.swap(keptCounts); // Use the remaining counts
+    scores.assign(counts.size(), CachedScores()); // Size the score cache to match
+    bool cached = finalized; // Remember if the scores were cached
+    finalized = false; // The cached scores belong to the old ids
+    if (cached) finalize(); // Cache the scores again
+    auto end = std::chrono::high_resolution_clock::now(); // End timing
+    std::chrono::duration<double> duration = end - start; // Calculate the duration
+    std::cout << "Pruning completed in " << duration.count() << " seconds." << std::endl; // Output the duration
+    return dropped; // Return the number of words dropped
+}
+
+void HashVocabulary::internTokens(const TokenBuffer& tokens, std::vector<uint32_t>& ids) { // Intern the tokens of a tweet
+    ids.resize(tokens.size()); // One id per token
+    for (size_t i = 0; i < tokens.size(); ++i) ids[i] = idOf(tokens[i]); // Intern the token, growing the arrays for new ones
+}
+
+void HashVocabulary::findIds(const TokenBuffer& tokens, std::vector<uint32_t>& ids) const { // Look the ids of a tweet's tokens up
+    words.find(tokens, ids); // Look every token up
+}
+
+void HashVocabulary::insertIds(const std::vector<uint32_t>& ids, bool isPositive) { // Count a tweet given as an id stream
+    for (uint32_t id : ids) { // Loop through each id
+        counts[id].totalTweets++; // Increment the totalTweets count
+        if (isPositive) counts[id].positiveSentiments++; // Increment the positiveSentiments count
+    }
+    finalized = false; // The counts changed
+}
+
+void HashVocabulary::trainRange(char* begin, char* end) { // Train the table with the records of a byte range
+    CSVReader reader(begin, end); // Declare a reader over the range
+    std::vector<std::string_view> fields; // Declare the field list, reused for every record
+    TokenBuffer tokens; // Declare the token buffer, reused for every record
+    std::vector<uint32_t> ids; // Declare the id stream, reused for every record
+    while (reader.next(fields, 6)) { // Read each record; the tweet takes the rest of the record
+        if (fields.size() < 6) continue; // Skip records with missing fields
+        Tokenizer::tokenize(fields[5], tokens); // Tokenize the tweet into words
+        internTokens(tokens, ids); // Turn the words into ids
+        insertIds(ids, fields[0] == "4"); // Count the ids; "4" is positive
+        Metrics::add(Counter::RecordsTrained); // Count the record
+        Metrics::add(Counter::TokensTrained, tokens.size()); // Count its tokens
+    }
+}
+
+void HashVocabulary::train(const DSString& file, unsigned numThreads) { // Train the table with data from a file
+    finalized = false; // The counts are about to change
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing
+
+    if (numThreads == 0) { // If the caller asked for the hardware concurrency
+        numThreads = std::max(1u, std::thread::hardware_concurrency()); // Use every core, but at least one thread
+    }
+
+    MappedFile mapped(file); // Map the training file into memory
+    CSVReader header(mapped.data(), mapped.data() + mapped.size()); // Declare a reader for the header line
+    header.skip(); // Skip the header line
+    char* first = const_cast<char*>(header.position()); // Get the start of the first record
+    std::vector<char*> bounds = splitRanges(first, mapped.data() + mapped.size(), numThreads, 6); // Split the records into byte ranges, read with six fields
+    size_t numRanges = bounds.size() - 1; // Get the number of ranges actually produced
+
+    if (numRanges == 1) { // If there is only one range
+        trainRange(bounds[0], bounds[1]); // Train in place, exactly as a serial pass would
+    } else { // If the file was split across several threads
+        std::vector<std::unique_ptr<HashVocabulary>> partials; // Declare one partial table per range
+        for (size_t i = 0; i < numRanges; ++i) { // Loop through each range
+            partials.emplace_back(new HashVocabulary()); // Create the partial table for the range
+        }
+        ThreadPool pool(numThreads); // Declare the pool running the counting tasks
+        TaskGroup counting(pool); // Declare the group of counting tasks
+        counting.runEach(numRanges, [&](size_t i) { // Count each range on the pool
+            partials[i]->trainRange(bounds[i], bounds[i + 1]); // Count the range into its partial table
+        });
+        counting.wait(); // Wait for every range; rethrows the first failure
+        auto counted = std::chrono::high_resolution_clock::now(); // Time the counting phase
+        std::chrono::duration<double> countDuration = counted - start; // Calculate the counting duration
+        std::cout << "Training counted " << numRanges << " ranges in " << countDuration.count() << " seconds." << std::endl; // Output the counting duration
+
+        for (const std::unique_ptr<HashVocabulary>& partial : partials) { // Loop through the partial tables in range order
+            for (uint32_t id = 0; id < partial->words.size(); ++id) { // Loop through their words in id order
+                WordCounts& wordCounts = counts[idOf(partial->words.token(id))]; // Find or add the word
+                wordCounts.totalTweets += partial->counts[id].totalTweets; // Add the totalTweets count
+                wordCounts.positiveSentiments += partial->counts[id].positiveSentiments; // Add the positiveSentiments count
+            }
+        }
+        auto merged = std::chrono::high_resolution_clock::now(); // Time the merge phase
+        std::chrono::duration<double> mergeDuration = merged - counted; // Calculate the merge duration
+        std::cout << "Training merged " << numRanges << " partial tables in " << mergeDuration.count() << " seconds." << std::endl; // Output the merge duration
+    }
+
+    auto end = std::chrono::high_resolution_clock::now(); // End timing
+    std::chrono::duration<double> duration = end - start; // Calculate the duration
+    std::cout << "Training completed in " << duration.count() << " seconds." << std::endl; // Output the duration
+}
+
+void HashVocabulary::save(const DSString& filename, unsigned /*numThreads*/) const { // Save the table to a file; the sort runs on this thread
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing
+
+    std::vector<uint32_t> ids; // Declare the ids of the words to save
+    ids.reserve(counts.size()); // Reserve room for every word
+    for (uint32_t id = 0; id < counts.size(); ++id) { // Loop through each word
+        if (counts[id].totalTweets > 0) ids.push_back(id); // Keep the words that were counted, as Trie::save does
+    }
+    std::sort(ids.begin(), ids.end(), [this](uint32_t a, uint32_t b) { // Sort them into the order Trie::save visits them
+        return words.token(a) < words.token(b); // Compare the words as bytes; a prefix comes before its extensions
+    });
+    std::string buffer; // Declare the encoded records
+    for (uint32_t id : ids) { // Loop through the words in order
+        appendRecord(buffer, words.token(id), counts[id].totalTweets, counts[id].positiveSentiments); // Encode the word's record
+    }
+
+    std::ofstream file(filename.c_str(), std::ios::binary); // Open the file for writing in binary mode
+    if (!file.is_open()) { // Check if the file is open
+        throw std::runtime_error("Could not open file for writing"); // Throw an error if the file could not be opened
+    }
+    file.write(buffer.data(), static_cast<std::streamsize>(buffer.size())); // Write the records
+    file.close(); // Close the file
+    if (!file) { // Check if every byte was written
+        throw std::runtime_error("Error writing file"); // Throw an error if writing failed
+    }
+
+    auto end = std::chrono::high_resolution_clock::now(); // End timing
+    std::chrono::duration<double> duration = end - start; // Calculate the duration
+    std::cout << "Saving completed in " << duration.count() << " seconds." << std::endl; // Output the duration
+}
+
+void HashVocabulary::load(const DSString& filename) { // Load the table from a file
+    finalized = false; // The counts are about to change
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing
+
+    readRecords(filename, [this](std::string_view word, int totalTweets, int positiveSentiments) { // Loop through each record
+        WordCounts& wordCounts = counts[idOf(word)]; // Find or add the word
+        wordCounts.totalTweets = totalTweets; // Set the totalTweets count
+        wordCounts.positiveSentiments = positiveSentiments; // Set the positiveSentiments count
+    });
+
+    auto end = std::chrono::high_resolution_clock::now(); // End timing
+    std::chrono::duration<double> duration = end - start; // Calculate the duration
+    std::cout << "Loading completed in " << duration.count() << " seconds." << std::endl; // Output the duration
+}
+
+void HashVocabulary::loadBinary(const DSString& filename, bool verifyChecksum) { // Read a binary model file into the table
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing
+
+    CompactTrie mapped; // Declare the mapped arrays
+    mapped.map(std::make_shared<MappedFile>(filename), verifyChecksum); // Map and validate the file before touching the table
+    words.clear(); // Drop the current words
+    counts.clear(); // Drop their counts
+    scores.clear(); // Drop their scores
+    finalized = false; // The cached scores belong to the old words
+    mapped.forEachWord([this](const std::string& word, const CompactTrie::Node& node) { // Loop through every word
+        WordCounts& wordCounts = counts[idOf(word)]; // Add the word
+        wordCounts.totalTweets = node.totalTweets; // Set the totalTweets count
+        wordCounts.positiveSentiments = node.positiveSentiments; // Set the positiveSentiments count
+    });
+
+    auto end = std::chrono::high_resolution_clock::now(); // End timing
+    std::chrono::duration<double> duration = end - start; // Calculate the duration
+    std::cout << "Loading completed in " << duration.count() << " seconds." << std::endl; // Output the duration
+}
+
+void HashVocabulary::finalize() { // Cache the scores of every word
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing
+
+    for (size_t id = 0; id < counts.size(); ++id) { // Loop through each word
+        WordScores computed = scoresOf(counts[id], smoothingAlpha); // Compute both scores
+        scores[id].logOdds = static_cast<float>(computed.logOdds); // Cache the log odds ratio
+        scores[id].sentimentScore = static_cast<float>(computed.sentimentScore); // Cache the sentiment score
+    }
+    finalized = true; // Let lookups read the cache
+
+    auto end = std::chrono::high_resolution_clock::now(); // End timing
+    std::chrono::duration<double> duration = end - start; // Calculate the duration
+    std::cout << "Finalizing completed in " << duration.count() << " seconds." << std::endl; // Output the duration
+}
+
+void HashVocabulary::setSmoothing(double alpha) { // Set the smoothing of the log odds ratio
+    smoothingAlpha = alpha; // Record the smoothing
+    if (finalized) finalize(); // Recompute the cache with it
+}
+
+double HashVocabulary::smoothing() const { // Get the smoothing of the log odds ratio
+    return smoothingAlpha; // Return the smoothing
+}
+
+size_t HashVocabulary::wordCount() const { // Count the distinct words
+    size_t count = 0; // Initialize the word count
+    for (const WordCounts& wordCounts : counts) { // Loop through each word
+        if (wordCounts.totalTweets > 0) count++; // Count the words that were counted
+    }
+    std::shared_ptr<const TrieDelta> snapshot = deltaSnapshot(); // Pin the delta
+    if (snapshot != nullptr) { // If words were added incrementally
+        snapshot->forEach([this, &count](std::string_view word, const WordCounts& added) { // Loop through each added word
+            uint32_t id = words.find(word); // Look the word up in the table
+            bool counted = id != TokenInterner::kUnknown && counts[id].totalTweets > 0; // Check if it was counted already
+            if (!counted && added.totalTweets > 0) count++; // Count words only the delta holds
+        });
+    }
+    return count; // Return the word count
+}
+
+WordScores HashVocabulary::scoresAt(uint32_t id) const { // Get both scores of a known id
+    if (!finalized) return scoresOf(counts[id], smoothingAlpha); // Compute them if the cache is stale
+    WordScores cached; // Declare the scores
+    cached.logOdds = scores[id].logOdds; // Read the log odds ratio
+    cached.sentimentScore = scores[id].sentimentScore; // Read the sentiment score
+    return cached; // Return both scores
+}
+
+WordScores HashVocabulary::getScores(std::string_view word) const { // Get both scores of a word
+    return getScores(word, deltaSnapshot().get()); // Score it against the current delta
+}
+
+WordScores HashVocabulary::getScores(std::string_view word, const TrieDelta* snapshot) const { // Get both scores of a word against a pinned delta
+    const WordCounts* added = nullptr; // Counts the delta holds for the word
+    if (snapshot != nullptr) { // If words were added incrementally
+        added = snapshot->find(word); // Look the word up in the delta
+    }
+    uint32_t id = words.find(word); // Probe the table once
+    WordScores result; // Declare the scores, zero for unknown words
+    bool seen = false; // Whether the word was seen in training
+    if (added == nullptr) { // If the table alone holds the word's counts
+        if (id != TokenInterner::kUnknown) { // If the word is in the table
+            result = scoresAt(id); // Read or compute its scores
+            seen = counts[id].totalTweets > 0; // Check if it was counted
+        }
+    } else { // If the delta adds to the word's counts
+        WordCounts combined; // Declare the counts of the word
+        if (id != TokenInterner::kUnknown) combined = counts[id]; // Get the counts stored in the table
+        combined.positiveSentiments += added->positiveSentiments; // Add the positiveSentiments count
+        combined.totalTweets += added->totalTweets; // Add the totalTweets count
+        seen = combined.totalTweets > 0; // Check if the word was seen
+        result = scoresOf(combined, smoothingAlpha); // Compute both scores from the counts
+    }
+    if (Metrics::enabled()) { // If metrics are being collected
+        Metrics::add(Counter::TrieLookups); // Count the lookup
+        Metrics::add(seen ? Counter::TrieHits : Counter::TrieMisses); // Count the hit or miss
+        if (added != nullptr) Metrics::add(Counter::DeltaHits); // Count the delta hit
+    }
+    return result; // Return both scores
+}
+
+WordScores HashVocabulary::sumScores(const TokenBuffer& tokens) const { // Sum both scores of tokenized words
+    if (hasDelta.load(std::memory_order_acquire)) return sumWith(*this, tokens); // Words the delta holds need their combined counts
+    thread_local std::vector<uint32_t> ids; // Id stream of the tweet, reused by each scoring thread
+    findIds(tokens, ids); // Probe the table once per word
+    WordScores sums = sumIds(ids); // Read the scores of the known ids
+    if (Metrics::enabled()) { // If metrics are being collected
+        size_t hits = 0; // Number of words seen in training
+        for (uint32_t id : ids) { // Loop through each id
+            if (id != TokenInterner::kUnknown && counts[id].totalTweets > 0) hits++; // Count the hit
+        }
+        Metrics::add(Counter::TrieLookups, tokens.size()); // Count the lookups
+        Metrics::add(Counter::TrieHits, hits); // Count the hits
+        Metrics::add(Counter::TrieMisses, tokens.size() - hits); // Count the misses
+    }
+    return sums; // Return both sums
+}
+
+WordScores HashVocabulary::sumIds(const std::vector<uint32_t>& ids) const { // Sum both scores of an id stream
+    WordScores sums; // Initialize both sums to zero
+    for (uint32_t id : ids) { // Iterate over each id
+        if (id == TokenInterner::kUnknown) continue; // Unknown words score zero
+        WordScores wordScores = scoresAt(id); // Read its scores
+        sums.logOdds += wordScores.logOdds; // Add the log-odds ratio of the word to the sum
+        sums.sentimentScore += wordScores.sentimentScore; // Add the sentiment score of the word to the sum
+    }
+    return sums; // Return both sums
+}
+
+const TokenInterner& HashVocabulary::interner() const { // Get the interner holding the words
+    return words; // Return the interner
+}
+
+size_t HashVocabulary::memoryUsage() const { // Get the memory held by the table
+    return words.memoryUsage() + counts.capacity() * sizeof(WordCounts) + scores.capacity() * sizeof(CachedScores); // Add up the arrays
+}
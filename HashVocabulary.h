@@ -0,0 +1,216 @@
+#ifndef HASH_VOCABULARY_H // Include guard to prevent multiple inclusions
+#define HASH_VOCABULARY_H // Define the include guard
+
+#include "SentimentModel.h" // Include SentimentModel, the interface the table implements
+#include "DSString.h" // Include DSString for file names
+#include "Tokenizer.h" // Include Tokenizer for the token buffer
+#include "TokenInterner.h" // Include TokenInterner for the dense token ids
+#include <cstddef> // Include cstddef for size_t
+#include <cstdint> // Include cstdint for the 32-bit ids
+#include <string_view> // Include string_view for words
+#include <vector> // Include vector for the count and score arrays
+
+/**
+ * @class HashVocabulary
+ * @brief A SentimentModel backend storing each word once, under a dense id, in a flat hash table.
+ *
+ * Scoring only looks whole tokens up, so no prefix structure is needed. A TokenInterner maps each
+ * token to a dense 32-bit id, and the counts and cached scores live in flat arrays indexed by id.
+ * Training interns each tweet's tokens into an id stream and counts the ids; scoring looks each
+ * token's id up once and then only reads the score array. Callers that keep id streams (see
+ * internTokens and findIds) skip the hashing too: insertIds and sumIds are array accesses only.
+ *
+ * The table has no read-only layout: a binary model file is read into it rather than mapped.
+ */
+class HashVocabulary : public SentimentModel {
+public:
+    /**
+     * @brief Constructs an empty table.
+     */
+    HashVocabulary();
+
+    /**
+     * @brief Gets the name of the backend.
+     * @return "hash table".
+     */
+    const char* name() const override;
+
+    /**
+     * @brief Trains the table with words from a file.
+     *
+     * With more than one thread the records are split into byte ranges on record boundaries, each
+     * range is counted into its own partial table, and the partial tables are merged in range order.
+     *
+     * @param file The file containing words to train the table.
+     * @param numThreads The number of threads to train with (0 uses the hardware concurrency).
+     */
+    void train(const DSString& file, unsigned numThreads = 1) override;
+
+    /**
+     * @brief Inserts a word into the table with its sentiment.
+     * @param word The word to insert.
+     * @param isPositive Boolean indicating if the word has a positive sentiment.
+     */
+    void insert(std::string_view word, bool isPositive) override;
+
+    /**
+     * @brief Adds counts to a word, adding the word if it is missing.
+     * @param word The word.
+     * @param counts The counts to add.
+     */
+    void addCounts(std::string_view word, const WordCounts& counts) override;
+
+    /**
+     * @brief Saves the table in the legacy record format; the file is identical to the one Trie::save writes.
+     * @param filename The name of the file to save the table to.
+     * @param numThreads Unused; the words are sorted into byte order on the calling thread.
+     */
+    void save(const DSString& filename, unsigned numThreads = 0) const override;
+
+    /**
+     * @brief Loads a model saved by save() or Trie::save.
+     * @param filename The name of the file to load the table from.
+     */
+    void load(const DSString& filename) override;
+
+    /**
+     * @brief Reads every word of a binary model file (see Trie::saveBinary) into the table.
+     * @param filename The name of the file to load the table from.
+     * @param verifyChecksum Whether to hash the whole file to detect corruption.
+     * @throws std::runtime_error If the file is not a valid binary model.
+     */
+    void loadBinary(const DSString& filename, bool verifyChecksum = true) override;
+
+    /**
+     * @brief Precomputes both scores of every word, as floats, so lookups read them.
+     */
+    void finalize() override;
+
+    /**
+     * @brief Sets the additive smoothing of the log odds ratio, recomputing the cache if it is in use.
+     * @param alpha The count added to both the positive and the negative count (1 is Laplace smoothing).
+     */
+    void setSmoothing(double alpha) override;
+
+    /**
+     * @brief Gets the additive smoothing of the log odds ratio.
+     * @return The smoothing count.
+     */
+    double smoothing() const override;
+
+    /**
+     * @brief Drops the words below the thresholds by rebuilding the interner and the arrays without them.
+     * @param options The thresholds a word must reach to be kept.
+     * @return The number of words dropped.
+     */
+    size_t prune(const PruneOptions& options) override;
+
+    /**
+     * @brief Counts the distinct words stored in the table.
+     * @return The number of words with a nonzero tweet count, including words only the delta holds.
+     */
+    size_t wordCount() const override;
+
+    /**
+     * @brief Gets both scores of a word against the current delta.
+     * @param word The word to score.
+     * @return Both scores of the word (zero if the word is not found).
+     */
+    WordScores getScores(std::string_view word) const;
+
+    /**
+     * @brief Gets both scores of a word against a pinned delta.
+     *
+     * Counts the lookup, whether the word was seen and delta hits in Metrics.
+     *
+     * @param word The word to score.
+     * @param snapshot The delta from deltaSnapshot(), or nullptr to read the table only.
+     * @return Both scores of the word (zero if the word is not found).
+     */
+    WordScores getScores(std::string_view word, const TrieDelta* snapshot) const override;
+
+    /**
+     * @brief Sums both scores of tokenized words against one delta snapshot, probing the table once per word.
+     *
+     * Without a delta the tweet becomes an id stream through findIds(), reusing one buffer per thread,
+     * and sumIds() reads the scores, so the analyzer's classification takes the id path.
+     *
+     * @param words The tokenized words.
+     * @return The log-odds sum and the sentiment score sum.
+     */
+    WordScores sumScores(const TokenBuffer& words) const override;
+
+    /**
+     * @brief Interns the tokens of a tweet, adding new tokens with zero counts.
+     * @param tokens The tokens.
+     * @param ids Receives one id per token, in order (cleared first).
+     */
+    void internTokens(const TokenBuffer& tokens, std::vector<uint32_t>& ids);
+
+    /**
+     * @brief Looks the ids of a tweet's tokens up without adding any.
+     * @param tokens The tokens.
+     * @param ids Receives one id per token, TokenInterner::kUnknown for unknown tokens (cleared first).
+     */
+    void findIds(const TokenBuffer& tokens, std::vector<uint32_t>& ids) const;
+
+    /**
+     * @brief Counts one tweet given as an id stream, as train() counts its tokens.
+     * @param ids Ids from internTokens().
+     * @param isPositive Boolean indicating if the tweet is positive.
+     */
+    void insertIds(const std::vector<uint32_t>& ids, bool isPositive);
+
+    /**
+     * @brief Sums both scores of a tweet given as an id stream, ignoring the delta.
+     *
+     * Once finalized this reads one score per known id and nothing else.
+     *
+     * @param ids Ids from findIds() or internTokens(); unknown ids score zero.
+     * @return The log-odds sum and the sentiment score sum.
+     */
+    WordScores sumIds(const std::vector<uint32_t>& ids) const;
+
+    /**
+     * @brief Gets the interner holding the words.
+     * @return The interner; the id of a word indexes the count and score arrays.
+     */
+    const TokenInterner& interner() const;
+
+    /**
+     * @brief Gets the memory held by the table.
+     * @return The number of bytes reserved for the interner and the count and score arrays.
+     */
+    size_t memoryUsage() const;
+
+private:
+    TokenInterner words; ///< Dense id of every word.
+    std::vector<WordCounts> counts; ///< Training counts, indexed by id.
+    std::vector<CachedScores> scores; ///< Scores precomputed by finalize(), indexed by id.
+    double smoothingAlpha; ///< Additive smoothing of the log odds ratio.
+    bool finalized; ///< Flag set while the cached scores match the counts and the smoothing.
+
+    /**
+     * @brief Gets the id of a word, adding the word with zero counts if it is missing.
+     * @param word The word.
+     * @return Its id.
+     * @throws std::runtime_error If the words no longer fit 32-bit offsets.
+     */
+    uint32_t idOf(std::string_view word);
+
+    /**
+     * @brief Gets both scores of a known id from the cache or its counts.
+     * @param id An id below words.size().
+     * @return Both scores.
+     */
+    WordScores scoresAt(uint32_t id) const;
+
+    /**
+     * @brief Inserts the words of the records of a byte range of a mapped training file.
+     * @param begin The first byte of the range; must be the start of a record.
+     * @param end One past the last byte of the range.
+     */
+    void trainRange(char* begin, char* end);
+};
+
+#endif // HASH_VOCABULARY_H // End of include guard
@@ -0,0 +1,579 @@
+#include "LabelModel.h" // Include the LabelModel header file
+#include "CorpusCache.h" // Include CorpusCache for training from a compiled corpus
+#include "CSVReader.h" // Include CSVReader for memory-mapped CSV parsing
+#include "SentimentModel.h" // Include SentimentModel for splitting the training file
+#include "ThreadPool.h" // Include ThreadPool for parallel counting
+#include <algorithm> // Include algorithm for std::max
+#include <chrono> // Include the chrono library for timing
+#include <cmath> // Include cmath for the log probabilities
+#include <cstdio> // Include cstdio for replacing the label file
+#include <cstring> // Include cstring for comparing the signature
+#include <filesystem> // Include filesystem for checking and trimming the delta file
+#include <fstream> // Include fstream for saving and loading the counts
+#include <iterator> // Include iterator for reading the learned tweets
+#include <iostream> // Include iostream for the timing output
+#include <memory> // Include memory for the partial models
+#include <stdexcept> // Include stdexcept for std::logic_error
+#include <string> // Include string for the temporary file name
+#include <thread> // Include thread for the hardware concurrency
+
+namespace {
+const char kMagic[8] = {'S', 'E', 'N', 'T', 'L', 'A', 'B', 'L'}; // Signature of a label file
+const uint32_t kVersion = 1; // Format version of a label file
+const uint32_t kByteOrder = 0x01020304; // Byte order marker, read back differently on a machine of the other endianness
+
+struct FileHeader { // The 56-byte header of a label file, followed by the counts and the tokens
+    char magic[8]; // Signature, kMagic
+    uint32_t version; // Format version, kVersion
+    uint32_t byteOrder; // kByteOrder as written by the producing machine
+    uint32_t labelCount; // Number of labels, the counts per row
+    uint32_t wordCount; // Number of distinct tokens, the rows
+    uint64_t vocabularyBytes; // Total length of the distinct tokens
+    uint64_t skipped; // Records skipped because of their label
+    int8_t labels[16]; // The labels in row order, -1 past labelCount
+};
+
+static_assert(sizeof(FileHeader) == 56, "The label header must be 56 bytes"); // Keep the layout fixed
+
+const char kDeltaMagic[8] = {'S', 'E', 'N', 'T', 'L', 'B', 'D', 'L'}; // Signature of a learned label file
+const size_t kTweetRecordHeader = 1 + sizeof(uint32_t); // A tweet record: its label digit, its length, then its bytes
+
+struct DeltaHeader { // The 48-byte header of a learned label file, followed by the tweet records
+    char magic[8]; // Signature, kDeltaMagic
+    uint32_t version; // Format version, kVersion
+    uint32_t labelCount; // Number of labels
+    int8_t labels[16]; // The labels in row order, -1 past labelCount
+    uint64_t baseSize; // Size of the base model file
+    uint64_t baseChecksum; // FNV-1a hash of the base model file
+};
+
+static_assert(sizeof(DeltaHeader) == 48, "The label delta header must be 48 bytes"); // Keep the layout fixed
+
+bool readHeader(const DSString& filename, FileHeader& header) { // Read and check the fixed part of a label file's header
+    std::ifstream file(filename.c_str(), std::ios::binary); // Open the file for reading in binary mode
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) return false; // Fail if it is missing or too short
+    return std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.version == kVersion && header.byteOrder == kByteOrder; // Check the signature, version and byte order
+}
+
+bool sameLabels(uint32_t labelCount, const int8_t* saved, const std::vector<int>& labels) { // Check that a header lists the same labels in the same order
+    if (labelCount != labels.size()) return false; // The rows must be as wide
+    for (size_t i = 0; i < labels.size(); ++i) { // Loop through each label
+        if (saved[i] != labels[i]) return false; // Each column must hold the same label
+    }
+    return true; // The counts line up
+}
+
+void appendTweet(std::string& out, const TrainingRecord& record) { // Append the record of a learned tweet
+    uint32_t length = static_cast<uint32_t>(record.tweet.size()); // Get the tweet's length
+    out.push_back(record.sentiment[0]); // Append the label digit
+    out.append(reinterpret_cast<const char*>(&length), sizeof(length)); // Append the length
+    out.append(record.tweet.data(), record.tweet.size()); // Append the tweet
+}
+
+template <typename T>
+void writeArray(std::ofstream& out, const std::vector<T>& values) { // Write the elements of an array back to back
+    out.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T))); // Write the raw bytes
+}
+
+template <typename T>
+bool readArray(std::ifstream& in, std::vector<T>& values) { // Read the elements of an array of known size
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)))); // Read the raw bytes
+}
+} // namespace
+
+LabelModel::LabelModel(const LabelOptions& labelOptions) // Constructor for LabelModel
+    : options(labelOptions), tweetCounts(labelOptions.labels.size()), tokenCounts(labelOptions.labels.size()), skipped(0), finalized(false), hasDelta(false), deltaFileSize(0) {
+    if (options.labels.size() < 2) { // Check that there is something to tell apart
+        throw std::logic_error("A label model needs at least two labels"); // Throw an error if there is not
+    }
+    if (!(options.smoothing > 0)) { // Check that every probability stays above zero
+        throw std::logic_error("The label smoothing must be positive"); // Throw an error if one would not
+    }
+    std::fill(labelIndex, labelIndex + kMaxLabels, static_cast<int8_t>(-1)); // No digit is a label yet
+    for (size_t i = 0; i < options.labels.size(); ++i) { // Loop through each label
+        int label = options.labels[i]; // Get the label
+        if (label < 0 || label >= static_cast<int>(kMaxLabels)) { // Check that it is written as one digit
+            throw std::logic_error("Labels must be single digits"); // Throw an error if it is not
+        }
+        if (labelIndex[label] >= 0) { // Check that it is listed once
+            throw std::logic_error("A label is listed twice"); // Throw an error if it is not
+        }
+        labelIndex[label] = static_cast<int8_t>(i); // Give it its row position
+    }
+}
+
+int LabelModel::indexOf(std::string_view label) const { // Get the row position of a label field
+    if (label.size() != 1 || label[0] < '0' || label[0] > '9') return -1; // Only single digits can be labels
+    return labelIndex[label[0] - '0']; // Look the digit up
+}
+
+uint32_t LabelModel::idOf(std::string_view token) { // Get the id of a token, adding a row if it is new
+    uint32_t id = words.intern(token); // Intern the token
+    if (id == counts.size() / options.labels.size()) { // If the token is new
+        counts.resize(counts.size() + options.labels.size()); // Give it a row of zero counts
+    }
+    return id; // Return the id
+}
+
+bool LabelModel::add(const TokenBuffer& tokens, std::string_view label) { // Count the tokens of one tweet
+    int index = indexOf(label); // Find the label's row position
+    if (index < 0) { // If the label is not one of ours
+        ++skipped; // Count the skipped record
+        return false; // Skip the tweet
+    }
+    size_t stride = options.labels.size(); // Counts per row
+    for (size_t i = 0; i < tokens.size(); ++i) { // Loop through each token
+        counts[idOf(tokens[i]) * stride + index]++; // Count the occurrence under the label
+    }
+    tweetCounts[index]++; // Count the tweet
+    tokenCounts[index] += tokens.size(); // Count its tokens
+    finalized = false; // The counts changed
+    return true; // The tweet was counted
+}
+
+void LabelModel::trainRange(char* begin, char* end) { // Count the tokens of the records of a byte range
+    CSVReader reader(begin, end); // Declare a reader over the range
+    std::vector<std::string_view> fields; // Declare the field list, reused for every record
+    TokenBuffer tokens; // Declare the token buffer, reused for every record
+    while (reader.next(fields, 6)) { // Read each record; the tweet takes the rest of the record
+        if (fields.size() < 6) continue; // Skip records with missing fields
+        Tokenizer::tokenize(fields[5], tokens); // Tokenize the tweet into words
+        add(tokens, fields[0]); // Count the tokens under the record's label
+    }
+}
+
+void LabelModel::merge(const LabelModel& other) { // Add the counts of a model with the same labels
+    size_t stride = options.labels.size(); // Counts per row
+    for (uint32_t id = 0; id < other.words.size(); ++id) { // Loop through its tokens in id order
+        uint32_t* row = &counts[idOf(other.words.token(id)) * stride]; // Find or add the token's row
+        const uint32_t* added = &other.counts[id * stride]; // Get the row to add
+        for (size_t i = 0; i < stride; ++i) row[i] += added[i]; // Add each label's count
+    }
+    for (size_t i = 0; i < stride; ++i) { // Loop through each label
+        tweetCounts[i] += other.tweetCounts[i]; // Add the tweets
+        tokenCounts[i] += other.tokenCounts[i]; // Add the tokens
+    }
+    skipped += other.skipped; // Add the skipped records
+    finalized = false; // The counts changed
+}
+
+void LabelModel::train(const DSString& file, unsigned numThreads) { // Count the tokens of a training file
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing
+    size_t skippedBefore = skipped; // Remember the records skipped before this file
+
+    if (numThreads == 0) { // If the caller asked for the hardware concurrency
+        numThreads = std::max(1u, std::thread::hardware_concurrency()); // Use every core, but at least one thread
+    }
+
+    MappedFile mapped(file); // Map the training file into memory
+    CSVReader header(mapped.data(), mapped.data() + mapped.size()); // Declare a reader for the header line
+    header.skip(); // Skip the header line
+    char* first = const_cast<char*>(header.position()); // Get the start of the first record
+    std::vector<char*> bounds = SentimentModel::splitRanges(first, mapped.data() + mapped.size(), numThreads, 6); // Split the records into byte ranges, read with six fields
+    size_t numRanges = bounds.size() - 1; // Get the number of ranges actually produced
+
+    if (numRanges == 1) { // If there is only one range
+        trainRange(bounds[0], bounds[1]); // Count in place
+    } else { // If the file was split across several threads
+        std::vector<std::unique_ptr<LabelModel>> partials; // Declare one partial model per range
+        for (size_t i = 0; i < numRanges; ++i) { // Loop through each range
+            partials.emplace_back(new LabelModel(options)); // Create the partial model for the range
+        }
+        ThreadPool pool(numThreads); // Declare the pool running the counting tasks
+        TaskGroup counting(pool); // Declare the group of counting tasks
+        counting.runEach(numRanges, [&](size_t i) { // Count each range on the pool
+            partials[i]->trainRange(bounds[i], bounds[i + 1]); // Count the range into its partial model
+        });
+        counting.wait(); // Wait for every range; rethrows the first failure
+        for (const std::unique_ptr<LabelModel>& partial : partials) merge(*partial); // Merge the partial models in range order
+    }
+
+    auto end = std::chrono::high_resolution_clock::now(); // End timing
+    std::chrono::duration<double> duration = end - start; // Calculate the duration
+    std::cout << "Counting labels completed in " << duration.count() << " seconds." << std::endl; // Output the duration
+    if (skipped > skippedBefore) std::cout << "Skipped " << skipped - skippedBefore << " records with other labels." << std::endl; // Report the records of this file left out
+}
+
+void LabelModel::trainCorpus(const CorpusCache& corpus, unsigned numThreads) { // Count the tokens of a compiled corpus
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing
+    size_t skippedBefore = skipped; // Remember the records skipped before this corpus
+
+    if (numThreads == 0) { // If the caller asked for the hardware concurrency
+        numThreads = std::max(1u, std::thread::hardware_concurrency()); // Use every core, but at least one thread
+    }
+
+    size_t stride = options.labels.size(); // Counts per row
+    size_t vocabulary = corpus.vocabularySize(); // Number of corpus ids
+    struct RangeCounts { // Counts of a range of records, indexed by corpus id
+        std::vector<uint32_t> cells; // One row of label counts per corpus id
+        std::vector<uint64_t> tweets; // Tweets of each label
+        std::vector<uint64_t> tokens; // Token occurrences of each label
+        size_t skipped = 0; // Records with other labels
+    };
+    auto countRecords = [&](RangeCounts& range, size_t firstRecord, size_t lastRecord) { // Count the tokens of a range of records
+        range.cells.assign(vocabulary * stride, 0); // Zero every row
+        range.tweets.assign(stride, 0); // Zero the tweets
+        range.tokens.assign(stride, 0); // Zero the tokens
+        for (size_t record = firstRecord; record < lastRecord; ++record) { // Loop through each record
+            int label = corpus.label(record); // Get its label digit
+            int index = label < 0 ? -1 : labelIndex[label]; // Find the label's row position
+            if (index < 0) { // If the label is not one of ours
+                range.skipped++; // Count the skipped record
+                continue; // Skip the tweet
+            }
+            std::pair<const uint32_t*, const uint32_t*> ids = corpus.recordIds(record); // Get its ids
+            for (const uint32_t* id = ids.first; id != ids.second; ++id) { // Loop through each token
+                if (*id >= vocabulary) throw std::runtime_error("Corpus cache token id is out of range"); // Check it against the vocabulary
+                range.cells[*id * stride + index]++; // Count the occurrence under the label
+            }
+            range.tweets[index]++; // Count the tweet
+            range.tokens[index] += static_cast<uint64_t>(ids.second - ids.first); // Count its tokens
+        }
+    };
+
+    size_t numRecords = corpus.records(); // Get the number of records
+    size_t numRanges = std::max<size_t>(1, std::min<size_t>(numThreads, numRecords)); // Use at most one range per record
+    std::vector<RangeCounts> ranges(numRanges); // Declare the counts of each range
+    if (numRanges == 1) { // If there is only one range
+        countRecords(ranges[0], 0, numRecords); // Count on this thread
+    } else { // If the records are split across several threads
+        ThreadPool pool(numThreads); // Declare the pool running the counting tasks
+        TaskGroup counting(pool); // Declare the group of counting tasks
+        counting.runEach(numRanges, [&](size_t i) { // Count each range on the pool
+            countRecords(ranges[i], numRecords * i / numRanges, numRecords * (i + 1) / numRanges); // Count the range into its own arrays
+        });
+        counting.wait(); // Wait for every range; rethrows the first failure
+    }
+
+    for (uint32_t id = 0; id < vocabulary; ++id) { // Loop through the corpus ids in order, so the ids do not depend on the thread count
+        bool counted = false; // Whether any range counted the token
+        for (const RangeCounts& range : ranges) { // Loop through the ranges
+            for (size_t i = 0; i < stride && !counted; ++i) counted = range.cells[id * stride + i] > 0; // Look for a count
+        }
+        if (!counted) continue; // Tokens only seen under other labels get no row, as in train()
+        uint32_t* row = &counts[idOf(corpus.token(id)) * stride]; // Find or add the token's row
+        for (const RangeCounts& range : ranges) { // Add the ranges in order
+            for (size_t i = 0; i < stride; ++i) row[i] += range.cells[id * stride + i]; // Add each label's count
+        }
+    }
+    for (const RangeCounts& range : ranges) { // Add the totals of each range
+        for (size_t i = 0; i < stride; ++i) { // Loop through each label
+            tweetCounts[i] += range.tweets[i]; // Add the tweets
+            tokenCounts[i] += range.tokens[i]; // Add the tokens
+        }
+        skipped += range.skipped; // Add the skipped records
+    }
+    finalized = false; // The counts changed
+
+    auto end = std::chrono::high_resolution_clock::now(); // End timing
+    std::chrono::duration<double> duration = end - start; // Calculate the duration
+    std::cout << "Counting labels completed in " << duration.count() << " seconds." << std::endl; // Output the duration
+    if (skipped > skippedBefore) std::cout << "Skipped " << skipped - skippedBefore << " records with other labels." << std::endl; // Report the records of this corpus left out
+}
+
+void LabelModel::save(const DSString& filename) const { // Save the counts to a file
+    FileHeader header = FileHeader(); // Declare the header, zeroed
+    std::memcpy(header.magic, kMagic, sizeof(kMagic)); // Set the signature
+    header.version = kVersion; // Set the format version
+    header.byteOrder = kByteOrder; // Set the byte order marker
+    header.labelCount = static_cast<uint32_t>(options.labels.size()); // Set the counts per row
+    header.wordCount = static_cast<uint32_t>(words.size()); // Set the number of rows
+    header.skipped = skipped; // Set the records skipped
+    std::fill(header.labels, header.labels + sizeof(header.labels), static_cast<int8_t>(-1)); // Mark the unused label slots
+    for (size_t i = 0; i < options.labels.size(); ++i) header.labels[i] = static_cast<int8_t>(options.labels[i]); // Set the labels in row order
+    std::vector<uint32_t> offsets(1, 0); // Declare the end of each token
+    std::string chars; // Declare the bytes of the tokens
+    for (uint32_t id = 0; id < words.size(); ++id) { // Loop through each token in id order
+        chars.append(words.token(id)); // Append its bytes
+        offsets.push_back(static_cast<uint32_t>(chars.size())); // Record where it ends
+    }
+    header.vocabularyBytes = chars.size(); // Set the length of the tokens
+
+    std::string temporary = std::string(filename) + ".tmp"; // Write next to the destination first
+    std::ofstream file(temporary, std::ios::binary); // Open the temporary file for writing in binary mode
+    if (!file.is_open()) { // Check if the file is open
+        throw std::runtime_error("Could not open file for writing"); // Throw an error if the file could not be opened
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header)); // Write the header
+    writeArray(file, tweetCounts); // Write the tweets of each label
+    writeArray(file, tokenCounts); // Write the tokens of each label
+    writeArray(file, counts); // Write the rows of counts
+    writeArray(file, offsets); // Write the token ends
+    file.write(chars.data(), static_cast<std::streamsize>(chars.size())); // Write the token bytes
+    file.close(); // Close the file
+    if (!file || std::rename(temporary.c_str(), filename.c_str()) != 0) { // Check the write, then replace the old counts
+        std::remove(temporary.c_str()); // Remove the partial file
+        throw std::runtime_error("Error writing label file"); // Throw an error if either failed
+    }
+}
+
+bool LabelModel::isCompatible(const DSString& filename, const LabelOptions& options) { // Check if a file holds counts of these labels
+    FileHeader header; // Declare the file's header
+    if (!readHeader(filename, header)) return false; // A missing or foreign file is never compatible
+    return sameLabels(header.labelCount, header.labels, options.labels); // Compare the labels
+}
+
+void LabelModel::load(const DSString& filename) { // Load the counts of a saved model
+    std::ifstream file(filename.c_str(), std::ios::binary); // Open the file for reading in binary mode
+    if (!file.is_open()) { // Check if the file is open
+        throw std::runtime_error("Could not open file for reading"); // Throw an error if the file could not be opened
+    }
+    FileHeader header; // Declare the file's header
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || // Read the header and check the signature
+        header.version != kVersion || header.byteOrder != kByteOrder) { // Check the version and byte order
+        throw std::runtime_error("Not a label file"); // Throw an error if any differs
+    }
+    if (!sameLabels(header.labelCount, header.labels, options.labels)) { // Check the labels
+        throw std::runtime_error("Label file has other labels"); // Throw an error if they differ
+    }
+    size_t stride = options.labels.size(); // Counts per row
+    std::vector<uint64_t> tweets(stride); // Declare the tweets of each label
+    std::vector<uint64_t> tokens(stride); // Declare the tokens of each label
+    std::vector<uint32_t> rows(static_cast<size_t>(header.wordCount) * stride); // Declare the rows of counts
+    std::vector<uint32_t> offsets(static_cast<size_t>(header.wordCount) + 1); // Declare the token ends
+    std::vector<char> chars(header.vocabularyBytes); // Declare the token bytes
+    if (!readArray(file, tweets) || !readArray(file, tokens) || !readArray(file, rows) || !readArray(file, offsets) || !readArray(file, chars) || // Read every array
+        file.peek() != std::ifstream::traits_type::eof()) { // Check that nothing follows
+        throw std::runtime_error("Label file is truncated"); // Throw an error if the size is wrong
+    }
+
+    TokenInterner loaded; // Declare the interner of the saved tokens
+    for (uint32_t id = 0; id < header.wordCount; ++id) { // Loop through the tokens in id order
+        if (offsets[id] > offsets[id + 1] || offsets[id + 1] > chars.size()) { // Check that the token lies inside the bytes
+            throw std::runtime_error("Label file tokens are corrupt"); // Throw an error if it does not
+        }
+        std::string_view token(chars.data() + offsets[id], offsets[id + 1] - offsets[id]); // View the token
+        if (loaded.intern(token) != id) { // Intern it; a repeated token would not get the next id
+            throw std::runtime_error("Label file tokens are corrupt"); // Throw an error if it did not
+        }
+    }
+    words = std::move(loaded); // Use the saved tokens
+    counts = std::move(rows); // Use the saved counts
+    tweetCounts = std::move(tweets); // Use the saved tweets
+    tokenCounts = std::move(tokens); // Use the saved tokens
+    skipped = static_cast<size_t>(header.skipped); // Use the saved skipped records
+    finalized = false; // The probabilities must be computed again
+}
+
+void LabelModel::finalize() { // Precompute the log priors and log probabilities
+    size_t stride = options.labels.size(); // Counts per row
+    double alpha = options.smoothing; // Get the smoothing
+    double vocabulary = static_cast<double>(words.size()); // Get the number of distinct tokens
+    uint64_t tweets = 0; // Declare the number of tweets counted
+    for (uint64_t count : tweetCounts) tweets += count; // Add up the tweets of every label
+    logPriors.resize(stride); // One prior per label
+    logDenominators.resize(stride); // One normalizer per label, kept for update()
+    for (size_t i = 0; i < stride; ++i) { // Loop through each label
+        logPriors[i] = std::log((tweetCounts[i] + alpha) / (tweets + alpha * stride)); // Smoothed, so a label without tweets is still possible
+        logDenominators[i] = std::log(tokenCounts[i] + alpha * vocabulary); // Normalize over every token of the vocabulary
+    }
+    logLikelihoods.resize(counts.size()); // One probability per count
+    for (size_t cell = 0; cell < counts.size(); ++cell) { // Loop through each count, row by row
+        logLikelihoods[cell] = static_cast<float>(std::log(counts[cell] + alpha) - logDenominators[cell % stride]); // Compute the smoothed log probability
+    }
+    finalized = true; // The probabilities match the counts
+}
+
+void LabelModel::scoreLabels(const TokenBuffer& tokens, double* scores) const { // Compute the naive Bayes score of every label
+    if (!finalized) { // Check that the probabilities are computed
+        throw std::logic_error("A label model must be finalized before scoring"); // Throw an error if they are not
+    }
+    size_t stride = options.labels.size(); // Scores per row
+    std::shared_ptr<const Delta> snapshot = deltaSnapshot(); // Pin the learned counts, if any
+    if (snapshot == nullptr) { // If nothing was learned
+        for (size_t i = 0; i < stride; ++i) scores[i] = logPriors[i]; // Start from the priors
+        for (size_t t = 0; t < tokens.size(); ++t) { // Loop through each token
+            uint32_t id = words.find(tokens[t]); // Look the token up once
+            if (id == TokenInterner::kUnknown) continue; // Skip tokens never seen in training
+            const float* row = &logLikelihoods[id * stride]; // Get the token's row, one cache line for every label
+            for (size_t i = 0; i < stride; ++i) scores[i] += row[i]; // Add its log probability under each label
+        }
+        return; // Every row was finalized with these totals
+    }
+
+    double alpha = options.smoothing; // Get the smoothing
+    for (size_t i = 0; i < stride; ++i) scores[i] = snapshot->logPriors[i]; // Start from the priors of all the tweets
+    size_t finalizedTokens = 0; // Tokens scored from their finalized rows, each owed the shift of every label
+    for (size_t t = 0; t < tokens.size(); ++t) { // Loop through each token
+        uint32_t id = words.find(tokens[t]); // Look the token up once
+        const LearnedRow* learned = snapshot->find(tokens[t]); // Look up what was learned about it
+        if (learned == nullptr) { // If its counts are the finalized ones
+            if (id == TokenInterner::kUnknown) continue; // Skip tokens never seen
+            const float* row = &logLikelihoods[id * stride]; // Get the token's row
+            for (size_t i = 0; i < stride; ++i) scores[i] += row[i]; // Add its log probability under each label
+            ++finalizedTokens; // Renormalize it below
+            continue; // Move on to the next token
+        }
+        const uint32_t* row = id != TokenInterner::kUnknown ? &counts[id * stride] : nullptr; // Get its finalized counts, if any
+        for (size_t i = 0; i < stride; ++i) { // Loop through each label
+            uint64_t count = static_cast<uint64_t>(learned->counts[i]) + (row != nullptr ? row[i] : 0); // Add up both counts
+            scores[i] += std::log(count + alpha) - snapshot->logDenominators[i]; // Add its log probability under the label
+        }
+    }
+    for (size_t i = 0; i < stride; ++i) scores[i] += finalizedTokens * snapshot->shifts[i]; // Move the finalized probabilities onto the new normalizers
+}
+
+int LabelModel::classify(const TokenBuffer& tokens) const { // Classify a tweet
+    double scores[kMaxLabels]; // Declare the score of each label
+    scoreLabels(tokens, scores); // Score every label
+    size_t best = 0; // Declare the winning position, the first label so far
+    for (size_t i = 1; i < options.labels.size(); ++i) { // Loop through the other labels
+        if (scores[i] > scores[best]) best = i; // Keep the earliest label on a tie
+    }
+    return options.labels[best]; // Return the winning label
+}
+
+void LabelModel::update(const std::vector<TrainingRecord>& records) { // Count learned tweets into the delta
+    std::lock_guard<std::mutex> lock(updateMutex); // Serialize the updates
+    learnRecords(records); // Count them and publish the delta
+}
+
+void LabelModel::learnRecords(const std::vector<TrainingRecord>& records) { // Count learned tweets into a new delta
+    if (!finalized) { // Check that the shifts have normalizers to start from
+        throw std::logic_error("A label model must be finalized before learning"); // Throw an error if they do not
+    }
+    size_t stride = options.labels.size(); // Counts per row
+    DeltaBuilder<Delta> builder(deltaSnapshot()); // Start from the published delta; readers keep it
+    Delta& next = builder.delta(); // Get the totals of the new delta
+    if (next.tweetCounts.empty()) { // If this is the first delta
+        next.tweetCounts.assign(stride, 0); // Nothing learned under any label yet
+        next.tokenCounts.assign(stride, 0); // Nor any token
+    }
+    size_t learned = 0; // Declare the number of tweets counted
+    TokenBuffer tokens; // Declare the token buffer, reused for every record
+    for (const TrainingRecord& record : records) { // Loop through each record
+        int index = indexOf(record.sentiment); // Find the label's row position
+        if (index < 0) continue; // Ignore tweets with other labels, as add() does
+        Tokenizer::tokenize(record.tweet, tokens); // Tokenize the tweet into words
+        for (size_t t = 0; t < tokens.size(); ++t) { // Loop through each token
+            bool created = false; // Declare whether the delta gets the token now
+            LearnedRow& row = builder.entry(tokens[t], &created).second; // Find or add its learned row; only its shard is copied
+            if (created && words.find(tokens[t]) == TokenInterner::kUnknown) next.newWords++; // A token without a finalized row grows the vocabulary
+            row.counts[index]++; // Count the occurrence under the label
+        }
+        next.tweetCounts[index]++; // Count the tweet
+        next.tokenCounts[index] += tokens.size(); // Count its tokens
+        appendTweet(learnedTweets, record); // Queue its record for the next saveDelta()
+        ++learned; // Count it
+    }
+    if (learned == 0) return; // Nothing changed
+    rescore(next); // Renormalize over the new totals, once per label
+    std::atomic_store(&delta, builder.finish()); // Swap the pointer; the old delta lives on in its readers
+    hasDelta.store(true, std::memory_order_release); // Let scoring see it
+}
+
+void LabelModel::rescore(Delta& next) const { // Compute the priors, normalizers and shifts of a delta
+    size_t stride = options.labels.size(); // Counts per row
+    double alpha = options.smoothing; // Get the smoothing
+    double vocabulary = static_cast<double>(words.size() + next.newWords); // Count the finalized and the learned tokens
+    uint64_t tweets = 0; // Declare the number of tweets counted
+    for (size_t i = 0; i < stride; ++i) tweets += tweetCounts[i] + next.tweetCounts[i]; // Add up the tweets of every label
+    next.logPriors.resize(stride); // One prior per label
+    next.logDenominators.resize(stride); // One normalizer per label
+    next.shifts.resize(stride); // One shift per label
+    for (size_t i = 0; i < stride; ++i) { // Loop through each label
+        next.logPriors[i] = std::log((tweetCounts[i] + next.tweetCounts[i] + alpha) / (tweets + alpha * stride)); // Smoothed, as in finalize()
+        next.logDenominators[i] = std::log(tokenCounts[i] + next.tokenCounts[i] + alpha * vocabulary); // Normalize over every token, as in finalize()
+        next.shifts[i] = logDenominators[i] - next.logDenominators[i]; // Trade the finalized normalizer for the new one
+    }
+}
+
+std::shared_ptr<const LabelModel::Delta> LabelModel::deltaSnapshot() const { // Pin the published delta
+    if (!hasDelta.load(std::memory_order_acquire)) return nullptr; // Skip the atomic load until a delta exists
+    return std::atomic_load(&delta); // Load the published delta
+}
+
+void LabelModel::saveDelta(const DSString& filename, const ModelStamp& base) { // Save the learned tweets
+    std::lock_guard<std::mutex> lock(updateMutex); // Keep updates out while the records are written
+    std::error_code error; // Declare the error of the size query; a missing file is rewritten
+    uintmax_t size = std::filesystem::file_size(filename.c_str(), error); // Get the size of the file on disk
+    bool sameBase = base.size == deltaBase.size && base.checksum == deltaBase.checksum; // Check that the file was stamped with this base
+    if (!deltaFile.empty() && filename == deltaFile && sameBase && !error && size == deltaFileSize) { // If the file holds exactly what this model saved or loaded
+        size_t saved = static_cast<size_t>(deltaFileSize - sizeof(DeltaHeader)); // Bytes of records already in the file
+        if (saved == learnedTweets.size()) return; // Nothing was learned since
+        std::ofstream file(filename.c_str(), std::ios::binary | std::ios::app); // Open the file for appending in binary mode
+        if (!file.is_open()) { // Check if the file is open
+            throw std::runtime_error("Could not open file for writing"); // Throw an error if the file could not be opened
+        }
+        file.write(learnedTweets.data() + saved, static_cast<std::streamsize>(learnedTweets.size() - saved)); // Append the new records
+        file.close(); // Close the file
+        if (!file) { // Check the write
+            std::filesystem::resize_file(filename.c_str(), deltaFileSize, error); // Cut off the partial records
+            throw std::runtime_error("Error writing label delta file"); // Throw an error if it failed
+        }
+        deltaFileSize = sizeof(DeltaHeader) + learnedTweets.size(); // The file holds every record now
+        return; // The file is up to date
+    }
+
+    DeltaHeader header = DeltaHeader(); // Declare the header, zeroed
+    std::memcpy(header.magic, kDeltaMagic, sizeof(kDeltaMagic)); // Set the signature
+    header.version = kVersion; // Set the format version
+    header.labelCount = static_cast<uint32_t>(options.labels.size()); // Set the number of labels
+    std::fill(header.labels, header.labels + sizeof(header.labels), static_cast<int8_t>(-1)); // Mark the unused label slots
+    for (size_t i = 0; i < options.labels.size(); ++i) header.labels[i] = static_cast<int8_t>(options.labels[i]); // Set the labels in row order
+    header.baseSize = base.size; // Set the base model's size
+    header.baseChecksum = base.checksum; // Set the base model's checksum
+
+    std::string temporary = std::string(filename) + ".tmp"; // Write next to the destination first
+    std::ofstream file(temporary, std::ios::binary); // Open the temporary file for writing in binary mode
+    if (!file.is_open()) { // Check if the file is open
+        throw std::runtime_error("Could not open file for writing"); // Throw an error if the file could not be opened
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header)); // Write the header
+    file.write(learnedTweets.data(), static_cast<std::streamsize>(learnedTweets.size())); // Write every record
+    file.close(); // Close the file
+    if (!file || std::rename(temporary.c_str(), filename.c_str()) != 0) { // Check the write, then replace the old file
+        std::remove(temporary.c_str()); // Remove the partial file
+        throw std::runtime_error("Error writing label delta file"); // Throw an error if either failed
+    }
+    deltaFile = filename; // Later saves append to this file
+    deltaBase = base; // Remember its stamp
+    deltaFileSize = sizeof(DeltaHeader) + learnedTweets.size(); // Remember its size
+}
+
+bool LabelModel::loadDelta(const DSString& filename, const ModelStamp& base) { // Learn the tweets of a delta file again
+    std::ifstream file(filename.c_str(), std::ios::binary); // Open the file for reading in binary mode
+    if (!file.is_open()) { // Check if the file is open
+        throw std::runtime_error("Could not open file for reading"); // Throw an error if the file could not be opened
+    }
+    DeltaHeader header; // Declare the header
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, kDeltaMagic, sizeof(kDeltaMagic)) != 0 || header.version != kVersion) { // Read and check the signature and version
+        return false; // Records of another format cannot be learned
+    }
+    if (!sameLabels(header.labelCount, header.labels, options.labels) || header.baseSize != base.size || header.baseChecksum != base.checksum) { // If they were learned with other labels or on another model
+        return false; // Leave the model as it is
+    }
+    std::string bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()); // Read every record
+    std::vector<TrainingRecord> records; // Declare the records; their views point into the bytes
+    size_t offset = 0; // Declare the start of the next record
+    while (bytes.size() - offset >= kTweetRecordHeader) { // Loop through each record with a complete header
+        uint32_t length; // Declare the tweet's length
+        std::memcpy(&length, bytes.data() + offset + 1, sizeof(length)); // Read it
+        if (bytes.size() - offset - kTweetRecordHeader < length) break; // Drop a record cut short by a crash
+        records.push_back(TrainingRecord{std::string_view(bytes.data() + offset, 1), std::string_view(bytes.data() + offset + kTweetRecordHeader, length)}); // Add the record
+        offset += kTweetRecordHeader + length; // Move past it
+    }
+    std::lock_guard<std::mutex> lock(updateMutex); // Serialize the updates
+    learnRecords(records); // Count them again, keeping their records for later saves
+    deltaFile = filename; // Later saves append to this file
+    deltaBase = base; // Remember its stamp
+    deltaFileSize = sizeof(DeltaHeader) + learnedTweets.size(); // Remember the size of the records read; a dropped tail makes the next save rewrite the file
+    return true; // The tweets were learned
+}
+
+const std::vector<int>& LabelModel::labels() const { // Get the labels
+    return options.labels; // Return the labels
+}
+
+size_t LabelModel::wordCount() const { // Count the distinct tokens
+    std::shared_ptr<const Delta> snapshot = deltaSnapshot(); // Pin the learned counts, if any
+    return words.size() + (snapshot != nullptr ? snapshot->newWords : 0); // One row per interned token, plus the learned tokens without one
+}
+
+size_t LabelModel::skippedRecords() const { // Count the records skipped because of their label
+    return skipped; // Return the count
+}
+
+size_t LabelModel::memoryUsage() const { // Get the memory held by the model
+    return words.memoryUsage() + counts.capacity() * sizeof(uint32_t) + logLikelihoods.capacity() * sizeof(float); // Add up the interner and both packed arrays
+}
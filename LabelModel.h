@@ -0,0 +1,295 @@
+#ifndef LABEL_MODEL_H // Include guard to prevent multiple inclusions
+#define LABEL_MODEL_H // Define the include guard
+
+#include "DeltaMap.h" // Include DeltaMap for the learned counts
+#include "DSString.h" // Include DSString for file names
+#include "CorpusCache.h" // Include CorpusCache for training from a compiled corpus
+#include "SentimentModel.h" // Include SentimentModel for the training records and model stamps
+#include "Tokenizer.h" // Include Tokenizer for the token buffer
+#include "TokenInterner.h" // Include TokenInterner for the dense token ids
+#include <atomic> // Include atomic for the published delta flag
+#include <cstddef> // Include cstddef for size_t
+#include <cstdint> // Include cstdint for the counts
+#include <memory> // Include memory for the published delta
+#include <mutex> // Include mutex for serializing learned updates
+#include <string> // Include string for the learned tweet records
+#include <string_view> // Include string_view for label fields
+#include <vector> // Include vector for the count and probability arrays
+
+/**
+ * @struct LabelOptions
+ * @brief The labels a LabelModel tells apart and the smoothing of its probabilities.
+ */
+struct LabelOptions {
+    std::vector<int> labels = {0, 2, 4}; ///< The labels, single digits as written to the results file; records with other labels are skipped.
+    double smoothing = 1.0; ///< Additive smoothing of the priors and of the per-label token probabilities.
+};
+
+/**
+ * @class LabelModel
+ * @brief Per-token counts for any number of labels, scored as a multinomial naive Bayes classifier.
+ *
+ * A SentimentModel keeps two counts per word, so it only tells positive (4) from everything else.
+ * This model counts every token occurrence once per label. A TokenInterner gives each token a dense
+ * id, and the counts are packed as one row of labels().size() counts per id, so the counts of a
+ * token for all labels share a cache line. finalize() turns the rows into log probabilities
+ * log((count + smoothing) / (label tokens + smoothing * vocabulary)), packed the same way as floats.
+ *
+ * A tweet scores the log prior of each label plus the row of each known token; unknown tokens are
+ * skipped. The label with the highest score wins, the earliest listed label on a tie. Lookups are
+ * safe from several threads once the model is finalized and nothing is added.
+ *
+ * Tweets learned after finalize() go through update() instead: their counts are kept in a delta of
+ * the touched tokens only, published like a TrieDelta, and the finalized rows are never rewritten.
+ * Growing a label's token total or the vocabulary moves that label's normalizer, which shifts every
+ * log probability of the label by the same amount, so a finalized row still scores exactly once the
+ * delta's per-label shift is added; only learned tokens compute their probabilities from counts.
+ */
+class LabelModel {
+public:
+    static const size_t kMaxLabels = 10; ///< Most labels supported: one per digit.
+
+    /**
+     * @brief Constructs an empty model.
+     * @param options The labels and the smoothing.
+     * @throws std::logic_error If there are fewer than two labels, a label is not a digit or is listed twice, or the smoothing is not positive.
+     */
+    explicit LabelModel(const LabelOptions& options);
+
+    /**
+     * @brief Counts the tokens of the records of a training file.
+     *
+     * With more than one thread the records are split into byte ranges on record boundaries and each
+     * range is counted into its own model; the models are then merged in range order, so the ids and
+     * counts do not depend on the thread count.
+     *
+     * @param file The training file; its header line is skipped.
+     * @param numThreads The number of threads to count with (0 uses the hardware concurrency).
+     */
+    void train(const DSString& file, unsigned numThreads = 1);
+
+    /**
+     * @brief Counts the tokens of a compiled corpus (see CorpusCache); the counts equal the ones train() makes.
+     *
+     * Each range of records is counted into an array indexed by corpus id; the arrays are added up in
+     * range order and each counted token gets its row in corpus id order.
+     *
+     * @param corpus The compiled corpus; its label digits pick the rows.
+     * @param numThreads The number of threads to count with (0 uses the hardware concurrency).
+     * @throws std::runtime_error If a token id is out of range.
+     */
+    void trainCorpus(const CorpusCache& corpus, unsigned numThreads = 1);
+
+    /**
+     * @brief Counts the tokens of one tweet.
+     * @param words The tokenized tweet.
+     * @param label The label field of the record.
+     * @return False if the label is not one of labels(); the tweet is then skipped.
+     */
+    bool add(const TokenBuffer& words, std::string_view label);
+
+    /**
+     * @brief Precomputes the log prior of each label and the log probability of each token under each label.
+     *
+     * Anything that adds counts drops them. Must not run while other threads read the model, nor after update().
+     */
+    void finalize();
+
+    /**
+     * @brief Saves the labels, the counts and the tokens; the probabilities are computed again on loading.
+     *
+     * Tweets learned by update() are left out; saveDelta() saves them.
+     *
+     * The file is written next to its destination and renamed over it, so a crash leaves the previous counts.
+     *
+     * @param filename The name of the file to save the counts to.
+     * @throws std::runtime_error If the file cannot be written.
+     */
+    void save(const DSString& filename) const;
+
+    /**
+     * @brief Replaces the counts with those of a file saved by save() with the same labels.
+     *
+     * The model must be finalized again before scoring.
+     *
+     * @param filename The name of the file to load the counts from.
+     * @throws std::runtime_error If the file cannot be read, is corrupt or holds other labels.
+     */
+    void load(const DSString& filename);
+
+    /**
+     * @brief Counts learned tweets on top of the finalized counts and publishes them for scoring.
+     *
+     * The new delta copies only the shards of the tokens the tweets contain, and its priors and
+     * normalizers take one pass over the labels; the finalized rows are left as they are. Other
+     * threads may score meanwhile, each against the delta it pinned. Calls are serialized with each
+     * other and with saveDelta() and loadDelta(). Tweets with other labels are ignored.
+     *
+     * @param records The labeled tweets.
+     * @throws std::logic_error If the model is not finalized.
+     */
+    void update(const std::vector<TrainingRecord>& records);
+
+    /**
+     * @brief Saves the tweets learned by update() or loadDelta(), stamped with the labels and a base model.
+     *
+     * The finalized counts are not written. If the file holds exactly the tweets saved or loaded before
+     * on the same base, only the tweets learned since are appended; otherwise the whole delta is
+     * written next to the file and renamed over it.
+     *
+     * @param filename The name of the delta file.
+     * @param base The stamp of the model file the tweets were learned on (see SentimentModel::stampOf()).
+     * @throws std::runtime_error If the file cannot be written.
+     */
+    void saveDelta(const DSString& filename, const ModelStamp& base);
+
+    /**
+     * @brief Learns the tweets of a file saved by saveDelta() again, if they were learned on the base model with these labels.
+     *
+     * A tweet cut short by a crash is dropped, and the next saveDelta() rewrites the file without it.
+     *
+     * @param filename The name of the delta file.
+     * @param base The stamp of the model file the delta must have been saved on.
+     * @return False if the tweets were learned on another model or with other labels; nothing is learned then.
+     * @throws std::runtime_error If the file cannot be read.
+     * @throws std::logic_error If the model is not finalized.
+     */
+    bool loadDelta(const DSString& filename, const ModelStamp& base);
+
+    /**
+     * @brief Checks if a file holds counts that load() accepts.
+     * @param filename The name of the file.
+     * @param options The labels to compare with, in row order.
+     * @return True if the file exists and holds counts of these labels in this order.
+     */
+    static bool isCompatible(const DSString& filename, const LabelOptions& options);
+
+    /**
+     * @brief Computes the naive Bayes score of every label for a tweet.
+     * @param words The tokenized tweet.
+     * @param scores Receives one unnormalized log posterior per label, in the order of labels().
+     * @throws std::logic_error If the model is not finalized.
+     */
+    void scoreLabels(const TokenBuffer& words, double* scores) const;
+
+    /**
+     * @brief Classifies a tweet.
+     * @param words The tokenized tweet.
+     * @return The label with the highest score.
+     * @throws std::logic_error If the model is not finalized.
+     */
+    int classify(const TokenBuffer& words) const;
+
+    /**
+     * @brief Gets the labels.
+     * @return The labels, in the order of the count rows.
+     */
+    const std::vector<int>& labels() const;
+
+    /**
+     * @brief Counts the distinct tokens.
+     * @return The number of tokens with a row or learned by update().
+     */
+    size_t wordCount() const;
+
+    /**
+     * @brief Counts the records skipped because of their label.
+     * @return The number of records whose label is not one of labels().
+     */
+    size_t skippedRecords() const;
+
+    /**
+     * @brief Gets the memory held by the interner, the counts and the probabilities.
+     * @return The number of bytes.
+     */
+    size_t memoryUsage() const;
+
+private:
+    /**
+     * @struct LearnedRow
+     * @brief Occurrences of a token under each label, learned by update().
+     */
+    struct LearnedRow {
+        uint32_t counts[kMaxLabels] = {}; ///< Occurrences under each label, in row order.
+    };
+
+    /**
+     * @struct Delta
+     * @brief The tweets learned by update(), with the priors and normalizers of all the counts.
+     */
+    struct Delta : DeltaMap<LearnedRow> {
+        std::vector<uint64_t> tweetCounts; ///< Tweets learned under each label.
+        std::vector<uint64_t> tokenCounts; ///< Token occurrences learned under each label.
+        size_t newWords = 0; ///< Learned tokens without a finalized row, which grow the vocabulary.
+        std::vector<double> logPriors; ///< Log prior of each label over the finalized and learned tweets.
+        std::vector<double> logDenominators; ///< Log normalizer of each label's token probabilities over all the counts.
+        std::vector<double> shifts; ///< Added to a finalized log probability of each label to renormalize it.
+    };
+
+    LabelOptions options; ///< Labels and smoothing.
+    int8_t labelIndex[kMaxLabels]; ///< Row position of each digit label, or -1 for labels not listed.
+    TokenInterner words; ///< Dense id of every token.
+    std::vector<uint32_t> counts; ///< Occurrences of each token under each label, one row of labels per id.
+    std::vector<float> logLikelihoods; ///< Log probabilities from finalize(), packed like the counts.
+    std::vector<uint64_t> tweetCounts; ///< Tweets of each label.
+    std::vector<uint64_t> tokenCounts; ///< Token occurrences of each label.
+    std::vector<double> logPriors; ///< Log prior of each label from finalize().
+    std::vector<double> logDenominators; ///< Log normalizer of each label's token probabilities from finalize().
+    size_t skipped; ///< Records skipped because of their label.
+    bool finalized; ///< Flag set while the probabilities match the counts.
+
+    std::shared_ptr<const Delta> delta; ///< Tweets learned by update(); accessed with std::atomic_load/atomic_store.
+    std::atomic<bool> hasDelta; ///< Flag set once a delta is published, so scoring skips the atomic load until then.
+    std::mutex updateMutex; ///< Serializes update(), saveDelta() and loadDelta().
+    std::string learnedTweets; ///< Records of the tweets learned by update() or loadDelta(), guarded by updateMutex.
+    DSString deltaFile; ///< File the records were last saved to or loaded from, empty if none.
+    ModelStamp deltaBase; ///< Base model stamp of deltaFile.
+    uint64_t deltaFileSize; ///< Bytes of deltaFile written or read by this model.
+
+    /**
+     * @brief Gets the row position of a label field.
+     * @param label The label field.
+     * @return Its position in labels(), or -1 if it is not one of them.
+     */
+    int indexOf(std::string_view label) const;
+
+    /**
+     * @brief Gets the id of a token, adding a row of zero counts if it is new.
+     * @param token The token.
+     * @return Its id.
+     */
+    uint32_t idOf(std::string_view token);
+
+    /**
+     * @brief Counts learned tweets into a new delta and publishes it; the caller holds updateMutex.
+     * @param records The labeled tweets.
+     */
+    void learnRecords(const std::vector<TrainingRecord>& records);
+
+    /**
+     * @brief Computes the priors, normalizers and shifts of a delta from its totals and the finalized ones.
+     * @param next The delta being built.
+     */
+    void rescore(Delta& next) const;
+
+    /**
+     * @brief Pins the published delta.
+     * @return The delta, or nullptr if nothing was learned.
+     */
+    std::shared_ptr<const Delta> deltaSnapshot() const;
+
+    /**
+     * @brief Adds the counts of a model with the same labels, in its id order.
+     * @param other The model to add.
+     */
+    void merge(const LabelModel& other);
+
+    /**
+     * @brief Counts the tokens of the records of a byte range of a mapped training file.
+     * @param begin The first byte of the range; must be the start of a record.
+     * @param end One past the last byte of the range.
+     */
+    void trainRange(char* begin, char* end);
+};
+
+#endif // LABEL_MODEL_H // End of include guard
@@ -0,0 +1,177 @@
+#include "Metrics.h" // Include the Metrics header file
+#include <algorithm> // Include algorithm for removing retired shards
+#include <fstream> // Include fstream for dumping to a file
+#include <mutex> // Include mutex for the shard registry
+#include <sstream> // Include sstream for formatting the exports
+#include <stdexcept> // Include stdexcept for std::runtime_error
+#include <vector> // Include vector for the live shards
+
+namespace {
+struct Description { const char* name; const char* help; }; // Exported name and help text of a metric
+
+const Description kCounterDescriptions[Metrics::kCounters] = { // Indexed by Counter
+    {"tweets_classified", "Tweets classified."},
+    {"score_fallbacks", "Tweets whose log-odds sum was zero, so the sentiment score decided."},
+    {"neutral_tweets", "Tweets classified neutral because both sums were zero."},
+    {"trie_lookups", "Words scored against the trie."},
+    {"trie_hits", "Scored words seen in training."},
+    {"trie_misses", "Scored words never seen in training."},
+    {"trie_nodes_visited", "Trie nodes visited by the scoring lookups, root included."},
+    {"delta_hits", "Scored words found in the incremental updates."},
+    {"records_trained", "Training records folded into the trie."},
+    {"tokens_trained", "Tokens inserted by training."},
+};
+
+const Description kHistogramDescriptions[Metrics::kHistograms] = { // Indexed by Histogram
+    {"tokens_per_tweet", "Tokens of each classified tweet."},
+};
+} // namespace
+
+struct Metrics::Registry { // Live shards and the totals of retired ones
+    std::mutex mutex; // Mutex protecting the registry
+    std::vector<Shard*> live; // Shards of the running threads
+    Shard retired; // Values of the threads that have exited
+};
+
+class Metrics::ShardOwner { // Owns one thread's shard
+public:
+    ShardOwner() { // Register the shard
+        Registry& shards = registry(); // Get the registry
+        std::lock_guard<std::mutex> lock(shards.mutex); // Lock the registry
+        shards.live.push_back(&shard); // Make the shard visible to snapshot()
+    }
+
+    ~ShardOwner() { // Fold the shard into the retired totals as the thread exits
+        Registry& shards = registry(); // Get the registry
+        std::lock_guard<std::mutex> lock(shards.mutex); // Lock the registry
+        for (size_t c = 0; c < kCounters; ++c) shards.retired.counters[c] += shard.counters[c].load(std::memory_order_relaxed); // Keep the counters
+        for (size_t h = 0; h < kHistograms; ++h) { // Loop through each histogram
+            for (size_t b = 0; b < kBuckets; ++b) shards.retired.buckets[h][b] += shard.buckets[h][b].load(std::memory_order_relaxed); // Keep the buckets
+            shards.retired.sums[h] += shard.sums[h].load(std::memory_order_relaxed); // Keep the sum
+        }
+        shards.live.erase(std::remove(shards.live.begin(), shards.live.end(), &shard), shards.live.end()); // Unregister the shard
+        localShard = nullptr; // A late recording registers a new shard instead of using this one
+    }
+
+    Shard shard; // The thread's values
+};
+
+std::atomic<bool> Metrics::enabledFlag(false); // Collection starts off
+
+void Metrics::setEnabled(bool enable) { // Turn collection on or off
+    enabledFlag.store(compiled() && enable, std::memory_order_relaxed); // Stay off if compiled out
+}
+
+Metrics::Registry& Metrics::registry() { // Get the registry of shards
+    static Registry shards; // Created on first use, destroyed after every thread-local shard
+    return shards; // Return the registry
+}
+
+thread_local Metrics::Shard* Metrics::localShard = nullptr; // Set by registerThread()
+
+Metrics::Shard& Metrics::registerThread() { // Create and register the calling thread's shard
+    thread_local ShardOwner owner; // Registered here, retired when the thread exits
+    localShard = &owner.shard; // Skip this function from now on
+    return owner.shard; // Return the shard
+}
+
+Metrics::Snapshot Metrics::snapshot() { // Merge every shard
+    Snapshot values; // Declare the merged values, all zero
+    Registry& shards = registry(); // Get the registry
+    std::lock_guard<std::mutex> lock(shards.mutex); // Keep threads from exiting while their shards are read
+    auto merge = [&values](const Shard& shard) { // Add one shard to the merged values
+        for (size_t c = 0; c < kCounters; ++c) values.counters[c] += shard.counters[c].load(std::memory_order_relaxed); // Add the counters
+        for (size_t h = 0; h < kHistograms; ++h) { // Loop through each histogram
+            for (size_t b = 0; b < kBuckets; ++b) values.buckets[h][b] += shard.buckets[h][b].load(std::memory_order_relaxed); // Add the buckets
+            values.sums[h] += shard.sums[h].load(std::memory_order_relaxed); // Add the sum
+        }
+    };
+    merge(shards.retired); // Add the threads that have exited
+    for (const Shard* shard : shards.live) merge(*shard); // Add the running threads
+    return values; // Return the merged values
+}
+
+void Metrics::reset() { // Zero every counter and histogram
+    Registry& shards = registry(); // Get the registry
+    std::lock_guard<std::mutex> lock(shards.mutex); // Lock the registry
+    auto clear = [](Shard& shard) { // Zero one shard
+        for (auto& counter : shard.counters) counter.store(0, std::memory_order_relaxed); // Zero the counters
+        for (auto& buckets : shard.buckets) { // Loop through each histogram
+            for (auto& bucket : buckets) bucket.store(0, std::memory_order_relaxed); // Zero the buckets
+        }
+        for (auto& sum : shard.sums) sum.store(0, std::memory_order_relaxed); // Zero the sums
+    };
+    clear(shards.retired); // Zero the retired totals
+    for (Shard* shard : shards.live) clear(*shard); // Zero the running threads
+}
+
+const char* Metrics::nameOf(Counter counter) { // Get the exported name of a counter
+    return kCounterDescriptions[static_cast<size_t>(counter)].name; // Look it up
+}
+
+const char* Metrics::nameOf(Histogram histogram) { // Get the exported name of a histogram
+    return kHistogramDescriptions[static_cast<size_t>(histogram)].name; // Look it up
+}
+
+uint64_t Metrics::upperBound(size_t bucket) { // Get the largest value a bucket holds
+    if (bucket + 1 >= kBuckets) return UINT64_MAX; // The last bucket is unbounded
+    return (uint64_t(1) << bucket) - 1; // Bucket b holds the values with b significant bits
+}
+
+std::string Metrics::toJson(const Snapshot& values) { // Format a snapshot as JSON
+    std::ostringstream out; // Declare the output
+    out << "{\n  \"counters\": {"; // Open the counters
+    for (size_t c = 0; c < kCounters; ++c) { // Loop through each counter
+        out << (c == 0 ? "\n" : ",\n") << "    \"" << kCounterDescriptions[c].name << "\": " << values.counters[c]; // Write the counter
+    }
+    out << "\n  },\n  \"histograms\": {"; // Close the counters and open the histograms
+    for (size_t h = 0; h < kHistograms; ++h) { // Loop through each histogram
+        uint64_t count = 0; // Observations so far, making the buckets cumulative like Prometheus
+        out << (h == 0 ? "\n" : ",\n") << "    \"" << kHistogramDescriptions[h].name << "\": {\"buckets\": ["; // Open the histogram
+        for (size_t b = 0; b < kBuckets; ++b) { // Loop through each bucket
+            count += values.buckets[h][b]; // Accumulate the bucket
+            out << (b == 0 ? "" : ", ") << "{\"le\": "; // Open the bucket
+            if (b + 1 == kBuckets) out << "\"+Inf\""; // The last bucket is unbounded
+            else out << upperBound(b); // Write the bound
+            out << ", \"count\": " << count << "}"; // Write the cumulative count
+        }
+        out << "], \"sum\": " << values.sums[h] << ", \"count\": " << count << "}"; // Close the histogram
+    }
+    out << "\n  }\n}\n"; // Close the histograms and the object
+    return out.str(); // Return the text
+}
+
+std::string Metrics::toPrometheus(const Snapshot& values) { // Format a snapshot in the Prometheus text format
+    std::ostringstream out; // Declare the output
+    for (size_t c = 0; c < kCounters; ++c) { // Loop through each counter
+        const Description& counter = kCounterDescriptions[c]; // Get its name and help
+        out << "# HELP sentiment_" << counter.name << "_total " << counter.help << "\n"; // Write the help line
+        out << "# TYPE sentiment_" << counter.name << "_total counter\n"; // Write the type line
+        out << "sentiment_" << counter.name << "_total " << values.counters[c] << "\n"; // Write the value
+    }
+    for (size_t h = 0; h < kHistograms; ++h) { // Loop through each histogram
+        const Description& histogram = kHistogramDescriptions[h]; // Get its name and help
+        out << "# HELP sentiment_" << histogram.name << " " << histogram.help << "\n"; // Write the help line
+        out << "# TYPE sentiment_" << histogram.name << " histogram\n"; // Write the type line
+        uint64_t count = 0; // Cumulative observations
+        for (size_t b = 0; b < kBuckets; ++b) { // Loop through each bucket
+            count += values.buckets[h][b]; // Accumulate the bucket
+            out << "sentiment_" << histogram.name << "_bucket{le=\""; // Open the bucket line
+            if (b + 1 == kBuckets) out << "+Inf"; // The last bucket is unbounded
+            else out << upperBound(b); // Write the bound
+            out << "\"} " << count << "\n"; // Write the cumulative count
+        }
+        out << "sentiment_" << histogram.name << "_sum " << values.sums[h] << "\n"; // Write the sum
+        out << "sentiment_" << histogram.name << "_count " << count << "\n"; // Write the count
+    }
+    return out.str(); // Return the text
+}
+
+void Metrics::dump(const std::string& filename) { // Write the current values to a file
+    bool json = filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".json") == 0; // Pick the format from the extension
+    Snapshot values = snapshot(); // Merge the shards
+    std::ofstream out(filename); // Open the file
+    if (!out) throw std::runtime_error("Could not open metrics file " + filename); // Report failure to open it
+    out << (json ? toJson(values) : toPrometheus(values)); // Write the values
+    if (!out) throw std::runtime_error("Could not write metrics file " + filename); // Report a failed write
+}
@@ -0,0 +1,204 @@
+#ifndef METRICS_H // Include guard to prevent multiple inclusions
+#define METRICS_H // Define the include guard
+
+#include <atomic> // Include atomic for the run-time switch and the shard slots
+#include <cstddef> // Include cstddef for size_t
+#include <cstdint> // Include cstdint for fixed-width counters
+#include <string> // Include string for the exported text
+
+#ifndef SENTIMENT_METRICS // If the build did not choose
+#define SENTIMENT_METRICS 1 // Compile the metrics in; they stay off until enabled at run time
+#endif
+
+/**
+ * @brief Counters collected on the hot paths.
+ */
+enum class Counter {
+    TweetsClassified, ///< Tweets classified by SentimentAnalyzer::classify.
+    ScoreFallbacks, ///< Tweets whose log-odds sum was zero, so the sentiment score decided.
+    NeutralTweets, ///< Tweets classified neutral (2) because both sums were zero.
+    TrieLookups, ///< Words scored by the model's getScores.
+    TrieHits, ///< Scored words seen in training (non-zero counts).
+    TrieMisses, ///< Scored words never seen in training.
+    TrieNodesVisited, ///< Trie nodes visited by the scoring lookups, root included (trie backend only).
+    DeltaHits, ///< Scored words found in the incremental delta.
+    RecordsTrained, ///< Training records folded into the trie.
+    TokensTrained, ///< Tokens inserted by training.
+    Count ///< Number of counters; not a counter.
+};
+
+/**
+ * @brief Histograms collected on the hot paths.
+ */
+enum class Histogram {
+    TokensPerTweet, ///< Tokens of each classified tweet.
+    Count ///< Number of histograms; not a histogram.
+};
+
+/**
+ * @class Metrics
+ * @brief Process-wide counters and histograms, kept per thread and merged when read.
+ *
+ * Every thread that records gets its own shard on first use, so recording never contends: it is a
+ * relaxed load and store on a slot only that thread writes. A shard is folded into the retired totals
+ * when its thread exits, so nothing recorded by short-lived threads is lost.
+ *
+ * Collection is off until setEnabled(true); while off, recording costs one relaxed load and a branch.
+ * Building with SENTIMENT_METRICS=0 compiles the recording out entirely.
+ */
+class Metrics {
+public:
+    static const size_t kCounters = static_cast<size_t>(Counter::Count); ///< Number of counters.
+    static const size_t kHistograms = static_cast<size_t>(Histogram::Count); ///< Number of histograms.
+    static const size_t kBuckets = 16; ///< Histogram buckets: 0, 1, 2-3, 4-7, ..., and everything from 2^14 up.
+
+    /**
+     * @brief Merged values of every counter and histogram.
+     */
+    struct Snapshot {
+        uint64_t counters[kCounters] = {}; ///< Value of each counter.
+        uint64_t buckets[kHistograms][kBuckets] = {}; ///< Observations in each bucket of each histogram.
+        uint64_t sums[kHistograms] = {}; ///< Sum of the observations of each histogram.
+    };
+
+    /**
+     * @brief Checks whether the metrics are compiled in.
+     * @return False if the build set SENTIMENT_METRICS to 0.
+     */
+    static constexpr bool compiled() { return SENTIMENT_METRICS != 0; }
+
+    /**
+     * @brief Checks whether the metrics are being collected.
+     * @return True if compiled in and enabled.
+     */
+    static bool enabled() { return compiled() && enabledFlag.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Turns collection on or off. Has no effect if the metrics are compiled out.
+     * @param enable Whether to collect.
+     */
+    static void setEnabled(bool enable);
+
+    /**
+     * @brief Adds to a counter of the calling thread.
+     * @param counter The counter.
+     * @param amount The amount to add.
+     */
+    static void add(Counter counter, uint64_t amount = 1) {
+        if (!enabled()) return; // Nothing to do while off
+        std::atomic<uint64_t>& slot = shard().counters[static_cast<size_t>(counter)]; // Get the thread's slot
+        slot.store(slot.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed); // Only this thread writes it
+    }
+
+    /**
+     * @brief Records an observation in a histogram of the calling thread.
+     * @param histogram The histogram.
+     * @param value The observed value.
+     */
+    static void observe(Histogram histogram, uint64_t value) {
+        if (!enabled()) return; // Nothing to do while off
+        Shard& local = shard(); // Get the thread's shard
+        size_t h = static_cast<size_t>(histogram); // Index of the histogram
+        std::atomic<uint64_t>& bucket = local.buckets[h][bucketOf(value)]; // Get the value's bucket
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); // Count the observation
+        local.sums[h].store(local.sums[h].load(std::memory_order_relaxed) + value, std::memory_order_relaxed); // Add it to the sum
+    }
+
+    /**
+     * @brief Merges the shards of every thread, including the threads that have exited.
+     * @return The merged values.
+     */
+    static Snapshot snapshot();
+
+    /**
+     * @brief Zeroes every counter and histogram. Recording threads may race with the reset.
+     */
+    static void reset();
+
+    /**
+     * @brief Formats a snapshot as a JSON object.
+     * @param values The merged values.
+     * @return The JSON text.
+     */
+    static std::string toJson(const Snapshot& values);
+
+    /**
+     * @brief Formats a snapshot in the Prometheus text exposition format.
+     * @param values The merged values.
+     * @return The exposition text.
+     */
+    static std::string toPrometheus(const Snapshot& values);
+
+    /**
+     * @brief Writes the current values to a file, as JSON if its name ends in ".json" and in the Prometheus text format otherwise.
+     * @param filename The file to write.
+     * @throws std::runtime_error If the file cannot be written.
+     */
+    static void dump(const std::string& filename);
+
+    /**
+     * @brief Gets the exported name of a counter.
+     * @param counter The counter.
+     * @return A snake_case name, e.g. "trie_hits".
+     */
+    static const char* nameOf(Counter counter);
+
+    /**
+     * @brief Gets the exported name of a histogram.
+     * @param histogram The histogram.
+     * @return A snake_case name, e.g. "tokens_per_tweet".
+     */
+    static const char* nameOf(Histogram histogram);
+
+    /**
+     * @brief Gets the largest value a histogram bucket holds.
+     * @param bucket The bucket index.
+     * @return The bucket's inclusive upper bound (UINT64_MAX for the last bucket).
+     */
+    static uint64_t upperBound(size_t bucket);
+
+private:
+    struct Shard { // Values recorded by one thread
+        std::atomic<uint64_t> counters[kCounters] = {}; // Value of each counter
+        std::atomic<uint64_t> buckets[kHistograms][kBuckets] = {}; // Observations in each bucket
+        std::atomic<uint64_t> sums[kHistograms] = {}; // Sum of the observations
+    };
+
+    class ShardOwner; // Registers a thread's shard and retires it when the thread exits
+    struct Registry; // Live shards and the totals of retired ones
+
+    static std::atomic<bool> enabledFlag; ///< Run-time switch.
+
+    /**
+     * @brief Gets the registry of shards, created on first use.
+     * @return The registry.
+     */
+    static Registry& registry();
+
+    static thread_local Shard* localShard; ///< The calling thread's shard, null until it first records.
+
+    /**
+     * @brief Gets the calling thread's shard, registering it on first use.
+     * @return The shard.
+     */
+    static Shard& shard() { return localShard != nullptr ? *localShard : registerThread(); }
+
+    /**
+     * @brief Creates and registers the calling thread's shard.
+     * @return The shard.
+     */
+    static Shard& registerThread();
+
+    /**
+     * @brief Gets the histogram bucket of a value.
+     * @param value The observed value.
+     * @return The bucket index.
+     */
+    static size_t bucketOf(uint64_t value) {
+        size_t bits = 0; // Number of significant bits of the value
+        while (value != 0 && bits < kBuckets - 1) { value >>= 1; ++bits; } // Count them, capped at the last bucket
+        return bits; // Return the bucket
+    }
+};
+
+#endif // METRICS_H // End of include guard
@@ -0,0 +1,379 @@
+#include "NGramSketch.h" // Include the NGramSketch header file
+#include "CSVReader.h" // Include CSVReader for memory-mapped CSV parsing
+#include "CompactTrie.h" // Include CompactTrie for the FNV-1a token hash
+#include "CorpusCache.h" // Include CorpusCache for counting a compiled corpus
+#include "ThreadPool.h" // Include ThreadPool for parallel counting
+#include <chrono> // Include the chrono library for timing
+#include <cstdio> // Include cstdio for replacing the sketch file
+#include <cstring> // Include cstring for comparing the signature
+#include <filesystem> // Include filesystem for the delta file's size
+#include <fstream> // Include fstream for saving and loading
+#include <iterator> // Include iterator for reading the learned n-grams
+#include <iostream> // Include iostream for the timing output
+#include <memory> // Include memory for the partial sketches
+#include <stdexcept> // Include stdexcept for std::logic_error and std::runtime_error
+#include <string> // Include string for the temporary file name
+#include <thread> // Include thread for the hardware concurrency
+
+namespace {
+const char kMagic[8] = {'S', 'E', 'N', 'T', 'N', 'G', 'R', 'M'}; // Signature of a sketch file
+const uint32_t kVersion = 2; // Format version of a sketch file; version 1 hashed tokens with std::hash
+const uint32_t kByteOrder = 0x01020304; // Byte order marker, read back differently on a machine of the other endianness
+
+struct FileHeader { // The 32-byte header of a sketch file, followed by the cells
+    char magic[8]; // Signature, kMagic
+    uint32_t version; // Format version, kVersion
+    uint32_t byteOrder; // kByteOrder as written by the producing machine
+    uint32_t order; // Longest n-gram counted
+    uint32_t depth; // Number of rows
+    uint64_t width; // Cells per row
+};
+
+static_assert(sizeof(FileHeader) == 32, "The sketch header must be 32 bytes"); // Keep the layout fixed
+
+const char kDeltaMagic[8] = {'S', 'E', 'N', 'T', 'N', 'G', 'D', 'L'}; // Signature of a learned n-gram file
+const size_t kGramRecordSize = sizeof(uint64_t) + 1; // An n-gram hash followed by one byte, 1 if the tweet was positive
+
+struct DeltaHeader { // The 32-byte header of a learned n-gram file, followed by the records
+    char magic[8]; // Signature, kDeltaMagic
+    uint32_t version; // Format version, kVersion; the records hold hashOf() chains
+    uint32_t order; // Longest n-gram counted
+    uint64_t baseSize; // Size of the base model file
+    uint64_t baseChecksum; // FNV-1a hash of the base model file
+};
+
+static_assert(sizeof(DeltaHeader) == 32, "The n-gram delta header must be 32 bytes"); // Keep the layout fixed
+
+void increment(std::atomic<uint32_t>& count, uint32_t amount) { // Add to a count that only one thread writes
+    count.store(count.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed); // Plain load and store; readers see either value
+}
+
+uint64_t mix(uint64_t hash) { // Spread the bits of a hash (the MurmurHash3 finalizer)
+    hash ^= hash >> 33; // Fold the high bits down
+    hash *= 0xff51afd7ed558ccdULL; // Multiply by the first constant
+    hash ^= hash >> 33; // Fold again
+    hash *= 0xc4ceb9fe1a85ec53ULL; // Multiply by the second constant
+    hash ^= hash >> 33; // Fold a last time
+    return hash; // Return the mixed hash
+}
+
+size_t roundUpToPowerOfTwo(size_t value) { // Round a positive size up to a power of two
+    size_t power = 1; // Start with the smallest power
+    while (power < value) power <<= 1; // Double until it fits
+    return power; // Return the power
+}
+
+bool readHeader(const DSString& filename, FileHeader& header) { // Read and check the fixed part of a sketch file's header
+    std::ifstream file(filename.c_str(), std::ios::binary); // Open the file for reading in binary mode
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) return false; // Fail if it is missing or too short
+    return std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.version == kVersion && header.byteOrder == kByteOrder; // Check the signature, version and byte order
+}
+} // namespace
+
+NGramSketch::NGramSketch(const NGramOptions& options) : shape(options), smoothingAlpha(1.0) { // Constructor for NGramSketch, with zeroed cells and Laplace smoothing
+    if (shape.order < 2 || shape.order > kMaxOrder) { // Check the order
+        throw std::logic_error("N-gram order must be between 2 and 4"); // Throw an error if it is out of range
+    }
+    if (shape.depth < 1 || shape.depth > kMaxDepth || shape.width == 0) { // Check the shape
+        throw std::logic_error("N-gram sketch needs 1 to 8 rows of at least one cell"); // Throw an error if it is out of range
+    }
+    static_assert(sizeof(Cell) == 8 && std::atomic<uint32_t>::is_always_lock_free, "Cells are saved and loaded as two plain 32-bit counts"); // Keep the file layout
+    shape.width = roundUpToPowerOfTwo(shape.width); // Round the rows up so a mask picks the cell
+    std::vector<Cell>(shape.width * shape.depth).swap(cells); // Zero every cell
+}
+
+uint64_t NGramSketch::hashOf(std::string_view token) { // Hash a token
+    return mix(CompactTrie::checksum(token.data(), token.size())); // FNV-1a, spread with the MurmurHash3 finalizer, so saved cells mean the same on every platform
+}
+
+uint64_t NGramSketch::extend(uint64_t gram, uint64_t token) { // Extend an n-gram's hash with the next token
+    return mix(gram) * 0x9e3779b97f4a7c15ULL + token; // Mix the prefix first so the order of the tokens matters
+}
+
+void NGramSketch::addGram(uint64_t gram, bool isPositive) { // Count one n-gram in every row
+    uint64_t hash = mix(gram); // Spread the bits of the n-gram hash
+    uint32_t first = static_cast<uint32_t>(hash); // Low half picks the cell of the first row
+    uint32_t step = static_cast<uint32_t>(hash >> 32) | 1; // High half steps from row to row
+    size_t mask = shape.width - 1; // Mask for picking a cell in a row
+    for (size_t row = 0; row < shape.depth; ++row) { // Loop through each row
+        Cell& cell = cells[row * shape.width + ((first + row * step) & mask)]; // Pick the n-gram's cell in the row
+        increment(cell.totalTweets, 1); // Increment the totalTweets count
+        if (isPositive) increment(cell.positiveSentiments, 1); // Increment the positiveSentiments count
+    }
+}
+
+WordCounts NGramSketch::estimateGram(uint64_t gram) const { // Estimate the counts of one n-gram
+    uint64_t hash = mix(gram); // Spread the bits of the n-gram hash, as addGram does
+    uint32_t first = static_cast<uint32_t>(hash); // Low half picks the cell of the first row
+    uint32_t step = static_cast<uint32_t>(hash >> 32) | 1; // High half steps from row to row
+    size_t mask = shape.width - 1; // Mask for picking a cell in a row
+    const Cell* best = nullptr; // Declare the cell with the smallest tweet count
+    for (size_t row = 0; row < shape.depth; ++row) { // Loop through each row
+        const Cell& cell = cells[row * shape.width + ((first + row * step) & mask)]; // Pick the n-gram's cell in the row
+        if (best == nullptr || cell.totalTweets.load(std::memory_order_relaxed) < best->totalTweets.load(std::memory_order_relaxed)) best = &cell; // Keep the smallest overestimate
+    }
+    WordCounts counts; // Declare the estimate
+    counts.totalTweets = static_cast<int>(best->totalTweets.load(std::memory_order_relaxed)); // Copy the totalTweets count
+    counts.positiveSentiments = static_cast<int>(best->positiveSentiments.load(std::memory_order_relaxed)); // Copy the positiveSentiments count of the same row
+    return counts; // Return the estimate
+}
+
+void NGramSketch::add(const TokenBuffer& words, bool isPositive) { // Count the n-grams of one tweet
+    forEachGram(words.size(), shape.order, [&words](size_t i) { return hashOf(words[i]); }, [&](uint64_t gram) { // Loop through each n-gram
+        addGram(gram, isPositive); // Count it
+    });
+}
+
+void NGramSketch::update(const TokenBuffer& words, bool isPositive) { // Count the n-grams of one learned tweet
+    forEachGram(words.size(), shape.order, [&words](size_t i) { return hashOf(words[i]); }, [&](uint64_t gram) { // Loop through each n-gram
+        addGram(gram, isPositive); // Count it
+        learnedGrams.append(reinterpret_cast<const char*>(&gram), sizeof(gram)); // Record its hash for saveDelta()
+        learnedGrams.push_back(isPositive ? 1 : 0); // Record the label
+    });
+}
+
+void NGramSketch::saveDelta(const DSString& filename, const ModelStamp& base) { // Save the learned n-grams
+    std::error_code error; // Declare the error of the size query; a missing file is rewritten
+    uintmax_t size = std::filesystem::file_size(filename.c_str(), error); // Get the size of the file on disk
+    bool sameBase = base.size == deltaBase.size && base.checksum == deltaBase.checksum; // Check that the file was stamped with this base
+    if (!deltaFile.empty() && filename == deltaFile && sameBase && !error && size == deltaFileSize) { // If the file holds exactly what this sketch saved or loaded
+        size_t saved = static_cast<size_t>(deltaFileSize - sizeof(DeltaHeader)); // Bytes of records already in the file
+        if (saved == learnedGrams.size()) return; // Nothing was learned since
+        std::ofstream file(filename.c_str(), std::ios::binary | std::ios::app); // Open the file for appending in binary mode
+        if (!file.is_open()) { // Check if the file is open
+            throw std::runtime_error("Could not open file for writing"); // Throw an error if the file could not be opened
+        }
+        file.write(learnedGrams.data() + saved, static_cast<std::streamsize>(learnedGrams.size() - saved)); // Append the new records
+        file.close(); // Close the file
+        if (!file) { // Check the write
+            std::filesystem::resize_file(filename.c_str(), deltaFileSize, error); // Cut off the partial records
+            throw std::runtime_error("Error writing n-gram delta file"); // Throw an error if it failed
+        }
+        deltaFileSize = sizeof(DeltaHeader) + learnedGrams.size(); // The file holds every record now
+        return; // The file is up to date
+    }
+
+    DeltaHeader header = DeltaHeader(); // Declare the header, zeroed
+    std::memcpy(header.magic, kDeltaMagic, sizeof(kDeltaMagic)); // Set the signature
+    header.version = kVersion; // Set the format version
+    header.order = shape.order; // Set the order
+    header.baseSize = base.size; // Set the base model's size
+    header.baseChecksum = base.checksum; // Set the base model's checksum
+
+    std::string temporary = std::string(filename) + ".tmp"; // Write next to the destination first
+    std::ofstream file(temporary, std::ios::binary); // Open the temporary file for writing in binary mode
+    if (!file.is_open()) { // Check if the file is open
+        throw std::runtime_error("Could not open file for writing"); // Throw an error if the file could not be opened
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header)); // Write the header
+    file.write(learnedGrams.data(), static_cast<std::streamsize>(learnedGrams.size())); // Write every record
+    file.close(); // Close the file
+    if (!file || std::rename(temporary.c_str(), filename.c_str()) != 0) { // Check the write, then replace the old file
+        std::remove(temporary.c_str()); // Remove the partial file
+        throw std::runtime_error("Error writing n-gram delta file"); // Throw an error if either failed
+    }
+    deltaFile = filename; // Later saves append to this file
+    deltaBase = base; // Remember its stamp
+    deltaFileSize = sizeof(DeltaHeader) + learnedGrams.size(); // Remember its size
+}
+
+bool NGramSketch::loadDelta(const DSString& filename, const ModelStamp& base) { // Count the learned n-grams of a file again
+    std::ifstream file(filename.c_str(), std::ios::binary); // Open the file for reading in binary mode
+    if (!file.is_open()) { // Check if the file is open
+        throw std::runtime_error("Could not open file for reading"); // Throw an error if the file could not be opened
+    }
+    DeltaHeader header; // Declare the header
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, kDeltaMagic, sizeof(kDeltaMagic)) != 0 || header.version != kVersion) { // Read and check the signature and version
+        return false; // Records of another format cannot be counted
+    }
+    if (header.order != shape.order || header.baseSize != base.size || header.baseChecksum != base.checksum) { // If they were learned with another order or on another model
+        return false; // Leave the sketch as it is
+    }
+    std::string records((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()); // Read every record
+    records.resize(records.size() - records.size() % kGramRecordSize); // Drop a record cut short by a crash
+    for (size_t offset = 0; offset < records.size(); offset += kGramRecordSize) { // Loop through each record
+        uint64_t gram; // Declare the n-gram hash
+        std::memcpy(&gram, records.data() + offset, sizeof(gram)); // Read it
+        addGram(gram, records[offset + sizeof(gram)] != 0); // Count the n-gram again
+    }
+    learnedGrams += records; // Keep the records for later saves
+    deltaFile = filename; // Later saves append to this file
+    deltaBase = base; // Remember its stamp
+    deltaFileSize = sizeof(DeltaHeader) + records.size(); // Remember the size of the records read
+    return true; // The records were counted
+}
+
+WordScores NGramSketch::sumScores(const TokenBuffer& words) const { // Sum both scores of the known n-grams of a tweet
+    WordScores sums; // Initialize both sums to zero
+    int minCount = static_cast<int>(shape.minCount); // Get the count an n-gram needs
+    forEachGram(words.size(), shape.order, [&words](size_t i) { return hashOf(words[i]); }, [&](uint64_t gram) { // Loop through each n-gram
+        WordCounts counts = estimateGram(gram); // Estimate its counts
+        if (counts.totalTweets < minCount) return; // Skip rare n-grams
+        WordScores scores = SentimentModel::scoresOf(counts, smoothingAlpha); // Compute both scores with the model's smoothing
+        sums.logOdds += scores.logOdds; // Add the log-odds ratio of the n-gram to the sum
+        sums.sentimentScore += scores.sentimentScore; // Add the sentiment score of the n-gram to the sum
+    });
+    return sums; // Return both sums
+}
+
+void NGramSketch::merge(const NGramSketch& other) { // Add the cells of a sketch of the same shape
+    for (size_t i = 0; i < cells.size(); ++i) { // Loop through each cell
+        increment(cells[i].totalTweets, other.cells[i].totalTweets.load(std::memory_order_relaxed)); // Add the totalTweets count
+        increment(cells[i].positiveSentiments, other.cells[i].positiveSentiments.load(std::memory_order_relaxed)); // Add the positiveSentiments count
+    }
+}
+
+void NGramSketch::trainRange(char* begin, char* end) { // Count the n-grams of the records of a byte range
+    CSVReader reader(begin, end); // Declare a reader over the range
+    std::vector<std::string_view> fields; // Declare the field list, reused for every record
+    TokenBuffer tokens; // Declare the token buffer, reused for every record
+    while (reader.next(fields, 6)) { // Read each record; the tweet takes the rest of the record
+        if (fields.size() < 6) continue; // Skip records with missing fields
+        Tokenizer::tokenize(fields[5], tokens); // Tokenize the tweet into words
+        add(tokens, fields[0] == "4"); // Count its n-grams; "4" is positive
+    }
+}
+
+void NGramSketch::train(const DSString& file, unsigned numThreads) { // Count the n-grams of a training file
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing
+
+    if (numThreads == 0) { // If the caller asked for the hardware concurrency
+        numThreads = std::max(1u, std::thread::hardware_concurrency()); // Use every core, but at least one thread
+    }
+
+    MappedFile mapped(file); // Map the training file into memory
+    CSVReader header(mapped.data(), mapped.data() + mapped.size()); // Declare a reader for the header line
+    header.skip(); // Skip the header line
+    char* first = const_cast<char*>(header.position()); // Get the start of the first record
+    std::vector<char*> bounds = SentimentModel::splitRanges(first, mapped.data() + mapped.size(), numThreads, 6); // Split the records into byte ranges, read with six fields
+    size_t numRanges = bounds.size() - 1; // Get the number of ranges actually produced
+
+    if (numRanges == 1) { // If there is only one range
+        trainRange(bounds[0], bounds[1]); // Count in place
+    } else { // If the file was split across several threads
+        std::vector<std::unique_ptr<NGramSketch>> partials; // Declare one partial sketch per range
+        for (size_t i = 0; i < numRanges; ++i) { // Loop through each range
+            partials.emplace_back(new NGramSketch(shape)); // Create the partial sketch for the range
+        }
+        ThreadPool pool(numThreads); // Declare the pool running the counting tasks
+        TaskGroup counting(pool); // Declare the group of counting tasks
+        counting.runEach(numRanges, [&](size_t i) { // Count each range on the pool
+            partials[i]->trainRange(bounds[i], bounds[i + 1]); // Count the range into its partial sketch
+        });
+        counting.wait(); // Wait for every range; rethrows the first failure
+        for (const std::unique_ptr<NGramSketch>& partial : partials) merge(*partial); // Add up the partial sketches
+    }
+
+    auto end = std::chrono::high_resolution_clock::now(); // End timing
+    std::chrono::duration<double> duration = end - start; // Calculate the duration
+    std::cout << "Counting n-grams completed in " << duration.count() << " seconds." << std::endl; // Output the duration
+}
+
+void NGramSketch::trainCorpus(const CorpusCache& corpus, unsigned numThreads) { // Count the n-grams of a compiled corpus
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing
+
+    if (numThreads == 0) { // If the caller asked for the hardware concurrency
+        numThreads = std::max(1u, std::thread::hardware_concurrency()); // Use every core, but at least one thread
+    }
+
+    std::vector<uint64_t> tokenHashes(corpus.vocabularySize()); // Declare the hash of every distinct token
+    for (uint32_t id = 0; id < tokenHashes.size(); ++id) tokenHashes[id] = hashOf(corpus.token(id)); // Hash each token once
+    auto countRecords = [&corpus, &tokenHashes](NGramSketch& sketch, size_t firstRecord, size_t lastRecord) { // Count the n-grams of a range of records
+        for (size_t record = firstRecord; record < lastRecord; ++record) { // Loop through each record
+            std::pair<const uint32_t*, const uint32_t*> ids = corpus.recordIds(record); // Get its ids
+            bool isPositive = corpus.isPositive(record); // Get its label
+            sketch.forEachGram(static_cast<size_t>(ids.second - ids.first), sketch.shape.order, [&](size_t i) { // Loop through each n-gram
+                uint32_t id = ids.first[i]; // Get the token's id
+                if (id >= tokenHashes.size()) throw std::runtime_error("Corpus cache token id is out of range"); // Check it against the vocabulary
+                return tokenHashes[id]; // Return the token's hash
+            }, [&](uint64_t gram) {
+                sketch.addGram(gram, isPositive); // Count the n-gram
+            });
+        }
+    };
+
+    size_t numRecords = corpus.records(); // Get the number of records
+    size_t numRanges = std::max<size_t>(1, std::min<size_t>(numThreads, numRecords)); // Use at most one range per record
+    if (numRanges == 1) { // If there is only one range
+        countRecords(*this, 0, numRecords); // Count in place
+    } else { // If the records are split across several threads
+        std::vector<std::unique_ptr<NGramSketch>> partials; // Declare one partial sketch per range
+        for (size_t i = 0; i < numRanges; ++i) { // Loop through each range
+            partials.emplace_back(new NGramSketch(shape)); // Create the partial sketch for the range
+        }
+        ThreadPool pool(numThreads); // Declare the pool running the counting tasks
+        TaskGroup counting(pool); // Declare the group of counting tasks
+        counting.runEach(numRanges, [&](size_t i) { // Count each range on the pool
+            countRecords(*partials[i], numRecords * i / numRanges, numRecords * (i + 1) / numRanges); // Count the range into its partial sketch
+        });
+        counting.wait(); // Wait for every range; rethrows the first failure
+        for (const std::unique_ptr<NGramSketch>& partial : partials) merge(*partial); // Add up the partial sketches
+    }
+
+    auto end = std::chrono::high_resolution_clock::now(); // End timing
+    std::chrono::duration<double> duration = end - start; // Calculate the duration
+    std::cout << "Counting n-grams completed in " << duration.count() << " seconds." << std::endl; // Output the duration
+}
+
+void NGramSketch::save(const DSString& filename) const { // Save the sketch to a file
+    FileHeader header = FileHeader(); // Declare the header, zeroed
+    std::memcpy(header.magic, kMagic, sizeof(kMagic)); // Set the signature
+    header.version = kVersion; // Set the format version
+    header.byteOrder = kByteOrder; // Set the byte order marker
+    header.order = shape.order; // Set the order
+    header.depth = shape.depth; // Set the number of rows
+    header.width = shape.width; // Set the cells per row
+
+    std::string temporary = std::string(filename) + ".tmp"; // Write next to the destination first
+    std::ofstream file(temporary, std::ios::binary); // Open the temporary file for writing in binary mode
+    if (!file.is_open()) { // Check if the file is open
+        throw std::runtime_error("Could not open file for writing"); // Throw an error if the file could not be opened
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header)); // Write the header
+    file.write(reinterpret_cast<const char*>(cells.data()), static_cast<std::streamsize>(cells.size() * sizeof(Cell))); // Write the cells
+    file.close(); // Close the file
+    if (!file || std::rename(temporary.c_str(), filename.c_str()) != 0) { // Check the write, then replace the old sketch
+        std::remove(temporary.c_str()); // Remove the partial file
+        throw std::runtime_error("Error writing n-gram sketch file"); // Throw an error if either failed
+    }
+}
+
+bool NGramSketch::isCompatible(const DSString& filename, const NGramOptions& options) { // Check if a file holds a sketch of this order and shape
+    FileHeader header; // Declare the file's header
+    if (!readHeader(filename, header)) return false; // A missing or foreign file is never compatible
+    return options.width > 0 && header.order == options.order && header.depth == options.depth && header.width == roundUpToPowerOfTwo(options.width); // Compare the order and shape
+}
+
+void NGramSketch::load(const DSString& filename) { // Load the cells of a saved sketch
+    std::ifstream file(filename.c_str(), std::ios::binary); // Open the file for reading in binary mode
+    if (!file.is_open()) { // Check if the file is open
+        throw std::runtime_error("Could not open file for reading"); // Throw an error if the file could not be opened
+    }
+    FileHeader header; // Declare the file's header
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || // Read the header and check the signature
+        header.version != kVersion || header.byteOrder != kByteOrder) { // Check the version and byte order
+        throw std::runtime_error("Not an n-gram sketch file"); // Throw an error if any differs
+    }
+    if (header.order != shape.order || header.depth != shape.depth || header.width != shape.width) { // Check the order and shape
+        throw std::runtime_error("N-gram sketch file has another order or shape"); // Throw an error if they differ
+    }
+    if (!file.read(reinterpret_cast<char*>(cells.data()), static_cast<std::streamsize>(cells.size() * sizeof(Cell))) || file.peek() != std::ifstream::traits_type::eof()) { // Read the cells and check that nothing follows
+        throw std::runtime_error("N-gram sketch file is truncated"); // Throw an error if the size is wrong
+    }
+}
+
+void NGramSketch::setSmoothing(double alpha) { // Set the smoothing of the n-grams' scores
+    smoothingAlpha = alpha; // Scores are computed per lookup, so nothing is cached
+}
+
+double NGramSketch::smoothing() const { // Get the smoothing of the n-grams' scores
+    return smoothingAlpha; // Return the smoothing
+}
+
+const NGramOptions& NGramSketch::options() const { // Get the order and shape of the sketch
+    return shape; // Return the options
+}
+
+size_t NGramSketch::memoryUsage() const { // Get the memory held by the cells
+    return cells.capacity() * sizeof(Cell); // Count the bytes of the cells
+}
@@ -0,0 +1,255 @@
+#ifndef NGRAM_SKETCH_H // Include guard to prevent multiple inclusions
+#define NGRAM_SKETCH_H // Define the include guard
+
+#include "DSString.h" // Include DSString for file names
+#include "SentimentModel.h" // Include SentimentModel for the counts and scores
+#include "Tokenizer.h" // Include Tokenizer for the token buffer
+#include <algorithm> // Include algorithm for std::min
+#include <atomic> // Include atomic for cells read while learn() counts
+#include <cstddef> // Include cstddef for size_t
+#include <cstdint> // Include cstdint for the hashes and cells
+#include <string> // Include string for the learned n-gram records
+#include <vector> // Include vector for the cells
+
+class CorpusCache; // Forward declaration of the compiled training corpus
+
+/**
+ * @struct NGramOptions
+ * @brief The shape of an NGramSketch and the count an n-gram needs before it is scored.
+ */
+struct NGramOptions {
+    unsigned order = 2; ///< Longest n-gram counted: 2 counts bigrams, 3 bigrams and trigrams.
+    size_t width = size_t(1) << 18; ///< Cells per row; rounded up to a power of two.
+    unsigned depth = 4; ///< Rows, each with its own hash of the n-gram.
+    unsigned minCount = 3; ///< N-grams estimated to occur in fewer tweets are not scored.
+};
+
+/**
+ * @class NGramSketch
+ * @brief Counts of the token n-grams of a training corpus in a Count-Min Sketch of fixed size.
+ *
+ * Each n-gram of 2 to order consecutive tokens (negation pairs such as "not good" are one token) is
+ * hashed into one cell of each of depth rows of width cells. A cell holds the tweet count and the
+ * positive count of every n-gram that lands in it, so the row with the smallest tweet count gives
+ * the closest overestimate of an n-gram's counts. Memory is depth * width * 8 bytes whatever the
+ * size of the corpus; collisions only ever inflate counts. N-grams below minCount are not scored,
+ * which keeps rare n-grams, whose estimates are the least reliable, out of the sums.
+ *
+ * Adding is order-independent, so sketches counted on separate ranges are merged by adding their
+ * cells and the result does not depend on the thread count. Lookups are safe from several threads,
+ * also while one thread adds: the cells are relaxed atomics with a single writer, so a lookup may
+ * see an n-gram's counts from just before or just after a tweet was added, never a torn count.
+ */
+class NGramSketch {
+public:
+    static const unsigned kMaxOrder = 4; ///< Longest n-gram supported.
+    static const unsigned kMaxDepth = 8; ///< Most rows supported.
+
+    /**
+     * @brief Constructs an empty sketch.
+     * @param options The order and shape of the sketch, and the count an n-gram needs before it is scored.
+     * @throws std::logic_error If the order is not between 2 and kMaxOrder, the depth not between 1 and kMaxDepth, or the width is zero.
+     */
+    explicit NGramSketch(const NGramOptions& options);
+
+    /**
+     * @brief Counts the n-grams of the records of a training file.
+     *
+     * With more than one thread the records are split into byte ranges on record boundaries and each
+     * range is counted into its own sketch; the sketches are then added up.
+     *
+     * @param file The training file; its header line is skipped.
+     * @param numThreads The number of threads to count with (0 uses the hardware concurrency).
+     */
+    void train(const DSString& file, unsigned numThreads = 1);
+
+    /**
+     * @brief Counts the n-grams of a compiled corpus (see CorpusCache); the sketch equals the one train() builds.
+     * @param corpus The compiled corpus.
+     * @param numThreads The number of threads to count with (0 uses the hardware concurrency).
+     * @throws std::runtime_error If a token id is out of range.
+     */
+    void trainCorpus(const CorpusCache& corpus, unsigned numThreads = 1);
+
+    /**
+     * @brief Counts the n-grams of one tweet.
+     * @param words The tokenized tweet.
+     * @param isPositive Boolean indicating if the tweet is positive.
+     */
+    void add(const TokenBuffer& words, bool isPositive);
+
+    /**
+     * @brief Counts the n-grams of one learned tweet and queues them for saveDelta().
+     *
+     * Other threads may score meanwhile; calls must be serialized with each other and with saveDelta().
+     *
+     * @param words The tokenized tweet.
+     * @param isPositive Boolean indicating if the tweet is positive.
+     */
+    void update(const TokenBuffer& words, bool isPositive);
+
+    /**
+     * @brief Saves the n-grams counted by update() since the base model was built.
+     *
+     * The file holds a header naming the base model and the order, then one record per n-gram: its
+     * hash and whether the tweet was positive. If the file is the one this sketch last saved or
+     * loaded, on the same base and still of the size it left it at, only the records added since are
+     * appended; otherwise every record is written next to the destination and renamed over it.
+     *
+     * @param filename The name of the file to save the records to.
+     * @param base The stamp of the model file the records were learned on (see SentimentModel::stampOf()).
+     * @throws std::runtime_error If the file cannot be written.
+     */
+    void saveDelta(const DSString& filename, const ModelStamp& base);
+
+    /**
+     * @brief Counts the records of a file saved by saveDelta() again, if they were learned on the base model.
+     *
+     * The records are n-gram hashes, so they apply to a sketch of any width and depth. A record cut
+     * short by a crash is dropped, and the next saveDelta() rewrites the file without it.
+     *
+     * @param filename The name of the file to load the records from.
+     * @param base The stamp of the model file loaded as the base.
+     * @return False if the records were learned on another model or with another order; nothing is counted then.
+     * @throws std::runtime_error If the file cannot be read.
+     */
+    bool loadDelta(const DSString& filename, const ModelStamp& base);
+
+    /**
+     * @brief Sums both scores of every n-gram of a tweet that reaches the minimum count.
+     * @param words The tokenized tweet.
+     * @return The log-odds sum and the sentiment score sum (zero for a tweet without known n-grams).
+     */
+    WordScores sumScores(const TokenBuffer& words) const;
+
+    /**
+     * @brief Sets the additive smoothing of the n-grams' log odds ratio.
+     *
+     * Must not run while other threads score.
+     *
+     * @param alpha The count added to both the positive and the negative count (1 is Laplace smoothing).
+     */
+    void setSmoothing(double alpha);
+
+    /**
+     * @brief Gets the additive smoothing of the n-grams' log odds ratio.
+     * @return The smoothing count.
+     */
+    double smoothing() const;
+
+    /**
+     * @brief Saves the cells with the order and shape of the sketch.
+     *
+     * The file is written next to its destination and renamed over it, so a crash leaves the previous sketch.
+     *
+     * @param filename The name of the file to save the sketch to.
+     * @throws std::runtime_error If the file cannot be written.
+     */
+    void save(const DSString& filename) const;
+
+    /**
+     * @brief Loads the cells of a sketch saved by save() with the same order and shape.
+     * @param filename The name of the file to load the sketch from.
+     * @throws std::runtime_error If the file cannot be read or holds a sketch of another order or shape.
+     */
+    void load(const DSString& filename);
+
+    /**
+     * @brief Checks if a file holds a sketch that load() accepts.
+     * @param filename The name of the file.
+     * @param options The order and shape to compare with.
+     * @return True if the file exists and holds a sketch of this order and shape.
+     */
+    static bool isCompatible(const DSString& filename, const NGramOptions& options);
+
+    /**
+     * @brief Gets the order and shape of the sketch.
+     * @return The options, with the width rounded up to a power of two.
+     */
+    const NGramOptions& options() const;
+
+    /**
+     * @brief Gets the memory held by the cells.
+     * @return The number of bytes of the cells.
+     */
+    size_t memoryUsage() const;
+
+private:
+    struct Cell { // Counts of every n-gram hashed into one position of a row
+        std::atomic<uint32_t> totalTweets{0}; // Tweets those n-grams appeared in
+        std::atomic<uint32_t> positiveSentiments{0}; // Positive tweets those n-grams appeared in
+    };
+
+    NGramOptions shape; ///< Order, shape and minimum count; the width is a power of two.
+    std::vector<Cell> cells; ///< Rows of width cells, back to back.
+    std::string learnedGrams; ///< Records of the n-grams counted by update() or loadDelta().
+    DSString deltaFile; ///< The delta file last saved or loaded.
+    ModelStamp deltaBase; ///< The base stamp of deltaFile.
+    uint64_t deltaFileSize = 0; ///< The size deltaFile was left at.
+    double smoothingAlpha; ///< Additive smoothing of the log odds ratio; not saved with the cells.
+
+    /**
+     * @brief Hashes a token with a hash that does not depend on the standard library.
+     * @param token The token.
+     * @return Its hash; extend() chains token hashes into n-gram hashes.
+     */
+    static uint64_t hashOf(std::string_view token);
+
+    /**
+     * @brief Extends the hash of an n-gram with the token that follows it.
+     * @param gram The hash of the n-gram (for a single token, its hashOf()).
+     * @param token The hashOf() of the next token.
+     * @return The hash of the longer n-gram; the order of the tokens matters.
+     */
+    static uint64_t extend(uint64_t gram, uint64_t token);
+
+    /**
+     * @brief Visits the hash of every n-gram of 2 to order tokens of a token sequence.
+     * @param count The number of tokens.
+     * @param order The longest n-gram.
+     * @param hashAt Returns the hashOf() of the token at a position.
+     * @param visit Called with the hash of each n-gram.
+     */
+    template <typename HashAt, typename Visit>
+    static void forEachGram(size_t count, unsigned order, HashAt hashAt, Visit visit) {
+        uint64_t grams[kMaxOrder]; // Hashes of the n-grams ending at the previous token, by length minus one
+        for (size_t i = 0; i < count; ++i) { // Loop through each token
+            uint64_t token = hashAt(i); // Hash the token
+            size_t longest = std::min<size_t>(order, i + 1); // Longest n-gram ending at the token
+            for (size_t k = longest - 1; k >= 1; --k) { // Loop through the lengths, longest first so shorter prefixes are still unchanged
+                grams[k] = extend(grams[k - 1], token); // Extend the shorter n-gram ending at the previous token
+                visit(grams[k]); // Visit the n-gram
+            }
+            grams[0] = token; // The token is the 1-gram ending here
+        }
+    }
+
+    /**
+     * @brief Counts one n-gram in every row.
+     * @param gram The hash of the n-gram.
+     * @param isPositive Boolean indicating if the tweet is positive.
+     */
+    void addGram(uint64_t gram, bool isPositive);
+
+    /**
+     * @brief Estimates the counts of one n-gram.
+     * @param gram The hash of the n-gram.
+     * @return The counts of the row with the smallest tweet count; never below the true counts.
+     */
+    WordCounts estimateGram(uint64_t gram) const;
+
+    /**
+     * @brief Adds the cells of a sketch of the same shape.
+     * @param other The sketch to add.
+     */
+    void merge(const NGramSketch& other);
+
+    /**
+     * @brief Counts the n-grams of the records of a byte range of a mapped training file.
+     * @param begin The first byte of the range; must be the start of a record.
+     * @param end One past the last byte of the range.
+     */
+    void trainRange(char* begin, char* end);
+};
+
+#endif // NGRAM_SKETCH_H // End of include guard
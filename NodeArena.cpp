@@ -0,0 +1,48 @@
+#include "NodeArena.h" // Include the NodeArena header file
+#include <algorithm> // Include algorithm for std::max and std::min
+#include <new> // Include new for operator new
+
+namespace {
+const size_t kFirstChunk = 64 * 1024; // Size of the first chunk
+const size_t kMaxChunk = 16 * 1024 * 1024; // Chunks double up to this size
+} // namespace
+
+NodeArena::NodeArena() : cursor(nullptr), limit(nullptr), nextChunk(kFirstChunk), reserved(0), concurrent(false) {} // Construct an empty arena
+
+NodeArena::~NodeArena() { // Free every chunk
+    release(); // Return the chunks to the heap
+}
+
+void NodeArena::release() { // Free every chunk
+    for (char* chunk : chunks) ::operator delete(chunk); // Free the chunk
+    chunks.clear(); // Forget the chunks
+    cursor = limit = nullptr; // No chunk is current
+    nextChunk = kFirstChunk; // Start small again
+    reserved = 0; // Nothing is held
+}
+
+void NodeArena::setConcurrent(bool enable) { // Turn synchronized allocation on or off
+    concurrent = enable; // Record the mode
+}
+
+size_t NodeArena::bytesReserved() const { // Get the total size of the chunks
+    return reserved; // Return the total
+}
+
+void* NodeArena::grow(size_t bytes, size_t alignment) { // Add a chunk and carve an allocation from it
+    size_t size = std::max(nextChunk, bytes + alignment); // Make room for an oversized allocation
+    chunks.reserve(chunks.size() + 1); // Make room in the list first, so a failure cannot leak the chunk
+    char* chunk = static_cast<char*>(::operator new(size)); // Allocate the chunk
+    chunks.push_back(chunk); // Keep it for release()
+    reserved += size; // Count it
+    nextChunk = std::min(nextChunk * 2, kMaxChunk); // Grow the next chunk
+    cursor = chunk; // Start carving from the new chunk
+    limit = chunk + size; // End of the new chunk
+    return bump(bytes, alignment); // Carve the allocation
+}
+
+void NodeArena::do_deallocate(void*, size_t, size_t) {} // Memory returns to the heap on release
+
+bool NodeArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept { // Compare resources
+    return this == &other; // Only the same arena can free its memory
+}
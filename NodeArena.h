@@ -0,0 +1,119 @@
+#ifndef NODE_ARENA_H // Include guard to prevent multiple inclusions
+#define NODE_ARENA_H // Define the include guard
+
+#include <cstddef> // Include cstddef for size_t
+#include <cstdint> // Include cstdint for aligning addresses
+#include <memory_resource> // Include memory_resource for the polymorphic allocator interface
+#include <mutex> // Include mutex for concurrent allocation
+#include <vector> // Include vector for the chunk list
+
+/**
+ * @class NodeArena
+ * @brief A bump allocator for trie nodes and their child maps.
+ *
+ * Memory comes from a few large chunks that grow geometrically up to a cap. Deallocation is a no-op, and
+ * release() or the destructor frees every chunk at once, so a trie of any size is torn down in
+ * O(chunks) without visiting its nodes. Objects in the arena are never destroyed, so they must not
+ * own memory from anywhere else; this is why TrieNode's child maps allocate from the same arena.
+ *
+ * Allocation is not synchronized unless setConcurrent(true) is in effect, which is meant for the
+ * short phases where several threads add nodes to one trie.
+ */
+class NodeArena final : public std::pmr::memory_resource {
+public:
+    /**
+     * @brief Constructs an empty arena; the first chunk is allocated on first use.
+     */
+    NodeArena();
+
+    /**
+     * @brief Frees every chunk.
+     */
+    ~NodeArena() override;
+
+    NodeArena(const NodeArena&) = delete; ///< Not copyable; objects in the arena point to it.
+    NodeArena& operator=(const NodeArena&) = delete; ///< Not copyable; objects in the arena point to it.
+
+    /**
+     * @brief Frees every chunk. Everything allocated from the arena becomes invalid.
+     */
+    void release();
+
+    /**
+     * @brief Turns synchronized allocation on or off. Must not be called while other threads allocate.
+     * @param enable Whether several threads may allocate at once.
+     */
+    void setConcurrent(bool enable);
+
+    /**
+     * @brief Gets the number of bytes held in chunks.
+     * @return The total size of the chunks.
+     */
+    size_t bytesReserved() const;
+
+    /**
+     * @brief Carves an allocation from the current chunk without going through the memory_resource interface.
+     * @param bytes The size of the allocation.
+     * @param alignment The alignment of the allocation; at most alignof(std::max_align_t).
+     * @return The allocated memory.
+     */
+    void* allocateDirect(size_t bytes, size_t alignment) {
+        if (concurrent) { // If several threads may allocate
+            std::lock_guard<std::mutex> lock(mutex); // Serialize them
+            return bump(bytes, alignment); // Carve the allocation
+        }
+        return bump(bytes, alignment); // Carve the allocation
+    }
+
+private:
+    std::vector<char*> chunks; ///< Chunks the allocations are carved from.
+    char* cursor; ///< Next free byte of the current chunk.
+    char* limit; ///< One past the last byte of the current chunk.
+    size_t nextChunk; ///< Size of the next chunk.
+    size_t reserved; ///< Total size of the chunks.
+    std::mutex mutex; ///< Mutex serializing allocations while concurrent.
+    bool concurrent; ///< Flag set while several threads may allocate.
+
+    /**
+     * @brief Carves an allocation from the current chunk, adding a chunk if it is full.
+     * @param bytes The size of the allocation.
+     * @param alignment The alignment of the allocation.
+     * @return The allocated memory.
+     */
+    void* bump(size_t bytes, size_t alignment) {
+        uintptr_t address = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1); // Align the cursor
+        if (cursor == nullptr || address + bytes > reinterpret_cast<uintptr_t>(limit)) return grow(bytes, alignment); // Add a chunk if this one is full
+        cursor = reinterpret_cast<char*>(address + bytes); // Advance past the allocation
+        return reinterpret_cast<void*>(address); // Return the allocation
+    }
+
+    /**
+     * @brief Adds a chunk and carves an allocation from it.
+     * @param bytes The size of the allocation.
+     * @param alignment The alignment of the allocation.
+     * @return The allocated memory.
+     */
+    void* grow(size_t bytes, size_t alignment);
+
+    /**
+     * @brief Carves an allocation for a polymorphic allocator.
+     * @param bytes The size of the allocation.
+     * @param alignment The alignment of the allocation.
+     * @return The allocated memory.
+     */
+    void* do_allocate(size_t bytes, size_t alignment) override { return allocateDirect(bytes, alignment); }
+
+    /**
+     * @brief Does nothing; the memory is reclaimed when the arena is released.
+     */
+    void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+
+    /**
+     * @brief Checks if memory from one resource can be freed by the other.
+     * @param other The other resource.
+     * @return True only for the same arena.
+     */
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+};
+
+#endif // NODE_ARENA_H // End of include guard
@@ -1,190 +1,468 @@
 #include "SentimentAnalyzer.h" // Include the header file for the SentimentAnalyzer class
-
-SentimentAnalyzer::SentimentAnalyzer(const DSString& saveFile, const DSString& trainFile) { // Constructor for SentimentAnalyzer
+#include "CorpusCache.h" // Include CorpusCache for training from a compiled corpus
+#include "Metrics.h" // Include Metrics for the classification counters
+
+SentimentAnalyzer::SentimentAnalyzer(const DSString& saveFile, const DSString& trainFile, unsigned trainThreads, std::optional<TrieLayout> layout, ModelBackend backend, const DSString& corpusFile, std::optional<NGramOptions> ngramOptions, std::optional<LabelOptions> labelOptions) // Constructor for SentimentAnalyzer
+    : model(SentimentModel::create(backend)), deltaFile(saveFile + ".delta"), labelFile(saveFile + ".labels"), labelDeltaFile(saveFile + ".labels.delta"), ngramDeltaFile(saveFile + ".ngrams.delta") {
+    Trie* trie = dynamic_cast<Trie*>(model.get()); // Get the Trie if the model is one, for the layout
+    if (layout && trie == nullptr) { // Check that the layout can be applied
+        throw std::logic_error("A node layout needs the trie backend"); // Throw an error if it cannot
+    }
+    if (ngramOptions && labelOptions) { // Check that the features are scored by the classifier
+        throw std::logic_error("The label model does not score n-grams"); // Throw an error if the sketch would go unused
+    }
+    if (ngramOptions) { // If n-gram features were requested
+        ngrams = std::make_unique<NGramSketch>(*ngramOptions); // Declare the empty sketch first, so bad options fail before any training
+    }
+    std::unique_ptr<LabelModel> labelCounts; // Per-label model being loaded or counted, kept once finalized
+    if (labelOptions) { // If multi-class labels were requested
+        labelCounts = std::make_unique<LabelModel>(*labelOptions); // Declare the empty model first, so bad labels fail before any training
+    }
+    std::unique_ptr<CorpusCache> corpus; // Compiled training corpus, mapped only if something is trained from it
     std::ifstream file(saveFile.c_str()); // Open the save file
-    if (file.good() && file.peek() != std::ifstream::traits_type::eof()) { // Check if the file is good and not empty
-        std::cout << "Loading trie from file..." << std::endl; // Print loading message
-        trie.load(saveFile); // Load the trie from the save file
-        std::cout << "Trie loaded!" << std::endl; // Print loaded message
+    bool loaded = file.good() && file.peek() != std::ifstream::traits_type::eof(); // Check if the file is good and not empty
+    if (loaded) { // If a saved model exists
+        std::cout << "Loading " << model->name() << " from file..." << std::endl; // Print loading message
+        if (Trie::isBinaryModel(saveFile)) { // If the file is a binary model
+            model->loadBinary(saveFile); // Map or read the model from the save file
+        } else { // If the file is a legacy model
+            model->load(saveFile); // Load the model from the save file
+        }
+        baseModel = SentimentModel::stampOf(saveFile); // Stamp the model, so only its own delta is applied
+        if (std::ifstream(deltaFile.c_str()).good()) { // If incremental updates were saved for a model
+            if (model->loadDelta(deltaFile, baseModel)) { // Apply them if they were saved on this one
+                std::cout << "Incremental updates loaded from " << deltaFile << "." << std::endl; // Print the delta message
+            } else { // If they belong to another model, or to an older format
+                std::cout << "Ignoring " << deltaFile << ": it was not saved on this model." << std::endl; // Print the mismatch message
+            }
+        }
+        std::cout << "Model loaded!" << std::endl; // Print loaded message
     } else { // If the file is not good or is empty
-        std::cout << "Training the trie..." << std::endl; // Print training message
-        trie.train(trainFile); // Train the trie using the training file
-        trie.save(saveFile); // Save the trained trie to the save file
-        std::cout << "Trie trained and saved!" << std::endl; // Print trained and saved message
+        std::cout << "Training the " << model->name() << "..." << std::endl; // Print training message
+        if (corpusFile.empty()) { // If no corpus cache was given
+            model->train(trainFile, trainThreads); // Train the model using the training file
+        } else { // If training should stream the compiled corpus
+            corpus = CorpusCache::openOrCompile(corpusFile, trainFile); // Map the cache, compiling it if the training file changed
+            model->trainCorpus(*corpus, trainThreads); // Train the model from its token ids
+        }
+        model->save(saveFile, trainThreads); // Save the trained model to the save file
+        std::remove(deltaFile.c_str()); // Updates learned on a previous model do not apply to this one
+        std::remove(ngramDeltaFile.c_str()); // Nor do the n-grams learned with them
+        std::remove(labelDeltaFile.c_str()); // Nor the tweets learned under their labels
+        baseModel = SentimentModel::stampOf(saveFile); // Stamp the new model for the updates learned on it
+        std::cout << "Model trained and saved!" << std::endl; // Print trained and saved message
     }
-}
-
-double SentimentAnalyzer::analyzeSentimentLO(const DSString& text) const { // Analyze sentiment using log-odds ratio
-    std::vector<DSString> words = trie.tokenize(text); // Tokenize the input text
-    double logOddsSum = 0.0; // Initialize log-odds sum
-    for (const DSString& word : words) { // Iterate over each word
-        logOddsSum += trie.getLogOddsRatio(word); // Add the log-odds ratio of the word to the sum
+    if (ngrams != nullptr) { // If n-gram features were requested
+        DSString ngramFile = saveFile + ".ngrams"; // The sketch is saved next to the model
+        if (loaded && NGramSketch::isCompatible(ngramFile, *ngramOptions)) { // If the loaded model has a sketch of this shape
+            ngrams->load(ngramFile); // Load it
+            std::cout << "N-gram counts loaded from " << ngramFile << "." << std::endl; // Print the n-gram message
+        } else { // If the sketch is missing, of another shape, or the model was just trained
+            if (corpus == nullptr && !corpusFile.empty()) corpus = CorpusCache::openOrCompile(corpusFile, trainFile); // Map the corpus if it was not used for the model
+            if (corpus != nullptr) { // If training streams the compiled corpus
+                ngrams->trainCorpus(*corpus, trainThreads); // Count the n-grams from its token ids
+            } else { // If training parses the training file
+                ngrams->train(trainFile, trainThreads); // Count the n-grams of the training file
+            }
+            ngrams->save(ngramFile); // Save the sketch next to the model
+        }
+        if (loaded && std::ifstream(ngramDeltaFile.c_str()).good()) { // If n-grams were learned on a model
+            if (ngrams->loadDelta(ngramDeltaFile, baseModel)) { // Count them again if they were learned on this one, with this order
+                std::cout << "Learned n-grams loaded from " << ngramDeltaFile << "." << std::endl; // Print the delta message
+            } else { // If they belong to another model or order
+                std::cout << "Ignoring " << ngramDeltaFile << ": it was not saved on this model and order." << std::endl; // Print the mismatch message
+            }
+        }
     }
-    return logOddsSum; // Return the log-odds sum
+    if (labelCounts != nullptr) { // If multi-class labels were requested
+        if (loaded && LabelModel::isCompatible(labelFile, *labelOptions)) { // If the loaded model has counts of these labels
+            labelCounts->load(labelFile); // Load them
+            std::cout << "Label counts loaded from " << labelFile << "." << std::endl; // Print the label message
+        } else { // If the counts are missing, of other labels, or the model was just trained
+            if (corpus == nullptr && !corpusFile.empty()) corpus = CorpusCache::openOrCompile(corpusFile, trainFile); // Map the corpus if nothing else used it
+            if (corpus != nullptr) { // If training streams the compiled corpus
+                labelCounts->trainCorpus(*corpus, trainThreads); // Count the tokens of each label from its token ids
+            } else { // If training parses the training file
+                labelCounts->train(trainFile, trainThreads); // Count the tokens of each label
+            }
+            labelCounts->save(labelFile); // Save the counts next to the model
+        }
+        labelCounts->finalize(); // Precompute the priors and the token probabilities
+        if (loaded && std::ifstream(labelDeltaFile.c_str()).good()) { // If tweets were learned on a model
+            if (labelCounts->loadDelta(labelDeltaFile, baseModel)) { // Learn them again if they were learned on this one, with these labels
+                std::cout << "Learned labels loaded from " << labelDeltaFile << "." << std::endl; // Print the delta message
+            } else { // If they belong to another model or other labels
+                std::cout << "Ignoring " << labelDeltaFile << ": it was not saved on this model and labels." << std::endl; // Print the mismatch message
+            }
+        }
+        labels = std::move(labelCounts); // Classify by label from now on
+    }
+    if (layout) { // If a layout was requested
+        trie->setLayout(*layout); // Switch to the requested node layout for scoring
+    }
+    model->finalize(); // Precompute the scores of every word for scoring
 }
 
-double SentimentAnalyzer::analyzeSentimentSS(const DSString& text) const { // Analyze sentiment using sentiment score
-    std::vector<DSString> words = trie.tokenize(text); // Tokenize the input text
-    double sentimentSum = 0.0; // Initialize sentiment sum
-    for (const DSString& word : words) { // Iterate over each word
-        sentimentSum += trie.getSentimentScore(word); // Add the sentiment score of the word to the sum
+size_t SentimentAnalyzer::learn(const DSString& trainFile) { // Fold a training file into the live model
+    MappedFile mapped(trainFile); // Map the file into memory
+    CSVReader reader(mapped.data(), mapped.data() + mapped.size()); // Declare a reader over the file
+    reader.skip(); // Skip the header line
+    std::vector<TrainingRecord> records; // Declare the records; their views point into the mapping
+    std::vector<std::string_view> fields; // Declare the field list, reused for every record
+    while (reader.next(fields, 6)) { // Read each record; the tweet takes the rest of the record
+        if (fields.size() < 6) continue; // Skip records with missing fields
+        records.push_back(TrainingRecord{fields[0], fields[5]}); // Add the record
     }
-    return sentimentSum; // Return the sentiment sum
+    learn(records); // Fold them in as one update
+    return records.size(); // Return the number of records
 }
 
-void SentimentAnalyzer::analyzeFile(const DSString& input, const DSString& output) const { // Analyze sentiment of a file
-    std::ifstream inputFile(input.c_str()); // Open the input file
-    std::ofstream outputFile(output.c_str()); // Open the output file
-
-    if (!inputFile.is_open()) { // Check if the input file is open
-        throw std::runtime_error("Could not open input file"); // Throw an error if the input file could not be opened
+void SentimentAnalyzer::learn(const std::vector<TrainingRecord>& records) { // Fold labeled tweets into the live model
+    std::lock_guard<std::mutex> lock(learnMutex); // Keep concurrent updates from interleaving their delta files
+    model->update(records); // Fold the records into the model
+    model->saveDelta(deltaFile, baseModel); // Persist the updates, stamped with the model they apply to
+    if (ngrams != nullptr) { // If n-gram features are scored
+        TokenBuffer words; // Declare a buffer for the words
+        for (const TrainingRecord& record : records) { // Loop through each tweet
+            Tokenizer::tokenize(record.tweet, words); // Tokenize it
+            ngrams->update(words, record.sentiment == "4"); // Count its n-grams in place; "4" is positive, as in training
+        }
+        ngrams->saveDelta(ngramDeltaFile, baseModel); // Persist the learned n-grams, stamped with the model they apply to
     }
-
-    if (!outputFile.is_open()) { // Check if the output file is open
-        throw std::runtime_error("Could not open output file"); // Throw an error if the output file could not be opened
+    if (labels != nullptr) { // If labels classify the tweets
+        labels->update(records); // Count the tweets into the label delta, skipping other labels
+        labels->saveDelta(labelDeltaFile, baseModel); // Persist the learned tweets, stamped with the model they apply to
     }
+}
 
-    std::cout << "Analyzing file..." << std::endl; // Print analyzing message
-    auto start = std::chrono::high_resolution_clock::now(); // Start the timer
+void SentimentAnalyzer::setSmoothing(double alpha) { // Set the smoothing of the model's scores
+    model->setSmoothing(alpha); // Recompute the cached scores with it
+    if (ngrams != nullptr) ngrams->setSmoothing(alpha); // Score the n-grams with it too
+}
 
-    DSString line; // Declare a string to hold each line
-    // Skip the header line
-    getline(inputFile, line); // Read the header line
-    outputFile << "Sentiment,id" << std::endl; // Write the header to the output file
-
-    while (getline(inputFile, line)) { // Read each line from the input file
-        std::istringstream stream(line.c_str()); // Create a string stream from the line
-        DSString id, date, query, user, tweet; // Declare strings to hold the CSV fields
-
-        // Read the CSV fields
-        getline(stream, id, ','); // Read the id field
-        getline(stream, date, ','); // Read the date field
-        getline(stream, query, ','); // Read the query field
-        getline(stream, user, ','); // Read the user field
-        getline(stream, tweet, ','); // Read the tweet field
-
-        double sentimentScore = analyzeSentimentLO(tweet) + 0.2; // Analyze the sentiment using log-odds ratio and add 0.2
-        int sentiment; // Declare an integer to hold the sentiment
-        if(sentimentScore) // Check if the sentiment score is not zero
-            sentiment = sentimentScore > 0 ? 4 : 0; // Set sentiment to 4 if positive, otherwise 0
-        else { // If the sentiment score is zero
-            double sentimentScore = analyzeSentimentSS(tweet) + 0.2; // Analyze the sentiment using sentiment score and add 0.2
-            sentiment = sentimentScore > 0 ? 4 : (sentimentScore == 0 ? 2 : 0); // Set sentiment based on the sentiment score
-        }
+double SentimentAnalyzer::analyzeSentimentLO(const DSString& text) const { // Analyze sentiment using log-odds ratio
+    TokenBuffer words; // Declare a buffer for the words
+    Tokenizer::tokenize(text, words); // Tokenize the input text
+    return sumScores(words).logOdds; // Return the log-odds sum
+}
 
-        outputFile << sentiment << "," << id << std::endl; // Write the sentiment, id, and sentiment score to the output file
+double SentimentAnalyzer::analyzeSentimentSS(const DSString& text) const { // Analyze sentiment using sentiment score
+    TokenBuffer words; // Declare a buffer for the words
+    Tokenizer::tokenize(text, words); // Tokenize the input text
+    return sumScores(words).sentimentScore; // Return the sentiment sum
+}
+
+WordScores SentimentAnalyzer::sumScores(const TokenBuffer& words) const { // Sum both scores of tokenized words
+    WordScores sums = model->sumScores(words); // One virtual call per tweet; the backend looks each word up directly
+    if (ngrams != nullptr) { // If n-gram features are enabled
+        WordScores grams = ngrams->sumScores(words); // Sum the scores of the tweet's n-grams
+        sums.logOdds += grams.logOdds; // Add their log-odds sum
+        sums.sentimentScore += grams.sentimentScore; // Add their sentiment sum
     }
+    return sums; // Return both sums
+}
 
-    inputFile.close(); // Close the input file
-    outputFile.close(); // Close the output file
+namespace { // Helpers for the analyzeFile pipeline and the mistakes file
+const size_t kBatchLines = 1024; // Number of lines the reader stage puts in one batch
+const size_t kBatchesPerWorker = 4; // Number of batches allowed in flight per scoring worker
 
-    auto end = std::chrono::high_resolution_clock::now(); // End the timer
-    std::chrono::duration<double> duration = end - start; // Calculate the duration
-    std::cout << "Analysis complete! Time taken: " << duration.count() << " seconds" << std::endl; // Print analysis complete message with time taken
+
+double secondsSince(std::chrono::high_resolution_clock::time_point start) { // Measure the time since a point
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count(); // Return it in seconds
 }
 
-double SentimentAnalyzer::accuracy(const DSString& analyzedFile, const DSString& answersFile, const DSString& mistakesFile) const { // Calculate accuracy of sentiment analysis
-    std::ifstream analyzed(analyzedFile.c_str()); // Open the analyzed file
-    std::ifstream answers(answersFile.c_str()); // Open the answers file
+std::ofstream openMistakes(const DSString& mistakesFile) { // Open a mistakes file, leaving room for the accuracy on its first line
     std::ofstream mistakes(mistakesFile.c_str()); // Open the mistakes file
-
-    if (!analyzed.is_open()) { // Check if the analyzed file is open
-        throw std::runtime_error("Could not open analyzed file"); // Throw an error if the analyzed file could not be opened
+    if (!mistakes.is_open()) { // Check if the mistakes file is open
+        throw std::runtime_error("Could not open mistakes file"); // Throw an error if the mistakes file could not be opened
     }
+    mistakes << "0.000\n"; // Reserve the accuracy line; 3 decimals of a value in [0, 1] are always 5 characters
+    return mistakes; // Return the stream, positioned for the mistakes
+}
 
-    if (!answers.is_open()) { // Check if the answers file is open
-        throw std::runtime_error("Could not open answers file"); // Throw an error if the answers file could not be opened
+void writeAccuracy(std::ofstream& mistakes, double accuracy) { // Fill in the accuracy line once every mistake is written
+    mistakes.seekp(0); // Go back to the reserved line
+    mistakes << std::fixed << std::setprecision(3) << accuracy; // Write the accuracy with 3 decimals
+    mistakes.close(); // Flush the file
+    if (mistakes.fail()) throw std::runtime_error("Could not write mistakes file"); // Report a failed write
+}
+
+template <typename T>
+class BlockingQueue { // A FIFO queue whose consumers block until an item arrives or the queue is closed
+public:
+    void push(T item) { // Add an item to the queue
+        {
+            std::lock_guard<std::mutex> lock(mutex); // Lock the queue
+            items.push_back(std::move(item)); // Add the item
+        }
+        ready.notify_one(); // Wake one consumer
     }
 
-    DSString analyzedLine, answersLine; // Declare strings to hold each line
-    int matchingLines = 0; // Initialize matching lines count
-    int totalLines = 0; // Initialize total lines count
+    bool pop(T& item) { // Take the next item; returns false once the queue is closed and drained
+        std::unique_lock<std::mutex> lock(mutex); // Lock the queue
+        ready.wait(lock, [this] { return closed || !items.empty(); }); // Wait for an item or the close signal
+        if (items.empty()) return false; // Stop if the queue is closed and empty
+        item = std::move(items.front()); // Take the item
+        items.pop_front(); // Remove it from the queue
+        return true; // Report success
+    }
 
-    // Skip the header lines
-    getline(analyzed, analyzedLine); // Read the header line from the analyzed file
-    getline(answers, answersLine); // Read the header line from the answers file
+    void close() { // Signal that no more items will be pushed
+        {
+            std::lock_guard<std::mutex> lock(mutex); // Lock the queue
+            closed = true; // Mark the queue as closed
+        }
+        ready.notify_all(); // Wake every consumer
+    }
 
-    //Analyze percent accuracy
-    while (getline(analyzed, analyzedLine) && getline(answers, answersLine)) { // Read each line from both files
-        std::istringstream analyzedStream(analyzedLine.c_str()); // Create a string stream from the analyzed line
-        std::istringstream answersStream(answersLine.c_str()); // Create a string stream from the answers line
+private:
+    std::deque<T> items; // Items waiting to be consumed
+    std::mutex mutex; // Mutex protecting the queue
+    std::condition_variable ready; // Condition variable signalled on push and close
+    bool closed = false; // Flag set once the producer is done
+};
+} // namespace
+
+struct SentimentAnalyzer::ScoreBatch { // A batch of input lines travelling through the pipeline
+    size_t sequence = 0; // Position of the batch in the input file
+    std::vector<std::pair<std::string_view, std::string_view>> records; // Id and tweet fields found by the reader stage
+    std::string results; // Result lines produced by a scoring worker
+    std::vector<int> labels; // Predicted label of each record, kept only for an evaluator
+    double scoreSeconds = 0; // Time a worker spent scoring the batch
+    bool failed = false; // Whether scoring the batch threw; the writer only counts it
+};
+
+int SentimentAnalyzer::classify(std::string_view tweet, TokenBuffer& words) const { // Classify a tweet
+    Tokenizer::tokenize(tweet, words); // Tokenize the tweet once for both methods
+    Metrics::add(Counter::TweetsClassified); // Count the tweet
+    Metrics::observe(Histogram::TokensPerTweet, words.size()); // Record its length in tokens
+    if (labels != nullptr) return labels->classify(words); // Pick the most probable of the configured labels
+    WordScores sums = sumScores(words); // Look each word up once for both sums
+    double sentimentScore = sums.logOdds + 0.2; // Analyze the sentiment using log-odds ratio and add 0.2
+    if (sentimentScore) // Check if the sentiment score is not zero
+        return sentimentScore > 0 ? 4 : 0; // Return 4 if positive, otherwise 0
+    Metrics::add(Counter::ScoreFallbacks); // Count the fallback to the sentiment score
+    sentimentScore = sums.sentimentScore + 0.2; // Fall back to the sentiment score and add 0.2
+    if (sentimentScore == 0) Metrics::add(Counter::NeutralTweets); // Count the neutral tweet
+    return sentimentScore > 0 ? 4 : (sentimentScore == 0 ? 2 : 0); // Return the sentiment based on the sentiment score
+}
 
-        int analyzedSentiment, answersSentiment, analyzedId, answersId; // Declare integers to hold the CSV fields
+int SentimentAnalyzer::analyzeRecord(std::string_view id, std::string_view tweet, TokenBuffer& words, std::string& results) const { // Analyze one record of the test file
+    int label = classify(tweet, words); // Classify the tweet
+    results += static_cast<char>('0' + label); // Append the sentiment, a single digit
+    results += ','; // Append the separator
+    results.append(id.data(), id.size()); // Append the id
+    results += '\n'; // End the result line
+    return label; // Return the sentiment
+}
 
-        // Read the CSV fields
-        analyzedStream >> analyzedSentiment; // Read the analyzed sentiment
-        analyzedStream.ignore(1, ','); // Ignore the comma
-        analyzedStream >> analyzedId; // Read the analyzed id
+void SentimentAnalyzer::analyzeFile(const DSString& input, const DSString& output, unsigned numThreads, Evaluator* evaluator) const { // Analyze sentiment of a file
+    BufferedWriter outputFile(output); // Open the output file
+    std::cout << "Analyzing file..." << std::endl; // Print analyzing message
+    StageTimes times; // Declare the stage times
+    size_t numLines = analyzeRecords(input, &outputFile, evaluator, numThreads, times); // Analyze every record
+    double linesPerSecond = times.total > 0 ? numLines / times.total : 0.0; // Calculate the throughput
+    std::cout << "Analysis complete! Time taken: " << times.total << " seconds (" << numLines << " lines, " << linesPerSecond << " lines/sec)" << std::endl; // Print analysis complete message with time taken and throughput
+}
 
-        answersStream >> answersSentiment; // Read the answers sentiment
-        answersStream.ignore(1, ','); // Ignore the comma
-        answersStream >> answersId; // Read the answers id
+size_t SentimentAnalyzer::analyzeRecords(const DSString& input, BufferedWriter* output, Evaluator* evaluator, unsigned numThreads, StageTimes& times) const { // Analyze every record of a file
+    auto start = std::chrono::high_resolution_clock::now(); // Start the timer
+    MappedFile inputFile(input); // Map the input file into memory
 
-        if (analyzedId != answersId) { // Check if the ids do not match
-            std::cerr << "ID mismatch at line " << totalLines + 1 << std::endl; // Print id mismatch message
-            break; // Break the loop
-        }
+    if (numThreads == 0) { // If the caller asked for the hardware concurrency
+        numThreads = std::max(1u, std::thread::hardware_concurrency()); // Use every core, but at least one thread
+    }
 
-        if (analyzedSentiment == answersSentiment) { // Check if the sentiments match
-            matchingLines++; // Increment matching lines count
+    CSVReader reader(inputFile.data(), inputFile.data() + inputFile.size()); // Declare a reader over the mapped file
+    // Skip the header line
+    reader.skip(); // Skip the header record
+    if (output != nullptr) output->write("Sentiment,id\n"); // Write the header to the output file
+
+    size_t numLines = 0; // Initialize the analyzed line count
+    if (numThreads == 1) { // If analyzing serially
+        std::vector<std::string_view> fields; // Declare the field list, reused for every record
+        TokenBuffer words; // Declare the token buffer, reused for every record
+        ScoreBatch batch; // Declare the batch, reused for every run of records
+        while (readBatch(reader, fields, batch, times)) { // Read each batch of records
+            scoreBatch(batch, words, evaluator != nullptr); // Score it
+            deliverBatch(batch, output, evaluator, times); // Write and evaluate it
+            numLines += batch.records.size(); // Count the lines
         }
-
-        totalLines++; // Increment total lines count
+    } else { // If analyzing with several workers
+        numLines = analyzePipelined(reader, output, evaluator, numThreads, times); // Run the pipeline
     }
 
-    analyzed.close(); // Close the analyzed file
-    answers.close(); // Close the answers file
-
-    if(totalLines != 0){
-        double accuracy = (static_cast<double>(matchingLines) / totalLines); // Calculate the accuracy as a percentage
-        mistakes << std::fixed << std::setprecision(3) << accuracy << std::endl; // Write the accuracy to the mistakes file with 3 significant figures
-    } else{
-        mistakes << std::fixed << std::setprecision(3) << 0.0 << std::endl; // Write 0.0 accuracy to the mistakes file with 3 significant figures
-        return 0.0; // Return 0.0 accuracy
+    if (output != nullptr) { // If the results are being written
+        auto closeStart = std::chrono::high_resolution_clock::now(); // Start timing the last write
+        output->close(); // Write what is buffered and close the output file
+        times.write += secondsSince(closeStart); // Count it as writing
     }
+    times.total = secondsSince(start); // Measure the whole pass
+    return numLines; // Return the number of analyzed lines
+}
 
-    analyzed.open(analyzedFile.c_str()); // Open the analyzed file
-    answers.open(answersFile.c_str()); // Open the answers file
-    
-    if (!analyzed.is_open()) { // Check if the analyzed file is open
-        throw std::runtime_error("Could not open analyzed file"); // Throw an error if the analyzed file could not be opened
+bool SentimentAnalyzer::readBatch(CSVReader& reader, std::vector<std::string_view>& fields, ScoreBatch& batch, StageTimes& times) { // Read the next batch of records
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing the read
+    batch.records.clear(); // Reuse the record list
+    batch.results.clear(); // Reuse the result buffer
+    batch.labels.clear(); // Reuse the label list
+    batch.records.reserve(kBatchLines); // Reserve room for the records
+    while (batch.records.size() < kBatchLines && reader.next(fields, 5)) { // Read records until the batch is full
+        fields.resize(5); // Treat missing fields as empty
+        batch.records.emplace_back(fields[0], fields[4]); // Add the id and tweet views to the batch
     }
+    times.read += secondsSince(start); // Count the read
+    return !batch.records.empty(); // Report whether anything was read
+}
 
-    if (!answers.is_open()) { // Check if the answers file is open
-        throw std::runtime_error("Could not open answers file"); // Throw an error if the answers file could not be opened
+void SentimentAnalyzer::scoreBatch(ScoreBatch& batch, TokenBuffer& words, bool keepLabels) const { // Score every record of a batch
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing the scoring
+    if (keepLabels) batch.labels.reserve(batch.records.size()); // Make room for the labels
+    for (const auto& record : batch.records) { // Loop through each record of the batch
+        int label = analyzeRecord(record.first, record.second, words, batch.results); // Score the record into the batch results
+        if (keepLabels) batch.labels.push_back(label); // Keep the label for the evaluator
     }
+    batch.scoreSeconds = secondsSince(start); // Keep the time for the writer stage to add up
+}
 
-    // Skip the header lines
-    getline(analyzed, analyzedLine); // Read the header line from the analyzed file
-    getline(answers, answersLine); // Read the header line from the answers file
-
-    while (getline(analyzed, analyzedLine) && getline(answers, answersLine)) { // Read each line from both files
-        std::istringstream analyzedStream(analyzedLine.c_str()); // Create a string stream from the analyzed line
-        std::istringstream answersStream(answersLine.c_str()); // Create a string stream from the answers line
-
-        int analyzedSentiment, answersSentiment, analyzedId, answersId; // Declare integers to hold the CSV fields
-
-        // Read the CSV fields
-        analyzedStream >> analyzedSentiment; // Read the analyzed sentiment
-        analyzedStream.ignore(1, ','); // Ignore the comma
-        analyzedStream >> analyzedId; // Read the analyzed id
-
-        answersStream >> answersSentiment; // Read the answers sentiment
-        answersStream.ignore(1, ','); // Ignore the comma
-        answersStream >> answersId; // Read the answers id
+void SentimentAnalyzer::deliverBatch(const ScoreBatch& batch, BufferedWriter* output, Evaluator* evaluator, StageTimes& times) { // Write and evaluate a scored batch
+    times.score += batch.scoreSeconds; // Add up the scoring time
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing the write
+    if (output != nullptr) output->write(batch.results); // Write the batch results
+    auto written = std::chrono::high_resolution_clock::now(); // Start timing the evaluation
+    times.write += std::chrono::duration<double>(written - start).count(); // Count the write
+    if (evaluator != nullptr) { // If the predictions are being evaluated
+        for (size_t i = 0; i < batch.labels.size(); ++i) evaluator->add(batch.records[i].first, batch.labels[i]); // Compare them in input order
+        times.evaluate += secondsSince(written); // Count the evaluation
+    }
+}
 
-        if (analyzedId != answersId) { // Check if the ids do not match
-            std::cerr << "ID mismatch at line " << totalLines + 1 << std::endl; // Print id mismatch message
-            break; // Break the loop
+size_t SentimentAnalyzer::analyzePipelined(CSVReader& reader, BufferedWriter* output, Evaluator* evaluator, unsigned numThreads, StageTimes& times) const { // Analyze a file with a reader, scoring workers and a writer
+    BlockingQueue<ScoreBatch> toWrite; // Scored batches waiting for the writer
+    std::mutex windowMutex; // Mutex protecting the number of written batches
+    std::condition_variable windowOpen; // Condition variable signalled when a batch is written
+    size_t written = 0; // Number of batches written so far
+    const size_t maxInFlight = kBatchesPerWorker * numThreads; // Number of batches allowed between reader and writer
+
+    ThreadPool pool(numThreads); // Declare the scoring workers
+    TaskGroup scoring(pool); // Declare the group of scoring tasks
+    bool keepLabels = evaluator != nullptr; // Whether the writer needs the labels
+    std::atomic<bool> scoringFailed(false); // Flag set when a batch fails, so the reader stops early
+    auto scoreAndHandOff = [this, &toWrite, &scoringFailed, keepLabels](ScoreBatch& batch) { // Score one batch and hand it to the writer
+        thread_local TokenBuffer words; // Declare the worker's token buffer, reused for every record
+        try {
+            scoreBatch(batch, words, keepLabels); // Score the batch
+        } catch (...) { // Catch any exception
+            scoringFailed.store(true); // Stop reading more batches
+            batch.failed = true; // Mark the batch so the writer skips it
+            toWrite.push(std::move(batch)); // Hand it on anyway, so the writer's sequence keeps advancing and the reader is not left waiting
+            throw; // Let the task group report the failure
         }
-
-        if (analyzedSentiment != answersSentiment) { // If the sentiments do not match
-            mistakes << analyzedSentiment << "," << answersSentiment << "," << analyzedId << std::endl; // Write the mistake to the mistakes file
+        if (!keepLabels) batch.records.clear(); // Release the record views unless the writer needs the ids
+        toWrite.push(std::move(batch)); // Hand the batch to the writer
+    };
+
+    StageTimes writerTimes; // Stage times of the writer thread, added after it joins
+    std::exception_ptr writeFailure; // Declare the first writing failure
+    std::thread writer([&] { // Start the writer stage
+        std::map<size_t, ScoreBatch> pending; // Scored batches that arrived ahead of their turn
+        ScoreBatch batch; // Declare the batch being received
+        bool stopped = false; // Whether a batch failed to score; nothing after it is written
+        while (toWrite.pop(batch)) { // Take batches until the workers are done
+            pending.emplace(batch.sequence, std::move(batch)); // Park the batch until its turn
+            for (auto it = pending.begin(); it != pending.end() && it->first == written; it = pending.erase(it)) { // Loop while the next batch in order is ready
+                stopped = stopped || it->second.failed; // Stop writing at the first batch that failed to score
+                if (!writeFailure && !stopped) { // Stop writing after a failure, but keep draining
+                    try {
+                        deliverBatch(it->second, output, evaluator, writerTimes); // Write and evaluate the batch
+                    } catch (...) { // Catch any exception
+                        writeFailure = std::current_exception(); // Keep it until the pipeline has stopped
+                    }
+                }
+                {
+                    std::lock_guard<std::mutex> lock(windowMutex); // Lock the window
+                    written++; // Count the written batch
+                }
+                windowOpen.notify_one(); // Let the reader continue
+            }
         }
+    });
+
+    size_t numLines = 0; // Initialize the analyzed line count
+    size_t sequence = 0; // Initialize the batch sequence number
+    std::vector<std::string_view> fields; // Declare the field list, reused for every record
+    std::exception_ptr readFailure; // Declare a failure of the reader stage
+    try {
+        while (!scoringFailed.load()) { // Loop until the input is exhausted or a batch fails
+            ScoreBatch batch; // Declare the batch being filled
+            if (!readBatch(reader, fields, batch, times)) break; // Stop if nothing was read
+            batch.sequence = sequence; // Record the batch position
+            numLines += batch.records.size(); // Count the lines
+            {
+                std::unique_lock<std::mutex> lock(windowMutex); // Lock the window
+                windowOpen.wait(lock, [&] { return sequence < written + maxInFlight; }); // Wait until the writer has caught up
+            }
+            auto shared = std::make_shared<ScoreBatch>(std::move(batch)); // Share the batch with its scoring task
+            scoring.run([shared, &scoreAndHandOff] { scoreAndHandOff(*shared); }); // Hand the batch to the workers
+            sequence++; // Move to the next batch
+        }
+    } catch (...) { // Catch any exception
+        readFailure = std::current_exception(); // Keep it until the writer has stopped; a joinable writer must not be destroyed
+    }
+
+    std::exception_ptr failure; // Declare the first scoring failure
+    try {
+        scoring.wait(); // Wait for the workers to score every batch already handed out
+    } catch (...) { // Catch any exception
+        failure = std::current_exception(); // Keep it until the writer has stopped
     }
+    toWrite.close(); // Tell the writer no more batches are coming
+    writer.join(); // Wait for the writer to finish
+    if (readFailure) std::rethrow_exception(readFailure); // Report the reading failure
+    if (failure) std::rethrow_exception(failure); // Report the scoring failure
+    if (writeFailure) std::rethrow_exception(writeFailure); // Report the writing failure
+    times.score += writerTimes.score; // Add the scoring time the writer added up
+    times.write += writerTimes.write; // Add the writing time
+    times.evaluate += writerTimes.evaluate; // Add the evaluation time
+    return numLines; // Return the number of analyzed lines
+}
 
-    analyzed.close(); // Close the analyzed file
-    answers.close(); // Close the answers file
+double SentimentAnalyzer::accuracy(const DSString& analyzedFile, const DSString& answersFile, const DSString& mistakesFile) const { // Calculate accuracy of sentiment analysis
+    return evaluate(analyzedFile, answersFile, mistakesFile).accuracy(); // Evaluate the results and keep the accuracy
+}
 
-    return (static_cast<double>(matchingLines) / totalLines); // Return the accuracy as a percentage
+std::vector<int> SentimentAnalyzer::evaluatedLabels() const { // Get the labels the confusion matrix covers
+    if (labels == nullptr) return std::vector<int>(); // The word model predicts 0, 2 and 4
+    return labels->labels(); // The label model predicts its own labels
+}
+
+EvaluationReport SentimentAnalyzer::evaluate(const DSString& analyzedFile, const DSString& answersFile, const DSString& mistakesFile) const { // Evaluate a results file in one pass
+    std::ofstream mistakes = openMistakes(mistakesFile); // Open the mistakes file
+    EvaluationReport report = Evaluator::evaluateFile(analyzedFile, answersFile, &mistakes, evaluatedLabels()); // Join the results with the answers, streaming the mistakes
+    writeAccuracy(mistakes, report.accuracy()); // Fill in the accuracy
+    return report; // Return the report
+}
+
+EvaluationReport SentimentAnalyzer::analyzeAndEvaluate(const DSString& input, const DSString& answersFile, const DSString& output, const DSString& mistakesFile, unsigned numThreads) const { // Analyze a file and evaluate it on the fly
+    auto start = std::chrono::high_resolution_clock::now(); // Start the timer
+    std::ofstream mistakes = openMistakes(mistakesFile); // Open the mistakes file
+    Evaluator evaluator(answersFile, &mistakes, evaluatedLabels()); // Open the answers
+    std::unique_ptr<BufferedWriter> outputFile; // Declare the results file, if any
+    if (output.length() != 0) outputFile = std::make_unique<BufferedWriter>(output); // Open it only if asked
+    std::cout << "Analyzing and evaluating file..." << std::endl; // Print analyzing message
+    StageTimes times; // Declare the stage times
+    size_t numLines = analyzeRecords(input, outputFile.get(), &evaluator, numThreads, times); // Analyze every record, comparing each prediction as it is made
+    auto finishStart = std::chrono::high_resolution_clock::now(); // Start timing the end of the evaluation
+    EvaluationReport report = evaluator.finish(); // Count the answers never predicted
+    writeAccuracy(mistakes, report.accuracy()); // Fill in the accuracy
+    times.evaluate += secondsSince(finishStart); // Count it as evaluation
+    times.total = secondsSince(start); // Measure the whole run
+
+    std::cout << "Reading completed in " << times.read << " seconds." << std::endl; // Print the reader stage
+    std::cout << "Scoring completed in " << times.score << " seconds (summed over the workers)." << std::endl; // Print the scoring stage
+    if (outputFile) std::cout << "Writing completed in " << times.write << " seconds." << std::endl; // Print the writing stage
+    std::cout << "Evaluation completed in " << times.evaluate << " seconds." << std::endl; // Print the evaluation stage
+    double linesPerSecond = times.total > 0 ? numLines / times.total : 0.0; // Calculate the throughput
+    std::cout << "Analysis and evaluation complete! Time taken: " << times.total << " seconds (" << numLines << " lines, " << linesPerSecond << " lines/sec)" << std::endl; // Print the total
+    return report; // Return the report
 }
@@ -3,6 +3,11 @@
 
 #include "DSString.h" // Include custom DSString class
 #include "Trie.h" // Include custom Trie class
+#include "SentimentModel.h" // Include the model interface the analyzer scores against
+#include "CSVReader.h" // Include the memory-mapped CSV reader
+#include "Evaluator.h" // Include the streaming evaluator
+#include "NGramSketch.h" // Include the n-gram counts
+#include "LabelModel.h" // Include the multi-class naive Bayes model
 #include <string> // Include standard string library
 #include <vector> // Include standard vector library
 #include <sstream> // Include string stream library
@@ -11,6 +16,23 @@
 #include <fstream> // Include file stream library
 #include <chrono> // Include the chrono library for measuring time
 #include <iomanip> // Include iomanip for output formatting
+#include <map> // Include map for reordering pipeline batches
+#include <deque> // Include deque for the pipeline queues
+#include <optional> // Include optional for the requested trie layout
+#include <mutex> // Include mutex for serializing incremental updates
+#include <atomic> // Include atomic for the pipeline failure flag
+#include <memory> // Include memory for the model
+
+/**
+ * @brief Wall-clock seconds spent in each stage of analyzing a file.
+ */
+struct StageTimes {
+    double read = 0; ///< Cutting the input into records.
+    double score = 0; ///< Tokenizing and classifying, summed over the workers.
+    double write = 0; ///< Writing the results file.
+    double evaluate = 0; ///< Joining the predictions with the answers.
+    double total = 0; ///< The whole pass, start to finish.
+};
 
 /**
  * @class SentimentAnalyzer
@@ -18,17 +40,71 @@
  * 
  * The SentimentAnalyzer class provides methods to analyze the sentiment of text using different methods,
  * analyze sentiment from files, and calculate the accuracy of the sentiment analysis.
- * It utilizes a Trie data structure for efficient sentiment analysis.
+ * It scores against a SentimentModel, a Trie or a flat hash table chosen at construction.
  */
 class SentimentAnalyzer { // Define SentimentAnalyzer class
 public: // Public members
     /**
      * @brief Constructs a new SentimentAnalyzer object.
      * 
-     * @param saveFile The file where the analysis results will be saved.
+     * With the trie backend, a binary model file (see Trie::saveBinary) is memory-mapped and scored in
+     * the compact layout, and a legacy model file is loaded into the map layout; the hash table backend
+     * reads either file into its table. If the file is missing or empty the model is
+     * trained and saved in the legacy format, and any "<saveFile>.delta" is deleted. Incremental updates
+     * saved by learn() in "<saveFile>.delta" are applied on top of a loaded model if the delta's header
+     * names that model file (its size and checksum); a delta saved on another model is ignored. If a corpus cache file is given, training
+     * reads the compiled corpus instead of the CSV, compiling it first if it is missing or stale.
+     * With n-gram options, n-gram counts are scored on top of the words. They are loaded from
+     * "<saveFile>.ngrams" when it holds a sketch of the same order and shape and the model itself was
+     * loaded; otherwise they are counted from the training data and saved there. N-grams learned on a
+     * loaded model are counted again from "<saveFile>.ngrams.delta", which training deletes.
+     * With label options, classify() picks one of the given labels with a multinomial naive Bayes
+     * model (see LabelModel) instead of thresholding the log odds. Its counts are loaded from
+     * "<saveFile>.labels" when it holds the same labels and the model itself was loaded; otherwise
+     * they are counted from the training data (or the corpus cache) and saved there. Tweets learned
+     * on a loaded model are learned again from "<saveFile>.labels.delta", which training deletes.
+     * 
+     * @param saveFile The model file to load, or to save the trained model to.
      * @param trainFile The file used for training the sentiment analysis model.
+     * @param trainThreads The number of threads used if the model has to be trained and saved.
+     * @param layout The trie node layout used for scoring; if empty, the layout the model was loaded or trained in is kept.
+     * @param backend The vocabulary store of the model.
+     * @param corpusFile The corpus cache (see CorpusCache) to train from, or empty to parse the training file.
+     * @param ngramOptions The n-gram features to score (see NGramSketch); if empty, only single tokens are scored.
+     * @param labelOptions The labels to classify into (see LabelModel); if empty, tweets are classified as positive or negative by their log odds.
+     * @throws std::logic_error If a layout is requested for a backend other than the trie, the n-gram or label options are out of range, or both are given (the label model scores single tokens only).
+     */
+    SentimentAnalyzer(const DSString& saveFile, const DSString& trainFile, unsigned trainThreads = 1, std::optional<TrieLayout> layout = std::nullopt, ModelBackend backend = ModelBackend::Trie, const DSString& corpusFile = DSString(), std::optional<NGramOptions> ngramOptions = std::nullopt, std::optional<LabelOptions> labelOptions = std::nullopt); // Constructor
+
+    /**
+     * @brief Folds the records of a training file into the model while other threads keep classifying.
+     * 
+     * The new counts are published atomically (see SentimentModel::update) and the accumulated updates are saved
+     * to the delta file next to the model; the model file itself is not rewritten. With label options the records are
+     * also counted into the label model's delta (see LabelModel::update), which touches only their tokens, and
+     * appended to "<saveFile>.labels.delta"; "<saveFile>.labels" is not rewritten. With n-gram options the tweets' n-grams are counted into the sketch in place and
+     * appended to "<saveFile>.ngrams.delta", which the constructor counts again on top of the sketch of a loaded model.
+     * 
+     * @param trainFile A file in the training file format.
+     * @return size_t The number of records folded in.
+     */
+    size_t learn(const DSString& trainFile); // Learn from a file
+
+    /**
+     * @brief Folds labeled tweets into the model while other threads keep classifying.
+     * 
+     * @param records The labeled tweets.
+     */
+    void learn(const std::vector<TrainingRecord>& records); // Learn from tweets
+
+    /**
+     * @brief Sets the additive smoothing of the log odds ratio of the model and of the n-gram sketch (see SentimentModel::setSmoothing).
+     * 
+     * Must not run while other threads classify.
+     * 
+     * @param alpha The count added to both the positive and the negative count (1 is Laplace smoothing).
      */
-    SentimentAnalyzer(const DSString& saveFile, const DSString& trainFile); // Constructor
+    void setSmoothing(double alpha); // Set the smoothing of the scores
 
     /**
      * @brief Analyzes the sentiment of the given text using the LO method.
@@ -49,10 +125,17 @@ public: // Public members
     /**
      * @brief Analyzes the sentiment of the text in the input file and writes the results to the output file.
      * 
+     * The input file is memory-mapped and scanned in place; the tweet is the rest of the record after the
+     * user field, unquoted if it is quoted. With more than one thread the file is processed as a pipeline:
+     * a reader stage cuts the input into batches of records, a pool of workers scores the batches against the read-only model, and a writer stage
+     * writes the results in input order, so the output is byte-identical to the serial path.
+     * 
      * @param input The input file containing text to be analyzed.
      * @param output The output file where the analysis results will be saved.
+     * @param numThreads The number of scoring workers (0 uses the hardware concurrency, 1 runs serially).
+     * @param evaluator If not null, receives every prediction in input order, so the results can be scored without reading the output file back.
      */
-    void analyzeFile(const DSString& input, const DSString& output) const; // Analyze sentiment of a file
+    void analyzeFile(const DSString& input, const DSString& output, unsigned numThreads = 1, Evaluator* evaluator = nullptr) const; // Analyze sentiment of a file
 
     /**
      * @brief Calculates the accuracy of the sentiment analysis by comparing the analyzed file with the answers file.
@@ -64,8 +147,138 @@ public: // Public members
      */
     double accuracy(const DSString& analyzedFile, const DSString& answersFile, const DSString& mistakesFile) const; // Calculate accuracy
 
+    /**
+     * @brief Compares the analyzed file with the answers file in one streaming pass (see Evaluator).
+     * 
+     * The mistakes file gets the accuracy with 3 decimals on its first line, then one "predicted,actual,id"
+     * line per mistake, written as the mistakes are found. The confusion matrix covers the labels of the label
+     * model if one classifies the tweets, and the labels 0, 2 and 4 otherwise.
+     * 
+     * @param analyzedFile The file containing the analyzed sentiment results.
+     * @param answersFile The file containing the correct sentiment answers.
+     * @param mistakesFile The file where the accuracy and the mistakes will be written.
+     * @return EvaluationReport The confusion matrix and the join counts.
+     */
+    EvaluationReport evaluate(const DSString& analyzedFile, const DSString& answersFile, const DSString& mistakesFile) const; // Evaluate a results file
+
+    /**
+     * @brief Analyzes the input file like analyzeFile and evaluates the predictions as they are made, without reading the output back.
+     * 
+     * Prints the time spent reading, scoring, writing and evaluating. The confusion matrix covers the same labels as evaluate().
+     * 
+     * @param input The input file containing text to be analyzed.
+     * @param answersFile The file containing the correct sentiment answers.
+     * @param output The output file where the analysis results will be saved; if empty, no results file is written.
+     * @param mistakesFile The file where the accuracy and the mistakes will be written, as by evaluate().
+     * @param numThreads The number of scoring workers (0 uses the hardware concurrency, 1 runs serially).
+     * @return EvaluationReport The confusion matrix and the join counts.
+     */
+    EvaluationReport analyzeAndEvaluate(const DSString& input, const DSString& answersFile, const DSString& output, const DSString& mistakesFile, unsigned numThreads = 1) const; // Analyze and evaluate a file
+
+    /**
+     * @brief Classifies a tweet as positive (4), negative (0) or neutral (2), or as one of the configured labels.
+     * 
+     * Safe to call from several threads at once, each with its own token buffer.
+     * 
+     * @param tweet The text of the tweet.
+     * @param words A scratch buffer for the tweet's tokens.
+     * @return int The predicted sentiment label.
+     */
+    int classify(std::string_view tweet, TokenBuffer& words) const; // Classify a tweet
+
 private: // Private members
-    Trie trie; // Trie data structure for sentiment analysis
+    /**
+     * @brief Sums the log-odds ratios and the sentiment scores of tokenized words, looking each word up once.
+     * 
+     * The scores of the words' n-grams are added when n-gram features are enabled.
+     * 
+     * @param words The tokenized words.
+     * @return WordScores The log-odds sum and the sentiment score sum.
+     */
+    WordScores sumScores(const TokenBuffer& words) const; // Sum both scores
+
+    /**
+     * @brief Classifies one record of the test file and appends its "sentiment,id" result line.
+     * 
+     * @param id The id field of the record.
+     * @param tweet The tweet field of the record.
+     * @param words A scratch buffer for the tweet's tokens.
+     * @param results The buffer the result line is appended to.
+     * @return int The predicted sentiment label.
+     */
+    int analyzeRecord(std::string_view id, std::string_view tweet, TokenBuffer& words, std::string& results) const; // Analyze one record of a file
+
+    struct ScoreBatch; // A batch of input records travelling through the pipeline
+
+    /**
+     * @brief Analyzes every record of a file, serially or as a pipeline, writing and evaluating the results in input order.
+     * 
+     * @param input The input file containing text to be analyzed.
+     * @param output The results file, or null to skip writing it; closed on return.
+     * @param evaluator If not null, receives every prediction in input order.
+     * @param numThreads The number of scoring workers (0 uses the hardware concurrency, 1 runs serially).
+     * @param times Receives the time spent in each stage.
+     * @return size_t The number of lines analyzed.
+     */
+    size_t analyzeRecords(const DSString& input, BufferedWriter* output, Evaluator* evaluator, unsigned numThreads, StageTimes& times) const; // Analyze every record of a file
+
+    /**
+     * @brief Runs the reader, scoring and writer stages of the parallel analyzeFile pipeline.
+     * 
+     * @param reader The CSV reader over the input file, positioned after the header line.
+     * @param output The results file, positioned after the header line, or null.
+     * @param evaluator If not null, receives every prediction in input order from the writer stage.
+     * @param numThreads The number of scoring workers.
+     * @param times Accumulates the time spent in each stage.
+     * @return size_t The number of lines analyzed.
+     */
+    size_t analyzePipelined(CSVReader& reader, BufferedWriter* output, Evaluator* evaluator, unsigned numThreads, StageTimes& times) const; // Analyze a file in parallel
+
+    /**
+     * @brief Reads the next batch of records into a batch, clearing it first.
+     * 
+     * @param reader The CSV reader over the input file.
+     * @param fields A scratch field list.
+     * @param batch The batch to fill.
+     * @param times Accumulates the reading time.
+     * @return bool True if any record was read.
+     */
+    static bool readBatch(CSVReader& reader, std::vector<std::string_view>& fields, ScoreBatch& batch, StageTimes& times); // Read a batch of records
+
+    /**
+     * @brief Classifies every record of a batch into its result lines.
+     * 
+     * @param batch The batch to score.
+     * @param words A scratch buffer for the tokens.
+     * @param keepLabels Whether to keep each predicted label for an evaluator.
+     */
+    void scoreBatch(ScoreBatch& batch, TokenBuffer& words, bool keepLabels) const; // Score a batch
+
+    /**
+     * @brief Writes a scored batch to the results file and hands its predictions to the evaluator.
+     * 
+     * @param batch The scored batch.
+     * @param output The results file, or null.
+     * @param evaluator The evaluator, or null.
+     * @param times Accumulates the scoring, writing and evaluation times.
+     */
+    static void deliverBatch(const ScoreBatch& batch, BufferedWriter* output, Evaluator* evaluator, StageTimes& times); // Write and evaluate a batch
+
+    std::unique_ptr<SentimentModel> model; // Vocabulary the tweets are scored against
+    std::unique_ptr<NGramSketch> ngrams; // N-gram counts scored on top of the words, if enabled
+    std::unique_ptr<LabelModel> labels; // Per-label counts that classify the tweets, if enabled
+    DSString deltaFile; // File holding the incremental updates to the model
+    DSString labelFile; // File holding the label counts
+    DSString labelDeltaFile; // File holding the tweets learned on top of the label counts
+    DSString ngramDeltaFile; // File holding the n-grams learned on top of the sketch
+    ModelStamp baseModel; // Stamp of the model file the updates are learned on top of
+    std::mutex learnMutex; // Mutex serializing learn() so the delta and label files match the published counts
+
+    /**
+     * @brief Gets the labels the evaluator's confusion matrix covers.
+     * @return The labels of the label model, or an empty list (0, 2 and 4) if none classifies the tweets.
+     */
+    std::vector<int> evaluatedLabels() const; // Get the evaluated labels
 };
 
 #endif // SENTIMENT_ANALYZER_H // End of include guard
\ No newline at end of file
@@ -0,0 +1,271 @@
+#include "SentimentModel.h" // Include the SentimentModel header file
+#include "Trie.h" // Include the Trie backend
+#include "HashVocabulary.h" // Include the hash table backend
+#include "CSVReader.h" // Include CSVReader for reading training files
+#include "CompactTrie.h" // Include CompactTrie for the model file checksum
+#include "CorpusCache.h" // Include CorpusCache for training from a compiled corpus
+#include "Metrics.h" // Include Metrics for the training counters
+#include <chrono> // Include the chrono library for timing
+#include <cmath> // Include cmath for the log odds ratio
+#include <cstdio> // Include cstdio for replacing the delta file
+#include <cstring> // Include cstring for the delta signature
+#include <filesystem> // Include filesystem for the delta file's size
+#include <fstream> // Include fstream for the save file format
+#include <iostream> // Include iostream for the timing output
+#include <map> // Include map for the records of an update, in word order
+#include <stdexcept> // Include stdexcept for std::runtime_error
+
+namespace {
+const char kDeltaMagic[8] = {'S', 'E', 'N', 'T', 'D', 'L', 'T', 'A'}; // Signature of a delta file
+
+struct DeltaHeader { // The 24-byte header of a delta file, followed by the records
+    char magic[8]; // Signature, kDeltaMagic
+    uint64_t baseSize; // Size of the base model file
+    uint64_t baseChecksum; // FNV-1a hash of the base model file
+};
+
+static_assert(sizeof(DeltaHeader) == 24, "The delta header must be 24 bytes"); // Keep the layout fixed
+
+std::string_view addToDelta(DeltaBuilder<TrieDelta>& builder, std::string_view word, int totalTweets, int positiveSentiments) { // Add counts to a word, returning its stored spelling
+    auto& entry = builder.entry(word); // Get the word's counts in the new delta
+    entry.second.totalTweets += totalTweets; // Add the totalTweets count
+    entry.second.positiveSentiments += positiveSentiments; // Add the positiveSentiments count
+    return entry.first; // Return the stored spelling
+}
+} // namespace
+
+SentimentModel::SentimentModel() : hasDelta(false) {} // Constructor for SentimentModel, no delta published yet
+
+SentimentModel::~SentimentModel() = default; // Destructor for SentimentModel
+
+std::unique_ptr<SentimentModel> SentimentModel::create(ModelBackend backend) { // Create an empty model on a backend
+    if (backend == ModelBackend::Hash) return std::make_unique<HashVocabulary>(); // Flat hash table keyed by the token
+    return std::make_unique<Trie>(); // Prefix tree
+}
+
+void SentimentModel::trainCorpus(const CorpusCache& corpus, unsigned numThreads) { // Train the model with a compiled corpus
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing
+    std::vector<WordCounts> counts = corpus.countTokens(numThreads); // Count every token id
+    for (uint32_t id = 0; id < counts.size(); ++id) { // Loop through each distinct word
+        if (counts[id].totalTweets > 0) addCounts(corpus.token(id), counts[id]); // Add its counts once
+    }
+    Metrics::add(Counter::RecordsTrained, corpus.records()); // Count the records
+    Metrics::add(Counter::TokensTrained, corpus.tokens()); // Count their tokens
+    auto end = std::chrono::high_resolution_clock::now(); // End timing
+    std::chrono::duration<double> duration = end - start; // Calculate the duration
+    std::cout << "Training completed in " << duration.count() << " seconds." << std::endl; // Output the duration
+}
+
+void SentimentModel::update(const std::vector<TrainingRecord>& records) { // Fold labeled tweets into the delta
+    std::lock_guard<std::mutex> lock(updateMutex); // Serialize the updates
+    DeltaBuilder<TrieDelta> builder(deltaSnapshot()); // Start from the published delta; readers keep it
+    std::map<std::string_view, WordCounts> added; // Counts this update adds, keyed by the stored spellings, for the delta file
+    TokenBuffer tokens; // Declare the token buffer, reused for every record
+    for (const TrainingRecord& record : records) { // Loop through each record
+        bool isPositive = (record.sentiment == "4"); // Determine if the sentiment is positive, as train() does
+        Tokenizer::tokenize(record.tweet, tokens); // Tokenize the tweet into words
+        for (size_t i = 0; i < tokens.size(); ++i) { // Loop through each word
+            WordCounts& counts = added[addToDelta(builder, tokens[i], 1, isPositive ? 1 : 0)]; // Add the word to the delta and to this update's records
+            counts.totalTweets++; // Increment the totalTweets count
+            if (isPositive) counts.positiveSentiments++; // Increment the positiveSentiments count
+        }
+        Metrics::add(Counter::TokensTrained, tokens.size()); // Count the record's tokens
+    }
+    for (const auto& pair : added) { // Loop through the words in order
+        appendRecord(unsavedRecords, pair.first, pair.second.totalTweets, pair.second.positiveSentiments); // Queue their records for the next saveDelta()
+    }
+    Metrics::add(Counter::RecordsTrained, records.size()); // Count the records
+    publishDelta(builder.finish()); // Swap the new delta in
+}
+
+size_t SentimentModel::update(const DSString& file) { // Fold the records of a training file into the delta
+    MappedFile mapped(file); // Map the file into memory
+    CSVReader reader(mapped.data(), mapped.data() + mapped.size()); // Declare a reader over the file
+    reader.skip(); // Skip the header line
+    std::vector<TrainingRecord> records; // Declare the records; their views point into the mapping
+    std::vector<std::string_view> fields; // Declare the field list, reused for every record
+    while (reader.next(fields, 6)) { // Read each record; the tweet takes the rest of the record
+        if (fields.size() < 6) continue; // Skip records with missing fields
+        records.push_back(TrainingRecord{fields[0], fields[5]}); // Add the record
+    }
+    update(records); // Fold them in as one update
+    return records.size(); // Return the number of records
+}
+
+std::shared_ptr<const TrieDelta> SentimentModel::deltaSnapshot() const { // Pin the current delta
+    if (!hasDelta.load(std::memory_order_acquire)) return nullptr; // Skip the atomic load until a delta exists
+    return std::atomic_load(&delta); // Load the published delta
+}
+
+void SentimentModel::forgetDeltaFile() { // Make the next save write the whole delta
+    deltaFile = DSString(); // No file holds the delta
+    deltaFileSize = 0; // Nor any part of it
+    unsavedRecords.clear(); // The next save writes every word
+}
+
+void SentimentModel::publishDelta(std::shared_ptr<const TrieDelta> next) { // Publish a new delta
+    std::atomic_store(&delta, std::move(next)); // Swap the pointer; the old delta lives on in its readers
+    hasDelta.store(true, std::memory_order_release); // Let lookups see it
+}
+
+void SentimentModel::saveDelta(const DSString& filename, const ModelStamp& base) { // Save the delta alone
+    std::lock_guard<std::mutex> lock(updateMutex); // Keep updates out while the records are written
+    std::error_code error; // Declare the error of the size query; a missing file is rewritten
+    uintmax_t size = std::filesystem::file_size(filename.c_str(), error); // Get the size of the file on disk
+    bool sameBase = base.size == deltaBase.size && base.checksum == deltaBase.checksum; // Check that the file was stamped with this base
+    if (!deltaFile.empty() && filename == deltaFile && sameBase && !error && size == deltaFileSize) { // If the file holds exactly what this model saved or loaded
+        if (unsavedRecords.empty()) return; // Nothing was learned since
+        std::ofstream file(filename.c_str(), std::ios::binary | std::ios::app); // Open the file for appending in binary mode
+        if (!file.is_open()) { // Check if the file is open
+            throw std::runtime_error("Could not open file for writing"); // Throw an error if the file could not be opened
+        }
+        file.write(unsavedRecords.data(), static_cast<std::streamsize>(unsavedRecords.size())); // Append the records of the new updates
+        file.close(); // Close the file
+        if (!file) { // Check the write
+            std::filesystem::resize_file(filename.c_str(), deltaFileSize, error); // Cut off the partial records
+            throw std::runtime_error("Error writing delta file"); // Throw an error if it failed
+        }
+        deltaFileSize += unsavedRecords.size(); // The file grew by the records
+        unsavedRecords.clear(); // They are saved
+        return; // The file is up to date
+    }
+
+    std::shared_ptr<const TrieDelta> snapshot = deltaSnapshot(); // Pin the delta
+    std::vector<std::pair<std::string_view, WordCounts>> words; // Declare the words in file order
+    if (snapshot != nullptr) { // If words were added incrementally
+        snapshot->forEach([&words](std::string_view word, const WordCounts& counts) { words.emplace_back(word, counts); }); // Collect them
+    }
+    std::sort(words.begin(), words.end(), [](const std::pair<std::string_view, WordCounts>& a, const std::pair<std::string_view, WordCounts>& b) { // Sort them so the file is deterministic
+        return a.first < b.first; // Compare the words
+    });
+    DeltaHeader header; // Declare the header naming the base model
+    std::memcpy(header.magic, kDeltaMagic, sizeof(kDeltaMagic)); // Write the signature
+    header.baseSize = base.size; // Write the base model's size
+    header.baseChecksum = base.checksum; // Write the base model's checksum
+    std::string buffer(reinterpret_cast<const char*>(&header), sizeof(header)); // Start the file with the header
+    for (const auto& pair : words) { // Loop through the words in order
+        appendRecord(buffer, pair.first, pair.second.totalTweets, pair.second.positiveSentiments); // Encode the word's record
+    }
+
+    std::string temporary = std::string(filename) + ".tmp"; // Write next to the destination first
+    std::ofstream file(temporary, std::ios::binary); // Open the temporary file for writing in binary mode
+    if (!file.is_open()) { // Check if the file is open
+        throw std::runtime_error("Could not open file for writing"); // Throw an error if the file could not be opened
+    }
+    file.write(buffer.data(), static_cast<std::streamsize>(buffer.size())); // Write the records
+    file.close(); // Close the file
+    if (!file || std::rename(temporary.c_str(), filename.c_str()) != 0) { // Check the write, then replace the old delta
+        std::remove(temporary.c_str()); // Remove the partial file
+        throw std::runtime_error("Error writing delta file"); // Throw an error if either failed
+    }
+    deltaFile = filename; // Later saves append to this file
+    deltaBase = base; // Remember its stamp
+    deltaFileSize = buffer.size(); // Remember its size
+    unsavedRecords.clear(); // Every update is saved
+}
+
+bool SentimentModel::loadDelta(const DSString& filename, const ModelStamp& base) { // Add the counts of a delta file saved on the base model
+    std::ifstream file(filename.c_str(), std::ios::binary); // Open the file for reading in binary mode
+    if (!file.is_open()) { // Check if the file is open
+        throw std::runtime_error("Could not open file for reading"); // Throw an error if the file could not be opened
+    }
+    DeltaHeader header; // Declare the header
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, kDeltaMagic, sizeof(kDeltaMagic)) != 0) { // Read and check the signature
+        return false; // A delta without a header cannot be matched with its model
+    }
+    if (header.baseSize != base.size || header.baseChecksum != base.checksum) { // If the delta was saved on another model
+        return false; // Leave the model as it is
+    }
+    file.close(); // The records are read from the header's end
+    std::lock_guard<std::mutex> lock(updateMutex); // Serialize the updates
+    DeltaBuilder<TrieDelta> builder(deltaSnapshot()); // Start from the published delta; readers keep it
+    uint64_t complete = sizeof(DeltaHeader); // Bytes up to the end of the last complete record
+    try { // Try block to catch a record cut short
+        readRecords(filename, [&builder, &complete](std::string_view word, int totalTweets, int positiveSentiments) { // Loop through each record
+            addToDelta(builder, word, totalTweets, positiveSentiments); // Add its counts
+            complete += sizeof(size_t) + word.size() + 2 * sizeof(int); // Count its bytes
+        }, sizeof(DeltaHeader)); // Start after the header
+    } catch (const std::runtime_error&) { // Catch block for a crash during an append
+        // The complete records are kept; the file no longer matches deltaFileSize, so the next save rewrites it.
+    }
+    publishDelta(builder.finish()); // Swap the new delta in
+    deltaFile = filename; // Later saves append to this file
+    deltaBase = base; // Remember its stamp
+    deltaFileSize = complete; // Remember the size of the records read
+    return true; // The delta was applied
+}
+
+ModelStamp SentimentModel::stampOf(const DSString& filename) { // Stamp a model file
+    MappedFile mapped(filename); // Map the file into memory
+    ModelStamp stamp; // Declare the stamp
+    stamp.size = mapped.size(); // Record the size
+    stamp.checksum = CompactTrie::checksum(mapped.data(), mapped.size()); // Hash the contents
+    return stamp; // Return the stamp
+}
+
+WordScores SentimentModel::scoresOf(const WordCounts& counts, double smoothing) { // Compute both scores from a word's counts
+    WordScores scores; // Declare the scores, zero for unknown words
+    if (counts.totalTweets == 0) { // If the totalTweets count is 0
+        return scores; // Return zero scores
+    }
+    double positiveRatio = counts.positiveSentiments + smoothing; // Calculate the positive ratio with additive smoothing
+    double negativeRatio = counts.totalTweets - counts.positiveSentiments + smoothing; // Calculate the negative ratio with additive smoothing
+    scores.logOdds = std::log(positiveRatio / negativeRatio); // Calculate the log odds ratio
+    scores.sentimentScore = static_cast<double>(counts.positiveSentiments - (counts.totalTweets - counts.positiveSentiments)) / counts.totalTweets; // Calculate the sentiment score
+    return scores; // Return both scores
+}
+
+bool SentimentModel::keeps(const WordCounts& counts, const PruneOptions& options, double smoothing) { // Check a word against the pruning thresholds
+    if (counts.totalTweets < options.minCount) return false; // Drop words seen in too few tweets
+    return std::abs(scoresOf(counts, smoothing).logOdds) >= options.minLogOdds; // Drop words that barely lean either way
+}
+
+std::vector<char*> SentimentModel::splitRanges(char* begin, char* end, unsigned numRanges, size_t maxFields) { // Split mapped CSV data on record boundaries
+    std::vector<char*> bounds(1, begin); // Start the first range at the first record
+    size_t size = static_cast<size_t>(end - begin); // Get the size of the data
+    for (unsigned i = 1; i < numRanges; ++i) { // Loop through each interior boundary
+        char* target = begin + size * i / numRanges; // Pick the evenly spaced position
+        if (target <= bounds.back()) continue; // Skip it if the previous record already covers it
+        char* boundary = const_cast<char*>(CSVReader::recordStart(bounds.back(), target, end, maxFields)); // Find the next record start, parsing on from the previous one
+        if (boundary >= end) break; // Stop if no more records start after it
+        bounds.push_back(boundary); // Add the boundary
+    }
+    bounds.push_back(end); // End the last range at the end of the data
+    return bounds; // Return the boundaries
+}
+
+void SentimentModel::appendRecord(std::string& out, std::string_view word, int totalTweets, int positiveSentiments) { // Encode one word record
+    size_t prefixSize = word.size(); // Get the length of the word
+    out.append(reinterpret_cast<const char*>(&prefixSize), sizeof(prefixSize)); // Append the prefix size
+    out.append(word.data(), word.size()); // Append the prefix
+    out.append(reinterpret_cast<const char*>(&totalTweets), sizeof(totalTweets)); // Append the totalTweets count
+    out.append(reinterpret_cast<const char*>(&positiveSentiments), sizeof(positiveSentiments)); // Append the positiveSentiments count
+}
+
+void SentimentModel::readRecords(const DSString& filename, const std::function<void(std::string_view, int, int)>& visit, std::streamoff offset) { // Read every record of a saved file
+    std::ifstream file(filename.c_str(), std::ios::binary); // Open the file for reading in binary mode
+    if (!file.is_open()) { // Check if the file is open
+        throw std::runtime_error("Could not open file for reading"); // Throw an error if the file could not be opened
+    }
+    file.seekg(offset); // Skip any header
+
+    DSString prefix; // Declare a string for the prefix, reused for every record
+    while (file) { // Loop while the file is open
+        size_t prefixSize; // Declare a variable for the prefix size
+        if (!file.read(reinterpret_cast<char*>(&prefixSize), sizeof(prefixSize))) { // Read the prefix size from the file
+            break; // Exit the loop if reading fails
+        }
+
+        prefix = DSString(prefixSize, '\0'); // Size the prefix
+        if (!file.read(&prefix[0], prefixSize)) { // Read the prefix from the file
+            throw std::runtime_error("Error reading prefix from file"); // Throw an error if reading fails
+        }
+
+        int totalTweets, positiveSentiments; // Declare variables for the tweet data
+        if (!file.read(reinterpret_cast<char*>(&totalTweets), sizeof(totalTweets)) || // Read the totalTweets count from the file
+            !file.read(reinterpret_cast<char*>(&positiveSentiments), sizeof(positiveSentiments))) { // Read the positiveSentiments count from the file
+            throw std::runtime_error("Error reading tweet data from file"); // Throw an error if reading fails
+        }
+        visit(std::string_view(prefix), totalTweets, positiveSentiments); // Hand the record to the caller
+    }
+}
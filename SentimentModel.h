@@ -0,0 +1,388 @@
+#ifndef SENTIMENT_MODEL_H // Include guard to prevent multiple inclusions
+#define SENTIMENT_MODEL_H // Define the include guard
+
+#include "DeltaMap.h" // Include DeltaMap for the incremental counts
+#include "DSString.h" // Include DSString for file names
+#include "Tokenizer.h" // Include Tokenizer for the token buffer
+#include <atomic> // Include atomic for the published delta flag
+#include <cstddef> // Include cstddef for size_t
+#include <cstdint> // Include cstdint for the model stamp
+#include <functional> // Include functional for std::function
+#include <ios> // Include ios for std::streamoff
+#include <memory> // Include memory for std::shared_ptr and std::unique_ptr
+#include <mutex> // Include mutex for serializing incremental updates
+#include <string> // Include string for the delta spellings
+#include <string_view> // Include string_view for words
+#include <vector> // Include vector for the training records
+
+class CorpusCache; // Forward declaration of the compiled training corpus
+
+/**
+ * @struct CachedScores
+ * @brief Both scores of a word, precomputed by SentimentModel::finalize().
+ */
+struct CachedScores {
+    float logOdds = 0.0f; ///< Smoothed log odds ratio.
+    float sentimentScore = 0.0f; ///< (positive - negative) / total.
+};
+
+/**
+ * @struct WordCounts
+ * @brief The training counts stored for a word.
+ */
+struct WordCounts {
+    int positiveSentiments = 0; ///< Number of positive tweets the word appeared in.
+    int totalTweets = 0; ///< Number of tweets the word appeared in.
+};
+
+/**
+ * @struct WordScores
+ * @brief Both per-word scores, computed from one lookup.
+ */
+struct WordScores {
+    double logOdds = 0.0; ///< Laplace-smoothed log odds ratio (0 for unknown words).
+    double sentimentScore = 0.0; ///< (positive - negative) / total (0 for unknown words).
+};
+
+/**
+ * @struct TrainingRecord
+ * @brief One labeled tweet for incremental training.
+ */
+struct TrainingRecord {
+    std::string_view sentiment; ///< The label field; "4" is positive, anything else negative.
+    std::string_view tweet; ///< The text of the tweet.
+};
+
+/**
+ * @struct TrieDelta
+ * @brief Counts added by incremental training on top of a model's vocabulary.
+ *
+ * A DeltaMap of WordCounts: a published delta is never modified, and an update copies only the
+ * shards it adds counts to.
+ */
+struct TrieDelta : DeltaMap<WordCounts> {};
+
+/**
+ * @struct ModelStamp
+ * @brief Identifies the base model file a delta was saved on top of.
+ */
+struct ModelStamp {
+    uint64_t size = 0; ///< Size of the model file in bytes.
+    uint64_t checksum = 0; ///< FNV-1a hash of the model file's bytes.
+};
+
+/**
+ * @struct PruneOptions
+ * @brief The words SentimentModel::prune() keeps.
+ */
+struct PruneOptions {
+    int minCount = 2; ///< Words seen in fewer tweets are dropped.
+    double minLogOdds = 0.0; ///< Words whose smoothed log odds ratio is closer to zero are dropped.
+};
+
+/**
+ * @brief Vocabulary stores a SentimentModel can be built on.
+ */
+enum class ModelBackend {
+    Trie, ///< A prefix tree (see Trie); supports the compact, memory-mapped layout.
+    Hash ///< A flat open-addressing hash table keyed by the whole token (see HashVocabulary).
+};
+
+/**
+ * @class SentimentModel
+ * @brief The vocabulary a SentimentAnalyzer scores against: per-word training counts and their scores.
+ *
+ * Scoring only ever looks whole tokens up, so any exact-match store can back the model. Backends
+ * implement training, persistence and lookups; the incremental delta layer (update, saveDelta,
+ * loadDelta) is shared, and every backend reads and writes the same save file format, so a model
+ * saved by one backend loads into the other.
+ *
+ * sumScores() is the one virtual call per tweet; backends implement it with sumWith(), which calls
+ * their own getScores() directly, so the per-token lookups are not dispatched through the vtable.
+ */
+class SentimentModel {
+public:
+    virtual ~SentimentModel(); ///< Destructor.
+
+    SentimentModel(const SentimentModel&) = delete; ///< Not copyable; the delta is shared with readers.
+    SentimentModel& operator=(const SentimentModel&) = delete; ///< Not copyable; the delta is shared with readers.
+
+    /**
+     * @brief Creates an empty model.
+     * @param backend The vocabulary store to build it on.
+     * @return The model.
+     */
+    static std::unique_ptr<SentimentModel> create(ModelBackend backend);
+
+    /**
+     * @brief Gets the name of the backend, for progress messages and reports.
+     * @return "trie" or "hash table".
+     */
+    virtual const char* name() const = 0;
+
+    /**
+     * @brief Trains the model with the records of a training file.
+     * @param file The training file; its header line is skipped.
+     * @param numThreads The number of threads to train with (0 uses the hardware concurrency).
+     */
+    virtual void train(const DSString& file, unsigned numThreads = 1) = 0;
+
+    /**
+     * @brief Counts one occurrence of a word.
+     * @param word The word to insert.
+     * @param isPositive Boolean indicating if the word has a positive sentiment.
+     */
+    virtual void insert(std::string_view word, bool isPositive) = 0;
+
+    /**
+     * @brief Adds counts to a word, as if each of its tweets had been inserted.
+     * @param word The word.
+     * @param counts The counts to add.
+     */
+    virtual void addCounts(std::string_view word, const WordCounts& counts) = 0;
+
+    /**
+     * @brief Trains the model with a compiled corpus (see CorpusCache) instead of a CSV file.
+     *
+     * The corpus' token ids are counted into flat arrays and each distinct word is then handed to
+     * addCounts() once, so nothing is parsed or tokenized. The counts equal those train() builds from
+     * the source file.
+     *
+     * @param corpus The compiled corpus.
+     * @param numThreads The number of threads to count with (0 uses the hardware concurrency).
+     */
+    void trainCorpus(const CorpusCache& corpus, unsigned numThreads = 1);
+
+    /**
+     * @brief Saves the model in the legacy record format, one record per word in byte order.
+     *
+     * The file does not depend on the backend or the thread count. Counts added by update() are not
+     * included; save them with saveDelta().
+     *
+     * @param filename The name of the file to save the model to.
+     * @param numThreads The number of threads to encode with (0 uses the hardware concurrency).
+     */
+    virtual void save(const DSString& filename, unsigned numThreads = 0) const = 0;
+
+    /**
+     * @brief Loads a model saved by save().
+     * @param filename The name of the file to load the model from.
+     */
+    virtual void load(const DSString& filename) = 0;
+
+    /**
+     * @brief Loads a binary model file (see Trie::saveBinary).
+     * @param filename The name of the file to load the model from.
+     * @param verifyChecksum Whether to hash the whole file to detect corruption.
+     * @throws std::runtime_error If the file is not a valid binary model.
+     */
+    virtual void loadBinary(const DSString& filename, bool verifyChecksum = true) = 0;
+
+    /**
+     * @brief Precomputes both scores of every word so lookups read them instead of computing them.
+     *
+     * Anything that changes the counts drops the cache. Must not run while other threads read the model.
+     */
+    virtual void finalize() = 0;
+
+    /**
+     * @brief Sets the additive smoothing of the log odds ratio, recomputing the cache if it is in use.
+     *
+     * The smoothing is not saved with the model; set it again after loading. It also decides which
+     * words prune() keeps by log odds. Must not run while other threads read the model.
+     *
+     * @param alpha The count added to both the positive and the negative count (1 is Laplace smoothing).
+     */
+    virtual void setSmoothing(double alpha) = 0;
+
+    /**
+     * @brief Gets the additive smoothing of the log odds ratio.
+     * @return The smoothing count.
+     */
+    virtual double smoothing() const = 0;
+
+    /**
+     * @brief Drops the trained words that carry too little evidence, and the storage they held.
+     *
+     * Words seen in fewer than minCount tweets (mostly words seen once) and words whose absolute log
+     * odds ratio is below minLogOdds are removed; lookups of them then score zero, like unknown words.
+     * The delta is not pruned. Must not run while other threads read the model.
+     *
+     * @param options The thresholds a word must reach to be kept.
+     * @return The number of words dropped.
+     */
+    virtual size_t prune(const PruneOptions& options) = 0;
+
+    /**
+     * @brief Counts the distinct words stored in the model.
+     * @return The number of words with a nonzero tweet count, including words only the delta holds.
+     */
+    virtual size_t wordCount() const = 0;
+
+    /**
+     * @brief Gets both scores of a word against a pinned delta.
+     * @param word The word to score.
+     * @param snapshot The delta from deltaSnapshot(), or nullptr to read the trained counts only.
+     * @return Both scores of the word (zero if the word is not found).
+     */
+    virtual WordScores getScores(std::string_view word, const TrieDelta* snapshot) const = 0;
+
+    /**
+     * @brief Sums both scores of tokenized words against one delta snapshot.
+     * @param words The tokenized words.
+     * @return The log-odds sum and the sentiment score sum.
+     */
+    virtual WordScores sumScores(const TokenBuffer& words) const = 0;
+
+    /**
+     * @brief Folds labeled tweets into the model while other threads keep scoring.
+     *
+     * The trained counts are not touched: the counts go into a new delta that copies the shards the
+     * records touch and shares the rest, which is then published with one atomic pointer swap. Readers
+     * never wait for an update; a reader that pinned the previous delta keeps seeing it until it takes
+     * a new snapshot. Updates are serialized, and the next saveDelta() appends their counts.
+     *
+     * @param records The labeled tweets, tokenized and counted exactly as train() counts them.
+     */
+    void update(const std::vector<TrainingRecord>& records);
+
+    /**
+     * @brief Folds the records of a training file into the model as one update.
+     * @param file A file in the training file format.
+     * @return The number of records folded in.
+     */
+    size_t update(const DSString& file);
+
+    /**
+     * @brief Pins the current delta so a series of lookups sees one consistent model.
+     * @return The current delta, or nullptr if nothing was added since the model was built.
+     */
+    std::shared_ptr<const TrieDelta> deltaSnapshot() const;
+
+    /**
+     * @brief Saves the delta alone, in the record format of save(), behind a header naming the base model.
+     *
+     * The header holds the stamp of the base model file, so the delta is never applied to another
+     * model. If the file is the one this model last saved or loaded, on the same base and still of the
+     * size it left it at, only the records of the updates since then are appended, one record per
+     * word and update; loadDelta() adds the records up. Otherwise the whole delta is written in word
+     * order next to the destination and renamed over it.
+     *
+     * @param filename The name of the file to save the delta to.
+     * @param base The stamp of the model file the delta was added on top of (see stampOf()).
+     * @throws std::runtime_error If the file cannot be written; the updates stay unsaved then.
+     */
+    void saveDelta(const DSString& filename, const ModelStamp& base);
+
+    /**
+     * @brief Adds the counts of a delta file saved by saveDelta() as one update, if it belongs to the base model.
+     *
+     * A record cut short by a crash during an append is dropped with the rest of that update, and the
+     * next saveDelta() rewrites the file without it.
+     *
+     * @param filename The name of the file to load the delta from.
+     * @param base The stamp of the model file loaded as the base.
+     * @return False if the delta was saved on top of another model, or has no header; nothing is added then.
+     * @throws std::runtime_error If the file cannot be read.
+     */
+    bool loadDelta(const DSString& filename, const ModelStamp& base);
+
+    /**
+     * @brief Stamps a model file, so a delta can be matched with the model it was saved on.
+     * @param filename The name of the model file.
+     * @return Its size and checksum.
+     * @throws std::runtime_error If the file cannot be mapped.
+     */
+    static ModelStamp stampOf(const DSString& filename);
+
+    /**
+     * @brief Computes both scores from a word's counts.
+     * @param counts The counts of the word.
+     * @param smoothing The additive smoothing of the log odds ratio.
+     * @return Both scores (zero if the word was never seen).
+     */
+    static WordScores scoresOf(const WordCounts& counts, double smoothing = 1.0);
+
+    /**
+     * @brief Splits mapped CSV data into ranges that start on record boundaries.
+     * @param begin The first byte of the data.
+     * @param end One past the last byte of the data.
+     * @param numRanges The desired number of ranges.
+     * @param maxFields The field count the records are read with (see CSVReader::next).
+     * @return The range boundaries, starting with @p begin and ending with @p end.
+     */
+    static std::vector<char*> splitRanges(char* begin, char* end, unsigned numRanges, size_t maxFields);
+
+protected:
+    std::shared_ptr<const TrieDelta> delta; ///< Counts added by incremental training; accessed with std::atomic_load/atomic_store.
+    std::atomic<bool> hasDelta; ///< Flag set once a delta is published, so lookups skip the snapshot until then.
+    std::mutex updateMutex; ///< Mutex serializing incremental updates.
+    std::string unsavedRecords; ///< Records of the counts added since the delta file was last written; guarded by updateMutex.
+    DSString deltaFile; ///< The delta file last saved or loaded; guarded by updateMutex.
+    ModelStamp deltaBase; ///< The base stamp of deltaFile; guarded by updateMutex.
+    uint64_t deltaFileSize = 0; ///< The size deltaFile was left at; guarded by updateMutex.
+
+    /**
+     * @brief Constructs a model without a delta.
+     */
+    SentimentModel();
+
+    /**
+     * @brief Checks if a word's counts reach the pruning thresholds.
+     * @param counts The counts of the word.
+     * @param options The thresholds.
+     * @param smoothing The additive smoothing of the log odds ratio.
+     * @return True if the word is kept.
+     */
+    static bool keeps(const WordCounts& counts, const PruneOptions& options, double smoothing = 1.0);
+
+    /**
+     * @brief Forgets the saved delta file, so the next saveDelta() writes the whole delta.
+     *
+     * Call with updateMutex held, after the delta was replaced other than by update().
+     */
+    void forgetDeltaFile();
+
+    /**
+     * @brief Publishes a new delta.
+     * @param next The delta to publish; never modified afterwards.
+     */
+    void publishDelta(std::shared_ptr<const TrieDelta> next);
+
+    /**
+     * @brief Sums both scores of tokenized words with a backend's own lookup.
+     * @param model The backend; its getScores() is called without virtual dispatch.
+     * @param words The tokenized words.
+     * @return The log-odds sum and the sentiment score sum.
+     */
+    template <typename Model>
+    static WordScores sumWith(const Model& model, const TokenBuffer& words) {
+        WordScores sums; // Initialize both sums to zero
+        std::shared_ptr<const TrieDelta> snapshot = model.deltaSnapshot(); // Pin the incremental counts so the tweet sees one model
+        for (size_t i = 0; i < words.size(); ++i) { // Iterate over each word
+            WordScores scores = model.Model::getScores(words[i], snapshot.get()); // Look the word up once for both scores
+            sums.logOdds += scores.logOdds; // Add the log-odds ratio of the word to the sum
+            sums.sentimentScore += scores.sentimentScore; // Add the sentiment score of the word to the sum
+        }
+        return sums; // Return both sums
+    }
+
+    /**
+     * @brief Reads every record of a file in the save file format.
+     * @param filename The name of the file to read.
+     * @param visit Called with the word, totalTweets and positiveSentiments of each record.
+     * @param offset The position of the first record, after any header.
+     */
+    static void readRecords(const DSString& filename, const std::function<void(std::string_view, int, int)>& visit, std::streamoff offset = 0);
+
+    /**
+     * @brief Encodes one word record in the save file format.
+     * @param out The buffer receiving the record.
+     * @param word The word.
+     * @param totalTweets The number of tweets the word appeared in.
+     * @param positiveSentiments The number of positive tweets the word appeared in.
+     */
+    static void appendRecord(std::string& out, std::string_view word, int totalTweets, int positiveSentiments);
+};
+
+#endif // SENTIMENT_MODEL_H // End of include guard
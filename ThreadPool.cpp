@@ -0,0 +1,194 @@
+#include "ThreadPool.h" // Include the ThreadPool header file
+#include <iostream> // Include iostream for reporting task exceptions
+#include <chrono> // Include chrono for the helping wait interval
+#include <algorithm> // Include algorithm for std::max
+
+namespace {
+thread_local const ThreadPool* tCurrentPool = nullptr; // Pool the calling thread works for, if any
+thread_local size_t tCurrentIndex = 0; // Deque of the calling worker within its pool
+
+void runTask(std::function<void()>& task) { // Run a task, reporting what escapes it
+    try {
+        task(); // Execute the task
+    } catch (const std::exception& e) { // Catch standard exceptions
+        std::cerr << "Task threw an exception: " << e.what() << std::endl; // Print the exception message
+    } catch (...) { // Catch all other exceptions
+        std::cerr << "Task threw an unknown exception" << std::endl; // Print a generic error message
+    }
+}
+} // namespace
+
+ThreadPool::ThreadPool(size_t numThreads) : queued(0), sleeping(0), nextQueue(0), stop(false) { // Constructor for ThreadPool
+    if (numThreads == 0) { // If the caller asked for the hardware concurrency
+        numThreads = std::max(1u, std::thread::hardware_concurrency()); // Use every core, but at least one thread
+    }
+    for (size_t i = 0; i < numThreads; ++i) { // Loop to create the deques
+        queues.emplace_back(new WorkerQueue()); // Add a deque for the worker
+    }
+    for (size_t i = 0; i < numThreads; ++i) { // Loop to create worker threads
+        workers.emplace_back(&ThreadPool::workerThread, this, i); // Add a worker thread to the pool
+    }
+}
+
+ThreadPool::~ThreadPool() { // Destructor for ThreadPool
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex); // Lock the sleep mutex
+        stop = true; // Set stop to true to signal threads to stop once the deques are empty
+    }
+    wake.notify_all(); // Notify all threads
+    for (std::thread& worker : workers) { // Loop through all worker threads
+        worker.join(); // Join each worker thread
+    }
+}
+
+void ThreadPool::enqueue(std::function<void()> task) { // Enqueue a task to the thread pool
+    WorkerQueue& queue = *queues[submitQueue()]; // Pick the deque for the task
+    queued++; // Count the task first so the count never falls below the deque contents
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex); // Lock the deque
+        queue.tasks.push_back(std::move(task)); // Add the task at the owner's end
+    }
+    notifyWorkers(1); // Wake a worker if one is asleep
+}
+
+void ThreadPool::enqueueBulk(std::vector<std::function<void()>> tasks) { // Enqueue several tasks at once
+    if (tasks.empty()) return; // Nothing to do for an empty list
+    size_t first = submitQueue(); // Pick the deque for the first task
+    queued += tasks.size(); // Count the tasks first so the count never falls below the deque contents
+    size_t perQueue = (tasks.size() + queues.size() - 1) / queues.size(); // Number of tasks each deque receives
+    for (size_t q = 0, t = 0; t < tasks.size(); ++q) { // Loop through the deques until every task is placed
+        WorkerQueue& queue = *queues[(first + q) % queues.size()]; // Get the next deque
+        std::lock_guard<std::mutex> lock(queue.mutex); // Lock it once for its share
+        for (size_t n = 0; n < perQueue && t < tasks.size(); ++n, ++t) { // Loop through its share of the tasks
+            queue.tasks.push_back(std::move(tasks[t])); // Add the task
+        }
+    }
+    notifyWorkers(tasks.size()); // Wake the sleeping workers once
+}
+
+bool ThreadPool::runPendingTask() { // Run one queued task on the calling thread
+    std::function<void()> task; // Declare a task
+    size_t index = tCurrentPool == this ? tCurrentIndex : 0; // Prefer the caller's own deque
+    if (!takeTask(index, task)) return false; // Report that nothing was queued
+    runTask(task); // Execute the task
+    return true; // Report that a task was run
+}
+
+size_t ThreadPool::size() const { // Get the number of worker threads
+    return workers.size(); // Return the worker count
+}
+
+void ThreadPool::workerThread(size_t index) { // Worker thread function
+    tCurrentPool = this; // Route tasks submitted by this thread to its own deque
+    tCurrentIndex = index; // Remember the deque
+    while (true) { // Infinite loop
+        std::function<void()> task; // Declare a task
+        if (takeTask(index, task)) { // If a task was found locally or stolen
+            runTask(task); // Execute the task
+            continue; // Look for the next task
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex); // Lock the sleep mutex
+        sleeping++; // Announce that this worker may sleep before checking for tasks once more
+        wake.wait(lock, [this] { return stop || queued > 0; }); // Wait for a task or stop signal
+        sleeping--; // This worker is awake again
+        if (stop && queued == 0) { // If stop is true and no tasks are left
+            return; // Exit the loop
+        }
+    }
+}
+
+bool ThreadPool::takeTask(size_t index, std::function<void()>& task) { // Take a task from the preferred deque or steal one
+    if (queued == 0) return false; // Skip the deques if every one is empty
+    {
+        WorkerQueue& own = *queues[index]; // Get the preferred deque
+        std::lock_guard<std::mutex> lock(own.mutex); // Lock it
+        if (!own.tasks.empty()) { // If it has a task
+            task = std::move(own.tasks.back()); // Take the newest task
+            own.tasks.pop_back(); // Remove it
+            queued--; // Count it as taken
+            return true; // Report success
+        }
+    }
+    for (size_t k = 1; k < queues.size(); ++k) { // Loop through the other deques
+        WorkerQueue& victim = *queues[(index + k) % queues.size()]; // Get the next deque
+        std::lock_guard<std::mutex> lock(victim.mutex); // Lock it
+        if (!victim.tasks.empty()) { // If it has a task
+            task = std::move(victim.tasks.front()); // Steal the oldest task
+            victim.tasks.pop_front(); // Remove it
+            queued--; // Count it as taken
+            return true; // Report success
+        }
+    }
+    return false; // Report that every deque was empty
+}
+
+size_t ThreadPool::submitQueue() { // Pick the deque for a new task
+    if (tCurrentPool == this) return tCurrentIndex; // Workers keep their own tasks
+    return nextQueue++ % queues.size(); // Spread outside submissions round robin
+}
+
+void ThreadPool::notifyWorkers(size_t count) { // Wake sleeping workers after queueing tasks
+    if (sleeping == 0) return; // Nobody to wake; a worker about to sleep rechecks the queued count first
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex); // Wait until a worker announcing sleep is actually waiting
+    }
+    if (count == 1) { // If one task was queued
+        wake.notify_one(); // Wake one worker
+    } else { // If several tasks were queued
+        wake.notify_all(); // Wake every worker
+    }
+}
+
+TaskGroup::TaskGroup(ThreadPool& pool) : pool(pool), pending(0) {} // Construct an empty group
+
+TaskGroup::~TaskGroup() { // Destructor for TaskGroup
+    join(); // Wait for the tasks; the destructor must not throw
+}
+
+void TaskGroup::run(std::function<void()> task) { // Add a task to the group
+    pool.enqueue(wrap(std::move(task))); // Queue the wrapped task
+}
+
+void TaskGroup::runEach(size_t count, std::function<void(size_t)> function) { // Add indexed tasks in one submission
+    auto shared = std::make_shared<std::function<void(size_t)>>(std::move(function)); // Share the function between the tasks
+    std::vector<std::function<void()>> tasks; // Declare the task list
+    tasks.reserve(count); // Reserve room for every task
+    for (size_t i = 0; i < count; ++i) { // Loop through each index
+        tasks.push_back(wrap([shared, i] { (*shared)(i); })); // Add the wrapped task
+    }
+    pool.enqueueBulk(std::move(tasks)); // Queue them together
+}
+
+void TaskGroup::wait() { // Wait for every task of the group
+    join(); // Wait for the tasks
+    std::exception_ptr failure; // Declare the exception to rethrow
+    {
+        std::lock_guard<std::mutex> lock(mutex); // Lock the group
+        failure = error; // Take the first exception
+        error = nullptr; // Reset it so the group can be reused
+    }
+    if (failure) std::rethrow_exception(failure); // Rethrow it
+}
+
+std::function<void()> TaskGroup::wrap(std::function<void()> task) { // Wrap a task for the group
+    pending++; // Count the task before it can run
+    return [this, task = std::move(task)] { // Return the wrapped task
+        try {
+            task(); // Run the task
+        } catch (...) { // Catch any exception
+            std::lock_guard<std::mutex> lock(mutex); // Lock the group
+            if (!error) error = std::current_exception(); // Keep the first exception
+        }
+        std::lock_guard<std::mutex> lock(mutex); // Lock the group so a waiter cannot destroy it while it is signalled
+        if (--pending == 0) done.notify_all(); // Signal the waiters after the last task
+    };
+}
+
+void TaskGroup::join() { // Wait for every task, helping the pool meanwhile
+    while (pending > 0) { // Loop until the group is finished
+        if (pool.runPendingTask()) continue; // Run a queued task instead of idling
+        std::unique_lock<std::mutex> lock(mutex); // Lock the group
+        done.wait_for(lock, std::chrono::milliseconds(1), [this] { return pending == 0; }); // Sleep briefly; new tasks may be queued meanwhile
+    }
+    std::lock_guard<std::mutex> lock(mutex); // Wait for the last task to release the group
+}
@@ -0,0 +1,193 @@
+#ifndef THREAD_POOL_H // Include guard to prevent multiple inclusions
+#define THREAD_POOL_H // Define the include guard
+
+#include <thread> // Include thread for the worker threads
+#include <mutex> // Include mutex for the per-worker queues
+#include <condition_variable> // Include condition_variable for sleeping workers
+#include <deque> // Include deque for the per-worker task queues
+#include <vector> // Include vector for the workers and their queues
+#include <functional> // Include functional for std::function
+#include <future> // Include future for task results
+#include <memory> // Include memory for std::unique_ptr and std::shared_ptr
+#include <atomic> // Include atomic for the task and sleeper counts
+#include <exception> // Include exception for std::exception_ptr
+#include <cstddef> // Include cstddef for size_t
+
+/**
+ * @class ThreadPool
+ * @brief A work-stealing thread pool.
+ *
+ * Every worker owns a task deque. A task submitted from a worker goes to the back of that worker's
+ * deque and the worker takes its own tasks from the back, so recursive tasks stay on the thread that
+ * spawned them; a worker whose deque is empty steals from the front of the other deques. Tasks
+ * submitted from outside the pool are spread over the deques round robin. Each deque has its own
+ * mutex, so there is no single lock every enqueue and dequeue contends on, and idle workers are only
+ * woken when some are actually asleep.
+ */
+class ThreadPool {
+public:
+    /**
+     * @brief Constructs a ThreadPool with a specified number of threads.
+     * @param numThreads The number of threads to create in the pool (0 uses the hardware concurrency).
+     */
+    explicit ThreadPool(size_t numThreads);
+
+    /**
+     * @brief Runs every queued task, then stops and joins the workers.
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete; ///< Not copyable; workers hold a pointer to the pool.
+    ThreadPool& operator=(const ThreadPool&) = delete; ///< Not copyable; workers hold a pointer to the pool.
+
+    /**
+     * @brief Adds a task to be executed by the thread pool.
+     *
+     * Exceptions escaping the task are reported on std::cerr; use submit() or a TaskGroup to
+     * receive them instead.
+     *
+     * @param task A function object representing the task to be executed.
+     */
+    void enqueue(std::function<void()> task);
+
+    /**
+     * @brief Adds several tasks at once, waking the sleeping workers once instead of per task.
+     * @param tasks The tasks to be executed.
+     */
+    void enqueueBulk(std::vector<std::function<void()>> tasks);
+
+    /**
+     * @brief Adds a task and returns a future for its result (or its exception).
+     * @param function The function to run.
+     * @return A future that becomes ready when the function has run.
+     */
+    template <typename Function>
+    auto submit(Function function) -> std::future<decltype(function())>;
+
+    /**
+     * @brief Runs one queued task on the calling thread, if there is one.
+     * @return True if a task was run, false if every deque was empty.
+     */
+    bool runPendingTask();
+
+    /**
+     * @brief Gets the number of worker threads.
+     * @return The number of workers.
+     */
+    size_t size() const;
+
+private:
+    struct WorkerQueue { // The task deque owned by one worker
+        std::mutex mutex; // Mutex protecting the deque
+        std::deque<std::function<void()>> tasks; // Tasks; the owner works at the back, thieves at the front
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues; ///< One deque per worker.
+    std::vector<std::thread> workers; ///< Worker threads.
+    std::atomic<size_t> queued; ///< Number of tasks queued and not yet taken (counted before they are pushed).
+    std::atomic<size_t> sleeping; ///< Number of workers waiting for tasks.
+    std::atomic<size_t> nextQueue; ///< Round-robin position for tasks submitted from outside the pool.
+    std::mutex sleepMutex; ///< Mutex the idle workers wait on.
+    std::condition_variable wake; ///< Condition variable signalled when tasks arrive or the pool stops.
+    bool stop; ///< Flag to stop the ThreadPool.
+
+    /**
+     * @brief Method for worker threads to execute tasks from their deque or steal from others.
+     * @param index The index of the worker's deque.
+     */
+    void workerThread(size_t index);
+
+    /**
+     * @brief Takes a task, from the back of the preferred deque or else from the front of another.
+     * @param index The index of the preferred deque.
+     * @param task Receives the task.
+     * @return True if a task was taken.
+     */
+    bool takeTask(size_t index, std::function<void()>& task);
+
+    /**
+     * @brief Gets the deque a task submitted from the calling thread should go to.
+     * @return The index of the calling worker's deque, or the next deque in round-robin order.
+     */
+    size_t submitQueue();
+
+    /**
+     * @brief Wakes sleeping workers after tasks were queued.
+     * @param count The number of tasks queued.
+     */
+    void notifyWorkers(size_t count);
+};
+
+/**
+ * @class TaskGroup
+ * @brief A set of tasks run on a ThreadPool that can be waited for together.
+ *
+ * wait() runs queued tasks on the calling thread while the group is unfinished, so a task running on
+ * the pool may itself wait for a nested group without deadlocking. The first exception thrown by a
+ * task of the group is rethrown by wait().
+ */
+class TaskGroup {
+public:
+    /**
+     * @brief Constructs an empty group on a pool.
+     * @param pool The pool running the group's tasks.
+     */
+    explicit TaskGroup(ThreadPool& pool);
+
+    /**
+     * @brief Waits for the group's tasks; their exceptions are discarded.
+     */
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup&) = delete; ///< Not copyable; tasks hold a pointer to the group.
+    TaskGroup& operator=(const TaskGroup&) = delete; ///< Not copyable; tasks hold a pointer to the group.
+
+    /**
+     * @brief Adds a task to the group.
+     * @param task The task to run.
+     */
+    void run(std::function<void()> task);
+
+    /**
+     * @brief Adds count tasks to the group in one bulk submission; task i calls function(i).
+     * @param count The number of tasks.
+     * @param function The function called with each task index.
+     */
+    void runEach(size_t count, std::function<void(size_t)> function);
+
+    /**
+     * @brief Waits until every task of the group has finished.
+     * @throws The first exception thrown by a task of the group.
+     */
+    void wait();
+
+private:
+    ThreadPool& pool; ///< Pool running the tasks.
+    std::atomic<size_t> pending; ///< Number of unfinished tasks.
+    std::mutex mutex; ///< Mutex protecting the error and the completion signal.
+    std::condition_variable done; ///< Condition variable signalled when the last task finishes.
+    std::exception_ptr error; ///< First exception thrown by a task.
+
+    /**
+     * @brief Wraps a task so it records its exception and its completion in the group.
+     * @param task The task to wrap.
+     * @return The wrapped task.
+     */
+    std::function<void()> wrap(std::function<void()> task);
+
+    /**
+     * @brief Waits until every task has finished, helping the pool meanwhile.
+     */
+    void join();
+};
+
+template <typename Function>
+auto ThreadPool::submit(Function function) -> std::future<decltype(function())> { // Add a task with a result
+    using Result = decltype(function()); // Get the result type of the function
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::move(function)); // Wrap the function so its result reaches the future
+    std::future<Result> result = task->get_future(); // Get the future before the task can run
+    enqueue([task] { (*task)(); }); // Queue the wrapped function
+    return result; // Return the future
+}
+
+#endif // THREAD_POOL_H // End of include guard
@@ -0,0 +1,86 @@
+#include "TokenInterner.h" // Include the TokenInterner header file
+#include <functional> // Include functional for hashing tokens
+#include <stdexcept> // Include stdexcept for std::runtime_error
+
+namespace {
+const size_t kInitialSlots = 1024; // Slots of an empty interner, a power of two
+} // namespace
+
+TokenInterner::TokenInterner() : offsets(1, 0), slots(kInitialSlots) {} // Constructor for TokenInterner, with an empty table
+
+uint64_t TokenInterner::hashOf(std::string_view token) { // Hash a token into 64 bits
+    uint64_t hash = std::hash<std::string_view>()(token); // Use the standard string hash, which is only 32 bits on some platforms
+    hash ^= hash >> 33; // Spread its bits over all 64 with the MurmurHash3 finalizer, so the tag is never constant
+    hash *= 0xff51afd7ed558ccdULL; // Multiply by the first constant
+    hash ^= hash >> 33; // Fold again
+    hash *= 0xc4ceb9fe1a85ec53ULL; // Multiply by the second constant
+    hash ^= hash >> 33; // Fold a last time
+    return hash; // Return the mixed hash
+}
+
+uint32_t TokenInterner::find(std::string_view token) const { // Get the id of a token without adding it
+    uint64_t hash = hashOf(token); // Hash the token
+    uint32_t tag = static_cast<uint32_t>(hash >> 32); // Get its tag
+    size_t mask = slots.size() - 1; // Mask for wrapping around the table
+    for (size_t slot = static_cast<size_t>(hash) & mask; slots[slot].id != 0; slot = (slot + 1) & mask) { // Probe until an empty slot
+        if (slots[slot].tag != tag) continue; // Skip other tokens without touching their bytes
+        uint32_t id = slots[slot].id - 1; // Get the id in the slot
+        if (this->token(id) == token) return id; // Return it if the bytes match
+    }
+    return kUnknown; // The token was never interned
+}
+
+uint32_t TokenInterner::intern(std::string_view token) { // Get the id of a token, adding it if it is new
+    if ((size() + 1) * 2 > slots.size()) grow(); // Keep the load factor at most one half
+    uint64_t hash = hashOf(token); // Hash the token
+    uint32_t tag = static_cast<uint32_t>(hash >> 32); // Get its tag
+    size_t mask = slots.size() - 1; // Mask for wrapping around the table
+    size_t slot = static_cast<size_t>(hash) & mask; // Start at the home slot
+    for (; slots[slot].id != 0; slot = (slot + 1) & mask) { // Probe until an empty slot
+        if (slots[slot].tag != tag) continue; // Skip other tokens without touching their bytes
+        uint32_t id = slots[slot].id - 1; // Get the id in the slot
+        if (this->token(id) == token) return id; // Return it if the bytes match
+    }
+    if (chars.size() + token.size() > UINT32_MAX || size() + 1 >= kUnknown) { // Check that the token's offset and id fit
+        throw std::runtime_error("Too many tokens to intern"); // Throw an error if they do not
+    }
+    uint32_t id = static_cast<uint32_t>(size()); // Hand out the next id
+    chars.insert(chars.end(), token.begin(), token.end()); // Append the token's bytes
+    offsets.push_back(static_cast<uint32_t>(chars.size())); // Record where it ends
+    slots[slot].tag = tag; // Claim the empty slot
+    slots[slot].id = id + 1; // Store the id plus one
+    return id; // Return the new id
+}
+
+void TokenInterner::intern(const TokenBuffer& tokens, std::vector<uint32_t>& ids) { // Intern every token of a buffer
+    ids.resize(tokens.size()); // One id per token
+    for (size_t i = 0; i < tokens.size(); ++i) ids[i] = intern(tokens[i]); // Intern the token
+}
+
+void TokenInterner::find(const TokenBuffer& tokens, std::vector<uint32_t>& ids) const { // Look every token of a buffer up
+    ids.resize(tokens.size()); // One id per token
+    for (size_t i = 0; i < tokens.size(); ++i) ids[i] = find(tokens[i]); // Look the token up
+}
+
+void TokenInterner::grow() { // Double the table
+    std::vector<Slot> larger(slots.size() * 2); // Declare the empty larger table
+    size_t mask = larger.size() - 1; // Mask for wrapping around it
+    for (uint32_t id = 0; id < size(); ++id) { // Loop through each token
+        uint64_t hash = hashOf(token(id)); // Hash it again
+        size_t slot = static_cast<size_t>(hash) & mask; // Get its home slot
+        while (larger[slot].id != 0) slot = (slot + 1) & mask; // Probe linearly for a free slot
+        larger[slot].tag = static_cast<uint32_t>(hash >> 32); // Store the tag
+        larger[slot].id = id + 1; // Store the id plus one
+    }
+    slots.swap(larger); // Use the larger table
+}
+
+void TokenInterner::clear() { // Forget every token
+    chars.clear(); // Drop the bytes
+    offsets.assign(1, 0); // Keep only the end offset
+    slots.assign(kInitialSlots, Slot()); // Empty the table
+}
+
+size_t TokenInterner::memoryUsage() const { // Get the memory held by the interner
+    return chars.capacity() + offsets.capacity() * sizeof(uint32_t) + slots.capacity() * sizeof(Slot); // Add up the three arrays
+}
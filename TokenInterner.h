@@ -0,0 +1,117 @@
+#ifndef TOKEN_INTERNER_H // Include guard to prevent multiple inclusions
+#define TOKEN_INTERNER_H // Define the include guard
+
+#include "Tokenizer.h" // Include Tokenizer for the token buffer
+#include <cstddef> // Include cstddef for size_t
+#include <cstdint> // Include cstdint for the 32-bit ids
+#include <string_view> // Include string_view for tokens
+#include <vector> // Include vector for the id streams
+
+/**
+ * @class TokenInterner
+ * @brief Maps each distinct normalized token to a dense 32-bit id, in order of first appearance.
+ *
+ * Tokens are whatever the Tokenizer produces, merged negation bigrams such as "not good" included,
+ * so one id stands for one scoring unit. Ids run from 0 to size() - 1, so anything kept per token
+ * (counts, scores) can live in flat arrays indexed by id.
+ *
+ * The table is open addressing with linear probing at a load factor of at most one half. Each slot
+ * holds a 32-bit hash tag and the id plus one, so a probe touches a token's bytes only when the tags
+ * match. The tokens' bytes sit back to back in one array.
+ *
+ * Lookups (find) are safe from several threads while nothing is interned.
+ */
+class TokenInterner {
+public:
+    static const uint32_t kUnknown = UINT32_MAX; ///< Id returned by find() for a token that was never interned.
+
+    /**
+     * @brief Constructs an empty interner.
+     */
+    TokenInterner();
+
+    /**
+     * @brief Gets the id of a token, adding the token if it is new.
+     * @param token The token.
+     * @return Its id; a new token gets size() before the call.
+     * @throws std::runtime_error If the tokens no longer fit 32-bit offsets.
+     */
+    uint32_t intern(std::string_view token);
+
+    /**
+     * @brief Gets the id of a token without adding it.
+     * @param token The token.
+     * @return Its id, or kUnknown if it was never interned.
+     */
+    uint32_t find(std::string_view token) const;
+
+    /**
+     * @brief Interns every token of a buffer.
+     * @param tokens The tokens.
+     * @param ids Receives one id per token, in order (cleared first).
+     */
+    void intern(const TokenBuffer& tokens, std::vector<uint32_t>& ids);
+
+    /**
+     * @brief Looks every token of a buffer up without adding any.
+     * @param tokens The tokens.
+     * @param ids Receives one id per token, kUnknown for new tokens (cleared first).
+     */
+    void find(const TokenBuffer& tokens, std::vector<uint32_t>& ids) const;
+
+    /**
+     * @brief Gets the token of an id.
+     * @param id An id below size().
+     * @return A view of the token, valid until the next token is interned.
+     */
+    std::string_view token(uint32_t id) const;
+
+    /**
+     * @brief Gets the number of distinct tokens.
+     * @return The number of ids handed out.
+     */
+    size_t size() const;
+
+    /**
+     * @brief Forgets every token.
+     */
+    void clear();
+
+    /**
+     * @brief Gets the memory held by the interner.
+     * @return The number of bytes reserved for the slots, the offsets and the tokens.
+     */
+    size_t memoryUsage() const;
+
+private:
+    struct Slot { // A position in the open-addressing table
+        uint32_t tag; // High half of the token's hash, compared before the token's bytes
+        uint32_t id; // Id of the token plus one (0 marks an empty slot)
+    };
+
+    std::vector<char> chars; ///< Bytes of every token, back to back, in id order.
+    std::vector<uint32_t> offsets; ///< Start of each token in chars, plus one final end offset.
+    std::vector<Slot> slots; ///< Open-addressing table; its size is a power of two.
+
+    /**
+     * @brief Hashes a token into 64 bits, whatever the width of size_t.
+     * @param token The token.
+     * @return The hash; its low bits pick the home slot and its high half is the tag.
+     */
+    static uint64_t hashOf(std::string_view token);
+
+    /**
+     * @brief Doubles the number of slots and reinserts every token.
+     */
+    void grow();
+};
+
+inline std::string_view TokenInterner::token(uint32_t id) const { // Get the token of an id
+    return std::string_view(chars.data() + offsets[id], offsets[id + 1] - offsets[id]); // View its bytes
+}
+
+inline size_t TokenInterner::size() const { // Get the number of distinct tokens
+    return offsets.size() - 1; // One offset per token plus the end offset
+}
+
+#endif // TOKEN_INTERNER_H // End of include guard
@@ -0,0 +1,301 @@
+#include "Tokenizer.h" // Include the Tokenizer header file
+#include <cstring> // Include cstring for padding the last block of a text
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define TOKENIZER_X86_SIMD 1 // SSE2 and AVX2 kernels are built and chosen at run time
+#include <immintrin.h> // Include immintrin for the SSE2 and AVX2 intrinsics
+#endif
+
+namespace { // Character classes of the "C" locale, which the original tokenizer relied on
+enum CharClass : unsigned char { kKeep = 0, kSpace = 1, kPunct = 2 }; // How a byte is treated
+
+struct CharTable { // Lookup table from byte to character class and lowercase form
+    unsigned char kind[256]; // Character class of each byte
+    char lower[256]; // Lowercase form of each byte
+
+    CharTable() { // Build the table
+        for (int c = 0; c < 256; ++c) { // Loop through each byte value
+            bool space = c == ' ' || (c >= '\t' && c <= '\r'); // Space, tab, newline, vertical tab, form feed, carriage return
+            bool punct = (c >= '!' && c <= '/') || (c >= ':' && c <= '@') || (c >= '[' && c <= '`') || (c >= '{' && c <= '~'); // ASCII punctuation
+            kind[c] = space ? kSpace : (punct ? kPunct : kKeep); // Record the class
+            lower[c] = static_cast<char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c); // Record the lowercase form
+        }
+    }
+};
+
+const CharTable kTable; // The shared lookup table
+const size_t kOutputSlack = 64; // Spare output bytes so a kernel may store a whole block past the last word
+
+bool isNegation(const char* word, size_t length) { // Check if a normalized word is a negation
+    switch (length) { // Compare by length first
+    case 2: return word[0] == 'n' && word[1] == 'o'; // "no"
+    case 3: return word[0] == 'n' && word[1] == 'o' && (word[2] == 't' || word[2] == 'r'); // "not" or "nor"
+    case 7: return std::string_view(word, length) == "neither"; // "neither"
+    default: return false; // Anything else
+    }
+}
+
+struct TokenWriter { // Pairs negations with the next word while the words are written
+    std::vector<uint32_t>& ends; // Token ends
+    size_t tokenStart = 0; // Start of the token being built
+    bool negationPending = false; // Flag set while a negation waits for its next word
+
+    // The output pointer and length stay in the callers' locals so that the byte stores, which may
+    // alias anything, do not force them to be reloaded.
+    void endWord(char* out, size_t wordStart, size_t& used) { // Handle a word written from wordStart to used
+        if (negationPending) { // If this word completes a negation pair
+            negationPending = false; // The pair is complete
+            ends.push_back(static_cast<uint32_t>(used)); // End the merged token
+            tokenStart = used; // Start the next token here
+        } else if (isNegation(out + wordStart, used - wordStart)) { // If the word is a negation
+            out[used++] = ' '; // Separate it from the next word
+            negationPending = true; // Wait for the next word
+        } else { // If the word stands alone
+            ends.push_back(static_cast<uint32_t>(used)); // End the token
+            tokenStart = used; // Start the next token here
+        }
+    }
+
+    void finish(char* out, size_t used) { // Handle the end of the text
+        if (!negationPending) return; // Nothing is pending
+        size_t negationLength = used - tokenStart - 1; // Length of the negation without its space
+        for (size_t i = 0; i < negationLength; ++i) { // Loop through the negation's characters
+            out[used + i] = out[tokenStart + i]; // Pair the negation with itself
+        }
+        used += negationLength; // Count the copied characters
+        ends.push_back(static_cast<uint32_t>(used)); // End the merged token
+    }
+};
+
+void tokenizeScalar(const unsigned char* text, size_t size, char* out, TokenWriter& writer) { // Split a text one byte at a time through the lookup table
+    size_t used = 0; // Number of output characters written
+    size_t pos = 0; // Current input byte
+    while (true) { // Loop through each word
+        while (pos < size && kTable.kind[text[pos]] == kSpace) ++pos; // Skip whitespace
+        if (pos == size) break; // Stop at the end of the text
+
+        size_t wordStart = used; // Remember where the normalized word starts
+        for (; pos < size && kTable.kind[text[pos]] != kSpace; ++pos) { // Loop through the characters of the word
+            if (kTable.kind[text[pos]] == kKeep) { // If the character is not punctuation
+                out[used++] = kTable.lower[text[pos]]; // Write its lowercase form
+            }
+        }
+        writer.endWord(out, wordStart, used); // Handle the word
+    }
+    writer.finish(out, used); // Handle a trailing negation
+}
+
+bool hasPunct(const uint64_t* punctBits, size_t begin, size_t end) { // Check a byte range for punctuation
+    if ((begin >> 6) == ((end - 1) >> 6)) { // If the range lies in one bitmap word, as almost every word does
+        uint64_t bits = punctBits[begin >> 6] >> (begin & 63); // Align the range's first byte to bit 0
+        return (bits & (~uint64_t(0) >> (64 - (end - begin)))) != 0; // Test the range's bytes
+    }
+    for (size_t w = begin >> 6; w <= (end - 1) >> 6; ++w) { // Loop through the bitmap words the range spans
+        uint64_t mask = ~uint64_t(0); // Bytes of the range within this bitmap word
+        if (w == begin >> 6) mask &= ~uint64_t(0) << (begin & 63); // Drop the bytes before the range
+        if (w == (end - 1) >> 6 && (end & 63) != 0) mask &= ~(~uint64_t(0) << (end & 63)); // Drop the bytes after the range
+        if ((punctBits[w] & mask) != 0) return true; // Report punctuation
+    }
+    return false; // The range has none
+}
+
+void tokenizeBitmaps(const char* lowered, const uint64_t* spaceBits, const uint64_t* punctBits, size_t groups, char* out, TokenWriter& writer) { // Split a text classified by a SIMD kernel
+    size_t used = 0; // Number of output characters written
+    uint64_t carry = 1; // Whether the byte before the current group is whitespace
+    size_t wordBegin = 0; // Input position of the current word
+    bool inWord = false; // Flag set between a word's first byte and the space after it
+    for (size_t g = 0; g <= groups; ++g) { // Loop through the groups and the closing all-space word
+        uint64_t space = spaceBits[g]; // Whitespace of the group
+        uint64_t before = (space << 1) | carry; // Whitespace of the byte before each byte
+        carry = space >> 63; // Carry the last byte into the next group
+        uint64_t edges = (~space & before) | (space & ~before); // Word starts and the spaces ending words, alternating
+        while (edges != 0) { // Loop through the edges in order
+            size_t pos = g * 64 + static_cast<size_t>(__builtin_ctzll(edges)); // Position of the edge
+            edges &= edges - 1; // Drop it
+            if (!inWord) { // If the edge starts a word
+                wordBegin = pos; // Remember the start
+                inWord = true; // Wait for its end
+                continue; // Move to the next edge
+            }
+            inWord = false; // The edge ends the word
+            size_t wordStart = used; // Remember where the normalized word starts
+            size_t length = pos - wordBegin; // Length of the word
+            if (!hasPunct(punctBits, wordBegin, pos)) { // If every byte of the word is kept
+                for (size_t i = 0; i < length; i += 16) std::memcpy(out + used + i, lowered + wordBegin + i, 16); // Copy it in 16-byte moves
+                used += length; // Keep the word's bytes
+            } else { // If some bytes are punctuation
+                for (size_t i = wordBegin; i < pos; ++i) { // Loop through the word's bytes
+                    out[used] = lowered[i]; // Write the byte
+                    used += ((punctBits[i >> 6] >> (i & 63)) & 1) ^ 1; // Keep it unless it is punctuation
+                }
+            }
+            writer.endWord(out, wordStart, used); // Handle the word
+        }
+    }
+    writer.finish(out, used); // Handle a trailing negation
+}
+
+#ifdef TOKENIZER_X86_SIMD
+// The SIMD kernels classify the whole text with byte comparisons, 16 or 32 bytes at a time, into a
+// lowercased copy and two bitmaps that tokenizeBitmaps() then walks. Bytes of 0x80 and
+// above compare as negative, so they fall outside every ASCII range and are kept unchanged, as in
+// the table. The last block is copied into a buffer padded with spaces, so nothing beyond the text
+// is read and the bitmaps mark everything after the text as whitespace.
+
+__attribute__((target("sse2"))) __m128i inRangeSSE2(__m128i x, char low, char high) { // Mark bytes within [low, high]
+    return _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8(static_cast<char>(low - 1))), _mm_cmplt_epi8(x, _mm_set1_epi8(static_cast<char>(high + 1)))); // Compare both bounds
+}
+
+__attribute__((target("sse2"))) void classifySSE2(const unsigned char* text, size_t size, char* lowered, uint64_t* spaceBits, uint64_t* punctBits) { // Classify a text 16 bytes at a time
+    size_t groups = (size + 63) / 64; // Number of 64-byte groups, one bitmap word each
+    for (size_t g = 0; g < groups; ++g) { // Loop through each group
+        uint64_t space = 0, punct = 0; // Masks of the group
+        for (size_t b = 0; b < 4; ++b) { // Loop through its four blocks
+            size_t offset = g * 64 + b * 16; // Position of the block
+            __m128i x; // Declare the block
+            if (offset + 16 <= size) { // If the block lies within the text
+                x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + offset)); // Load it straight from the text
+            } else { // If the block runs past the end
+                alignas(16) unsigned char padded[16]; // Declare the padded block
+                std::memset(padded, ' ', sizeof(padded)); // Fill it with spaces
+                if (offset < size) std::memcpy(padded, text + offset, size - offset); // Copy the rest of the text
+                x = _mm_load_si128(reinterpret_cast<const __m128i*>(padded)); // Load it
+            }
+            __m128i spaces = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), inRangeSSE2(x, '\t', '\r')); // Space, tab, newline, vertical tab, form feed, carriage return
+            __m128i puncts = _mm_or_si128(_mm_or_si128(inRangeSSE2(x, '!', '/'), inRangeSSE2(x, ':', '@')), _mm_or_si128(inRangeSSE2(x, '[', '`'), inRangeSSE2(x, '{', '~'))); // ASCII punctuation
+            __m128i lower = _mm_add_epi8(x, _mm_and_si128(inRangeSSE2(x, 'A', 'Z'), _mm_set1_epi8(0x20))); // Lowercase the capitals
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lowered + offset), lower); // Store the lowercased block
+            space |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(spaces))) << (b * 16); // Add the space bits
+            punct |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(puncts))) << (b * 16); // Add the punctuation bits
+        }
+        spaceBits[g] = space; // Store the space bits of the group
+        punctBits[g] = punct; // Store the punctuation bits of the group
+    }
+    spaceBits[groups] = ~uint64_t(0); // End the bitmap with spaces
+    punctBits[groups] = 0; // and no punctuation
+}
+
+__attribute__((target("avx2"))) __m256i inRangeAVX2(__m256i x, char low, char high) { // Mark bytes within [low, high]
+    return _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8(static_cast<char>(low - 1))), _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(high + 1)), x)); // Compare both bounds
+}
+
+__attribute__((target("avx2"))) void classifyAVX2(const unsigned char* text, size_t size, char* lowered, uint64_t* spaceBits, uint64_t* punctBits) { // Classify a text 32 bytes at a time
+    size_t groups = (size + 63) / 64; // Number of 64-byte groups, one bitmap word each
+    for (size_t g = 0; g < groups; ++g) { // Loop through each group
+        uint64_t space = 0, punct = 0; // Masks of the group
+        for (size_t b = 0; b < 2; ++b) { // Loop through its two blocks
+            size_t offset = g * 64 + b * 32; // Position of the block
+            __m256i x; // Declare the block
+            if (offset + 32 <= size) { // If the block lies within the text
+                x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + offset)); // Load it straight from the text
+            } else { // If the block runs past the end
+                alignas(32) unsigned char padded[32]; // Declare the padded block
+                std::memset(padded, ' ', sizeof(padded)); // Fill it with spaces
+                if (offset < size) std::memcpy(padded, text + offset, size - offset); // Copy the rest of the text
+                x = _mm256_load_si256(reinterpret_cast<const __m256i*>(padded)); // Load it
+            }
+            __m256i spaces = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')), inRangeAVX2(x, '\t', '\r')); // Space, tab, newline, vertical tab, form feed, carriage return
+            __m256i puncts = _mm256_or_si256(_mm256_or_si256(inRangeAVX2(x, '!', '/'), inRangeAVX2(x, ':', '@')), _mm256_or_si256(inRangeAVX2(x, '[', '`'), inRangeAVX2(x, '{', '~'))); // ASCII punctuation
+            __m256i lower = _mm256_add_epi8(x, _mm256_and_si256(inRangeAVX2(x, 'A', 'Z'), _mm256_set1_epi8(0x20))); // Lowercase the capitals
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(lowered + offset), lower); // Store the lowercased block
+            space |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(spaces))) << (b * 32); // Add the space bits
+            punct |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(puncts))) << (b * 32); // Add the punctuation bits
+        }
+        spaceBits[g] = space; // Store the space bits of the group
+        punctBits[g] = punct; // Store the punctuation bits of the group
+    }
+    spaceBits[groups] = ~uint64_t(0); // End the bitmap with spaces
+    punctBits[groups] = 0; // and no punctuation
+}
+#endif
+
+Tokenizer::Kernel bestKernel() { // Pick the default kernel for the processor
+    if (Tokenizer::supports(Tokenizer::Kernel::SSE2)) return Tokenizer::Kernel::SSE2; // Prefer 16-byte blocks: AVX2 measures no faster on tweets
+    return Tokenizer::Kernel::Scalar; // Fall back to the table
+}
+
+Tokenizer::Kernel& activeKernel() { // Get the kernel tokenize() uses
+    static Tokenizer::Kernel kernel = bestKernel(); // Detect it on first use
+    return kernel; // Return it
+}
+} // namespace
+
+size_t TokenBuffer::size() const { // Get the number of tokens
+    return ends.size(); // Return the token count
+}
+
+bool TokenBuffer::empty() const { // Check if there are no tokens
+    return ends.empty(); // Return true if there are no tokens
+}
+
+std::string_view TokenBuffer::operator[](size_t index) const { // Get a token
+    uint32_t start = index == 0 ? 0 : ends[index - 1]; // Get the start of the token
+    return std::string_view(chars.data() + start, ends[index] - start); // Return a view of the token
+}
+
+void TokenBuffer::clear() { // Remove every token
+    ends.clear(); // Forget the token offsets
+}
+
+void Tokenizer::tokenize(std::string_view text, TokenBuffer& tokens) { // Tokenize text into a reusable buffer
+    tokens.clear(); // Reuse the buffer
+    size_t needed = text.size() * 2 + kOutputSlack; // Worst case: every word doubled by a trailing negation, plus separators and a spare block
+    if (tokens.chars.size() < needed) { // If the storage is too small
+        tokens.chars.resize(needed); // Grow it once for this text
+    }
+    TokenWriter writer{tokens.ends}; // Declare the writer of the tokens
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(text.data()); // View the text as bytes
+
+#ifdef TOKENIZER_X86_SIMD
+    Kernel kernel = activeKernel(); // Get the selected kernel
+    if (kernel != Kernel::Scalar) { // If a SIMD kernel classifies the text
+        size_t groups = (text.size() + 63) / 64; // Number of 64-byte groups, one bitmap word each
+        if (tokens.lowered.size() < groups * 64 + kOutputSlack) tokens.lowered.resize(groups * 64 + kOutputSlack); // Room for whole blocks plus a spare copy
+        if (tokens.spaceBits.size() < groups + 1) { // If the bitmaps are too small
+            tokens.spaceBits.resize(groups + 1); // Room for the groups and the closing word
+            tokens.punctBits.resize(groups + 1); // Room for the groups and the closing word
+        }
+        if (kernel == Kernel::AVX2) { // If the AVX2 kernel is selected
+            classifyAVX2(bytes, text.size(), tokens.lowered.data(), tokens.spaceBits.data(), tokens.punctBits.data()); // Classify 32 bytes at a time
+        } else { // If the SSE2 kernel is selected
+            classifySSE2(bytes, text.size(), tokens.lowered.data(), tokens.spaceBits.data(), tokens.punctBits.data()); // Classify 16 bytes at a time
+        }
+        tokenizeBitmaps(tokens.lowered.data(), tokens.spaceBits.data(), tokens.punctBits.data(), groups, tokens.chars.data(), writer); // Split the classified text
+        return; // The tokens are ready
+    }
+#endif
+    tokenizeScalar(bytes, text.size(), tokens.chars.data(), writer); // Split the text one byte at a time
+}
+
+Tokenizer::Kernel Tokenizer::kernel() { // Get the kernel tokenize() uses
+    return activeKernel(); // Return the selected kernel
+}
+
+bool Tokenizer::setKernel(Kernel kernel) { // Select the kernel tokenize() uses
+    if (!supports(kernel)) return false; // Refuse kernels that cannot run here
+    activeKernel() = kernel; // Use the kernel from now on
+    return true; // Report success
+}
+
+bool Tokenizer::supports(Kernel kernel) { // Check if a kernel can run on this processor
+#ifdef TOKENIZER_X86_SIMD
+    static const bool detected = (__builtin_cpu_init(), true); // Read the processor features once, before any check
+    (void)detected; // Only the initialization matters
+#endif
+    switch (kernel) { // Check the kernel
+#ifdef TOKENIZER_X86_SIMD
+    case Kernel::AVX2: return __builtin_cpu_supports("avx2"); // Ask the processor
+    case Kernel::SSE2: return __builtin_cpu_supports("sse2"); // Ask the processor
+#endif
+    case Kernel::Scalar: return true; // The table always works
+    default: return false; // The kernel is not built for this platform
+    }
+}
+
+const char* Tokenizer::kernelName(Kernel kernel) { // Get the name of a kernel
+    switch (kernel) { // Check the kernel
+    case Kernel::AVX2: return "avx2"; // 32-byte blocks
+    case Kernel::SSE2: return "sse2"; // 16-byte blocks
+    default: return "scalar"; // The table
+    }
+}
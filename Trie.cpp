@@ -1,105 +1,289 @@
 #include "Trie.h" // Include the Trie header file
 #include "DSString.h" // Include the DSString header file
+#include "Metrics.h" // Include Metrics for the lookup and training counters
 
-std::mutex mtx; // Declare a mutex for thread synchronization
+TrieNode::TrieNode(std::pmr::memory_resource* resource) : children(resource), positiveSentiments(0), totalTweets(0) {} // Constructor for TrieNode, initializes totalTweets and positiveSentiments to 0
 
-ThreadPool::ThreadPool(size_t numThreads) : stop(false) { // Constructor for ThreadPool, initializes stop to false
-    for (size_t i = 0; i < numThreads; ++i) { // Loop to create worker threads
-        workers.emplace_back(&ThreadPool::workerThread, this); // Add a worker thread to the pool
-    }
+Trie::Trie() : currentLayout(TrieLayout::Map), smoothingAlpha(1.0), finalized(false) { // Constructor for Trie
+    root = newNode(); // Create a new TrieNode for the root
 }
 
-ThreadPool::~ThreadPool() { // Destructor for ThreadPool
-    {
-        std::unique_lock<std::mutex> lock(queueMutex); // Lock the queue mutex
-        stop = true; // Set stop to true to signal threads to stop
-    }
-    condition.notify_all(); // Notify all threads
-    for (std::thread &worker : workers) { // Loop through all worker threads
-        worker.join(); // Join each worker thread
-    }
+const char* Trie::name() const { // Get the name of the backend
+    return "trie"; // Name the backend
 }
 
-void ThreadPool::enqueue(std::function<void()> task) { // Enqueue a task to the thread pool
-    {
-        std::unique_lock<std::mutex> lock(queueMutex); // Lock the queue mutex
-        tasks.push(std::move(task)); // Add the task to the queue
-    }
-    condition.notify_one(); // Notify one thread
+WordScores Trie::sumScores(const TokenBuffer& words) const { // Sum both scores of tokenized words
+    return sumWith(*this, words); // Walk the Trie once per word without virtual dispatch
 }
 
-void ThreadPool::workerThread() { // Worker thread function
-    while (true) { // Infinite loop
-        std::function<void()> task; // Declare a task
-        {
-            std::unique_lock<std::mutex> lock(queueMutex); // Lock the queue mutex
-            condition.wait(lock, [this] { return stop || !tasks.empty(); }); // Wait for a task or stop signal
-            if (stop && tasks.empty()) { // If stop is true and no tasks are left
-                return; // Exit the loop
+void Trie::setLayout(TrieLayout layout) { // Switch the Trie to a node layout
+    if (layout == currentLayout) return; // Nothing to do if the layout is already in use
+    if (layout == TrieLayout::Compact) { // If switching to the compact layout
+        compactNodes.build(root); // Copy the nodes into the arrays
+        resetNodes(); // Free the map-based nodes, keeping an empty root so the map layout stays valid
+    } else { // If switching back to the map layout
+        compactNodes.forEachWord([this](const std::string& word, const CompactTrie::Node& node) { // Loop through every word
+            TrieNode* current = root; // Start at the root node
+            for (char c : word) { // Loop through each character in the word
+                TrieNode*& child = current->children[c]; // Find or create the child slot
+                if (child == nullptr) child = newNode(); // Create the child node if needed
+                current = child; // Move to the child node
             }
-            task = std::move(tasks.front()); // Get the task from the queue
-            tasks.pop(); // Remove the task from the queue
-        }
-        try {
-            task(); // Execute the task
-        } catch (const std::exception& e) { // Catch standard exceptions
-            std::cerr << "Task threw an exception: " << e.what() << std::endl; // Print the exception message
-        } catch (...) { // Catch all other exceptions
-            std::cerr << "Task threw an unknown exception" << std::endl; // Print a generic error message
+            current->totalTweets = node.totalTweets; // Restore the totalTweets count
+            current->positiveSentiments = node.positiveSentiments; // Restore the positiveSentiments count
+        });
+        compactNodes = CompactTrie(); // Free the arrays
+    }
+    currentLayout = layout; // Record the new layout
+    bool cached = finalized; // Remember if the scores were cached
+    finalized = false; // The cache belongs to the old layout
+    compactScores.clear(); // Free the cached scores of the compact nodes
+    if (cached) finalize(); // Cache the scores for the new layout
+}
+
+void Trie::finalize() { // Cache the scores of every node
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing
+
+    if (currentLayout == TrieLayout::Compact) { // If the Trie uses the compact layout
+        compactScores.assign(compactNodes.size(), CachedScores()); // Declare one entry per node
+        for (uint32_t i = 0; i < compactScores.size(); ++i) { // Loop through each node
+            const CompactTrie::Node& node = compactNodes.at(i); // Get the node
+            WordCounts counts; // Declare its counts
+            counts.positiveSentiments = node.positiveSentiments; // Copy the positiveSentiments count
+            counts.totalTweets = node.totalTweets; // Copy the totalTweets count
+            WordScores scores = scoresOf(counts, smoothingAlpha); // Compute both scores
+            compactScores[i].logOdds = static_cast<float>(scores.logOdds); // Cache the log odds ratio
+            compactScores[i].sentimentScore = static_cast<float>(scores.sentimentScore); // Cache the sentiment score
         }
+    } else { // If the Trie uses the map layout
+        finalizeNode(root, smoothingAlpha); // Cache the scores in the nodes
     }
+    finalized = true; // Let lookups read the cache
+
+    auto end = std::chrono::high_resolution_clock::now(); // End timing
+    std::chrono::duration<double> duration = end - start; // Calculate the duration
+    std::cout << "Finalizing completed in " << duration.count() << " seconds." << std::endl; // Output the duration
 }
 
-TrieNode::TrieNode() : totalTweets(0), positiveSentiments(0) {} // Constructor for TrieNode, initializes totalTweets and positiveSentiments to 0
+void Trie::finalizeNode(TrieNode* node, double smoothing) { // Cache the scores of a subtree
+    WordCounts counts; // Declare the node's counts
+    counts.positiveSentiments = node->positiveSentiments; // Copy the positiveSentiments count
+    counts.totalTweets = node->totalTweets; // Copy the totalTweets count
+    WordScores scores = scoresOf(counts, smoothing); // Compute both scores
+    node->scores.logOdds = static_cast<float>(scores.logOdds); // Cache the log odds ratio
+    node->scores.sentimentScore = static_cast<float>(scores.sentimentScore); // Cache the sentiment score
+    for (auto& pair : node->children) { // Loop through each child node
+        finalizeNode(pair.second, smoothing); // Cache the scores of the child subtree
+    }
+}
 
-Trie::Trie() { // Constructor for Trie
-    root = new TrieNode(); // Create a new TrieNode for the root
+bool Trie::isFinalized() const { // Check if the cached scores are in use
+    return finalized; // Return the flag
 }
 
-void Trie::train(const DSString& file) { // Train the Trie with data from a file
-    auto start = std::chrono::high_resolution_clock::now(); // Start timing
+void Trie::setSmoothing(double alpha) { // Set the smoothing of the log odds ratio
+    smoothingAlpha = alpha; // Record the smoothing
+    if (finalized) finalize(); // Recompute the cache with it
+}
 
-    std::ifstream infile(file.c_str()); // Open the file for reading
-    if (!infile.is_open()) { // Check if the file is open
-        throw std::runtime_error("Could not open file for reading"); // Throw an error if the file could not be opened
+double Trie::smoothing() const { // Get the smoothing of the log odds ratio
+    return smoothingAlpha; // Return the smoothing
+}
+
+size_t Trie::wordCount() const { // Count the distinct words
+    size_t count = 0; // Initialize the word count
+    if (currentLayout == TrieLayout::Compact) { // If the Trie uses the compact layout
+        compactNodes.forEachWord([&count](const std::string&, const CompactTrie::Node&) { count++; }); // Count every word
+    } else { // If the Trie uses the map layout
+        count = countWords(root); // Count the words of the map-based nodes
+    }
+    std::shared_ptr<const TrieDelta> snapshot = deltaSnapshot(); // Pin the delta
+    if (snapshot != nullptr) { // If words were added incrementally
+        snapshot->forEach([this, &count](std::string_view word, const WordCounts& added) { // Loop through each added word
+            WordCounts counts; // Declare the counts in the nodes
+            lookupNodes(word, counts); // Look the word up in the nodes
+            if (counts.totalTweets == 0 && added.totalTweets > 0) count++; // Count words only the delta holds
+        });
     }
+    return count; // Return the word count
+}
 
-    DSString line; // Declare a string to hold each line
-    while (getline(infile, line)) { // Read each line from the file
-        std::istringstream ss(line.c_str()); // Create a string stream from the line
-        DSString sentimentStr, id, date, query, user, tweet; // Declare strings for each field
+size_t Trie::countWords(const TrieNode* node) { // Count the words stored in a subtree
+    size_t count = node->totalTweets > 0 ? 1 : 0; // Count the node itself if it holds a word
+    for (const auto& pair : node->children) { // Loop through each child node
+        count += countWords(pair.second); // Add the words of the child subtree
+    }
+    return count; // Return the word count
+}
 
-        if (!getline(ss, sentimentStr, ',')) continue; // Read the sentiment field
-        if (!getline(ss, id, ',')) continue; // Read the id field
-        if (!getline(ss, date, ',')) continue; // Read the date field
-        if (!getline(ss, query, ',')) continue; // Read the query field
-        if (!getline(ss, user, ',')) continue; // Read the user field
-        if (!getline(ss, tweet)) continue; // Read the tweet field
+size_t Trie::prune(const PruneOptions& options) { // Drop the words below the thresholds
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing
+    TrieLayout original = currentLayout; // Remember the layout to return to
+    bool cached = finalized; // Remember if the scores were cached
+    finalized = false; // Skip caching scores while the layout changes
+    setLayout(TrieLayout::Map); // Unpack a compact Trie into map-based nodes
+    size_t dropped = 0; // Declare the number of words dropped
+    pruneNode(root, options, smoothingAlpha, dropped); // Drop the words and the emptied nodes
+    setLayout(TrieLayout::Compact); // Copy the remaining words into compact arrays, freeing every node
+    if (original == TrieLayout::Map) setLayout(TrieLayout::Map); // Rebuild the nodes in an arena holding only the remaining words
+    if (cached) finalize(); // Cache the scores again
+    auto end = std::chrono::high_resolution_clock::now(); // End timing
+    std::chrono::duration<double> duration = end - start; // Calculate the duration
+    std::cout << "Pruning completed in " << duration.count() << " seconds." << std::endl; // Output the duration
+    return dropped; // Return the number of words dropped
+}
 
-        bool isPositive = (sentimentStr == "4"); // Determine if the sentiment is positive
+bool Trie::pruneNode(TrieNode* node, const PruneOptions& options, double smoothing, size_t& dropped) { // Prune a subtree
+    for (auto it = node->children.begin(); it != node->children.end();) { // Loop through each child
+        if (pruneNode(it->second, options, smoothing, dropped)) { // If the child's subtree lost every word
+            it = node->children.erase(it); // Unlink it; the arena frees it with the next reset
+        } else { // If the child still leads to a word
+            ++it; // Keep it
+        }
+    }
+    WordCounts counts; // Declare the node's counts
+    counts.positiveSentiments = node->positiveSentiments; // Copy the positiveSentiments count
+    counts.totalTweets = node->totalTweets; // Copy the totalTweets count
+    if (counts.totalTweets > 0 && !keeps(counts, options, smoothing)) { // If the node holds a word below the thresholds
+        node->totalTweets = 0; // Drop the totalTweets count
+        node->positiveSentiments = 0; // Drop the positiveSentiments count
+        ++dropped; // Count the word
+    }
+    return node->totalTweets == 0 && node->children.empty(); // Report whether anything is left below the node
+}
 
-        std::istringstream tweetStream(tweet.c_str()); // Create a string stream from the tweet
+TrieLayout Trie::layout() const { // Get the node layout used for lookups
+    return currentLayout; // Return the current layout
+}
 
-        std::vector<DSString> words = tokenize(tweet); // Tokenize the tweet into words
-        for (const DSString& word : words) { // Loop through each word
-            insert(word, isPositive); // Insert the word into the Trie
-        }
+void Trie::train(const DSString& file, unsigned numThreads) { // Train the Trie with data from a file
+    if (currentLayout == TrieLayout::Compact) { // Check if the Trie is read-only
+        throw std::logic_error("Cannot train a compact Trie"); // Throw an error if it is
+    }
+    finalized = false; // The counts are about to change
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing
+
+    if (numThreads == 0) { // If the caller asked for the hardware concurrency
+        numThreads = std::max(1u, std::thread::hardware_concurrency()); // Use every core, but at least one thread
     }
 
-    infile.close(); // Close the file
+    MappedFile mapped(file); // Map the training file into memory
+    CSVReader header(mapped.data(), mapped.data() + mapped.size()); // Declare a reader for the header line
+    header.skip(); // Skip the header line
+    char* first = const_cast<char*>(header.position()); // Get the start of the first record
+    std::vector<char*> bounds = splitRanges(first, mapped.data() + mapped.size(), numThreads, 6); // Split the records into byte ranges, read with six fields
+    size_t numRanges = bounds.size() - 1; // Get the number of ranges actually produced
+    auto split = std::chrono::high_resolution_clock::now(); // Time the split phase
+    std::chrono::duration<double> splitDuration = split - start; // Calculate the split duration
+    std::cout << "Training split into " << numRanges << " range(s) in " << splitDuration.count() << " seconds." << std::endl; // Output the split duration
+
+    if (numRanges == 1) { // If there is only one range
+        trainRange(bounds[0], bounds[1]); // Train in place, exactly as a serial pass would
+        auto counted = std::chrono::high_resolution_clock::now(); // Time the counting phase
+        std::chrono::duration<double> countDuration = counted - split; // Calculate the counting duration
+        std::cout << "Training counted 1 range in " << countDuration.count() << " seconds." << std::endl; // Output the counting duration
+    } else { // If the file was split across several threads
+        std::vector<std::unique_ptr<Trie>> partials; // Declare one partial Trie per range
+        for (size_t i = 0; i < numRanges; ++i) { // Loop through each range
+            partials.emplace_back(new Trie()); // Create the partial Trie for the range
+        }
+        ThreadPool pool(numThreads); // Declare the pool running the counting and merging tasks
+        TaskGroup counting(pool); // Declare the group of counting tasks
+        counting.runEach(numRanges, [&](size_t i) { // Count each range on the pool
+            partials[i]->trainRange(bounds[i], bounds[i + 1]); // Count the range into its partial Trie
+        });
+        counting.wait(); // Wait for every range; rethrows the first failure
+        auto counted = std::chrono::high_resolution_clock::now(); // Time the counting phase
+        std::chrono::duration<double> countDuration = counted - split; // Calculate the counting duration
+        std::cout << "Training counted " << numRanges << " ranges in " << countDuration.count() << " seconds." << std::endl; // Output the counting duration
+
+        // Merge the root counts and create every top-level node, in range order
+        std::vector<char> firstChars; // Declare the list of top-level characters to merge
+        for (const std::unique_ptr<Trie>& partial : partials) { // Loop through the partial tries in range order
+            root->totalTweets += partial->root->totalTweets; // Add the root counts (the empty word)
+            root->positiveSentiments += partial->root->positiveSentiments; // Add the root positive counts
+            for (const auto& pair : partial->root->children) { // Loop through the partial's top-level children
+                TrieNode*& child = root->children[pair.first]; // Find or create the final child slot
+                if (child == nullptr) child = newNode(); // Create the final child if needed
+                firstChars.push_back(pair.first); // Remember to merge the subtree
+            }
+        }
+        std::sort(firstChars.begin(), firstChars.end()); // Sort the characters to fix the merge order
+        firstChars.erase(std::unique(firstChars.begin(), firstChars.end()), firstChars.end()); // Remove duplicates
+
+        // Copy each top-level subtree in its own task; the subtrees are disjoint, and only the arena is shared.
+        // The partial tries, and their arenas, are freed when train() returns.
+        arena.setConcurrent(true); // Let the tasks allocate nodes at the same time
+        TaskGroup merging(pool); // Declare the group of merging tasks
+        merging.runEach(firstChars.size(), [&](size_t i) { // Merge each top-level subtree on the pool
+            TrieNode* target = root->children.find(firstChars[i])->second; // Get the final subtree
+            for (const std::unique_ptr<Trie>& partial : partials) { // Loop through the partial tries in range order
+                auto it = partial->root->children.find(firstChars[i]); // Look for the subtree in the partial Trie
+                if (it != partial->root->children.end()) { // If the partial Trie has it
+                    mergeNode(target, it->second); // Merge it into the final subtree
+                }
+            }
+        });
+        try { // Try block to restore the arena if a task failed
+            merging.wait(); // Wait for every subtree; rethrows the first failure
+        } catch (...) { // Catch block for any failure
+            arena.setConcurrent(false); // No task allocates any more
+            throw; // Rethrow the failure
+        }
+        arena.setConcurrent(false); // Single-threaded allocation again
+        auto merged = std::chrono::high_resolution_clock::now(); // Time the merge phase
+        std::chrono::duration<double> mergeDuration = merged - counted; // Calculate the merge duration
+        std::cout << "Training merged " << numRanges << " partial tries in " << mergeDuration.count() << " seconds." << std::endl; // Output the merge duration
+    }
 
     auto end = std::chrono::high_resolution_clock::now(); // End timing
     std::chrono::duration<double> duration = end - start; // Calculate the duration
     std::cout << "Training completed in " << duration.count() << " seconds." << std::endl; // Output the duration
 }
 
-void Trie::insert(const DSString& word, bool isPositive) { // Insert a word into the Trie
+void Trie::trainRecord(std::string_view sentiment, std::string_view tweet, TokenBuffer& tokens) { // Insert the words of a training record
+    bool isPositive = (sentiment == "4"); // Determine if the sentiment is positive
+
+    tokenize(tweet, tokens); // Tokenize the tweet into words
+    for (size_t i = 0; i < tokens.size(); ++i) { // Loop through each word
+        insert(tokens[i], isPositive); // Insert the word into the Trie
+    }
+    Metrics::add(Counter::RecordsTrained); // Count the record
+    Metrics::add(Counter::TokensTrained, tokens.size()); // Count its tokens
+}
+
+void Trie::trainRange(char* begin, char* end) { // Train the Trie with the records of a byte range
+    CSVReader reader(begin, end); // Declare a reader over the range
+    std::vector<std::string_view> fields; // Declare the field list, reused for every record
+    TokenBuffer tokens; // Declare the token buffer, reused for every record
+    while (reader.next(fields, 6)) { // Read each record; the tweet takes the rest of the record
+        if (fields.size() < 6) continue; // Skip records with missing fields
+        trainRecord(fields[0], fields[5], tokens); // Insert the words of the tweet
+    }
+}
+
+void Trie::mergeNode(TrieNode* target, const TrieNode* source) { // Merge a subtree into another
+    target->totalTweets += source->totalTweets; // Add the totalTweets count
+    target->positiveSentiments += source->positiveSentiments; // Add the positiveSentiments count
+    for (const auto& pair : source->children) { // Loop through each child of the source
+        TrieNode*& child = target->children[pair.first]; // Find or create the same child in the target
+        if (child == nullptr) child = newNode(); // Create it in this Trie's arena if needed
+        mergeNode(child, pair.second); // Merge the child subtrees
+    }
+}
+
+void Trie::insert(std::string_view word, bool isPositive) { // Insert a word into the Trie
+    if (currentLayout == TrieLayout::Compact) { // Check if the Trie is read-only
+        throw std::logic_error("Cannot insert into a compact Trie"); // Throw an error if it is
+    }
+    finalized = false; // The counts are about to change
     TrieNode* current = root; // Start at the root node
     for (char c : word) { // Loop through each character in the word
-        if (current->children.find(c) == current->children.end()) { // If the character is not in the children map
-            current->children[c] = new TrieNode(); // Create a new TrieNode for the character
+        TrieNode*& child = current->children[c]; // Find or create the child slot with one probe
+        if (child == nullptr) { // If the character was not in the children map
+            child = newNode(); // Create a new TrieNode for the character
         }
-        current = current->children[c]; // Move to the child node
+        current = child; // Move to the child node
     }
     current->totalTweets++; // Increment the totalTweets count
     if (isPositive) { // If the sentiment is positive
@@ -107,165 +291,349 @@ void Trie::insert(const DSString& word, bool isPositive) { // Insert a word into
     }
 }
 
-double Trie::getSentimentScore(const DSString& word) const { // Get the sentiment score for a word
+void Trie::addCounts(std::string_view word, const WordCounts& counts) { // Add counts to a word
+    if (currentLayout == TrieLayout::Compact) { // Check if the Trie is read-only
+        throw std::logic_error("Cannot insert into a compact Trie"); // Throw an error if it is
+    }
+    finalized = false; // The counts are about to change
     TrieNode* current = root; // Start at the root node
     for (char c : word) { // Loop through each character in the word
-        if (current->children.find(c) == current->children.end()) { // If the character is not in the children map
-            return 0.0; // Return 0.0 if the word is not found
-        }
-        current = current->children[c]; // Move to the child node
+        TrieNode*& child = current->children[c]; // Find or create the child slot with one probe
+        if (child == nullptr) child = newNode(); // Create the child node if needed
+        current = child; // Move to the child node
     }
-    if (current->totalTweets == 0) { // If the totalTweets count is 0
-        return 0.0; // Return 0.0
+    current->totalTweets += counts.totalTweets; // Add the totalTweets count
+    current->positiveSentiments += counts.positiveSentiments; // Add the positiveSentiments count
+}
+
+double Trie::getSentimentScore(std::string_view word) const { // Get the sentiment score for a word
+    return getScores(word).sentimentScore; // Return the sentiment score
+}
+
+double Trie::getLogOddsRatio(std::string_view word) const { // Get the log odds ratio for a word
+    return getScores(word).logOdds; // Return the log odds ratio
+}
+
+bool Trie::lookup(std::string_view word, WordCounts& counts) const { // Look up the counts of a word
+    return lookup(word, counts, deltaSnapshot().get()); // Look it up against the current delta
+}
+
+bool Trie::lookup(std::string_view word, WordCounts& counts, const TrieDelta* snapshot) const { // Look up the counts of a word against a pinned delta
+    lookupNodes(word, counts); // Get the counts stored in the nodes
+    if (snapshot != nullptr) { // If words were added incrementally
+        const WordCounts* added = snapshot->find(word); // Look the word up in the delta
+        if (added != nullptr) { // If the delta holds it
+            counts.positiveSentiments += added->positiveSentiments; // Add the positiveSentiments count
+            counts.totalTweets += added->totalTweets; // Add the totalTweets count
+        }
     }
-    return static_cast<double>(current->positiveSentiments - (current->totalTweets - current->positiveSentiments)) / current->totalTweets; // Calculate and return the sentiment score
+    return counts.totalTweets > 0; // Report whether the word was seen
 }
 
-double Trie::getLogOddsRatio(const DSString& word) const { // Get the log odds ratio for a word
-    TrieNode* current = root; // Start at the root node
+void Trie::lookupNodes(std::string_view word, WordCounts& counts, size_t* visited) const { // Look up the counts stored in the nodes
+    counts = WordCounts(); // Report zero counts unless the word is found
+    if (currentLayout == TrieLayout::Compact) { // If the Trie uses the compact layout
+        const CompactTrie::Node* node = compactNodes.find(word, visited); // Find the node of the word
+        if (node == nullptr) return; // Return if the word is not found
+        counts.positiveSentiments = node->positiveSentiments; // Copy the positiveSentiments count
+        counts.totalTweets = node->totalTweets; // Copy the totalTweets count
+        return; // Return the counts
+    }
+    const TrieNode* current = root; // Start at the root node
+    size_t depth = 1; // Nodes visited so far, root included
     for (char c : word) { // Loop through each character in the word
-        if (current->children.find(c) == current->children.end()) { // If the character is not in the children map
-            return 0.0; // Return 0.0 if the word is not found
+        auto it = current->children.find(c); // Probe the children map once
+        if (it == current->children.end()) { // If the character is not in the children map
+            if (visited != nullptr) *visited = depth; // Report the nodes visited
+            return; // Return if the word is not found
+        }
+        current = it->second; // Move to the child node
+        ++depth; // Count the child
+    }
+    if (visited != nullptr) *visited = depth; // Report the nodes visited
+    counts.positiveSentiments = current->positiveSentiments; // Copy the positiveSentiments count
+    counts.totalTweets = current->totalTweets; // Copy the totalTweets count
+}
+
+WordScores Trie::getScores(std::string_view word) const { // Get both scores of a word
+    return getScores(word, deltaSnapshot().get()); // Score it against the current delta
+}
+
+WordScores Trie::getScores(std::string_view word, const TrieDelta* snapshot) const { // Get both scores of a word against a pinned delta
+    const WordCounts* added = nullptr; // Counts the delta holds for the word
+    if (snapshot != nullptr) { // If words were added incrementally
+        added = snapshot->find(word); // Look the word up in the delta
+    }
+    size_t visited = 0; // Nodes visited by the walk
+    WordScores scores; // Declare the scores, zero for unknown words
+    bool seen = false; // Whether the word was seen in training
+    if (finalized && added == nullptr) { // If the cache holds the word's scores
+        const CachedScores* cached = nullptr; // Declare the cached scores of the word's node
+        if (currentLayout == TrieLayout::Compact) { // If the Trie uses the compact layout
+            const CompactTrie::Node* node = compactNodes.find(word, &visited); // Find the node of the word
+            if (node != nullptr) { // If the word's node exists
+                cached = &compactScores[compactNodes.indexOf(node)]; // Get its cached scores
+                seen = node->totalTweets > 0; // Check if it holds a word
+            }
+        } else { // If the Trie uses the map layout
+            const TrieNode* current = root; // Start at the root node
+            visited = 1; // Count the root
+            for (char c : word) { // Loop through each character in the word
+                auto it = current->children.find(c); // Probe the children map once
+                if (it == current->children.end()) { // If the character is not in the children map
+                    current = nullptr; // The word is not found
+                    break; // Exit the loop
+                }
+                current = it->second; // Move to the child node
+                ++visited; // Count the child
+            }
+            if (current != nullptr) { // If the word's node exists
+                cached = &current->scores; // Get its cached scores
+                seen = current->totalTweets > 0; // Check if it holds a word
+            }
+        }
+        if (cached != nullptr) { // If the word's node exists
+            scores.logOdds = cached->logOdds; // Read the log odds ratio
+            scores.sentimentScore = cached->sentimentScore; // Read the sentiment score
         }
-        current = current->children[c]; // Move to the child node
+    } else { // If the scores have to be computed
+        WordCounts counts; // Declare the counts of the word
+        lookupNodes(word, counts, &visited); // Get the counts stored in the nodes
+        if (added != nullptr) { // If the delta holds the word
+            counts.positiveSentiments += added->positiveSentiments; // Add the positiveSentiments count
+            counts.totalTweets += added->totalTweets; // Add the totalTweets count
+        }
+        seen = counts.totalTweets > 0; // Check if the word was seen
+        scores = scoresOf(counts, smoothingAlpha); // Compute both scores from the counts
     }
-    if (current->totalTweets == 0) { // If the totalTweets count is 0
-        return 0.0; // Return 0.0
+    if (Metrics::enabled()) { // If metrics are being collected
+        Metrics::add(Counter::TrieLookups); // Count the lookup
+        Metrics::add(seen ? Counter::TrieHits : Counter::TrieMisses); // Count the hit or miss
+        Metrics::add(Counter::TrieNodesVisited, visited); // Count the nodes visited
+        if (added != nullptr) Metrics::add(Counter::DeltaHits); // Count the delta hit
     }
-    double positiveRatio = static_cast<double>(current->positiveSentiments + 1); // Calculate the positive ratio with Laplace smoothing
-    double negativeRatio = static_cast<double>(current->totalTweets - current->positiveSentiments + 1); // Calculate the negative ratio with Laplace smoothing
-    return std::log(positiveRatio / negativeRatio); // Calculate and return the log odds ratio
+    return scores; // Return both scores
+}
+
+void Trie::mergeDelta() { // Add the delta to the nodes
+    if (currentLayout == TrieLayout::Compact) { // Check if the Trie is read-only
+        throw std::logic_error("Cannot merge into a compact Trie"); // Throw an error if it is
+    }
+    std::lock_guard<std::mutex> lock(updateMutex); // Keep updates out while the delta is merged
+    std::shared_ptr<const TrieDelta> snapshot = deltaSnapshot(); // Get the published delta
+    if (snapshot == nullptr) return; // Nothing to merge
+    finalized = false; // The counts are about to change
+    snapshot->forEach([this](std::string_view word, const WordCounts& added) { // Loop through each added word
+        TrieNode* current = root; // Start at the root node
+        for (char c : word) { // Loop through each character in the word
+            TrieNode*& child = current->children[c]; // Find or create the child slot
+            if (child == nullptr) child = newNode(); // Create the child node if needed
+            current = child; // Move to the child node
+        }
+        current->totalTweets += added.totalTweets; // Add the totalTweets count
+        current->positiveSentiments += added.positiveSentiments; // Add the positiveSentiments count
+    });
+    hasDelta.store(false, std::memory_order_release); // Lookups read the nodes alone again
+    std::atomic_store(&delta, std::shared_ptr<const TrieDelta>()); // Drop the delta
+    forgetDeltaFile(); // A saved delta file no longer matches the delta
 }
 
 Trie::~Trie() { // Destructor for Trie
-    deleteTrie(root); // Delete the Trie starting from the root
+    // The arena frees every node and child map with its chunks; nothing is visited node by node
 }
 
-void Trie::deleteTrie(TrieNode* node) { // Delete the Trie recursively
-    if (node == nullptr) return; // Return if the node is null
-    for (auto& pair : node->children) { // Loop through each child node
-        deleteTrie(pair.second); // Recursively delete the child node
-    }
-    delete node; // Delete the current node
+TrieNode* Trie::newNode() { // Create a node in the arena
+    return new (arena.allocateDirect(sizeof(TrieNode), alignof(TrieNode))) TrieNode(&arena); // Construct it in place, its children in the arena too
+}
+
+void Trie::resetNodes() { // Free every map-based node at once
+    arena.release(); // Free the chunks; the nodes own nothing outside them, so none is destroyed
+    root = newNode(); // Start over with an empty root
 }
 
-void Trie::save(const DSString& filename) const { // Save the Trie to a file
+void Trie::save(const DSString& filename, unsigned numThreads) const { // Save the Trie to a file
     auto start = std::chrono::high_resolution_clock::now(); // Start timing
 
+    if (numThreads == 0) { // If the caller asked for the hardware concurrency
+        numThreads = std::max(1u, std::thread::hardware_concurrency()); // Use every core, but at least one thread
+    }
+
     std::ofstream file(filename.c_str(), std::ios::binary); // Open the file for writing in binary mode
     if (!file.is_open()) { // Check if the file is open
         throw std::runtime_error("Could not open file for writing"); // Throw an error if the file could not be opened
     }
-    std::vector<std::pair<DSString, TrieNode*>> batch; // Declare a batch vector to hold nodes
-    ThreadPool* pool = new ThreadPool(std::thread::hardware_concurrency()); // Create a thread pool with hardware concurrency
-    saveNode(file, root, "", batch, *pool); // Save the root node
-    delete pool; // Delete the thread pool
-    if (!batch.empty()) { // If the batch is not empty
-        writeBatch(file, batch); // Write the batch to the file
+    if (currentLayout == TrieLayout::Compact) { // If the Trie uses the compact layout
+        std::string buffer; // Declare the encoded records
+        compactNodes.forEachWord([&buffer](const std::string& word, const CompactTrie::Node& node) { // Loop through every word in label order
+            appendRecord(buffer, word, node.totalTweets, node.positiveSentiments); // Encode the word's record
+        });
+        file.write(buffer.data(), static_cast<std::streamsize>(buffer.size())); // Write the records
+    } else { // If the Trie uses the map layout
+        // Partition the Trie by top-level subtree, in label order, so the file does not depend on thread scheduling
+        std::vector<std::pair<char, const TrieNode*>> partitions(root->children.begin(), root->children.end()); // Declare one partition per top-level child
+        std::sort(partitions.begin(), partitions.end(), [](const std::pair<char, const TrieNode*>& a, const std::pair<char, const TrieNode*>& b) { // Sort them by label
+            return static_cast<unsigned char>(a.first) < static_cast<unsigned char>(b.first); // Compare the labels as bytes
+        });
+        std::vector<std::string> buffers(partitions.size()); // Declare one buffer per partition
+        auto encodePartition = [&](size_t i) { // Encode one partition into its buffer
+            std::string prefix(1, partitions[i].first); // Start the prefix with the top-level label
+            encodeNode(buffers[i], partitions[i].second, prefix); // Encode the subtree
+        };
+
+        // Encode the partitions as pool tasks; partitions are disjoint and read-only, so no locking is needed
+        if (numThreads > 1 && partitions.size() > 1) { // If the save runs in parallel
+            ThreadPool pool(std::min<size_t>(numThreads, partitions.size())); // Declare the pool, no larger than the partition count
+            TaskGroup encoding(pool); // Declare the group of encoding tasks
+            encoding.runEach(partitions.size(), encodePartition); // Encode each partition on the pool
+            encoding.wait(); // Wait for every partition; rethrows the first failure
+        } else { // If the save runs serially
+            for (size_t i = 0; i < partitions.size(); ++i) { // Loop through the partitions in label order
+                encodePartition(i); // Encode the partition
+            }
+        }
+
+        std::string rootRecord; // Declare the record of the empty word
+        if (root->totalTweets > 0) { // If the empty word was counted
+            appendRecord(rootRecord, std::string_view(), root->totalTweets, root->positiveSentiments); // Encode it
+        }
+        file.write(rootRecord.data(), static_cast<std::streamsize>(rootRecord.size())); // Write the empty word first
+        for (const std::string& buffer : buffers) { // Loop through the partitions in label order
+            file.write(buffer.data(), static_cast<std::streamsize>(buffer.size())); // Write the partition
+        }
     }
     file.close(); // Close the file
+    if (!file) { // Check if every byte was written
+        throw std::runtime_error("Error writing file"); // Throw an error if writing failed
+    }
 
     auto end = std::chrono::high_resolution_clock::now(); // End timing
     std::chrono::duration<double> duration = end - start; // Calculate the duration
     std::cout << "Saving completed in " << duration.count() << " seconds." << std::endl; // Output the duration
 }
 
-void Trie::saveNode(std::ofstream& file, TrieNode* node, const DSString& prefix, std::vector<std::pair<DSString, TrieNode*>>& batch, ThreadPool& pool) const { // Save a node to the file
-    if (node->totalTweets > 0) { // If the node has tweets
-        {
-            std::lock_guard<std::mutex> lock(mtx); // Lock the mutex
-            batch.emplace_back(prefix, node); // Add the node to the batch
-        }
-        if (batch.size() >= 1000) { // If the batch size is 1000 or more
-            std::vector<std::pair<DSString, TrieNode*>> batchCopy; // Declare a batch copy vector
-            {
-                std::lock_guard<std::mutex> lock(mtx); // Lock the mutex
-                batchCopy.swap(batch); // Swap the batch with the batch copy
-            }
-            pool.enqueue([this, &file, batchCopy] { // Enqueue a task to write the batch to the file
-                writeBatch(file, batchCopy); // Write the batch to the file
-            });
-        }
+void Trie::encodeNode(std::string& out, const TrieNode* node, std::string& prefix) { // Encode a subtree depth first
+    if (node->totalTweets > 0) { // If the node holds a word
+        appendRecord(out, prefix, node->totalTweets, node->positiveSentiments); // Encode its record
     }
-    for (const auto& pair : node->children) { // Loop through each child node
-        pool.enqueue([this, &file, pair, prefix, &batch, &pool] { // Enqueue a task to save the child node
-            saveNode(file, pair.second, prefix + pair.first, batch, pool); // Save the child node
-        });
-    }
-}
-
-void Trie::writeBatch(std::ofstream& file, const std::vector<std::pair<DSString, TrieNode*>>& batch) const { // Write a batch of nodes to the file
-    std::lock_guard<std::mutex> lock(mtx); // Lock the mutex
-    for (const auto& pair : batch) { // Loop through each pair in the batch
-        const DSString& prefix = pair.first; // Get the prefix
-        TrieNode* node = pair.second; // Get the node
-        size_t prefixSize = prefix.length(); // Get the length of the prefix
-        file.write(reinterpret_cast<const char*>(&prefixSize), sizeof(prefixSize)); // Write the prefix size to the file
-        file.write(prefix.c_str(), prefixSize); // Write the prefix to the file
-        file.write(reinterpret_cast<const char*>(&node->totalTweets), sizeof(node->totalTweets)); // Write the totalTweets count to the file
-        file.write(reinterpret_cast<const char*>(&node->positiveSentiments), sizeof(node->positiveSentiments)); // Write the positiveSentiments count to the file
+    std::vector<std::pair<char, const TrieNode*>> children(node->children.begin(), node->children.end()); // Collect the children
+    std::sort(children.begin(), children.end(), [](const std::pair<char, const TrieNode*>& a, const std::pair<char, const TrieNode*>& b) { // Sort them by label
+        return static_cast<unsigned char>(a.first) < static_cast<unsigned char>(b.first); // Compare the labels as bytes
+    });
+    for (const auto& child : children) { // Loop through the children in label order
+        prefix.push_back(child.first); // Extend the prefix
+        encodeNode(out, child.second, prefix); // Encode the child subtree
+        prefix.pop_back(); // Restore the prefix
     }
 }
 
 void Trie::load(const DSString& filename) { // Load the Trie from a file
-    auto start = std::chrono::high_resolution_clock::now(); // Start timing
-
-    std::ifstream file(filename.c_str(), std::ios::binary); // Open the file for reading in binary mode
-    if (!file.is_open()) { // Check if the file is open
-        throw std::runtime_error("Could not open file for reading"); // Throw an error if the file could not be opened
+    if (currentLayout == TrieLayout::Compact) { // Check if the Trie is read-only
+        throw std::logic_error("Cannot load into a compact Trie"); // Throw an error if it is
     }
+    finalized = false; // The counts are about to change
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing
 
-    while (file) { // Loop while the file is open
-        size_t prefixSize; // Declare a variable for the prefix size
-        if (!file.read(reinterpret_cast<char*>(&prefixSize), sizeof(prefixSize))) { // Read the prefix size from the file
-            break; // Exit the loop if reading fails
-        }
-
-        DSString prefix(prefixSize, '\0'); // Declare a string for the prefix
-        if (!file.read(&prefix[0], prefixSize)) { // Read the prefix from the file
-            throw std::runtime_error("Error reading prefix from file"); // Throw an error if reading fails
-        }
-
-        int totalTweets, positiveSentiments; // Declare variables for the tweet data
-        if (!file.read(reinterpret_cast<char*>(&totalTweets), sizeof(totalTweets)) || // Read the totalTweets count from the file
-            !file.read(reinterpret_cast<char*>(&positiveSentiments), sizeof(positiveSentiments))) { // Read the positiveSentiments count from the file
-            throw std::runtime_error("Error reading tweet data from file"); // Throw an error if reading fails
-        }
-
+    readRecords(filename, [this](std::string_view prefix, int totalTweets, int positiveSentiments) { // Loop through each record
         TrieNode* current = root; // Start at the root node
         for (char c : prefix) { // Loop through each character in the prefix
             if (current->children.find(c) == current->children.end()) { // If the character is not in the children map
-                current->children[c] = new TrieNode(); // Create a new TrieNode for the character
+                current->children[c] = newNode(); // Create a new TrieNode for the character
             }
             current = current->children[c]; // Move to the child node
         }
         current->totalTweets = totalTweets; // Set the totalTweets count
         current->positiveSentiments = positiveSentiments; // Set the positiveSentiments count
-    }
+    });
+
+    auto end = std::chrono::high_resolution_clock::now(); // End timing
+    std::chrono::duration<double> duration = end - start; // Calculate the duration
+    std::cout << "Loading completed in " << duration.count() << " seconds." << std::endl; // Output the duration
+}
+
+void Trie::saveBinary(const DSString& filename) const { // Save the Trie as a binary model file
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing
 
+    std::ofstream file(filename.c_str(), std::ios::binary); // Open the file for writing in binary mode
+    if (!file.is_open()) { // Check if the file is open
+        throw std::runtime_error("Could not open file for writing"); // Throw an error if the file could not be opened
+    }
+    if (currentLayout == TrieLayout::Compact) { // If the Trie already uses the compact layout
+        compactNodes.write(file); // Write its arrays
+    } else { // If the Trie uses the map layout
+        CompactTrie arrays; // Declare temporary arrays
+        arrays.build(root); // Copy the nodes into them
+        arrays.write(file); // Write the arrays
+    }
     file.close(); // Close the file
+    if (!file) { // Check if every byte was written
+        throw std::runtime_error("Error writing binary model file"); // Throw an error if writing failed
+    }
+
+    auto end = std::chrono::high_resolution_clock::now(); // End timing
+    std::chrono::duration<double> duration = end - start; // Calculate the duration
+    std::cout << "Saving completed in " << duration.count() << " seconds." << std::endl; // Output the duration
+}
+
+void Trie::loadBinary(const DSString& filename, bool verifyChecksum) { // Load a binary model file by mapping it
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing
+
+    CompactTrie mapped; // Declare the mapped arrays
+    mapped.map(std::make_shared<MappedFile>(filename), verifyChecksum); // Map and validate the file before touching the Trie
+    resetNodes(); // Free the current nodes, keeping an empty root so the map layout stays valid
+    compactNodes = std::move(mapped); // Use the mapped arrays for lookups
+    currentLayout = TrieLayout::Compact; // The mapped arrays are read-only
+    finalized = false; // The cached scores belong to the old nodes
+    compactScores.clear(); // Free them
 
     auto end = std::chrono::high_resolution_clock::now(); // End timing
     std::chrono::duration<double> duration = end - start; // Calculate the duration
     std::cout << "Loading completed in " << duration.count() << " seconds." << std::endl; // Output the duration
 }
 
+bool Trie::isBinaryModel(const DSString& filename) { // Check if a file is a binary model file
+    std::ifstream file(filename.c_str(), std::ios::binary); // Open the file for reading in binary mode
+    char signature[8]; // Declare a buffer for the signature
+    file.read(signature, sizeof(signature)); // Read the first bytes
+    return CompactTrie::hasSignature(signature, static_cast<size_t>(file.gcount())); // Compare them with the signature
+}
+
+void Trie::convertModel(const DSString& legacyFile, const DSString& binaryFile) { // Convert a legacy model file
+    Trie trie; // Declare a Trie to hold the model
+    trie.load(legacyFile); // Load the legacy file
+    trie.saveBinary(binaryFile); // Write the binary file
+}
+
+size_t Trie::pruneModel(const DSString& inputFile, const DSString& outputFile, const PruneOptions& options, double alpha) { // Prune a model file into a new file
+    Trie trie; // Declare a Trie to hold the model
+    trie.setSmoothing(alpha); // Check the log odds with the requested smoothing
+    bool binary = isBinaryModel(inputFile); // Keep the format of the input
+    if (binary) { // If the input is a binary model
+        trie.loadBinary(inputFile); // Map it
+    } else { // If the input is a legacy model
+        trie.load(inputFile); // Load it
+    }
+    size_t words = trie.wordCount(); // Count the words before pruning
+    size_t dropped = trie.prune(options); // Drop the words below the thresholds
+    if (binary) { // If the input was a binary model
+        trie.saveBinary(outputFile); // Write a binary model
+    } else { // If the input was a legacy model
+        trie.save(outputFile); // Write a legacy model
+    }
+    std::cout << "Kept " << words - dropped << " of " << words << " words." << std::endl; // Report the vocabulary sizes
+    return dropped; // Return the number of words dropped
+}
+
 std::vector<DSString> Trie::tokenize(const DSString& text) const { // Tokenize a string into words
+    TokenBuffer buffer; // Declare a buffer for the tokens
+    tokenize(text, buffer); // Tokenize the text
     std::vector<DSString> tokens; // Declare a vector to hold the tokens
-    std::istringstream stream(text.c_str()); // Create a string stream from the text
-    DSString word; // Declare a string for each word
-    while (stream >> word) { // Loop through each word in the stream
-        word.erase(std::remove_if(word.begin(), word.end(), ::ispunct), word.end()); // Remove punctuation from the word
-        std::transform(word.begin(), word.end(), word.begin(), ::tolower); // Convert the word to lowercase
-        if (word == "not" || word == "no" || word == "nor" || word == "neither") { // Check for negation words
-            DSString nextWord; // Declare a string for the next word
-            stream >> nextWord; // Read the next word
-            nextWord.erase(std::remove_if(nextWord.begin(), nextWord.end(), ::ispunct), nextWord.end()); // Remove punctuation from the next word
-            std::transform(nextWord.begin(), nextWord.end(), nextWord.begin(), ::tolower); // Convert the next word to lowercase
-            word += " "; // Add a space to the word
-            word += nextWord; // Add the next word to the word
-        }
-        tokens.push_back(word); // Add the word to the tokens vector
+    tokens.reserve(buffer.size()); // Reserve room for every token
+    for (size_t i = 0; i < buffer.size(); ++i) { // Loop through each token
+        tokens.emplace_back(buffer[i].data(), buffer[i].size()); // Copy the token into the vector
     }
     return tokens; // Return the tokens vector
 }
+
+void Trie::tokenize(std::string_view text, TokenBuffer& tokens) const { // Tokenize a string into a reusable buffer
+    Tokenizer::tokenize(text, tokens); // Split and normalize the words in one pass
+}
@@ -2,75 +2,65 @@
 #define TRIE_H // Define the include guard
 
 #include "DSString.h" // Include DSString header
+#include "CSVReader.h" // Include CSVReader for memory-mapped CSV parsing
+#include "Tokenizer.h" // Include Tokenizer for allocation-free tokenization
+#include "CompactTrie.h" // Include CompactTrie for the array-based layout
+#include "ThreadPool.h" // Include ThreadPool for parallel training and saving
+#include "NodeArena.h" // Include NodeArena for the node storage
+#include "SentimentModel.h" // Include SentimentModel, the interface the Trie implements
 #include <unordered_map> // Include unordered_map for TrieNode children
+#include <memory_resource> // Include memory_resource for the arena-backed child maps
 #include <fstream> // Include fstream for file operations
 #include <sstream> // Include sstream for string stream operations
 #include <thread> // Include thread for multithreading
 #include <mutex> // Include mutex for thread synchronization
+#include <string> // Include string for encoding save records
 #include <vector> // Include vector for dynamic array
-#include <queue> // Include queue for task queue in ThreadPool
 #include <condition_variable> // Include condition_variable for thread synchronization
 #include <functional> // Include functional for std::function
 #include <iostream> // Include iostream for input/output operations
 #include <cmath> // Include cmath for mathematical operations
 #include <chrono> // Include the chrono library for timing
-
-/**
- * @class ThreadPool
- * @brief A simple thread pool implementation to manage and execute tasks using multiple threads.
- *
- * The ThreadPool class allows for the creation of a pool of worker threads that can be used to
- * execute tasks concurrently. Tasks are added to a queue and worker threads pick up tasks from
- * the queue and execute them.
- */
-class ThreadPool {
-public:
-    /**
-     * @brief Constructs a ThreadPool with a specified number of threads.
-     * @param numThreads The number of threads to create in the pool.
-     */
-    ThreadPool(size_t numThreads);
-
-    /**
-     * @brief Destructor to clean up resources used by the ThreadPool.
-     */
-    ~ThreadPool();
-
-    /**
-     * @brief Adds a task to the task queue to be executed by the thread pool.
-     * @param task A function object representing the task to be executed.
-     */
-    void enqueue(std::function<void()> task);
-
-private:
-    std::vector<std::thread> workers; ///< Vector to hold worker threads.
-    std::queue<std::function<void()>> tasks; ///< Queue to hold tasks.
-    std::mutex queueMutex; ///< Mutex to protect task queue.
-    std::condition_variable condition; ///< Condition variable for task synchronization.
-    bool stop; ///< Flag to stop the ThreadPool.
-
-    /**
-     * @brief Method for worker thread to execute tasks from the task queue.
-     */
-    void workerThread();
-};
+#include <memory> // Include memory for std::unique_ptr
+#include <atomic> // Include atomic for lock-free work distribution
+#include <limits> // Include limits for std::numeric_limits
+#include <algorithm> // Include algorithm for sorting labels
+#include <exception> // Include exception for std::exception_ptr
+#include <cstdio> // Include cstdio for replacing the delta file
 
 class TrieNode { // Define TrieNode class
 public: // Public members
-    std::unordered_map<char, TrieNode*> children; // Map to hold children nodes
+    std::pmr::unordered_map<char, TrieNode*> children; // Map to hold children nodes, allocated from the Trie's arena
     int positiveSentiments; // Counter for positive sentiments
     int totalTweets; // Counter for total tweets
+    CachedScores scores; // Scores precomputed from the counters by Trie::finalize()
 
-    TrieNode(); // Constructor to initialize TrieNode
+    explicit TrieNode(std::pmr::memory_resource* resource = std::pmr::get_default_resource()); // Constructor to initialize TrieNode with the resource its children come from
+};
+
+/**
+ * @brief Node representations a Trie can use.
+ */
+enum class TrieLayout {
+    Map, ///< TrieNodes with unordered_map children, allocated from the Trie's NodeArena; supports insertion.
+    Compact ///< Read-only contiguous arrays with 32-bit indices (see CompactTrie).
 };
 
 /**
  * @class Trie
  * @brief A class representing a Trie (prefix tree) for storing and analyzing words with sentiment scores.
+ *
+ * The default SentimentModel backend, and the only one with the compact, memory-mapped layout.
  */
-class Trie { // Define Trie class
+class Trie : public SentimentModel { // Define Trie class, a SentimentModel backend
 private: // Private members
+    NodeArena arena; // Storage of the map-based nodes and their children, released all at once
     TrieNode* root; // Root node of the Trie
+    CompactTrie compactNodes; // Array-based copy of the Trie once it is compacted
+    TrieLayout currentLayout; // Layout used for lookups
+    double smoothingAlpha; // Additive smoothing of the log odds ratio
+    bool finalized; // Flag set while the cached scores match the counts and the smoothing
+    std::vector<CachedScores> compactScores; // Cached scores of the compact nodes, by node index
 
 public: // Public members
     /**
@@ -78,49 +68,240 @@ public: // Public members
      */
     Trie();
 
+    /**
+     * @brief Gets the name of the backend.
+     * @return "trie".
+     */
+    const char* name() const override;
+
     /**
      * @brief Trains the Trie with words from a file.
+     *
+     * The file is memory-mapped and its header line skipped. With more than one thread the records
+     * are split into byte ranges on record boundaries, each range is counted into its own partial
+     * Trie, and the partial tries are merged back in range order so the result does not depend on
+     * thread scheduling. A thread count of 1 trains in place.
+     *
      * @param file The file containing words to train the Trie.
+     * @param numThreads The number of threads to train with (0 uses the hardware concurrency).
      */
-    void train(const DSString& file);
+    void train(const DSString& file, unsigned numThreads = 1) override;
 
     /**
      * @brief Inserts a word into the Trie with its sentiment.
      * @param word The word to insert.
      * @param isPositive Boolean indicating if the word has a positive sentiment.
      */
-    void insert(const DSString& word, bool isPositive);
+    void insert(std::string_view word, bool isPositive) override;
+
+    /**
+     * @brief Adds counts to a word's node, creating the path to it if needed.
+     * @param word The word.
+     * @param counts The counts to add.
+     * @throws std::logic_error If the Trie uses the compact layout.
+     */
+    void addCounts(std::string_view word, const WordCounts& counts) override;
+
+    /**
+     * @brief Adds the delta to the nodes and drops it.
+     *
+     * Must not run while other threads read the Trie.
+     *
+     * @throws std::logic_error If the Trie uses the compact layout.
+     */
+    void mergeDelta();
 
     /**
      * @brief Gets the sentiment score of a word.
      * @param word The word to get the sentiment score for.
      * @return The sentiment score of the word.
      */
-    double getSentimentScore(const DSString& word) const;
+    double getSentimentScore(std::string_view word) const;
 
     /**
      * @brief Gets the log odds ratio of a word.
      * @param word The word to get the log odds ratio for.
      * @return The log odds ratio of the word.
      */
-    double getLogOddsRatio(const DSString& word) const;
+    double getLogOddsRatio(std::string_view word) const;
+
+    /**
+     * @brief Looks up the training counts of a word with a single walk of the Trie.
+     * @param word The word to look up.
+     * @param counts Receives the counts (zero if the word is not found).
+     * @return True if the word was seen in training, false otherwise.
+     */
+    bool lookup(std::string_view word, WordCounts& counts) const;
+
+    /**
+     * @brief Looks up the training counts of a word against a pinned delta.
+     * @param word The word to look up.
+     * @param counts Receives the counts of the nodes plus the delta (zero if the word is not found).
+     * @param snapshot The delta from deltaSnapshot(), or nullptr to read the nodes only.
+     * @return True if the word was seen in training, false otherwise.
+     */
+    bool lookup(std::string_view word, WordCounts& counts, const TrieDelta* snapshot) const;
+
+    /**
+     * @brief Gets the log odds ratio and the sentiment score of a word with a single walk of the Trie.
+     * @param word The word to score.
+     * @return Both scores of the word (zero if the word is not found).
+     */
+    WordScores getScores(std::string_view word) const;
+
+    /**
+     * @brief Gets both scores of a word against a pinned delta.
+     *
+     * Counts the lookup, whether the word was seen, the nodes visited and delta hits in Metrics.
+     *
+     * @param word The word to score.
+     * @param snapshot The delta from deltaSnapshot(), or nullptr to read the nodes only.
+     * @return Both scores of the word (zero if the word is not found).
+     */
+    WordScores getScores(std::string_view word, const TrieDelta* snapshot) const override;
+
+    /**
+     * @brief Sums both scores of tokenized words against one delta snapshot, walking the Trie once per word.
+     * @param words The tokenized words.
+     * @return The log-odds sum and the sentiment score sum.
+     */
+    WordScores sumScores(const TokenBuffer& words) const override;
+
+    /**
+     * @brief Precomputes both scores of every node so lookups read them instead of computing them.
+     *
+     * Call after train, load or loadBinary; anything that changes the nodes' counts drops the cache
+     * and lookups compute the scores again until the next finalize. Words the delta holds are still
+     * scored from their combined counts. The scores are cached as floats. Must not run while other
+     * threads read the Trie.
+     */
+    void finalize() override;
+
+    /**
+     * @brief Checks if the cached scores are in use.
+     * @return True if finalize() ran after the last change to the nodes.
+     */
+    bool isFinalized() const;
+
+    /**
+     * @brief Sets the additive smoothing of the log odds ratio, recomputing the cache if it is in use.
+     *
+     * Must not run while other threads read the Trie.
+     *
+     * @param alpha The count added to both the positive and the negative count (1 is Laplace smoothing).
+     */
+    void setSmoothing(double alpha) override;
+
+    /**
+     * @brief Gets the additive smoothing of the log odds ratio.
+     * @return The smoothing count.
+     */
+    double smoothing() const override;
+
+    /**
+     * @brief Drops the words below the thresholds and the interior nodes left without words.
+     *
+     * The map-based nodes are pruned in place (a compact Trie is unpacked first), then copied into a
+     * new compact layout, which frees every node. A Trie that used the map layout is then rebuilt
+     * from the compact arrays, so its arena holds the remaining nodes only.
+     *
+     * @param options The thresholds a word must reach to be kept.
+     * @return The number of words dropped.
+     */
+    size_t prune(const PruneOptions& options) override;
+
+    /**
+     * @brief Counts the distinct words stored in the Trie.
+     * @return The number of words with a nonzero tweet count, including words only the delta holds.
+     */
+    size_t wordCount() const override;
+
+    /**
+     * @brief Switches the Trie to a node layout.
+     *
+     * Switching to TrieLayout::Compact copies the words into a CompactTrie and frees the map-based
+     * nodes. The compact layout is read-only: insert, train and load throw std::logic_error until the
+     * Trie is switched back to TrieLayout::Map, which rebuilds the map-based nodes.
+     *
+     * @param layout The layout to switch to.
+     */
+    void setLayout(TrieLayout layout);
+
+    /**
+     * @brief Gets the node layout used for lookups.
+     * @return The current layout.
+     */
+    TrieLayout layout() const;
 
     /**
      * @brief Destructor to clean up resources.
      */
-    ~Trie();
+    ~Trie() override;
 
     /**
      * @brief Saves the Trie to a file.
+     *
+     * Each top-level subtree is a partition that one thread encodes into its own buffer, visiting
+     * children in label order; the buffers are written in label order after the empty word. The file
+     * is therefore identical for any thread count and in either layout. Counts added by update() are
+     * not included; save them with saveDelta() or fold them in with mergeDelta() first.
+     *
      * @param filename The name of the file to save the Trie to.
+     * @param numThreads The number of threads to encode with (0 uses the hardware concurrency).
      */
-    void save(const DSString& filename) const;
+    void save(const DSString& filename, unsigned numThreads = 0) const override;
 
     /**
      * @brief Loads the Trie from a file.
      * @param filename The name of the file to load the Trie from.
      */
-    void load(const DSString& filename);
+    void load(const DSString& filename) override;
+
+    /**
+     * @brief Saves the Trie as a binary model file (see CompactTrie::FileHeader).
+     *
+     * The file holds the compact node arrays behind a versioned, checksummed header, so it can be
+     * memory-mapped by loadBinary() and queried without deserialization.
+     *
+     * @param filename The name of the file to save the Trie to.
+     */
+    void saveBinary(const DSString& filename) const;
+
+    /**
+     * @brief Loads a binary model file by memory-mapping it.
+     *
+     * The Trie switches to TrieLayout::Compact and answers lookups straight from the mapping, so
+     * the load cost does not grow with the vocabulary (apart from the optional checksum pass).
+     *
+     * @param filename The name of the file to load the Trie from.
+     * @param verifyChecksum Whether to hash the whole file to detect corruption.
+     * @throws std::runtime_error If the file is not a valid binary model.
+     */
+    void loadBinary(const DSString& filename, bool verifyChecksum = true) override;
+
+    /**
+     * @brief Checks if a file is a binary model file rather than a legacy one.
+     * @param filename The name of the file to check.
+     * @return True if the file starts with the binary model signature.
+     */
+    static bool isBinaryModel(const DSString& filename);
+
+    /**
+     * @brief Converts a legacy model file written by save() into a binary model file.
+     * @param legacyFile The name of the legacy model file.
+     * @param binaryFile The name of the binary model file to write.
+     */
+    static void convertModel(const DSString& legacyFile, const DSString& binaryFile);
+
+    /**
+     * @brief Prunes a model file (see prune()) into a new file of the same format, legacy or binary.
+     * @param inputFile The name of the model file to prune.
+     * @param outputFile The name of the pruned model file to write.
+     * @param options The thresholds a word must reach to be kept.
+     * @param alpha The additive smoothing of the log odds the thresholds are checked against.
+     * @return The number of words dropped.
+     */
+    static size_t pruneModel(const DSString& inputFile, const DSString& outputFile, const PruneOptions& options, double alpha = 1.0);
 
     /**
      * @brief Tokenizes a text into words.
@@ -129,29 +310,86 @@ public: // Public members
      */
     std::vector<DSString> tokenize(const DSString& text) const;
 
+    /**
+     * @brief Tokenizes a text into a reusable buffer without allocating per word.
+     * @param text The text to tokenize.
+     * @param tokens The buffer receiving the tokens (cleared first).
+     */
+    void tokenize(std::string_view text, TokenBuffer& tokens) const;
+
 private: // Private members
     /**
-     * @brief Saves a node and its children to a file.
-     * @param file The file stream to write to.
-     * @param node The node to save.
-     * @param prefix The prefix of the current node.
-     * @param batch A batch of nodes to save.
-     * @param pool The thread pool for parallel processing.
+     * @brief Inserts the words of one training record.
+     * @param sentiment The sentiment field of the record.
+     * @param tweet The tweet field of the record.
+     * @param tokens A scratch buffer for the tweet's tokens.
+     */
+    void trainRecord(std::string_view sentiment, std::string_view tweet, TokenBuffer& tokens);
+
+    /**
+     * @brief Trains the Trie with the records of a byte range of a mapped training file.
+     * @param begin The first byte of the range; must be the start of a record.
+     * @param end One past the last byte of the range.
+     */
+    void trainRange(char* begin, char* end);
+
+    /**
+     * @brief Adds the counts of one subtree into another, creating the nodes the target is missing.
+     * @param target The node receiving the counts.
+     * @param source The node whose counts and children are merged; left unchanged.
+     */
+    void mergeNode(TrieNode* target, const TrieNode* source);
+
+    /**
+     * @brief Looks up the counts stored in the nodes, ignoring the delta.
+     * @param word The word to look up.
+     * @param counts Receives the counts (zero if the word is not found).
+     * @param visited If not null, receives the number of nodes visited, root included.
+     */
+    void lookupNodes(std::string_view word, WordCounts& counts, size_t* visited = nullptr) const;
+
+    /**
+     * @brief Caches the scores of a subtree.
+     * @param node The root of the subtree.
+     * @param smoothing The additive smoothing of the log odds ratio.
+     */
+    static void finalizeNode(TrieNode* node, double smoothing);
+
+    /**
+     * @brief Encodes the records of a subtree depth first, children in label order.
+     * @param out The buffer receiving the records.
+     * @param node The root of the subtree.
+     * @param prefix The word spelled by the path to @p node; restored before returning.
+     */
+    static void encodeNode(std::string& out, const TrieNode* node, std::string& prefix);
+
+    /**
+     * @brief Drops the words of a subtree that are below the thresholds, and the children left without words.
+     * @param node The root of the subtree.
+     * @param options The thresholds a word must reach to be kept.
+     * @param smoothing The additive smoothing of the log odds ratio.
+     * @param dropped Incremented for each word dropped.
+     * @return True if the subtree no longer holds any word.
+     */
+    static bool pruneNode(TrieNode* node, const PruneOptions& options, double smoothing, size_t& dropped);
+
+    /**
+     * @brief Counts the words stored in a subtree.
+     * @param node The root of the subtree.
+     * @return The number of nodes with a nonzero tweet count.
      */
-    void saveNode(std::ofstream& file, TrieNode* node, const DSString& prefix, std::vector<std::pair<DSString, TrieNode*>>& batch, ThreadPool& pool) const;
+    static size_t countWords(const TrieNode* node);
 
     /**
-     * @brief Writes a batch of nodes to a file.
-     * @param file The file stream to write to.
-     * @param batch The batch of nodes to write.
+     * @brief Creates a node in the arena.
+     * @return The new node, with zero counts and no children.
      */
-    void writeBatch(std::ofstream& file, const std::vector<std::pair<DSString, TrieNode*>>& batch) const;
+    TrieNode* newNode();
 
     /**
-     * @brief Deletes the Trie and frees memory.
-     * @param node The root node of the Trie to delete.
+     * @brief Frees every map-based node at once and starts over with an empty root.
      */
-    void deleteTrie(TrieNode* node);
+    void resetNodes();
 };
 
 #endif // TRIE_H // End of include guard
\ No newline at end of file
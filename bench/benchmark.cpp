@@ -0,0 +1,1340 @@
+// Benchmarks for the sentiment analysis pipeline.
+//
+// Build with CMake (Release by default), which also copies data/ into the build directory:
+//   cmake -S . -B build && cmake --build build
+// Run from the directory holding data/:
+//   ./benchmark [--tweets N] [--threads N] [--repetitions N] [--json FILE] [case ...]
+// No case names runs every case. The "pipeline" case times every stage from tokenizing to accuracy,
+// and the fused classify-and-evaluate pass, on a corpus of --tweets training tweets (and half as many
+// test tweets), resampled from the bundled data when N is not 20000; --json writes its measurements
+// for comparing builds.
+
+#include "DSString.h" // Include DSString for the legacy parsing path
+#include "CSVReader.h" // Include the memory-mapped CSV reader
+#include "Tokenizer.h" // Include the single-pass tokenizer
+#include "Trie.h" // Include the Trie for the layout benchmarks
+#include "SentimentModel.h" // Include the model interface for the backend comparison
+#include "HashVocabulary.h" // Include the hash table backend for the interning benchmark
+#include "ThreadPool.h" // Include the work-stealing pool
+#include "SentimentAnalyzer.h" // Include the analyzer for the pipeline stages
+#include "Metrics.h" // Include Metrics for the instrumentation overhead case
+#include "Evaluator.h" // Include the streaming evaluator
+#include "CorpusCache.h" // Include the compiled training corpus
+#include "LabelModel.h" // Include the multi-class naive Bayes model
+#include <atomic> // Include atomic for the allocation counters
+#include <cstdlib> // Include cstdlib for malloc and free
+#include <new> // Include new for replacing the global allocator
+#include <algorithm> // Include algorithm for the legacy tokenizer
+#include <chrono> // Include chrono for timing
+#include <cstring> // Include cstring for comparing case names
+#include <fstream> // Include fstream for the legacy parsing path
+#include <functional> // Include functional for the case table
+#include <iostream> // Include iostream for reporting
+#include <sstream> // Include sstream for the legacy parsing path
+#include <string_view> // Include string_view for CSV fields
+#include <vector> // Include vector for the case table
+#include <cstdio> // Include cstdio for removing temporary files
+#include <string> // Include string for comparing saved files
+#include <thread> // Include thread for the hardware concurrency
+#include <queue> // Include queue for the legacy thread pool
+#include <mutex> // Include mutex for the legacy thread pool
+#include <condition_variable> // Include condition_variable for the legacy thread pool
+#include <memory> // Include memory for the per-repetition tries
+#include <random> // Include random for resampling the corpus
+#include <cstdint> // Include cstdint for the resampling seed
+#include <iomanip> // Include iomanip for the JSON number precision
+
+#ifndef _WIN32
+#include <fcntl.h> // Include fcntl for open and posix_fadvise
+#include <unistd.h> // Include unistd for close and the page size
+#endif
+
+namespace { // Heap accounting: the global allocator is replaced so cases can measure bytes and allocations
+std::atomic<size_t> gLiveBytes(0); // Bytes currently allocated through operator new
+std::atomic<size_t> gAllocations(0); // Number of calls to operator new so far
+const size_t kHeader = 16; // Bytes in front of each block recording its size (keeps 16-byte alignment)
+} // namespace
+
+void* operator new(size_t size) { // Allocate a block and account for it
+    char* block = static_cast<char*>(std::malloc(size + kHeader)); // Allocate room for the size header
+    if (block == nullptr) throw std::bad_alloc(); // Report allocation failure
+    *reinterpret_cast<size_t*>(block) = size; // Record the requested size
+    gLiveBytes += size; // Count the bytes
+    gAllocations++; // Count the allocation
+    return block + kHeader; // Return the memory after the header
+}
+
+#if defined(__GNUC__) && !defined(__clang__) // GCC sees free() in the replaced operator delete and assumes the block came from new
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete" // The block came from malloc() in the replaced operator new
+#endif
+void operator delete(void* pointer) noexcept { // Free a block and account for it
+    if (pointer == nullptr) return; // Ignore null pointers
+    char* block = static_cast<char*>(pointer) - kHeader; // Find the size header
+    gLiveBytes -= *reinterpret_cast<size_t*>(block); // Uncount the bytes
+    std::free(block); // Free the block
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+void operator delete(void* pointer, size_t) noexcept { // Sized delete forwards to the unsized one
+    operator delete(pointer); // Free the block
+}
+
+namespace {
+const char* kTrainFile = "data/train_dataset_20k.csv"; // Training data with six columns
+const char* kTestFile = "data/test_dataset_10k.csv"; // Test data with five columns
+const char* kAnswersFile = "data/test_dataset_sentiment_10k.csv"; // Sentiment and id of every test tweet
+const int kRepetitions = 5; // Number of timed runs; the fastest is reported
+const size_t kBundledTweets = 20000; // Number of tweets in the bundled training file
+
+struct Options { // Command-line options
+    size_t tweets = kBundledTweets; // Training tweets in the pipeline corpus
+    unsigned threads = 1; // Threads used for training, saving and scoring (0 uses the hardware concurrency)
+    int repetitions = kRepetitions; // Timed runs of each pipeline stage
+    const char* json = nullptr; // File receiving the pipeline measurements, if any
+};
+Options gOptions; // Options of this run
+
+template <typename Setup, typename Function>
+double bestOf(int repetitions, Setup setup, Function function) { // Run untimed setup then a timed function several times and return the fastest time
+    double best = 1e300; // Initialize the best time
+    for (int i = 0; i < repetitions; ++i) { // Loop through each repetition
+        setup(); // Prepare the run without timing it
+        auto start = std::chrono::high_resolution_clock::now(); // Start timing
+        function(); // Run the function
+        std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start; // Measure the run
+        if (duration.count() < best) best = duration.count(); // Keep the fastest run
+    }
+    return best; // Return the fastest run
+}
+
+template <typename Function>
+double bestOf(int repetitions, Function function) { // Run a function several times and return the fastest time in seconds
+    double best = 1e300; // Initialize the best time
+    for (int i = 0; i < repetitions; ++i) { // Loop through each repetition
+        auto start = std::chrono::high_resolution_clock::now(); // Start timing
+        function(); // Run the function
+        std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start; // Measure the run
+        if (duration.count() < best) best = duration.count(); // Keep the fastest run
+    }
+    return best; // Return the fastest run
+}
+
+volatile size_t sink; // Keeps results alive so the compiler cannot drop the work
+
+size_t parseLegacy(const char* file, int numFields) { // Parse a CSV file the way Trie::train and analyzeFile used to
+    std::ifstream infile(file); // Open the file for reading
+    DSString line; // Declare a string to hold each line
+    size_t bytes = 0; // Total tweet bytes seen
+    getline(infile, line); // Skip the header line
+    while (getline(infile, line)) { // Read each line from the file
+        std::istringstream ss(line.c_str()); // Create a string stream from the line
+        DSString field; // Declare a string for each field
+        for (int i = 0; i + 1 < numFields; ++i) { // Loop through the leading fields
+            getline(ss, field, ','); // Read the field
+        }
+        getline(ss, field); // Read the tweet field
+        bytes += field.length(); // Count the tweet bytes
+    }
+    return bytes; // Return the tweet bytes
+}
+
+size_t parseMapped(const char* file, size_t numFields) { // Parse a CSV file with the memory-mapped reader
+    MappedFile mapped(file); // Map the file into memory
+    CSVReader reader(mapped.data(), mapped.data() + mapped.size()); // Declare a reader over the file
+    std::vector<std::string_view> fields; // Declare the field list, reused for every record
+    size_t bytes = 0; // Total tweet bytes seen
+    reader.skip(); // Skip the header line
+    while (reader.next(fields, numFields)) { // Read each record
+        bytes += fields.back().size(); // Count the tweet bytes
+    }
+    return bytes; // Return the tweet bytes
+}
+
+void benchCsv() { // Compare the getline/istringstream parser with the memory-mapped reader
+    struct Input { const char* file; int numFields; }; // A data file and its column count
+    for (const Input& input : {Input{kTrainFile, 6}, Input{kTestFile, 5}}) { // Loop through the bundled data files
+        double legacy = bestOf(kRepetitions, [&] { sink = parseLegacy(input.file, input.numFields); }); // Time the legacy parser
+        double mapped = bestOf(kRepetitions, [&] { sink = parseMapped(input.file, input.numFields); }); // Time the mapped reader
+        std::cout << "csv " << input.file << ": getline " << legacy * 1e3 << " ms, mmap " << mapped * 1e3 << " ms, speedup " << legacy / mapped << "x" << std::endl; // Report the times
+    }
+}
+
+std::vector<DSString> loadTweets(const char* file, size_t numFields) { // Read the tweet column of a CSV file
+    MappedFile mapped(file); // Map the file into memory
+    CSVReader reader(mapped.data(), mapped.data() + mapped.size()); // Declare a reader over the file
+    std::vector<std::string_view> fields; // Declare the field list, reused for every record
+    std::vector<DSString> tweets; // Declare the tweets
+    reader.skip(); // Skip the header line
+    while (reader.next(fields, numFields)) { // Read each record
+        tweets.emplace_back(fields.back().data(), fields.back().size()); // Copy the tweet
+    }
+    return tweets; // Return the tweets
+}
+
+std::vector<DSString> legacyTokenize(const DSString& text) { // The istringstream tokenizer Trie::tokenize used to run
+    std::vector<DSString> tokens; // Declare a vector to hold the tokens
+    std::istringstream stream(text.c_str()); // Create a string stream from the text
+    DSString word; // Declare a string for each word
+    while (stream >> word) { // Loop through each word in the stream
+        word.erase(std::remove_if(word.begin(), word.end(), ::ispunct), word.end()); // Remove punctuation from the word
+        std::transform(word.begin(), word.end(), word.begin(), ::tolower); // Convert the word to lowercase
+        if (word == "not" || word == "no" || word == "nor" || word == "neither") { // Check for negation words
+            DSString nextWord; // Declare a string for the next word
+            stream >> nextWord; // Read the next word
+            nextWord.erase(std::remove_if(nextWord.begin(), nextWord.end(), ::ispunct), nextWord.end()); // Remove punctuation from the next word
+            std::transform(nextWord.begin(), nextWord.end(), nextWord.begin(), ::tolower); // Convert the next word to lowercase
+            word += " "; // Add a space to the word
+            word += nextWord; // Add the next word to the word
+        }
+        tokens.push_back(word); // Add the word to the tokens vector
+    }
+    return tokens; // Return the tokens vector
+}
+
+void benchTokenize() { // Compare the istringstream tokenizer with the single-pass tokenizer
+    std::vector<DSString> tweets = loadTweets(kTrainFile, 6); // Load the training tweets
+    std::vector<DSString> testTweets = loadTweets(kTestFile, 5); // Load the test tweets
+    tweets.insert(tweets.end(), testTweets.begin(), testTweets.end()); // Use both data sets
+
+    size_t numTokens = 0; // Number of tokens in the corpus
+    size_t mismatches = 0; // Number of tweets the tokenizers disagree on
+    TokenBuffer buffer; // Declare the reusable token buffer
+    for (const DSString& tweet : tweets) { // Loop through each tweet
+        std::vector<DSString> expected = legacyTokenize(tweet); // Tokenize the old way
+        Tokenizer::tokenize(tweet, buffer); // Tokenize the new way
+        bool same = expected.size() == buffer.size(); // Compare the token counts
+        for (size_t i = 0; same && i < expected.size(); ++i) { // Loop through each token
+            same = std::string_view(expected[i]) == buffer[i]; // Compare the tokens
+        }
+        mismatches += same ? 0 : 1; // Count disagreements
+        numTokens += expected.size(); // Count the tokens
+    }
+
+    double legacy = bestOf(kRepetitions, [&] { // Time the legacy tokenizer
+        size_t count = 0; // Number of tokens produced
+        for (const DSString& tweet : tweets) count += legacyTokenize(tweet).size(); // Tokenize every tweet
+        sink = count; // Keep the result alive
+    });
+    double streaming = bestOf(kRepetitions, [&] { // Time the single-pass tokenizer
+        size_t count = 0; // Number of tokens produced
+        for (const DSString& tweet : tweets) { // Loop through each tweet
+            Tokenizer::tokenize(tweet, buffer); // Tokenize into the reused buffer
+            count += buffer.size(); // Count the tokens
+        }
+        sink = count; // Keep the result alive
+    });
+    std::cout << "tokenize " << tweets.size() << " tweets, " << numTokens << " tokens, " << mismatches << " mismatches: istringstream " << numTokens / legacy / 1e6 << " Mtokens/s, single-pass " << numTokens / streaming / 1e6 << " Mtokens/s, speedup " << legacy / streaming << "x" << std::endl; // Report the throughput
+
+    size_t numBytes = 0; // Number of text bytes in the corpus
+    for (const DSString& tweet : tweets) numBytes += tweet.length(); // Count them
+    Tokenizer::Kernel selected = Tokenizer::kernel(); // Remember the kernel picked at run time
+    std::vector<std::vector<std::string>> reference; // Tokens of every tweet from the scalar kernel
+    for (Tokenizer::Kernel kernel : {Tokenizer::Kernel::Scalar, Tokenizer::Kernel::SSE2, Tokenizer::Kernel::AVX2}) { // Loop through the kernels
+        if (!Tokenizer::setKernel(kernel)) { // If the kernel cannot run here
+            std::cout << "tokenize " << Tokenizer::kernelName(kernel) << ": not supported" << std::endl; // Report it
+            continue; // Move to the next kernel
+        }
+        size_t differences = 0; // Number of tweets the kernel tokenizes differently from the scalar kernel
+        for (size_t t = 0; t < tweets.size(); ++t) { // Loop through each tweet
+            Tokenizer::tokenize(tweets[t], buffer); // Tokenize it
+            std::vector<std::string> tokens; // Declare a copy of its tokens
+            for (size_t i = 0; i < buffer.size(); ++i) tokens.emplace_back(buffer[i]); // Copy them
+            if (kernel == Tokenizer::Kernel::Scalar) reference.push_back(std::move(tokens)); // Keep the scalar tokens as the reference
+            else differences += tokens == reference[t] ? 0 : 1; // Compare with the reference
+        }
+        double seconds = bestOf(kRepetitions, [&] { // Time the kernel
+            size_t count = 0; // Number of tokens produced
+            for (const DSString& tweet : tweets) { // Loop through each tweet
+                Tokenizer::tokenize(tweet, buffer); // Tokenize into the reused buffer
+                count += buffer.size(); // Count the tokens
+            }
+            sink = count; // Keep the result alive
+        });
+        std::cout << "tokenize " << Tokenizer::kernelName(kernel) << (kernel == selected ? " (selected)" : "") << ": " << numBytes / seconds / 1e6 << " MB/s, " << differences << " differences from scalar" << std::endl; // Report the throughput
+    }
+    Tokenizer::setKernel(selected); // Restore the kernel picked at run time
+}
+
+void benchLayout() { // Compare the map-based and compact trie layouts
+    size_t before = gLiveBytes; // Heap in use before training
+    Trie mapTrie; // Declare the map-based trie
+    mapTrie.train(kTrainFile); // Train it
+    size_t mapBytes = gLiveBytes - before; // Heap held by the map-based nodes
+
+    Trie compactTrie; // Declare the trie to compact
+    compactTrie.train(kTrainFile); // Train it
+    before = gLiveBytes; // Heap in use before compacting
+    compactTrie.setLayout(TrieLayout::Compact); // Switch it to the compact layout
+    size_t compactBytes = gLiveBytes - before + mapBytes; // Compacting frees the map nodes and allocates the arrays
+
+    std::vector<DSString> tweets = loadTweets(kTestFile, 5); // Load the test tweets
+    std::vector<DSString> words; // Declare the lookup workload
+    TokenBuffer buffer; // Declare the reusable token buffer
+    for (const DSString& tweet : tweets) { // Loop through each tweet
+        Tokenizer::tokenize(tweet, buffer); // Tokenize the tweet
+        for (size_t i = 0; i < buffer.size(); ++i) words.emplace_back(buffer[i].data(), buffer[i].size()); // Keep every token
+    }
+
+    double mapSum = 0, compactSum = 0; // Log-odds sums, compared to check that the layouts agree
+    double mapTime = bestOf(kRepetitions, [&] { // Time lookups in the map layout
+        mapSum = 0; // Reset the sum
+        for (const DSString& word : words) mapSum += mapTrie.getLogOddsRatio(word); // Look up every word
+    });
+    double compactTime = bestOf(kRepetitions, [&] { // Time lookups in the compact layout
+        compactSum = 0; // Reset the sum
+        for (const DSString& word : words) compactSum += compactTrie.getLogOddsRatio(word); // Look up every word
+    });
+
+    size_t numWords = mapTrie.wordCount(); // Number of distinct words in the model
+    std::cout << "layout " << numWords << " words, " << words.size() << " lookups" << (mapSum == compactSum ? "" : " (SUMS DIFFER)") << std::endl; // Report the workload
+    std::cout << "layout map: " << mapBytes << " heap bytes, " << static_cast<double>(mapBytes) / numWords << " bytes/word, " << mapTime / words.size() * 1e9 << " ns/lookup" << std::endl; // Report the map layout
+    std::cout << "layout compact: " << compactBytes << " heap bytes, " << static_cast<double>(compactBytes) / numWords << " bytes/word, " << compactTime / words.size() * 1e9 << " ns/lookup" << std::endl; // Report the compact layout
+}
+
+void benchScores() { // Compare computing the scores per lookup with reading them from the finalized cache
+    std::vector<DSString> tweets = loadTweets(kTestFile, 5); // Load the test tweets
+    std::vector<DSString> words; // Declare the lookup workload
+    TokenBuffer buffer; // Declare the reusable token buffer
+    for (const DSString& tweet : tweets) { // Loop through each tweet
+        Tokenizer::tokenize(tweet, buffer); // Tokenize the tweet
+        for (size_t i = 0; i < buffer.size(); ++i) words.emplace_back(buffer[i].data(), buffer[i].size()); // Keep every token
+    }
+
+    for (TrieLayout layout : {TrieLayout::Map, TrieLayout::Compact}) { // Loop through both layouts
+        Trie trie; // Declare the trie
+        trie.train(kTrainFile); // Train it
+        trie.setLayout(layout); // Switch it to the layout
+        auto score = [&](double& sum) { // Score every word, summing both scores as the analyzer does
+            sum = 0; // Reset the sum
+            for (const DSString& word : words) { // Loop through each word
+                WordScores scores = trie.getScores(word); // Look the word up
+                sum += scores.logOdds + scores.sentimentScore; // Add both scores
+            }
+        };
+        double computedSum = 0, cachedSum = 0; // Score sums, compared to show the float rounding of the cache
+        double computed = bestOf(kRepetitions, [&] { score(computedSum); }); // Time scoring with std::log per lookup
+        trie.finalize(); // Precompute the scores
+        double cached = bestOf(kRepetitions, [&] { score(cachedSum); }); // Time scoring from the cache
+        const char* name = layout == TrieLayout::Map ? "map" : "compact"; // Name the layout
+        std::cout << "scores " << name << " " << words.size() << " tokens: computed " << computed / words.size() * 1e9 << " ns/token, cached " << cached / words.size() * 1e9 << " ns/token, speedup " << computed / cached << "x, sum difference " << std::abs(computedSum - cachedSum) << std::endl; // Report the per-token cost
+    }
+}
+
+void evictFromPageCache(const char* file) { // Ask the kernel to drop a file's cached pages so the next read is cold
+#ifndef _WIN32
+    int fd = ::open(file, O_RDONLY); // Open the file
+    if (fd < 0) return; // Nothing to evict if it cannot be opened
+    ::fdatasync(fd); // Make sure no dirty pages keep the file in memory
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED); // Drop the clean pages
+    ::close(fd); // Close the file
+#endif
+}
+
+template <typename Function>
+double timeLoad(bool cold, const char* file, Function function) { // Time a model load, warm or after evicting the file
+    std::streambuf* saved = std::cout.rdbuf(nullptr); // Silence the loaders' progress output
+    double best = 1e300; // Initialize the best time
+    for (int i = 0; i < kRepetitions; ++i) { // Loop through each repetition
+        if (cold) evictFromPageCache(file); // Start from an empty page cache if requested
+        best = std::min(best, bestOf(1, function)); // Keep the fastest run
+    }
+    std::cout.rdbuf(saved); // Restore the output
+    return best; // Return the fastest run
+}
+
+void benchLoad() { // Compare the legacy model loader with mapping a binary model
+    const char* legacyFile = "bench_model.dat"; // Temporary legacy model file
+    const char* binaryFile = "bench_model.bin"; // Temporary binary model file
+    {
+        std::streambuf* saved = std::cout.rdbuf(nullptr); // Silence the training output
+        Trie trie; // Declare the trie to save
+        trie.train(kTrainFile); // Train it
+        trie.save(legacyFile); // Write the legacy model
+        Trie::convertModel(legacyFile, binaryFile); // Convert it to the binary model
+        std::cout.rdbuf(saved); // Restore the output
+    }
+
+    size_t words = 0; // Word count, read back to check that both loaders agree
+    for (bool cold : {false, true}) { // Measure with a warm and with a cold page cache
+        const char* cache = cold ? "cold" : "warm"; // Label of the page cache state
+        double legacy = timeLoad(cold, legacyFile, [&] { // Time the legacy loader up to its first lookup
+            Trie trie; // Declare a fresh trie
+            trie.load(legacyFile); // Load the legacy model
+            sink = static_cast<size_t>(trie.getLogOddsRatio("good") * 1000); // Answer the first lookup
+            words = trie.wordCount(); // Keep the word count
+        });
+        double mapped = timeLoad(cold, binaryFile, [&] { // Time the binary loader with checksum verification
+            Trie trie; // Declare a fresh trie
+            trie.loadBinary(binaryFile, true); // Map and verify the binary model
+            sink = static_cast<size_t>(trie.getLogOddsRatio("good") * 1000); // Answer the first lookup
+        });
+        double unchecked = timeLoad(cold, binaryFile, [&] { // Time the binary loader without checksum verification
+            Trie trie; // Declare a fresh trie
+            trie.loadBinary(binaryFile, false); // Map the binary model
+            sink = static_cast<size_t>(trie.getLogOddsRatio("good") * 1000); // Answer the first lookup
+        });
+        std::cout << "load " << cache << " legacy: " << legacy * 1e3 << " ms to first lookup (" << words << " words)" << std::endl; // Report the legacy loader
+        std::cout << "load " << cache << " mmap+checksum: " << mapped * 1e3 << " ms to first lookup" << std::endl; // Report the verified binary loader
+        std::cout << "load " << cache << " mmap: " << unchecked * 1e3 << " ms to first lookup" << std::endl; // Report the unverified binary loader
+    }
+    std::remove(legacyFile); // Delete the temporary legacy model
+    std::remove(binaryFile); // Delete the temporary binary model
+}
+
+std::string readFile(const char* file) { // Read a whole file into a string
+    std::ifstream in(file, std::ios::binary); // Open the file in binary mode
+    std::ostringstream contents; // Declare the contents buffer
+    contents << in.rdbuf(); // Copy the file
+    return contents.str(); // Return the contents
+}
+
+void benchSave() { // Time saving the trained model with 1..N encoding threads
+    const char* saveFile = "bench_save.dat"; // Temporary model file
+    Trie trie; // Declare the trie to save
+    std::streambuf* saved = std::cout.rdbuf(nullptr); // Silence the training output
+    trie.train(kTrainFile); // Train it
+    trie.save(saveFile, 1); // Write the single-threaded reference file
+    std::cout.rdbuf(saved); // Restore the output
+    std::string reference = readFile(saveFile); // Keep the reference bytes
+
+    unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency()); // Highest thread count to try
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) { // Double the thread count each step
+        saved = std::cout.rdbuf(nullptr); // Silence the saving output
+        double seconds = bestOf(kRepetitions, [&] { trie.save(saveFile, threads); }); // Time the save
+        std::cout.rdbuf(saved); // Restore the output
+        bool identical = readFile(saveFile) == reference; // Check that the file does not depend on the thread count
+        std::cout << "save " << threads << " thread(s): " << seconds * 1e3 << " ms, " << reference.size() << " bytes" << (identical ? "" : " (FILE DIFFERS)") << std::endl; // Report the run
+        if (threads == maxThreads) break; // Stop after the hardware concurrency
+        if (threads * 2 > maxThreads) threads = maxThreads / 2; // Make the next step the hardware concurrency
+    }
+    std::remove(saveFile); // Delete the temporary model
+}
+
+class LegacyThreadPool { // The global-queue pool Trie.h used to define, kept as the baseline for the pool benchmark
+public:
+    explicit LegacyThreadPool(size_t numThreads) : stop(false) { // Start the workers
+        for (size_t i = 0; i < numThreads; ++i) workers.emplace_back(&LegacyThreadPool::workerThread, this); // Add a worker thread
+    }
+
+    ~LegacyThreadPool() { // Drain the queue and join the workers
+        {
+            std::unique_lock<std::mutex> lock(queueMutex); // Lock the queue mutex
+            stop = true; // Signal the workers to stop
+        }
+        condition.notify_all(); // Notify all threads
+        for (std::thread& worker : workers) worker.join(); // Join each worker thread
+    }
+
+    void enqueue(std::function<void()> task) { // Add a task to the single queue
+        {
+            std::unique_lock<std::mutex> lock(queueMutex); // Lock the queue mutex
+            tasks.push(std::move(task)); // Add the task to the queue
+        }
+        condition.notify_one(); // Notify one thread
+    }
+
+private:
+    std::vector<std::thread> workers; // Worker threads
+    std::queue<std::function<void()>> tasks; // The shared task queue
+    std::mutex queueMutex; // Mutex protecting the queue
+    std::condition_variable condition; // Condition variable for task synchronization
+    bool stop; // Flag to stop the pool
+
+    void workerThread() { // Take tasks until the pool stops
+        while (true) { // Infinite loop
+            std::function<void()> task; // Declare a task
+            {
+                std::unique_lock<std::mutex> lock(queueMutex); // Lock the queue mutex
+                condition.wait(lock, [this] { return stop || !tasks.empty(); }); // Wait for a task or stop signal
+                if (stop && tasks.empty()) return; // Exit once the queue is drained
+                task = std::move(tasks.front()); // Get the task from the queue
+                tasks.pop(); // Remove the task from the queue
+            }
+            task(); // Execute the task
+        }
+    }
+};
+
+const size_t kPoolTasks = 200000; // Number of tiny tasks in the flat pool workload
+const int kPoolDepth = 16; // Depth of the binary task tree in the recursive pool workload (2^16 - 1 tasks)
+
+template <typename Pool>
+void spawnTree(Pool& pool, std::atomic<size_t>& counter, int depth) { // Run one task of a binary task tree, like the old saveNode recursion
+    counter++; // Count the task
+    if (depth == 0) return; // Leaves spawn nothing
+    for (int child = 0; child < 2; ++child) { // Loop through both children
+        pool.enqueue([&pool, &counter, depth] { spawnTree(pool, counter, depth - 1); }); // Spawn the child task
+    }
+}
+
+template <typename Pool>
+double poolFlat(size_t threads) { // Time kPoolTasks tiny tasks submitted from outside the pool; returns tasks/sec
+    std::atomic<size_t> counter(0); // Number of tasks run
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing
+    {
+        Pool pool(threads); // Start the pool
+        for (size_t i = 0; i < kPoolTasks; ++i) pool.enqueue([&counter] { counter++; }); // Submit every task
+    } // The destructor drains the queue and joins the workers
+    std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start; // Measure the run
+    return counter / duration.count(); // Return the throughput
+}
+
+template <typename Pool>
+double poolTree(size_t threads) { // Time a recursively spawned task tree; returns tasks/sec
+    std::atomic<size_t> counter(0); // Number of tasks run
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing
+    {
+        Pool pool(threads); // Start the pool
+        pool.enqueue([&pool, &counter] { spawnTree(pool, counter, kPoolDepth - 1); }); // Submit the root task
+        while (counter < (size_t(1) << kPoolDepth) - 1) std::this_thread::yield(); // Wait until the whole tree ran
+    } // Join the workers
+    std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start; // Measure the run
+    return counter / duration.count(); // Return the throughput
+}
+
+void benchPool() { // Compare the global-queue pool with the work-stealing pool under contention
+    unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency()); // Highest thread count to try
+    for (unsigned threads = 1; threads <= maxThreads; threads = threads == maxThreads ? maxThreads + 1 : std::min(threads * 2, maxThreads)) { // Try 1, 2, 4, ... and the hardware concurrency
+        double legacyFlat = poolFlat<LegacyThreadPool>(threads); // Flat workload on the old pool
+        double stealingFlat = poolFlat<ThreadPool>(threads); // Flat workload on the new pool
+        double legacyTree = poolTree<LegacyThreadPool>(threads); // Recursive workload on the old pool
+        double stealingTree = poolTree<ThreadPool>(threads); // Recursive workload on the new pool
+        std::cout << "pool " << threads << " thread(s) flat: legacy " << legacyFlat << " tasks/sec, work-stealing " << stealingFlat << " tasks/sec" << std::endl; // Report the flat workload
+        std::cout << "pool " << threads << " thread(s) tree: legacy " << legacyTree << " tasks/sec, work-stealing " << stealingTree << " tasks/sec" << std::endl; // Report the recursive workload
+    }
+}
+
+template <typename Function>
+void reportAllocations(const char* label, size_t numTweets, Function function) { // Report allocations and time per tweet of a DSString workload
+    size_t before = gAllocations; // Allocations so far
+    function(); // Run the workload once to count its allocations
+    size_t allocations = gAllocations - before; // Allocations made by the workload
+    double seconds = bestOf(kRepetitions, function); // Time the workload
+    std::cout << "dsstring " << label << ": " << static_cast<double>(allocations) / numTweets << " allocations/tweet, " << seconds / numTweets * 1e9 << " ns/tweet" << std::endl; // Report the workload
+}
+
+void benchDSString() { // Count DSString allocations per tweet on the paths that still build DSStrings
+    std::vector<DSString> tweets = loadTweets(kTestFile, 5); // Load the test tweets
+    Trie trie; // Declare a trie for its DSString tokenizer
+    reportAllocations("copy tweets into a growing vector", tweets.size(), [&] { // Copy every tweet, letting the vector grow
+        std::vector<DSString> copies; // Declare the copies
+        for (const DSString& tweet : tweets) copies.push_back(tweet); // Copy the tweet; growth moves the earlier copies
+        sink = copies.size(); // Keep the result alive
+    });
+    reportAllocations("Trie::tokenize into DSStrings", tweets.size(), [&] { // Tokenize every tweet into a vector of DSStrings
+        size_t count = 0; // Number of tokens produced
+        for (const DSString& tweet : tweets) count += trie.tokenize(tweet).size(); // Tokenize the tweet
+        sink = count; // Keep the result alive
+    });
+    reportAllocations("istringstream tokenizer", tweets.size(), [&] { // Tokenize every tweet the old way
+        size_t count = 0; // Number of tokens produced
+        for (const DSString& tweet : tweets) count += legacyTokenize(tweet).size(); // Tokenize the tweet
+        sink = count; // Keep the result alive
+    });
+    reportAllocations("build prefixes with operator+", tweets.size(), [&] { // Spell every token one character at a time, as the old saveNode did
+        size_t count = 0; // Total prefix length
+        for (const DSString& tweet : tweets) { // Loop through each tweet
+            for (const DSString& token : trie.tokenize(tweet)) { // Loop through each token
+                DSString prefix; // Declare the prefix
+                for (char c : std::string_view(token)) prefix = prefix + c; // Extend the prefix by one character
+                count += prefix.length(); // Count the characters
+            }
+        }
+        sink = count; // Keep the result alive
+    });
+    reportAllocations("append tweets to one DSString", tweets.size(), [&] { // Concatenate every tweet with +=
+        DSString all; // Declare the concatenation
+        for (const DSString& tweet : tweets) all += tweet; // Append the tweet
+        sink = all.length(); // Keep the result alive
+    });
+}
+
+void benchMetrics() { // Compare classifying with the metrics off and on
+    const char* modelFile = "bench_metrics.dat"; // Temporary model file
+    std::streambuf* saved = std::cout.rdbuf(nullptr); // Silence the training output
+    std::unique_ptr<SentimentAnalyzer> analyzer = std::make_unique<SentimentAnalyzer>(modelFile, kTrainFile); // Train and save a model
+    std::cout.rdbuf(saved); // Restore the output
+    std::vector<DSString> tweets = loadTweets(kTestFile, 5); // Load the test tweets
+    TokenBuffer buffer; // Declare the reusable token buffer
+    auto classifyAll = [&] { // Classify every test tweet
+        size_t positive = 0; // Number of positive tweets
+        for (const DSString& tweet : tweets) positive += analyzer->classify(tweet, buffer) == 4 ? 1 : 0; // Classify the tweet
+        sink = positive; // Keep the result alive
+    };
+
+    bool wasEnabled = Metrics::enabled(); // Remember the run-time switch
+    Metrics::setEnabled(false); // Classify with the metrics off
+    double off = bestOf(kRepetitions, classifyAll); // Time it
+    Metrics::setEnabled(true); // Classify with the metrics on
+    Metrics::reset(); // Count one pass only
+    classifyAll(); // Collect the counters of one pass
+    Metrics::Snapshot values = Metrics::snapshot(); // Read them
+    double on = bestOf(kRepetitions, classifyAll); // Time it
+    Metrics::setEnabled(wasEnabled); // Restore the run-time switch
+
+    const uint64_t* counters = values.counters; // Counters of one pass
+    uint64_t lookups = counters[static_cast<size_t>(Counter::TrieLookups)]; // Words scored in one pass
+    std::cout << "metrics " << (Metrics::compiled() ? "compiled in" : "compiled out") << ", " << tweets.size() << " tweets: off " << off / tweets.size() * 1e9 << " ns/tweet, on " << on / tweets.size() * 1e9 << " ns/tweet, overhead " << (on / off - 1) * 100 << "%" << std::endl; // Report the overhead
+    if (Metrics::compiled() && lookups != 0) { // If the counters were collected
+        std::cout << "metrics per pass: " << lookups << " lookups, hit rate " << static_cast<double>(counters[static_cast<size_t>(Counter::TrieHits)]) / lookups << ", " << static_cast<double>(counters[static_cast<size_t>(Counter::TrieNodesVisited)]) / lookups << " nodes/lookup, " << counters[static_cast<size_t>(Counter::ScoreFallbacks)] << " score fallbacks, " << static_cast<double>(values.sums[static_cast<size_t>(Histogram::TokensPerTweet)]) / tweets.size() << " tokens/tweet" << std::endl; // Report what was counted
+    }
+    analyzer.reset(); // Release the model
+    std::remove(modelFile); // Delete the temporary model
+}
+
+size_t residentBytes() { // Get the resident set size of the process (0 where unknown)
+#ifdef __linux__
+    std::ifstream statm("/proc/self/statm"); // Open the memory statistics
+    size_t pages = 0, resident = 0; // Total and resident pages
+    statm >> pages >> resident; // Read them
+    return resident * static_cast<size_t>(::sysconf(_SC_PAGESIZE)); // Convert the resident pages to bytes
+#else
+    return 0; // Not available
+#endif
+}
+
+const size_t kArenaWords = 1000000; // Distinct synthetic words in the large-vocabulary workload
+
+std::vector<std::string> syntheticVocabulary() { // Random lowercase strings, like a large vocabulary
+    std::vector<std::string> vocabulary; // Declare the words
+    std::mt19937_64 random(3); // Fixed seed, so every build inserts the same words
+    while (vocabulary.size() < kArenaWords) { // Until there are enough words
+        std::string word(3 + random() % 10, ' '); // Pick a length of 3 to 12
+        for (char& c : word) c = static_cast<char>('a' + random() % 26); // Pick the letters
+        vocabulary.push_back(std::move(word)); // Keep the word (duplicates are rare and harmless)
+    }
+    return vocabulary; // Return the words
+}
+
+void benchArena() { // Time building and destroying tries, and measure the memory they hold
+    std::vector<std::string> vocabulary = syntheticVocabulary(); // Synthetic words for the large-vocabulary workload
+
+    struct Workload { const char* name; std::function<void(Trie&)> build; }; // A named way to fill a trie
+    const Workload workloads[] = { // Every workload, smallest first
+        {"train 20k", [](Trie& trie) { trie.train(kTrainFile); }},
+        {"insert 1M words", [&vocabulary](Trie& trie) { for (const std::string& word : vocabulary) trie.insert(word, word.size() % 2 == 0); }},
+    };
+    for (const Workload& workload : workloads) { // Loop through each workload
+        double build = 1e300, teardown = 1e300; // Fastest build and destruction
+        size_t heapBytes = 0, rssBytes = 0, words = 0; // Memory held by the trie, and its size
+        for (int i = 0; i < kRepetitions; ++i) { // Loop through each repetition
+            size_t heapBefore = gLiveBytes, rssBefore = residentBytes(); // Memory in use before building
+            std::unique_ptr<Trie> trie = std::make_unique<Trie>(); // Declare a fresh trie
+            std::streambuf* saved = std::cout.rdbuf(nullptr); // Silence the training output
+            build = std::min(build, bestOf(1, [&] { workload.build(*trie); })); // Time the build
+            std::cout.rdbuf(saved); // Restore the output
+            heapBytes = gLiveBytes - heapBefore; // Heap held by the trie
+            rssBytes = std::max(rssBytes, residentBytes() - std::min(rssBefore, residentBytes())); // Resident memory the build added
+            words = trie->wordCount(); // Count the words
+            teardown = std::min(teardown, bestOf(1, [&] { trie.reset(); })); // Time the destruction
+        }
+        std::cout << "arena " << workload.name << ": " << words << " words, build " << build * 1e3 << " ms, " << heapBytes << " heap bytes (" << static_cast<double>(heapBytes) / words << " bytes/word), RSS +" << rssBytes / 1024 << " KiB, teardown " << teardown * 1e3 << " ms" << std::endl; // Report the workload
+    }
+}
+
+void benchBackend() { // Compare the model backends head to head: build time, memory and lookup throughput
+    std::vector<std::string> vocabulary = syntheticVocabulary(); // Synthetic words for the large-vocabulary workload
+    std::vector<std::string> shuffled = vocabulary; // Look the words up in another order than they were inserted
+    std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937_64(5)); // Fixed seed, so every build looks up the same order
+    std::vector<std::string> testTokens; // Every token of the test tweets, as the analyzer looks them up
+    TokenBuffer buffer; // Declare the reusable token buffer
+    for (const DSString& tweet : loadTweets(kTestFile, 5)) { // Loop through each test tweet
+        Tokenizer::tokenize(tweet, buffer); // Tokenize the tweet
+        for (size_t i = 0; i < buffer.size(); ++i) testTokens.emplace_back(buffer[i]); // Keep every token
+    }
+
+    struct Backend { const char* name; ModelBackend backend; bool compact; }; // A named model configuration
+    const Backend backends[] = { // Every configuration the analyzer can run
+        {"trie map", ModelBackend::Trie, false},
+        {"trie compact", ModelBackend::Trie, true},
+        {"hash", ModelBackend::Hash, false},
+    };
+    struct Workload { const char* name; std::function<void(SentimentModel&)> build; const std::vector<std::string>* lookups; }; // A named way to fill a model, and the words looked up in it
+    const Workload workloads[] = { // Every workload, smallest first
+        {"train 20k", [](SentimentModel& model) { model.train(kTrainFile); }, &testTokens},
+        {"insert 1M words", [&vocabulary](SentimentModel& model) { for (const std::string& word : vocabulary) model.insert(word, word.size() % 2 == 0); }, &shuffled},
+    };
+    for (const Workload& workload : workloads) { // Loop through each workload
+        double firstSum = 0; // Log-odds sum of the first backend, compared to check that the backends agree
+        for (const Backend& backend : backends) { // Loop through each backend
+            double build = 1e300; // Fastest build, finalize included
+            size_t heapBytes = 0, words = 0; // Heap held by the model once built, and its size
+            std::unique_ptr<SentimentModel> model; // Model kept from the last repetition for the lookups
+            for (int i = 0; i < kRepetitions; ++i) { // Loop through each repetition
+                model.reset(); // Free the previous model before measuring
+                size_t heapBefore = gLiveBytes; // Heap in use before building
+                std::streambuf* saved = std::cout.rdbuf(nullptr); // Silence the training output
+                build = std::min(build, bestOf(1, [&] { // Time the build as the analyzer does it
+                    model = SentimentModel::create(backend.backend); // Declare a fresh model
+                    workload.build(*model); // Fill it
+                    if (backend.compact) static_cast<Trie&>(*model).setLayout(TrieLayout::Compact); // Compact it
+                    model->finalize(); // Cache the scores
+                }));
+                std::cout.rdbuf(saved); // Restore the output
+                heapBytes = gLiveBytes - heapBefore; // Heap held by the model
+                words = model->wordCount(); // Count the words
+            }
+            const std::vector<std::string>& lookups = *workload.lookups; // Words looked up in the model
+            double sum = 0; // Log-odds sum of the lookups
+            double lookup = bestOf(kRepetitions, [&] { // Time the lookups
+                sum = 0; // Reset the sum
+                for (const std::string& word : lookups) sum += model->getScores(word, nullptr).logOdds; // Look up every word
+            });
+            if (&backend == backends) firstSum = sum; // The first backend is the reference
+            std::cout << "backend " << workload.name << " " << backend.name << ": " << words << " words, build " << build * 1e3 << " ms, " << heapBytes << " heap bytes (" << static_cast<double>(heapBytes) / words << " bytes/word), " << lookup / lookups.size() * 1e9 << " ns/lookup over " << lookups.size() << " lookups" << (sum == firstSum ? "" : " (SUMS DIFFER)") << std::endl; // Report the backend
+        }
+    }
+}
+
+void benchIntern() { // Compare string tokens with interned id streams, for training and for scoring
+    struct Tweet { TokenBuffer tokens; std::vector<uint32_t> ids; bool positive; }; // A tokenized tweet and its id stream
+    auto tokenizeFile = [](const char* file, size_t numFields) { // Tokenize every tweet of a CSV file
+        MappedFile mapped(file); // Map the file into memory
+        CSVReader reader(mapped.data(), mapped.data() + mapped.size()); // Declare a reader over the file
+        std::vector<std::string_view> fields; // Declare the field list, reused for every record
+        std::vector<Tweet> tweets; // Declare the tweets
+        reader.skip(); // Skip the header line
+        while (reader.next(fields, numFields)) { // Read each record
+            if (fields.size() < numFields) continue; // Skip records with missing fields
+            tweets.emplace_back(); // Add the tweet
+            Tokenizer::tokenize(fields.back(), tweets.back().tokens); // Tokenize it
+            tweets.back().positive = fields[0] == "4"; // Keep its label (the test file has none)
+        }
+        return tweets; // Return the tweets
+    };
+    std::vector<Tweet> training = tokenizeFile(kTrainFile, 6); // Tokenized training tweets
+    std::vector<Tweet> test = tokenizeFile(kTestFile, 5); // Tokenized test tweets
+    size_t trainTokens = 0, testTokens = 0; // Tokens in each workload
+    for (const Tweet& tweet : training) trainTokens += tweet.tokens.size(); // Count the training tokens
+    for (const Tweet& tweet : test) testTokens += tweet.tokens.size(); // Count the test tokens
+
+    std::unique_ptr<HashVocabulary> model; // Model built by the timed runs
+    double stringTrain = bestOf(kRepetitions, [&] { model = std::make_unique<HashVocabulary>(); }, [&] { // Time counting string tokens
+        for (const Tweet& tweet : training) { // Loop through each tweet
+            for (size_t i = 0; i < tweet.tokens.size(); ++i) model->insert(tweet.tokens[i], tweet.positive); // Hash and count each token
+        }
+    });
+    for (Tweet& tweet : training) model->internTokens(tweet.tokens, tweet.ids); // Intern the training tweets once, as a cached corpus would
+    double idTrain = bestOf(kRepetitions, [&] { // Time counting the id streams
+        for (const Tweet& tweet : training) model->insertIds(tweet.ids, tweet.positive); // Count each id
+    });
+    std::cout << "intern train " << trainTokens << " tokens: strings " << stringTrain / trainTokens * 1e9 << " ns/token, ids " << idTrain / trainTokens * 1e9 << " ns/token" << std::endl; // Report training
+
+    model = std::make_unique<HashVocabulary>(); // Build the model to score against
+    Trie trie; // And the same model in a trie
+    for (Tweet& tweet : training) { // Loop through each tweet
+        model->internTokens(tweet.tokens, tweet.ids); // Intern it
+        model->insertIds(tweet.ids, tweet.positive); // Count it
+        for (size_t i = 0; i < tweet.tokens.size(); ++i) trie.insert(tweet.tokens[i], tweet.positive); // Count it in the trie
+    }
+    std::streambuf* saved = std::cout.rdbuf(nullptr); // Silence the finalize output
+    model->finalize(); // Cache the scores
+    trie.finalize(); // Cache the scores
+    std::cout.rdbuf(saved); // Restore the output
+    for (Tweet& tweet : test) model->findIds(tweet.tokens, tweet.ids); // Look the test tweets' ids up once
+
+    double trieSum = 0, hashSum = 0, idSum = 0; // Log-odds sums, compared to check that the paths agree
+    double trieTime = bestOf(kRepetitions, [&] { // Time scoring through the trie
+        trieSum = 0; // Reset the sum
+        for (const Tweet& tweet : test) trieSum += trie.sumScores(tweet.tokens).logOdds; // Walk the trie per token
+    });
+    double hashTime = bestOf(kRepetitions, [&] { // Time scoring strings through the interner
+        hashSum = 0; // Reset the sum
+        for (const Tweet& tweet : test) hashSum += model->sumScores(tweet.tokens).logOdds; // Probe per token, then read the score
+    });
+    double idTime = bestOf(kRepetitions, [&] { // Time scoring the id streams
+        idSum = 0; // Reset the sum
+        for (const Tweet& tweet : test) idSum += model->sumIds(tweet.ids).logOdds; // Read the scores only
+    });
+    std::cout << "intern score " << testTokens << " tokens: trie " << trieTime / testTokens * 1e9 << " ns/token, interned strings " << hashTime / testTokens * 1e9 << " ns/token, id streams " << idTime / testTokens * 1e9 << " ns/token" << (trieSum == hashSum && hashSum == idSum ? "" : " (SUMS DIFFER)") << std::endl; // Report scoring
+    std::cout << "intern vocabulary " << model->interner().size() << " ids, " << model->memoryUsage() << " bytes" << std::endl; // Report the table size
+}
+
+void benchCorpus() { // Compare training from the CSV with compiling the corpus once and training from the cache
+    const char* cacheFile = "bench_corpus.bin"; // Temporary corpus cache
+    std::streambuf* saved = std::cout.rdbuf(nullptr); // Silence the compile and training output
+    double compile = bestOf(kRepetitions, [&] { CorpusCache::compile(kTrainFile, cacheFile); }); // Time compiling the corpus
+    std::cout.rdbuf(saved); // Restore the output
+    std::unique_ptr<CorpusCache> corpus; // The mapped cache
+    double open = bestOf(kRepetitions, [&] { corpus.reset(); corpus = std::make_unique<CorpusCache>(cacheFile); }); // Time mapping it
+    std::cout << "corpus compile " << corpus->records() << " records, " << corpus->tokens() << " tokens, " << corpus->vocabularySize() << " ids: " << compile * 1e3 << " ms, open " << open * 1e3 << " ms, " << corpus->fileSize() << " bytes (CSV " << MappedFile(kTrainFile).size() << " bytes)" << std::endl; // Report the cache
+
+    double count = bestOf(kRepetitions, [&] { corpus->countTokens(); }); // Time counting the ids alone
+    std::cout << "corpus count ids: " << count * 1e3 << " ms, " << count / corpus->tokens() * 1e9 << " ns/token" << std::endl; // Report the counting pass
+
+    const std::pair<const char*, ModelBackend> backends[] = {{"trie", ModelBackend::Trie}, {"hash", ModelBackend::Hash}}; // Every backend
+    for (const auto& backend : backends) { // Loop through each backend
+        std::unique_ptr<SentimentModel> model; // Model built by the timed runs
+        saved = std::cout.rdbuf(nullptr); // Silence the training output
+        double fromCsv = bestOf(kRepetitions, [&] { model = SentimentModel::create(backend.second); }, [&] { model->train(kTrainFile); }); // Time parsing and tokenizing the CSV
+        size_t csvWords = model->wordCount(); // Count the words trained from the CSV
+        double fromCache = bestOf(kRepetitions, [&] { model = SentimentModel::create(backend.second); }, [&] { model->trainCorpus(*corpus); }); // Time streaming the ids
+        std::cout.rdbuf(saved); // Restore the output
+        std::cout << "corpus train " << backend.first << ": CSV " << fromCsv * 1e3 << " ms, cache " << fromCache * 1e3 << " ms (" << fromCsv / fromCache << "x)" << (model->wordCount() == csvWords ? "" : " (WORD COUNTS DIFFER)") << std::endl; // Report the backend
+    }
+    corpus.reset(); // Unmap the cache
+    std::remove(cacheFile); // Delete the cache
+}
+
+void benchNGrams() { // Compare scoring single tokens with adding n-gram counts of several sketch shapes
+    const char* modelFile = "bench_ngrams.dat"; // Temporary model; trained once, then loaded for every configuration
+    const char* mistakesFile = "bench_ngrams_mistakes.txt"; // Temporary mistakes file
+    std::vector<DSString> tweets = loadTweets(kTestFile, 5); // Test tweets
+    struct Configuration { const char* name; std::optional<NGramOptions> options; }; // A named n-gram setting
+    auto shape = [](unsigned order, size_t width, unsigned minCount) { // Build n-gram options with four rows
+        NGramOptions options; // Start from the defaults
+        options.order = order; // Set the order
+        options.width = width; // Set the cells per row
+        options.minCount = minCount; // Set the minimum count
+        return std::optional<NGramOptions>(options); // Return the options
+    };
+    const Configuration configurations[] = { // Single tokens, then bigrams and trigrams from small sketches to nearly exact counts
+        {"unigrams", std::nullopt},
+        {"bigrams 2^12 min 3", shape(2, size_t(1) << 12, 3)},
+        {"bigrams 2^14 min 3", shape(2, size_t(1) << 14, 3)},
+        {"bigrams 2^16 min 3", shape(2, size_t(1) << 16, 3)},
+        {"bigrams 2^18 min 3", shape(2, size_t(1) << 18, 3)},
+        {"bigrams 2^20 min 3", shape(2, size_t(1) << 20, 3)},
+        {"bigrams 2^18 min 1", shape(2, size_t(1) << 18, 1)},
+        {"bigrams 2^18 min 10", shape(2, size_t(1) << 18, 10)},
+        {"trigrams 2^18 min 3", shape(3, size_t(1) << 18, 3)},
+        {"trigrams 2^20 min 3", shape(3, size_t(1) << 20, 3)},
+    };
+    std::remove(modelFile); // Train the model on the first configuration
+    double unigramAccuracy = 0; // Accuracy without n-grams, for the differences
+    size_t unigramBytes = 0; // Heap held by the analyzer without n-grams, for the differences
+    for (const Configuration& configuration : configurations) { // Loop through each configuration
+        std::remove((std::string(modelFile) + ".ngrams").c_str()); // Count the n-grams again for every shape
+        std::streambuf* saved = std::cout.rdbuf(nullptr); // Silence the loading and counting output
+        size_t heapBefore = gLiveBytes; // Heap in use before building the analyzer
+        auto start = std::chrono::high_resolution_clock::now(); // Time loading the model and counting the n-grams
+        SentimentAnalyzer analyzer(modelFile, kTrainFile, 1, std::nullopt, ModelBackend::Trie, DSString(), configuration.options); // Build the analyzer
+        std::chrono::duration<double> setup = std::chrono::high_resolution_clock::now() - start; // Measure the setup
+        size_t heapBytes = gLiveBytes - heapBefore; // Heap held by the analyzer
+        double accuracy = analyzer.analyzeAndEvaluate(kTestFile, kAnswersFile, "", mistakesFile).accuracy(); // Score the test set
+        std::cout.rdbuf(saved); // Restore the output
+        TokenBuffer words; // Declare the reusable token buffer
+        int sink = 0; // Sum of the labels, so the classification is not optimized away
+        double classify = bestOf(kRepetitions, [&] { // Time classifying the test tweets
+            for (const DSString& tweet : tweets) sink += analyzer.classify(tweet, words); // Classify each tweet
+        });
+        if (!configuration.options) { // The first configuration is the reference
+            unigramAccuracy = accuracy; // Keep its accuracy
+            unigramBytes = heapBytes; // And its heap
+        }
+        std::cout << "ngrams " << configuration.name << ": setup " << setup.count() * 1e3 << " ms, +" << heapBytes - unigramBytes << " heap bytes, " << classify / tweets.size() * 1e9 << " ns/tweet, accuracy " << accuracy << " (" << (accuracy - unigramAccuracy >= 0 ? "+" : "") << (accuracy - unigramAccuracy) * 100 << " points)" << (sink < 0 ? " " : "") << std::endl; // Report the configuration
+    }
+    std::remove(modelFile); // Delete the model
+    std::remove((std::string(modelFile) + ".ngrams").c_str()); // Delete the sketch
+    std::remove(mistakesFile); // Delete the mistakes file
+}
+
+void benchPrune() { // Compare the full model with models pruned at several thresholds: size, load time and accuracy
+    const char* modelFile = "bench_prune.dat"; // Temporary full model
+    const char* prunedFile = "bench_pruned.dat"; // Temporary pruned legacy model
+    const char* binaryFile = "bench_pruned.bin"; // Temporary pruned binary model
+    const char* mistakesFile = "bench_prune_mistakes.txt"; // Temporary mistakes file
+    auto thresholds = [](int minCount, double minLogOdds) { // Build pruning options
+        PruneOptions options; // Start from the defaults
+        options.minCount = minCount; // Set the tweets a word needs
+        options.minLogOdds = minLogOdds; // Set the absolute log odds a word needs
+        return options; // Return the options
+    };
+    const std::pair<const char*, PruneOptions> configurations[] = { // The full model (min 1 keeps every word), then count thresholds, log odds thresholds and both
+        {"full", thresholds(1, 0.0)},
+        {"min 2", thresholds(2, 0.0)},
+        {"min 3", thresholds(3, 0.0)},
+        {"min 5", thresholds(5, 0.0)},
+        {"min 10", thresholds(10, 0.0)},
+        {"lo 0.1", thresholds(1, 0.1)},
+        {"lo 0.3", thresholds(1, 0.3)},
+        {"min 3 lo 0.3", thresholds(3, 0.3)},
+    };
+    {
+        std::streambuf* saved = std::cout.rdbuf(nullptr); // Silence the training output
+        Trie trie; // Declare the trie to save
+        trie.train(kTrainFile); // Train it
+        trie.save(modelFile); // Write the full model
+        std::cout.rdbuf(saved); // Restore the output
+    }
+    double fullAccuracy = 0; // Accuracy of the full model, for the differences
+    for (const auto& configuration : configurations) { // Loop through each configuration
+        std::streambuf* saved = std::cout.rdbuf(nullptr); // Silence the pruning, converting and scoring output
+        Trie::pruneModel(modelFile, prunedFile, configuration.second); // Prune the full model
+        Trie::convertModel(prunedFile, binaryFile); // Write the binary form of the pruned model
+        double accuracy = SentimentAnalyzer(prunedFile, kTrainFile).analyzeAndEvaluate(kTestFile, kAnswersFile, "", mistakesFile).accuracy(); // Score the test set with the pruned model
+        std::cout.rdbuf(saved); // Restore the output
+        size_t words = 0; // Words kept
+        size_t heapBytes = 0; // Heap held by the loaded map-layout trie
+        double legacy = timeLoad(false, prunedFile, [&] { // Time the legacy loader up to its first lookup
+            size_t heapBefore = gLiveBytes; // Heap in use before loading
+            Trie trie; // Declare a fresh trie
+            trie.load(prunedFile); // Load the legacy model
+            sink = static_cast<size_t>(trie.getLogOddsRatio("good") * 1000); // Answer the first lookup
+            words = trie.wordCount(); // Keep the word count
+            heapBytes = gLiveBytes - heapBefore; // Keep the heap it holds
+        });
+        double mapped = timeLoad(false, binaryFile, [&] { // Time the binary loader with checksum verification
+            Trie trie; // Declare a fresh trie
+            trie.loadBinary(binaryFile, true); // Map and verify the binary model
+            sink = static_cast<size_t>(trie.getLogOddsRatio("good") * 1000); // Answer the first lookup
+        });
+        if (configuration.second.minCount <= 1 && configuration.second.minLogOdds <= 0) fullAccuracy = accuracy; // The first configuration is the reference
+        std::cout << "prune " << configuration.first << ": " << words << " words, legacy " << MappedFile(prunedFile).size() << " bytes (" << heapBytes << " heap bytes) loads in " << legacy * 1e3 << " ms, binary " << MappedFile(binaryFile).size() << " bytes maps in " << mapped * 1e3 << " ms, accuracy " << accuracy << " (" << (accuracy - fullAccuracy >= 0 ? "+" : "") << (accuracy - fullAccuracy) * 100 << " points)" << std::endl; // Report the configuration
+    }
+    std::remove(modelFile); // Delete the full model
+    std::remove(prunedFile); // Delete the pruned legacy model
+    std::remove(binaryFile); // Delete the pruned binary model
+    std::remove(mistakesFile); // Delete the mistakes file
+}
+
+void benchLabels() { // Compare two counts per word scored by log odds with per-label counts scored by naive Bayes: memory, speed and accuracy
+    const char* modelFile = "bench_labels.dat"; // Temporary binary model for the analyzer
+    const char* mistakesFile = "bench_labels_mistakes.txt"; // Temporary mistakes file
+    std::vector<DSString> tweets = loadTweets(kTestFile, 5); // Test tweets
+    std::vector<TokenBuffer> tokenized(tweets.size()); // Their tokens, so the timing covers scoring only
+    for (size_t i = 0; i < tweets.size(); ++i) Tokenizer::tokenize(tweets[i], tokenized[i]); // Tokenize each tweet once
+    auto labelSet = [](std::vector<int> labels) { // Build label options with the default smoothing
+        LabelOptions options; // Start from the defaults
+        options.labels = std::move(labels); // Set the labels
+        return std::optional<LabelOptions>(options); // Return the options
+    };
+    struct Configuration { const char* name; std::optional<LabelOptions> options; }; // A named label setting
+    const Configuration configurations[] = { // The binary counts of the hash table backend (both interned, so only the per-word layout differs), then two and three labels
+        {"binary log odds", std::nullopt},
+        {"naive Bayes 0,4", labelSet({0, 4})},
+        {"naive Bayes 0,2,4", labelSet({0, 2, 4})},
+    };
+    std::remove(modelFile); // Train the model on the first configuration
+    for (const Configuration& configuration : configurations) { // Loop through each configuration
+        double build = 1e300; // Fastest build, finalize included
+        size_t heapBytes = 0, words = 0; // Heap held by the model once built, and its size
+        std::unique_ptr<SentimentModel> binary; // Binary model, for the first configuration
+        std::unique_ptr<LabelModel> labels; // Per-label model, for the others
+        for (int i = 0; i < kRepetitions; ++i) { // Loop through each repetition
+            binary.reset(); // Free the previous binary model before measuring
+            labels.reset(); // Free the previous per-label model before measuring
+            size_t heapBefore = gLiveBytes; // Heap in use before building
+            std::streambuf* saved = std::cout.rdbuf(nullptr); // Silence the training output
+            build = std::min(build, bestOf(1, [&] { // Time the build as the analyzer does it
+                if (configuration.options) { // If counting per label
+                    labels = std::make_unique<LabelModel>(*configuration.options); // Declare a fresh model
+                    labels->train(kTrainFile); // Count the tokens of each label
+                    labels->finalize(); // Compute the probabilities
+                } else { // If counting positive and total tweets
+                    binary = SentimentModel::create(ModelBackend::Hash); // Declare a fresh model
+                    binary->train(kTrainFile); // Count the words
+                    binary->finalize(); // Cache the scores
+                }
+            }));
+            std::cout.rdbuf(saved); // Restore the output
+            heapBytes = gLiveBytes - heapBefore; // Heap held by the model
+            words = labels != nullptr ? labels->wordCount() : binary->wordCount(); // Count the words
+        }
+        size_t predicted = 0; // Sum of the labels, so the scoring is not optimized away
+        double score = bestOf(kRepetitions, [&] { // Time scoring the pre-tokenized test tweets
+            predicted = 0; // Reset the sum
+            if (labels != nullptr) { // If scoring per label
+                for (const TokenBuffer& tweet : tokenized) predicted += labels->classify(tweet); // Pick the most probable label
+            } else { // If scoring by log odds
+                for (const TokenBuffer& tweet : tokenized) predicted += binary->sumScores(tweet).logOdds + 0.2 > 0 ? 4 : 0; // Threshold the log-odds sum
+            }
+        });
+        sink = predicted; // Keep the labels alive
+        std::streambuf* saved = std::cout.rdbuf(nullptr); // Silence the analyzer output
+        double accuracy = SentimentAnalyzer(modelFile, kTrainFile, 1, std::nullopt, ModelBackend::Hash, DSString(), std::nullopt, configuration.options).analyzeAndEvaluate(kTestFile, kAnswersFile, "", mistakesFile).accuracy(); // Score the test set
+        std::cout.rdbuf(saved); // Restore the output
+        std::cout << "labels " << configuration.name << ": " << words << " words, build " << build * 1e3 << " ms, " << heapBytes << " heap bytes (" << static_cast<double>(heapBytes) / words << " bytes/word), " << score / tokenized.size() * 1e9 << " ns/tweet scoring, accuracy " << accuracy << std::endl; // Report the configuration
+    }
+    std::remove(modelFile); // Delete the model
+    std::remove(mistakesFile); // Delete the mistakes file
+}
+
+struct Corpus { // The files the pipeline stages read
+    std::string trainFile; // Training data with six columns
+    std::string testFile; // Test data with five columns
+    std::string answersFile; // Sentiment and id of every test tweet
+    size_t testTweets; // Number of test tweets
+    bool synthetic; // Whether the files were resampled (and are deleted afterwards)
+};
+
+struct Resampled { // A bundled file and the resampled file written from it
+    const char* source; // Bundled file
+    std::string target; // Resampled file
+    size_t idField; // Index of the id field, renumbered so that ids stay unique
+};
+
+std::vector<std::string_view> rawRecords(const MappedFile& mapped) { // Split a CSV file into its raw records, header excluded
+    CSVReader reader(mapped.data(), mapped.data() + mapped.size()); // Declare a reader over the file
+    std::vector<std::string_view> records; // Declare the records
+    reader.skip(); // Skip the header line
+    const char* start = reader.position(); // Start of the first record
+    while (reader.skip()) { // Skip each record
+        const char* end = reader.position(); // End of the record, including its line break
+        records.emplace_back(start, static_cast<size_t>(end - start)); // Keep the record
+        start = end; // The next record starts here
+    }
+    return records; // Return the records
+}
+
+void resample(const std::vector<Resampled>& files, size_t count, uint64_t seed) { // Write count records drawn with replacement, the same draws for every file
+    std::vector<std::unique_ptr<MappedFile>> mapped; // Mappings of the bundled files
+    std::vector<std::vector<std::string_view>> records; // Records of each bundled file
+    for (const Resampled& file : files) { // Loop through each file
+        mapped.push_back(std::make_unique<MappedFile>(file.source)); // Map it
+        records.push_back(rawRecords(*mapped.back())); // Split it into records
+        if (records.back().size() != records.front().size()) throw std::runtime_error("Resampled files must have the same number of records"); // Keep the files aligned
+    }
+    if (records.front().empty()) throw std::runtime_error("Cannot resample an empty file"); // Nothing to draw from
+
+    std::mt19937_64 random(seed); // Fixed seed, so every build benchmarks the same corpus
+    std::vector<size_t> draws(count); // Bundled record of each resampled record
+    for (size_t& draw : draws) draw = random() % records.front().size(); // Draw the records
+
+    for (size_t f = 0; f < files.size(); ++f) { // Loop through each file
+        const MappedFile& source = *mapped[f]; // Get the bundled file
+        std::ofstream out(files[f].target, std::ios::binary); // Open the resampled file
+        if (!out) throw std::runtime_error("Could not create " + files[f].target); // Report failure to create it
+        std::string buffer(source.data(), static_cast<size_t>(records[f].front().data() - source.data())); // Start with the header line
+        for (size_t i = 0; i < count; ++i) { // Loop through each resampled record
+            std::string_view record = records[f][draws[i]]; // Get the drawn record
+            size_t idStart = 0; // Start of the id field
+            for (size_t field = 0; field < files[f].idField; ++field) idStart = record.find(',', idStart) + 1; // Skip the fields before it
+            size_t idEnd = record.find_first_of(",\r\n", idStart); // End of the id field
+            buffer.append(record.data(), idStart); // Copy the fields before the id
+            buffer += std::to_string(i + 1); // Renumber the id
+            buffer.append(record.data() + idEnd, record.size() - idEnd); // Copy the rest of the record
+            if (buffer.size() >= (size_t(1) << 20)) { // Write in 1 MiB chunks
+                out.write(buffer.data(), static_cast<std::streamsize>(buffer.size())); // Write the chunk
+                buffer.clear(); // Reuse the buffer
+            }
+        }
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size())); // Write the rest
+        if (!out) throw std::runtime_error("Could not write " + files[f].target); // Report a failed write
+    }
+}
+
+Corpus makeCorpus(size_t tweets) { // Get the bundled corpus, or resample one of another size
+    if (tweets == kBundledTweets) return Corpus{kTrainFile, kTestFile, kAnswersFile, kBundledTweets / 2, false}; // Use the bundled files as they are
+    Corpus corpus{"bench_train.csv", "bench_test.csv", "bench_answers.csv", std::max<size_t>(1, tweets / 2), true}; // Name the resampled files
+    auto start = std::chrono::high_resolution_clock::now(); // Start timing
+    resample({Resampled{kTrainFile, corpus.trainFile, 1}}, tweets, 1); // Resample the training tweets
+    resample({Resampled{kTestFile, corpus.testFile, 0}, Resampled{kAnswersFile, corpus.answersFile, 1}}, corpus.testTweets, 2); // Resample the test tweets with their answers
+    std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start; // Measure the resampling
+    std::cout << "pipeline resampled " << tweets << " training and " << corpus.testTweets << " test tweets in " << duration.count() << " seconds" << std::endl; // Report the corpus
+    return corpus; // Return the corpus
+}
+
+double legacyAccuracy(const char* analyzedFile, const char* answersFile, const char* mistakesFile) { // The two-pass istringstream evaluation SentimentAnalyzer::accuracy used to run
+    std::ifstream analyzed(analyzedFile); // Open the analyzed file
+    std::ifstream answers(answersFile); // Open the answers file
+    std::ofstream mistakes(mistakesFile); // Open the mistakes file
+    DSString analyzedLine, answersLine; // Declare strings to hold each line
+    int matchingLines = 0, totalLines = 0; // Initialize the counts
+    for (int pass = 0; pass < 2; ++pass) { // Count the matches, then write the mistakes
+        if (pass == 1) { // Before the second pass
+            mistakes << std::fixed << std::setprecision(3) << (totalLines ? static_cast<double>(matchingLines) / totalLines : 0.0) << std::endl; // Write the accuracy
+            analyzed.close(); answers.close(); // Close both files
+            analyzed.open(analyzedFile); answers.open(answersFile); // Reopen them
+        }
+        getline(analyzed, analyzedLine); // Skip the header line
+        getline(answers, answersLine); // Skip the header line
+        while (getline(analyzed, analyzedLine) && getline(answers, answersLine)) { // Read each line from both files
+            std::istringstream analyzedStream(analyzedLine.c_str()), answersStream(answersLine.c_str()); // Parse both lines
+            int analyzedSentiment, answersSentiment, analyzedId, answersId; // Declare the CSV fields
+            analyzedStream >> analyzedSentiment; analyzedStream.ignore(1, ','); analyzedStream >> analyzedId; // Read the analyzed fields
+            answersStream >> answersSentiment; answersStream.ignore(1, ','); answersStream >> answersId; // Read the answer fields
+            if (analyzedId != answersId) break; // The legacy evaluation stopped at the first misaligned id
+            if (pass == 0) { matchingLines += analyzedSentiment == answersSentiment; totalLines++; } // Count the line
+            else if (analyzedSentiment != answersSentiment) mistakes << analyzedSentiment << "," << answersSentiment << "," << analyzedId << std::endl; // Write the mistake
+        }
+    }
+    return totalLines ? static_cast<double>(matchingLines) / totalLines : 0.0; // Return the accuracy
+}
+
+void benchEvaluate() { // Compare the two-pass evaluation with the streaming evaluator, aligned and shuffled
+    Corpus corpus = makeCorpus(gOptions.tweets); // Get the answers of the corpus
+    const char* alignedFile = "bench_predictions.csv"; // Predictions in the order of the answers
+    const char* shuffledFile = "bench_shuffled.csv"; // The same predictions in random order
+    const char* mistakesFile = "bench_mistakes.txt"; // Temporary mistakes file
+    {
+        MappedFile answers(corpus.answersFile.c_str()); // Map the answers
+        std::vector<std::string_view> records = rawRecords(answers); // Split them into records
+        std::vector<std::string> predictions; // Predictions, one record each
+        for (size_t i = 0; i < records.size(); ++i) { // Loop through each answer
+            std::string record(records[i]); // Copy it
+            if (i % 4 == 0) record[0] = record[0] == '4' ? '0' : '4'; // Get every fourth one wrong
+            predictions.push_back(std::move(record)); // Keep the prediction
+        }
+        for (int shuffled = 0; shuffled < 2; ++shuffled) { // Write the aligned file, then the shuffled one
+            if (shuffled) std::shuffle(predictions.begin(), predictions.end(), std::mt19937_64(4)); // Shuffle with a fixed seed
+            std::ofstream out(shuffled ? shuffledFile : alignedFile, std::ios::binary); // Open the predictions file
+            out << "Sentiment,id\n"; // Write the header
+            for (const std::string& record : predictions) out << record; // Write the predictions
+            if (!out) throw std::runtime_error("Could not write the predictions"); // Report a failed write
+        }
+    }
+
+    size_t records = corpus.testTweets; // Number of predictions
+    double accuracy = 0; // Accuracy of the last run
+    double legacy = bestOf(gOptions.repetitions, [&] { accuracy = legacyAccuracy(alignedFile, corpus.answersFile.c_str(), mistakesFile); }); // Time the legacy evaluation
+    std::cout << "evaluate " << records << " predictions: legacy two-pass " << legacy * 1e3 << " ms (accuracy " << accuracy << ")"; // Report it
+    EvaluationReport report; // Report of the last run
+    for (const char* file : {alignedFile, shuffledFile}) { // Evaluate both orders
+        double seconds = bestOf(gOptions.repetitions, [&] { // Time the streaming evaluator
+            std::ofstream mistakes(mistakesFile); // Open the mistakes file
+            report = Evaluator::evaluateFile(file, corpus.answersFile.c_str(), &mistakes); // Evaluate the predictions
+        });
+        std::cout << ", " << (file == alignedFile ? "merge join " : "hash join ") << seconds * 1e3 << " ms (accuracy " << report.accuracy() << ", speedup " << legacy / seconds << "x)"; // Report it
+    }
+    std::cout << std::endl; // End the line
+
+    for (const char* file : {alignedFile, shuffledFile, mistakesFile}) std::remove(file); // Delete the temporary files
+    if (corpus.synthetic) { // If the corpus was resampled
+        for (const std::string& file : {corpus.trainFile, corpus.testFile, corpus.answersFile}) std::remove(file.c_str()); // Delete it
+    }
+}
+
+struct Measurement { // One timed pipeline stage
+    std::string name; // Stage name
+    double seconds; // Fastest run
+    size_t items; // Items processed per run (tweets, tokens or words)
+    const char* unit; // What the items are
+    size_t bytes; // Bytes processed per run (0 if not meaningful)
+};
+std::vector<Measurement> gMeasurements; // Every pipeline stage measured so far
+double gAccuracy = -1; // Accuracy of the pipeline run, negative if it did not run
+
+void record(const char* name, double seconds, size_t items, const char* unit, size_t bytes) { // Report a pipeline stage and keep it for the JSON output
+    gMeasurements.push_back(Measurement{name, seconds, items, unit, bytes}); // Keep the measurement
+    std::cout << "pipeline " << name << ": " << seconds * 1e3 << " ms, " << items / seconds << " " << unit << "/sec"; // Report the time and throughput
+    if (bytes != 0) std::cout << ", " << bytes / seconds / 1e6 << " MB/s"; // Report the bandwidth
+    std::cout << std::endl; // End the line
+}
+
+struct FlatTokens { // Tokens of a whole corpus, back to back
+    std::string chars; // Characters of every token
+    std::vector<size_t> ends; // Offset one past the last character of each token
+    std::vector<size_t> tweetEnds; // Index one past the last token of each tweet
+
+    std::string_view operator[](size_t i) const { // Get a token
+        size_t begin = i == 0 ? 0 : ends[i - 1]; // Start of the token
+        return std::string_view(chars.data() + begin, ends[i] - begin); // View the token
+    }
+};
+
+FlatTokens flatten(const std::vector<std::string_view>& tweets) { // Tokenize every tweet once, outside of the timed stages
+    FlatTokens flat; // Declare the tokens
+    TokenBuffer buffer; // Declare the reusable token buffer
+    for (std::string_view tweet : tweets) { // Loop through each tweet
+        Tokenizer::tokenize(tweet, buffer); // Tokenize it
+        for (size_t i = 0; i < buffer.size(); ++i) { // Loop through each token
+            flat.chars += buffer[i]; // Append its characters
+            flat.ends.push_back(flat.chars.size()); // End it
+        }
+        flat.tweetEnds.push_back(flat.ends.size()); // End the tweet
+    }
+    return flat; // Return the tokens
+}
+
+size_t fileSize(const std::string& file) { // Get the size of a file in bytes
+    std::ifstream in(file, std::ios::binary | std::ios::ate); // Open the file at its end
+    return in ? static_cast<size_t>(in.tellg()) : 0; // Return its size
+}
+
+void benchPipeline() { // Time every stage of the pipeline on a corpus of gOptions.tweets training tweets
+    Corpus corpus = makeCorpus(gOptions.tweets); // Get the corpus
+    unsigned threads = gOptions.threads; // Threads used by the stages that take a thread count
+    int repetitions = gOptions.repetitions; // Timed runs of each stage
+    const char* modelFile = "bench_pipeline.dat"; // Temporary model file
+    const char* resultsFile = "bench_results.csv"; // Temporary classification results
+    const char* mistakesFile = "bench_mistakes.txt"; // Temporary accuracy report
+
+    MappedFile train(corpus.trainFile.c_str()); // Map the training data
+    CSVReader reader(train.data(), train.data() + train.size()); // Declare a reader over it
+    std::vector<std::string_view> fields; // Declare the field list, reused for every record
+    std::vector<std::string_view> tweets; // Training tweets
+    std::vector<bool> positive; // Whether each training tweet is positive
+    size_t tweetBytes = 0; // Bytes of training tweet text
+    reader.skip(); // Skip the header line
+    while (reader.next(fields, 6)) { // Read each record
+        if (fields.size() < 6) continue; // Skip records with missing fields, as training does
+        tweets.push_back(fields[5]); // Keep the tweet
+        positive.push_back(fields[0] == "4"); // Keep its label
+        tweetBytes += fields[5].size(); // Count its bytes
+    }
+    std::vector<DSString> testTweets = loadTweets(corpus.testFile.c_str(), 5); // Load the test tweets
+    std::vector<std::string_view> testViews(testTweets.begin(), testTweets.end()); // View them
+    std::cout << "pipeline " << tweets.size() << " training tweets, " << testTweets.size() << " test tweets, " << (threads == 0 ? std::thread::hardware_concurrency() : threads) << " thread(s), " << Tokenizer::kernelName(Tokenizer::kernel()) << " tokenizer" << std::endl; // Report the workload
+
+    TokenBuffer buffer; // Declare the reusable token buffer
+    double seconds = bestOf(repetitions, [&] { // Time tokenizing the training tweets
+        size_t count = 0; // Number of tokens produced
+        for (std::string_view tweet : tweets) { // Loop through each tweet
+            Tokenizer::tokenize(tweet, buffer); // Tokenize it into the reused buffer
+            count += buffer.size(); // Count the tokens
+        }
+        sink = count; // Keep the result alive
+    });
+    record("tokenize", seconds, tweets.size(), "tweets", tweetBytes); // Report the stage
+
+    FlatTokens trainTokens = flatten(tweets); // Tokenize the training tweets once for the insert stage
+    std::unique_ptr<Trie> trie; // Trie built by the insert and train stages
+    seconds = bestOf(repetitions, [&] { trie.reset(); trie = std::make_unique<Trie>(); }, [&] { // Time inserting every token into a fresh trie
+        size_t token = 0; // Index of the next token
+        for (size_t t = 0; t < trainTokens.tweetEnds.size(); ++t) { // Loop through each tweet
+            for (; token < trainTokens.tweetEnds[t]; ++token) trie->insert(trainTokens[token], positive[t]); // Insert its tokens
+        }
+    });
+    record("insert", seconds, trainTokens.ends.size(), "tokens", 0); // Report the stage
+    trainTokens = FlatTokens(); // Free the training tokens
+
+    std::streambuf* saved = std::cout.rdbuf(nullptr); // Silence the stages' own progress output
+    seconds = bestOf(repetitions, [&] { trie.reset(); trie = std::make_unique<Trie>(); }, [&] { trie->train(corpus.trainFile.c_str(), threads); }); // Time training a fresh trie from the file
+    std::cout.rdbuf(saved); // Restore the output
+    record("train", seconds, tweets.size(), "tweets", fileSize(corpus.trainFile)); // Report the stage
+
+    FlatTokens testTokens = flatten(testViews); // Tokenize the test tweets once for the lookup stage
+    saved = std::cout.rdbuf(nullptr); // Silence the finalizing output
+    trie->finalize(); // Precompute the scores, as the analyzer does
+    std::cout.rdbuf(saved); // Restore the output
+    seconds = bestOf(repetitions, [&] { // Time scoring every test token
+        double sum = 0; // Sum of the scores
+        for (size_t i = 0; i < testTokens.ends.size(); ++i) { // Loop through each token
+            WordScores scores = trie->getScores(testTokens[i]); // Look the token up
+            sum += scores.logOdds + scores.sentimentScore; // Add both scores
+        }
+        sink = static_cast<size_t>(sum); // Keep the result alive
+    });
+    record("lookup", seconds, testTokens.ends.size(), "tokens", 0); // Report the stage
+
+    saved = std::cout.rdbuf(nullptr); // Silence the saving output
+    seconds = bestOf(repetitions, [&] { trie->save(modelFile, threads == 0 ? std::thread::hardware_concurrency() : threads); }); // Time saving the model
+    std::cout.rdbuf(saved); // Restore the output
+    record("save", seconds, trie->wordCount(), "words", fileSize(modelFile)); // Report the stage
+    trie.reset(); // Free the trained trie
+
+    size_t words = 0; // Number of words loaded
+    saved = std::cout.rdbuf(nullptr); // Silence the loading output
+    seconds = bestOf(repetitions, [&] { trie.reset(); trie = std::make_unique<Trie>(); }, [&] { trie->load(modelFile); }); // Time loading the model into a fresh trie
+    words = trie->wordCount(); // Count the loaded words
+    trie.reset(); // Free the loaded trie
+    std::cout.rdbuf(saved); // Restore the output
+    record("load", seconds, words, "words", fileSize(modelFile)); // Report the stage
+
+    saved = std::cout.rdbuf(nullptr); // Silence the analyzer's output
+    {
+        SentimentAnalyzer analyzer(modelFile, corpus.trainFile.c_str()); // Load the saved model
+        seconds = bestOf(repetitions, [&] { analyzer.analyzeFile(corpus.testFile.c_str(), resultsFile, threads); }); // Time classifying the test file
+        double accuracySeconds = bestOf(repetitions, [&] { gAccuracy = analyzer.accuracy(resultsFile, corpus.answersFile.c_str(), mistakesFile); }); // Time scoring the results
+        double fusedSeconds = bestOf(repetitions, [&] { gAccuracy = analyzer.analyzeAndEvaluate(corpus.testFile.c_str(), corpus.answersFile.c_str(), "", mistakesFile, threads).accuracy(); }); // Time classifying and scoring in one pass, without a results file
+        std::cout.rdbuf(saved); // Restore the output
+        record("analyzeFile", seconds, testTweets.size(), "tweets", fileSize(corpus.testFile)); // Report the classification stage
+        record("accuracy", accuracySeconds, testTweets.size(), "tweets", 0); // Report the accuracy stage
+        record("analyzeAndEvaluate", fusedSeconds, testTweets.size(), "tweets", fileSize(corpus.testFile)); // Report the fused stage
+    }
+    std::cout << "pipeline " << testTweets.size() << " test tweets classified, accuracy " << gAccuracy << std::endl; // Report the accuracy itself
+
+    for (const char* file : {modelFile, resultsFile, mistakesFile}) std::remove(file); // Delete the temporary files
+    if (corpus.synthetic) { // If the corpus was resampled
+        for (const std::string& file : {corpus.trainFile, corpus.testFile, corpus.answersFile}) std::remove(file.c_str()); // Delete it
+    }
+}
+
+std::string jsonString(const std::string& text) { // Quote a string for JSON
+    std::string quoted = "\""; // Open the string
+    for (char c : text) { // Loop through each character
+        if (c == '"' || c == '\\') quoted += '\\'; // Escape quotes and backslashes
+        if (static_cast<unsigned char>(c) >= 0x20) quoted += c; // Keep printable characters, drop control characters
+    }
+    return quoted + "\""; // Close the string
+}
+
+void writeJson(const char* file) { // Write the pipeline measurements as JSON
+    std::ofstream out(file); // Open the file
+    if (!out) throw std::runtime_error(std::string("Could not create ") + file); // Report failure to create it
+    out << std::setprecision(9); // Keep enough digits to compare builds
+    out << "{\n"; // Open the document
+#ifdef __VERSION__
+    out << "  \"compiler\": " << jsonString(__VERSION__) << ",\n"; // Record the compiler
+#endif
+    out << "  \"tweets\": " << gOptions.tweets << ",\n"; // Record the corpus size
+    out << "  \"threads\": " << gOptions.threads << ",\n"; // Record the thread count
+    out << "  \"repetitions\": " << gOptions.repetitions << ",\n"; // Record the repetitions
+    out << "  \"tokenizer_kernel\": " << jsonString(Tokenizer::kernelName(Tokenizer::kernel())) << ",\n"; // Record the tokenizer kernel
+    out << "  \"stages\": ["; // Open the stage list
+    for (size_t i = 0; i < gMeasurements.size(); ++i) { // Loop through each stage
+        const Measurement& m = gMeasurements[i]; // Get the stage
+        out << (i == 0 ? "\n" : ",\n"); // Separate the stages
+        out << "    {\"name\": " << jsonString(m.name) << ", \"seconds\": " << m.seconds << ", \"items\": " << m.items << ", \"unit\": " << jsonString(m.unit) << ", \"items_per_second\": " << m.items / m.seconds; // Write the time and throughput
+        if (m.bytes != 0) out << ", \"bytes\": " << m.bytes << ", \"bytes_per_second\": " << m.bytes / m.seconds; // Write the bandwidth
+        out << "}"; // Close the stage
+    }
+    out << "\n  ]"; // Close the stage list
+    if (gAccuracy >= 0) out << ",\n  \"accuracy\": " << gAccuracy; // Record the accuracy
+    out << "\n}\n"; // Close the document
+    if (!out) throw std::runtime_error(std::string("Could not write ") + file); // Report a failed write
+}
+
+struct BenchCase { const char* name; std::function<void()> run; }; // A named benchmark case
+
+const std::vector<BenchCase> kCases = { // Every benchmark case, in the order they run
+    {"csv", benchCsv},
+    {"tokenize", benchTokenize},
+    {"layout", benchLayout},
+    {"scores", benchScores},
+    {"load", benchLoad},
+    {"save", benchSave},
+    {"pool", benchPool},
+    {"dsstring", benchDSString},
+    {"metrics", benchMetrics},
+    {"arena", benchArena},
+    {"backend", benchBackend},
+    {"intern", benchIntern},
+    {"corpus", benchCorpus},
+    {"ngrams", benchNGrams},
+    {"prune", benchPrune},
+    {"labels", benchLabels},
+    {"evaluate", benchEvaluate},
+    {"pipeline", benchPipeline},
+};
+} // namespace
+
+int main(int argc, char* argv[]) { // Run the requested benchmark cases
+    std::vector<const char*> names; // Names of the cases to run
+    for (int i = 1; i < argc; ++i) { // Loop through the command-line arguments
+        if (std::strcmp(argv[i], "--tweets") == 0 && i + 1 < argc) { // Check for the corpus size option
+            gOptions.tweets = std::strtoull(argv[++i], nullptr, 10); // Read the number of training tweets
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) { // Check for the thread count option
+            gOptions.threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10)); // Read the thread count (0 means all cores)
+        } else if (std::strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) { // Check for the repetition option
+            gOptions.repetitions = std::max(1, std::atoi(argv[++i])); // Read the number of timed runs
+        } else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) { // Check for the JSON output option
+            gOptions.json = argv[++i]; // Read the output file name
+        } else { // Otherwise it names a case
+            names.push_back(argv[i]); // Keep the case name
+        }
+    }
+    if (gOptions.tweets == 0) { // Check for an empty corpus
+        std::cerr << "--tweets must be at least 1" << std::endl; // Report the error
+        return -1; // Return error code -1
+    }
+
+    try { // Try block to catch exceptions
+        for (const BenchCase& benchCase : kCases) { // Loop through each case
+            bool selected = names.empty(); // Run every case if none were named
+            for (const char* name : names) { // Loop through the named cases
+                selected = selected || std::strcmp(name, benchCase.name) == 0; // Check if this case was named
+            }
+            if (selected) benchCase.run(); // Run the case
+        }
+        if (gOptions.json != nullptr) writeJson(gOptions.json); // Write the pipeline measurements
+    } catch (const std::exception& e) { // Catch block for standard exceptions
+        std::cerr << "Exception: " << e.what() << std::endl; // Output the exception message
+        return -1; // Return error code -1
+    }
+    return 0; // Return 0 to indicate successful execution
+}
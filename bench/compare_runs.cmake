@@ -0,0 +1,43 @@
+# Runs the sentiment program twice with different options and checks that both runs write the same files.
+# Each run trains from scratch in its own directory under WORK_DIR, so no model is reused between them.
+#
+# Variables (pass with -D):
+#   PROGRAM      Path of the sentiment program
+#   DATA_DIR     Directory holding the training, test and answer files
+#   WORK_DIR     Scratch directory for the two runs (emptied first)
+#   FIRST_ARGS   Options of the first run, as a semicolon-separated list
+#   SECOND_ARGS  Options of the second run, as a semicolon-separated list
+
+foreach(variable PROGRAM DATA_DIR WORK_DIR) # Check the required variables
+    if(NOT DEFINED ${variable})
+        message(FATAL_ERROR "compare_runs.cmake needs -D${variable}=...")
+    endif()
+endforeach()
+
+file(REMOVE_RECURSE ${WORK_DIR}) # Start without any model or output from an earlier run
+
+foreach(run first second) # Run the program once per option set
+    string(TOUPPER ${run} prefix) # FIRST or SECOND
+    file(MAKE_DIRECTORY ${WORK_DIR}/${run}) # Each run gets its own model file
+    execute_process(
+        COMMAND ${PROGRAM} ${${prefix}_ARGS}
+                ${DATA_DIR}/train_dataset_20k.csv ${DATA_DIR}/test_dataset_10k.csv ${DATA_DIR}/test_dataset_sentiment_10k.csv
+                results.csv accuracy.txt
+        WORKING_DIRECTORY ${WORK_DIR}/${run}
+        RESULT_VARIABLE status
+        OUTPUT_QUIET
+    )
+    if(NOT status EQUAL 0) # The run must succeed
+        message(FATAL_ERROR "${PROGRAM} ${${prefix}_ARGS} failed: ${status}")
+    endif()
+endforeach()
+
+foreach(output results.csv accuracy.txt) # Compare every output file
+    execute_process(
+        COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK_DIR}/first/${output} ${WORK_DIR}/second/${output}
+        RESULT_VARIABLE different
+    )
+    if(different) # The two runs must agree byte for byte
+        message(FATAL_ERROR "${output} differs between [${FIRST_ARGS}] and [${SECOND_ARGS}]")
+    endif()
+endforeach()
@@ -1,21 +1,252 @@
 #include <iostream> // Include the iostream library for input and output
 #include <exception> // Include the exception library for handling exceptions
+#include <vector> // Include the vector library for the positional arguments
+#include <cstring> // Include cstring for comparing option names
+#include <cstdlib> // Include cstdlib for parsing option values
+#include <optional> // Include optional for the requested trie layout
+#include <chrono> // Include chrono for timing the model setup
+#include <iomanip> // Include iomanip for formatting the accuracy
+#include <filesystem> // Include filesystem for reporting model file sizes
 #include "Trie.h" // Include the Trie header file
 #include "SentimentAnalyzer.h" // Include the SentimentAnalyzer header file
+#include "ClassificationServer.h" // Include the ClassificationServer header file
+#include "Metrics.h" // Include Metrics for the --metrics option
+#include "CorpusCache.h" // Include CorpusCache for the --compile-corpus command
+#include <csignal> // Include csignal for stopping the server on SIGINT and SIGTERM
+#include <limits> // Include limits for the option value ranges
+#include <cmath> // Include cmath for checking the smoothing is finite
+
+namespace {
+ClassificationServer* gServer = nullptr; // Server stopped by the signal handler
+
+extern "C" void stopServer(int) { // Signal handler that stops the server
+    if (gServer != nullptr) gServer->stop(); // Ask the server to return from run()
+}
+
+void printUsage(const char* program) { // Print every way to run the program
+    std::cerr << "Usage: " << program << " [--threads N] [--backend trie|hash] [--layout map|compact] [--model FILE] [--smoothing ALPHA] [--corpus FILE] [--ngrams N] [--ngram-width CELLS] [--ngram-min COUNT] [--labels L,L,...] [--metrics FILE] <train_dataset> <test_dataset> <test_sentiment> <output_file> <accuracy_file>" << std::endl;
+    std::cerr << "       " << program << " [--threads N] [--backend trie|hash] [--layout map|compact] [--model FILE] [--smoothing ALPHA] [--corpus FILE] [--ngrams N] [--ngram-width CELLS] [--ngram-min COUNT] [--labels L,L,...] [--metrics FILE] --fused [--results FILE] <train_dataset> <test_dataset> <test_sentiment> <accuracy_file>" << std::endl;
+    std::cerr << "       " << program << " [--threads N] [--backend trie|hash] [--layout map|compact] [--model FILE] [--smoothing ALPHA] [--corpus FILE] [--ngrams N] [--ngram-width CELLS] [--ngram-min COUNT] [--labels L,L,...] [--metrics FILE] --serve <socket_path|port> <train_dataset>" << std::endl;
+    std::cerr << "       " << program << " --convert-model <legacy_model> <binary_model>" << std::endl;
+    std::cerr << "       " << program << " [--smoothing ALPHA] [--prune-min COUNT] [--prune-lo LOG_ODDS] --prune-model <model> <pruned_model>" << std::endl;
+    std::cerr << "       " << program << " --compile-corpus <train_dataset> <corpus_cache>" << std::endl;
+}
+
+bool parseCount(const char* text, unsigned long long max, unsigned long long& value) { // Parse a whole non-negative number no larger than max
+    if (*text < '0' || *text > '9') return false; // Reject empty text, signs and words up front
+    char* end = nullptr; // Declare the end of the number
+    value = std::strtoull(text, &end, 10); // Read the number
+    return *end == '\0' && value <= max; // Accept it only if nothing follows and it fits
+}
+
+bool parseReal(const char* text, double& value) { // Parse a decimal number
+    char* end = nullptr; // Declare the end of the number
+    value = std::strtod(text, &end); // Read the number
+    return end != text && *end == '\0'; // Accept it only if it was a number and nothing follows
+}
+} // namespace
 
 int main(int argc, char* argv[]) { // Main function with command-line arguments
-    if (argc != 6) { // Check if the correct number of arguments is provided
-        std::cerr << "Usage: " << argv[0] << " <train_dataset> <test_dataset> <test_sentiment> <output_file> <accuracy_file>" << std::endl;
+    unsigned threads = 1; // Number of threads used for training and scoring
+    std::optional<TrieLayout> layout; // Node layout used for scoring (empty keeps the layout of the loaded model)
+    ModelBackend backend = ModelBackend::Trie; // Vocabulary store of the model
+    const char* modelFile = "trie.dat"; // Model file to load, or to save the trained model to
+    std::optional<double> smoothing; // Additive smoothing of the log odds (empty keeps Laplace smoothing)
+    const char* serveAddress = nullptr; // Socket path or TCP port to serve on, if running as a server
+    const char* metricsFile = nullptr; // File receiving the metrics, if collecting them
+    const char* corpusFile = ""; // Corpus cache to train from, if training from a compiled corpus
+    std::optional<NGramOptions> ngrams; // N-gram features scored on top of the words (empty scores single tokens only)
+    std::optional<LabelOptions> labels; // Labels classified by naive Bayes (empty classifies by the log odds)
+    bool fused = false; // Whether to classify and evaluate in one pass
+    const char* resultsFile = nullptr; // Results file written by the fused mode, if asked for
+    const char* pruneInput = nullptr; // Model file to prune, if running the pruning command
+    const char* pruneOutput = nullptr; // Pruned model file written by the pruning command
+    PruneOptions pruneOptions; // Thresholds of the pruning command
+    std::vector<char*> args; // Positional arguments left after removing the options
+    auto invalid = [&](int option) { // Reject the value of an option
+        std::cerr << "Invalid value for " << argv[option] << ": " << argv[option + 1] << std::endl; // Name the option and the value
+        printUsage(argv[0]); // Show what is accepted
+        return -1; // Return error code -1
+    };
+    const unsigned long long maxUnsigned = std::numeric_limits<unsigned>::max(); // Largest value of an unsigned option
+    unsigned long long count = 0; // Declare the value of a numeric option
+    for (int i = 1; i < argc; ++i) { // Loop through the command-line arguments
+        if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) { // Check for the thread count option
+            if (!parseCount(argv[i + 1], maxUnsigned, count)) return invalid(i); // Reject anything but a count
+            threads = static_cast<unsigned>(count); // Use the thread count (0 means all cores)
+            ++i; // Move past the value
+        } else if (std::strcmp(argv[i], "--layout") == 0 && i + 1 < argc) { // Check for the trie layout option
+            if (std::strcmp(argv[i + 1], "compact") == 0) { // If the compact layout was asked for
+                layout = TrieLayout::Compact; // Use the compact layout
+            } else if (std::strcmp(argv[i + 1], "map") == 0) { // If the map layout was asked for
+                layout = TrieLayout::Map; // Use the map layout
+            } else { // If the layout is unknown
+                return invalid(i); // Reject it
+            }
+            ++i; // Move past the value
+        } else if (std::strcmp(argv[i], "--backend") == 0 && i + 1 < argc) { // Check for the model backend option
+            if (std::strcmp(argv[i + 1], "hash") == 0) { // If the hash table was asked for
+                backend = ModelBackend::Hash; // Use the hash table
+            } else if (std::strcmp(argv[i + 1], "trie") == 0) { // If the trie was asked for
+                backend = ModelBackend::Trie; // Use the trie
+            } else { // If the backend is unknown
+                return invalid(i); // Reject it
+            }
+            ++i; // Move past the value
+        } else if (std::strcmp(argv[i], "--model") == 0 && i + 1 < argc) { // Check for the model file option
+            modelFile = argv[++i]; // Read the model file name
+        } else if (std::strcmp(argv[i], "--smoothing") == 0 && i + 1 < argc) { // Check for the smoothing option
+            double alpha = 0; // Declare the smoothing count
+            if (!parseReal(argv[i + 1], alpha) || !(alpha > 0) || !std::isfinite(alpha)) return invalid(i); // Reject anything but a positive number
+            smoothing = alpha; // Use the smoothing
+            ++i; // Move past the value
+        } else if (std::strcmp(argv[i], "--serve") == 0 && i + 1 < argc) { // Check for the server mode option
+            serveAddress = argv[++i]; // Read the socket path or TCP port
+        } else if (std::strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) { // Check for the metrics option
+            metricsFile = argv[++i]; // Read the metrics file name (.json for JSON, otherwise Prometheus text)
+        } else if (std::strcmp(argv[i], "--corpus") == 0 && i + 1 < argc) { // Check for the corpus cache option
+            corpusFile = argv[++i]; // Read the corpus cache file name
+        } else if (std::strcmp(argv[i], "--ngrams") == 0 && i + 1 < argc) { // Check for the n-gram order option
+            if (!parseCount(argv[i + 1], maxUnsigned, count)) return invalid(i); // Reject anything but a count
+            unsigned order = static_cast<unsigned>(count); // Read the longest n-gram (1 turns them off)
+            ++i; // Move past the value
+            if (order >= 2) { // If n-grams were asked for
+                if (!ngrams) ngrams = NGramOptions(); // Start from the default shape
+                ngrams->order = order; // Set the order
+            } else { // If only single tokens should be scored
+                ngrams.reset(); // Turn n-grams off
+            }
+        } else if (std::strcmp(argv[i], "--ngram-width") == 0 && i + 1 < argc) { // Check for the sketch width option
+            if (!parseCount(argv[i + 1], std::numeric_limits<size_t>::max(), count)) return invalid(i); // Reject anything but a count
+            if (!ngrams) ngrams = NGramOptions(); // Enable bigrams if no order was given
+            ngrams->width = static_cast<size_t>(count); // Use the cells per row
+            ++i; // Move past the value
+        } else if (std::strcmp(argv[i], "--ngram-min") == 0 && i + 1 < argc) { // Check for the n-gram minimum count option
+            if (!parseCount(argv[i + 1], maxUnsigned, count)) return invalid(i); // Reject anything but a count
+            if (!ngrams) ngrams = NGramOptions(); // Enable bigrams if no order was given
+            ngrams->minCount = static_cast<unsigned>(count); // Use the count an n-gram needs to be scored
+            ++i; // Move past the value
+        } else if (std::strcmp(argv[i], "--labels") == 0 && i + 1 < argc) { // Check for the multi-class labels option
+            labels = LabelOptions(); // Start from the default smoothing
+            labels->labels.clear(); // Replace the default labels
+            for (const char* label = argv[++i];; ++label) { // Loop through the comma-separated labels
+                char* next = nullptr; // Declare the end of the label
+                long value = std::strtol(label, &next, 10); // Read the label
+                labels->labels.push_back(next == label ? -1 : static_cast<int>(value)); // Keep it; LabelModel rejects anything but a digit
+                label = next; // Move past the label
+                if (*label != ',') break; // Stop after the last label
+            }
+        } else if (std::strcmp(argv[i], "--fused") == 0) { // Check for the fused classify-and-evaluate mode
+            fused = true; // Compare the predictions in memory instead of through the results file
+        } else if (std::strcmp(argv[i], "--results") == 0 && i + 1 < argc) { // Check for the fused mode's results option
+            resultsFile = argv[++i]; // Read the results file name
+        } else if (std::strcmp(argv[i], "--convert-model") == 0 && i + 2 < argc) { // Check for the model conversion command
+            try { // Try block to catch exceptions
+                Trie::convertModel(argv[i + 1], argv[i + 2]); // Convert the legacy model to the binary format
+            } catch (const std::exception& e) { // Catch block for standard exceptions
+                std::cerr << "Exception: " << e.what() << std::endl; // Output the exception message
+                return -1; // Return error code -1
+            }
+            return 0; // Conversion is a command of its own
+        } else if (std::strcmp(argv[i], "--prune-min") == 0 && i + 1 < argc) { // Check for the pruning count threshold
+            if (!parseCount(argv[i + 1], static_cast<unsigned long long>(std::numeric_limits<int>::max()), count)) return invalid(i); // Reject anything but a count
+            pruneOptions.minCount = static_cast<int>(count); // Use the tweets a word needs to be kept
+            ++i; // Move past the value
+        } else if (std::strcmp(argv[i], "--prune-lo") == 0 && i + 1 < argc) { // Check for the pruning log odds threshold
+            if (!parseReal(argv[i + 1], pruneOptions.minLogOdds)) return invalid(i); // Read the absolute log odds a word needs to be kept
+            ++i; // Move past the value
+        } else if (std::strcmp(argv[i], "--prune-model") == 0 && i + 2 < argc) { // Check for the model pruning command
+            pruneInput = argv[++i]; // Read the model file to prune
+            pruneOutput = argv[++i]; // Read the pruned model file; the thresholds may follow, so it runs after the loop
+        } else if (std::strcmp(argv[i], "--compile-corpus") == 0 && i + 2 < argc) { // Check for the corpus compilation command
+            try { // Try block to catch exceptions
+                CorpusCache::compile(argv[i + 1], argv[i + 2]); // Compile the training file into a corpus cache
+            } catch (const std::exception& e) { // Catch block for standard exceptions
+                std::cerr << "Exception: " << e.what() << std::endl; // Output the exception message
+                return -1; // Return error code -1
+            }
+            return 0; // Compilation is a command of its own
+        } else { // Otherwise it is a positional argument
+            args.push_back(argv[i]); // Keep the positional argument
+        }
+    }
+
+    if (labels && ngrams) { // Check the features the label model can score
+        std::cerr << "--labels classifies with single tokens only and cannot be combined with --ngrams" << std::endl; // Name the conflicting options
+        printUsage(argv[0]); // Show what is accepted
+        return -1; // Return error code -1
+    }
+
+    if (pruneInput != nullptr) { // If pruning a model file
+        try { // Try block to catch exceptions
+            Trie::pruneModel(pruneInput, pruneOutput, pruneOptions, smoothing.value_or(1.0)); // Drop the rare and uninformative words
+            std::cout << "Model size: " << std::filesystem::file_size(pruneInput) << " -> " << std::filesystem::file_size(pruneOutput) << " bytes." << std::endl; // Report the file sizes
+        } catch (const std::exception& e) { // Catch block for standard exceptions
+            std::cerr << "Exception: " << e.what() << std::endl; // Output the exception message
+            return -1; // Return error code -1
+        }
+        return 0; // Pruning is a command of its own
+    }
+
+    if (metricsFile != nullptr) { // If metrics were requested
+        if (!Metrics::compiled()) std::cerr << "Warning: this build has no metrics (SENTIMENT_METRICS=0)" << std::endl; // Warn that the file will hold zeros
+        Metrics::setEnabled(true); // Start collecting
+    }
+
+    if (serveAddress != nullptr && args.size() == 1) { // If running as a server
+        try { // Try block to catch exceptions
+            SentimentAnalyzer analyzer(modelFile, args[0], threads, layout, backend, corpusFile, ngrams, labels); // Load the model once, training it if needed
+            if (smoothing) analyzer.setSmoothing(*smoothing); // Rescore the words with the requested smoothing
+            ClassificationServer server(analyzer, serveAddress); // Start listening
+            gServer = &server; // Let the signal handler stop the server
+            std::signal(SIGINT, stopServer); // Stop on Ctrl-C
+            std::signal(SIGTERM, stopServer); // Stop on termination requests
+#ifdef SIGPIPE
+            std::signal(SIGPIPE, SIG_IGN); // A client hanging up must not kill the server
+#endif
+            server.run(); // Serve clients until stopped
+            gServer = nullptr; // The server is about to be destroyed
+            if (metricsFile != nullptr) Metrics::dump(metricsFile); // Write the metrics
+        } catch (const std::exception& e) { // Catch block for standard exceptions
+            std::cerr << "Exception: " << e.what() << std::endl; // Output the exception message
+            return -1; // Return error code -1
+        }
+        return 0; // Return 0 to indicate successful execution
+    }
+
+    if (fused && args.size() == 4) { // If classifying and evaluating in one pass
+        try { // Try block to catch exceptions
+            auto start = std::chrono::high_resolution_clock::now(); // Start timing the model setup
+            SentimentAnalyzer analyzer(modelFile, args[0], threads, layout, backend, corpusFile, ngrams, labels); // Load the model, training it if needed
+            if (smoothing) analyzer.setSmoothing(*smoothing); // Rescore the words with the requested smoothing
+            std::chrono::duration<double> setup = std::chrono::high_resolution_clock::now() - start; // Measure the model setup
+            std::cout << "Model setup completed in " << setup.count() << " seconds." << std::endl; // Print the model stage
+            EvaluationReport report = analyzer.analyzeAndEvaluate(args[1], args[2], resultsFile != nullptr ? resultsFile : "", args[3], threads); // Classify and compare every tweet
+            std::cout << "Accuracy: " << std::fixed << std::setprecision(5) << report.accuracy() << std::endl; // Output the accuracy
+            std::cout << report.summary(); // Output the confusion matrix and the per-label scores
+            if (metricsFile != nullptr) Metrics::dump(metricsFile); // Write the metrics
+        } catch (const std::exception& e) { // Catch block for standard exceptions
+            std::cerr << "Exception: " << e.what() << std::endl; // Output the exception message
+            return -1; // Return error code -1
+        }
+        return 0; // Return 0 to indicate successful execution
+    }
+
+    if (args.size() != 5 || fused) { // Check if the correct number of arguments is provided
+        printUsage(argv[0]); // Show what is accepted
         return -1; // Return error code -1
     }
 
     try { // Try block to catch exceptions
-        SentimentAnalyzer analyzer("trie.dat", argv[1]); // Create a SentimentAnalyzer object with the specified files
+        SentimentAnalyzer analyzer(modelFile, args[0], threads, layout, backend, corpusFile, ngrams, labels); // Create a SentimentAnalyzer object with the specified files
+        if (smoothing) analyzer.setSmoothing(*smoothing); // Rescore the words with the requested smoothing
 
-        analyzer.analyzeFile(argv[2], argv[4]); // Analyze the test dataset and output the results to a file
+        analyzer.analyzeFile(args[1], args[3], threads); // Analyze the test dataset and output the results to a file
 
-        double acc = analyzer.accuracy(argv[4], argv[3], argv[5]); // Calculate the accuracy of the analysis
-        std::cout << "Accuracy: " << std::fixed << std::setprecision(5) << acc << std::endl; // Output the accuracy
+        EvaluationReport report = analyzer.evaluate(args[3], args[2], args[4]); // Compare the results with the answers
+        std::cout << "Accuracy: " << std::fixed << std::setprecision(5) << report.accuracy() << std::endl; // Output the accuracy
+        std::cout << report.summary(); // Output the confusion matrix and the per-label scores
+        if (metricsFile != nullptr) Metrics::dump(metricsFile); // Write the metrics
     } catch (const std::exception& e) { // Catch block for standard exceptions
         std::cerr << "Exception: " << e.what() << std::endl; // Output the exception message
         return -1; // Return error code -1
@@ -25,4 +256,4 @@ int main(int argc, char* argv[]) { // Main function with command-line arguments
     }
 
     return 0; // Return 0 to indicate successful execution
-}
\ No newline at end of file
+}